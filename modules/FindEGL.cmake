@@ -0,0 +1,28 @@
+################################################################################
+#
+# CMake script for finding EGL (headless rendering, see HeadlessRenderer).
+# The default CMake search process is used to locate files.
+#
+# This script creates the following variables:
+#  EGL_FOUND: Boolean that indicates if the package was found
+#  EGL_INCLUDE_DIRS: Paths to the necessary header files
+#  EGL_LIBRARIES: Package libraries
+#
+################################################################################
+
+include(FindPackageHandleStandardArgs)
+
+find_path(EGL_INCLUDE_DIR NAMES EGL/egl.h)
+find_library(EGL_LIBRARY NAMES EGL)
+
+# Set EGL_FOUND honoring the QUIET and REQUIRED arguments
+find_package_handle_standard_args(EGL DEFAULT_MSG EGL_LIBRARY EGL_INCLUDE_DIR)
+
+# Output variables
+if(EGL_FOUND)
+  set(EGL_INCLUDE_DIRS ${EGL_INCLUDE_DIR})
+  set(EGL_LIBRARIES ${EGL_LIBRARY})
+endif()
+
+# Advanced options for not cluttering the cmake UIs
+mark_as_advanced(EGL_INCLUDE_DIR EGL_LIBRARY)
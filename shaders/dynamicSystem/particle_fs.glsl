@@ -0,0 +1,27 @@
+#version 330
+
+in VS_FS_VERTEX {
+	vec3 center;
+	vec2 corner;
+	flat float r;
+	flat vec3 colour;
+} vertex_in;
+
+out vec4 out_colour;
+
+uniform mat4 projectionMatrix;
+
+void main (void)
+{
+	float d = dot(vertex_in.corner, vertex_in.corner);
+	if(d > 1.0)
+		discard;
+
+	//sphere point seen by the fragment (view space), its depth written
+	vec3 normal = vec3(vertex_in.corner, sqrt(1.0 - d));
+	vec4 pos = projectionMatrix * vec4(vertex_in.center + vertex_in.r*normal, 1.0);
+	gl_FragDepth = 0.5*(pos.z/pos.w) + 0.5;
+
+	//head light
+	out_colour = vec4(vertex_in.colour*(0.3 + 0.7*normal.z), 1.0);
+}
@@ -0,0 +1,32 @@
+#version 330
+
+in float x;
+in float y;
+in float z;
+in float r;
+in vec3 colour;
+
+out VS_FS_VERTEX {
+	vec3 center;
+	vec2 corner;
+	flat float r;
+	flat vec3 colour;
+} vertex_out;
+
+uniform mat4 projectionMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 modelMatrix;
+
+//one camera facing quad per instance (4 vertices triangle strip),
+//the sphere is ray cast by the fragment shader
+void main(void) {
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1)*2.0 - 1.0;
+	vec4 center = viewMatrix * modelMatrix * vec4(x,y,z,1);
+
+	vertex_out.center = center.xyz/center.w;
+	vertex_out.corner = corner;
+	vertex_out.r = r;
+	vertex_out.colour = colour;
+
+	gl_Position = projectionMatrix * vec4(vertex_out.center + vec3(corner*r, 0.0), 1.0);
+}
@@ -0,0 +1,10 @@
+#version 330
+
+out vec4 out_colour;
+
+uniform vec3 colour;
+
+void main (void)
+{
+	out_colour = vec4(colour, 1.0);
+}
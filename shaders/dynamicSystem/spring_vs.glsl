@@ -0,0 +1,13 @@
+#version 330
+
+in float x;
+in float y;
+in float z;
+
+uniform mat4 projectionMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 modelMatrix;
+
+void main(void) {
+	gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(x,y,z,1);
+}
@@ -12,6 +12,9 @@ uniform vec2 textureSize;
 
 uniform vec3 worldSize = vec3(100,100,100);
 
+//R8_SNORM textures : the field is scaled so that the values near the surface keep their precision
+uniform float densityScale = 1.0;
+
 float metaball(vec3 xyz, vec3 center) {
 	vec3 v = xyz - center;
 	return 1/dot(v,v);
@@ -86,6 +89,8 @@ void main (void)
 	density = min(density, -ellipsoide(oldcoord, vec3(0,-0.2,-0.25), vec3(0.45,0.2,0.2)) + n2);
 	density = min(density, -0.2*pillar(oldcoord, vec3(0,-0.5,-1), vec3(0,-0.05,0), 0.025, -0.1, 0.3) + n1);
 	density += clamp(-0.3 - oldcoord.y,0,1)*10; 
+
+	density *= densityScale;
 }
 
 
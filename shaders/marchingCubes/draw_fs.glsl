@@ -1,7 +1,8 @@
 #version 330
 
 in VS_FS_VERTEX {
-	vec3 pos;
+	vec3 pos;        //volume (brick) frame, for the normals fetch
+	vec3 terrainPos; //terrain frame, for the lighting
 } vertex_in;
 
 layout(std140) uniform generalData {
@@ -12,6 +13,10 @@ layout(std140) uniform generalData {
 
 uniform sampler2D terrain_texture;
 uniform sampler3D normals_occlusion;
+uniform int packedNormals = 0; //octahedral normal in .xy
+
+//extent of the whole terrain, the light position is given in [0,1] of it
+uniform vec3 terrainSize = vec3(100,100,100);
 
 vec3 sourcePos = vec3(0.5,1,1);
 
@@ -24,14 +29,18 @@ float snoise(vec3 v);
 float turbulence(vec3 pos);
 vec3 marble(vec3 pos);
 vec3 applyFog(in vec3 fragColor);
+vec3 octDecode(vec2 uv);
 
 void main (void)
 {	
 	vec3 texCoord = vertex_in.pos/(textureSize*voxelDim);
 	vec4 normal_occlusion = texture(normals_occlusion, texCoord);
-	vec3 normal = normal_occlusion.xyz; 
+	vec3 normal = (packedNormals == 1 ? octDecode(normal_occlusion.xy*2 - 1) : normal_occlusion.xyz); 
 	float occlusion = normal_occlusion.w;
 
+	//same light for all the bricks of a terrain
+	vec3 lightingPos = vertex_in.terrainPos/terrainSize;
+
 	float y = vertex_in.pos.y/(textureSize.y*voxelDim.y);
 
 	/*if(texCoord.x > 0.5)*/
@@ -41,12 +50,20 @@ void main (void)
 	out_colour = vec3(0.88,0.66,0.37);
 	//out_colour = mix(out_colour, marble(texCoord), 0.3);
 	//out_colour = mix(out_colour,texture(terrain_texture, vec2(texCoord.y*4+turbulence(texCoord)/2, texCoord.x)).xyz,0.2);
-	out_colour = clamp(out_colour*(max(0.3,0.3+dot(normal, normalize(sourcePos - texCoord)))),0,1);
+	out_colour = clamp(out_colour*(max(0.3,0.3+dot(normal, normalize(sourcePos - lightingPos)))),0,1);
 
     out_colour = applyFog(out_colour);
 }
 
 
+//inverse of the octahedral mapping (VolumeEncoding::decodeOctahedral)
+vec3 octDecode(vec2 uv) {
+	vec3 n = vec3(uv, 1 - abs(uv.x) - abs(uv.y));
+	if(n.z < 0)
+		n.xy = (1 - abs(n.yx)) * vec2(n.x >= 0 ? 1 : -1, n.y >= 0 ? 1 : -1);
+	return normalize(n);
+}
+
 vec3 applyFog(in vec3 fragColor) {
     return mix( fogColor, fragColor, fogFactor );
 }
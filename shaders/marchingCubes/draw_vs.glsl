@@ -4,6 +4,7 @@ in vec3 vertex_position;
 
 out VS_FS_VERTEX {
 	vec3 pos;
+	vec3 terrainPos;
 } vertex_out;
 
 uniform mat4 modelMatrix = mat4(1,0,0,0,
@@ -20,6 +21,9 @@ layout(std140) uniform projectionView {
 	vec3 cameraRight;
 };
 
+//terrain bricks : brick position in the terrain frame
+uniform vec3 brickOrigin = vec3(0,0,0);
+
 uniform	float fogDensity = 0.05;
 uniform	float underWaterFogEnd = 50.0;
 uniform vec3 sunDir = vec3(100.0,40.0,-50.0);
@@ -34,7 +38,8 @@ void computeFogColor(in vec4 position);
 void main (void)
 {	
 	vertex_out.pos = vertex_position;
-    vec4 worldPos = modelMatrix * vec4(vertex_position, 1.0);
+	vertex_out.terrainPos = vertex_position + brickOrigin;
+    vec4 worldPos = modelMatrix * vec4(vertex_position + brickOrigin, 1.0);
     computeFogColor(worldPos);
 	gl_Position = projectionMatrix * viewMatrix * worldPos;
 }
@@ -0,0 +1,59 @@
+#version 330
+
+out uint triangleCount;
+
+in GS_FS_VERTEX {
+	flat int instanceID;
+} vertex_in;
+
+uniform sampler3D density;
+
+layout (std140) uniform lookupTable {
+	uint caseToNumPolys[256]; //nb de triangle par cas
+	vec3 edgeStart[12];
+	vec3 edgeDir[12];
+	vec4 maskA0123[12];
+	vec4 maskB0123[12];
+	vec4 maskA4567[12];
+	vec4 maskB4567[12];
+};
+
+layout(std140) uniform generalData {
+	vec3 textureSize;
+	vec3 voxelGridSize;
+	vec3 voxelDim;
+};
+
+//level 0 of the histopyramid : triangles of the voxel whose lower left corner is this texel
+//the pyramid is a power of two wide, the voxels outside of the grid are empty
+void main(void) {
+	ivec3 voxel = ivec3(gl_FragCoord.xy, vertex_in.instanceID);
+
+	if(any(greaterThanEqual(voxel, ivec3(voxelGridSize)))) {
+		triangleCount = 0u;
+		return;
+	}
+
+	//same corners and inside test as marchingCube_vs.glsl
+	vec4 f0123 = vec4(
+		texelFetch(density, voxel + ivec3(0,0,0), 0).r,
+		texelFetch(density, voxel + ivec3(0,1,0), 0).r,
+		texelFetch(density, voxel + ivec3(1,1,0), 0).r,
+		texelFetch(density, voxel + ivec3(1,0,0), 0).r
+		);
+
+	vec4 f4567 = vec4(
+		texelFetch(density, voxel + ivec3(0,0,1), 0).r,
+		texelFetch(density, voxel + ivec3(0,1,1), 0).r,
+		texelFetch(density, voxel + ivec3(1,1,1), 0).r,
+		texelFetch(density, voxel + ivec3(1,0,1), 0).r
+		);
+
+	uvec4 n0123 = uvec4(clamp(f0123*99999, 0.0, 1.0));
+	uvec4 n4567 = uvec4(clamp(f4567*99999, 0.0, 1.0));
+
+	uint caseId = (n0123.x << 0) | (n0123.y << 1) | (n0123.z << 2) | (n0123.w << 3)
+		  | (n4567.x << 4) | (n4567.y << 5) | (n4567.z << 6) | (n4567.w << 7);
+
+	triangleCount = caseToNumPolys[caseId];
+}
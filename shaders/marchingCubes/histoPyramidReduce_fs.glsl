@@ -0,0 +1,22 @@
+#version 330
+
+out uint triangleCount;
+
+in GS_FS_VERTEX {
+	flat int instanceID;
+} vertex_in;
+
+//the level below is the only level the sampler can reach (base level = max level)
+uniform usampler3D histoPyramid;
+
+//sum of the 2x2x2 cells below, the level sizes are powers of two
+void main(void) {
+	ivec3 cell = 2*ivec3(gl_FragCoord.xy, vertex_in.instanceID);
+
+	uint sum = 0u;
+	for(int c = 0; c < 8; c++) {
+		sum += texelFetch(histoPyramid, cell + ivec3(c & 1, (c >> 1) & 1, c >> 2), 0).r;
+	}
+
+	triangleCount = sum;
+}
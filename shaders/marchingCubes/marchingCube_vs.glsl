@@ -1,16 +1,33 @@
-
 #version 330
 
-in vec2 voxelLowerLeftXY; //[0.1]x[0,1]
+in float triangleCorner; //0, 1 or 2, one instance per triangle
 
-out VS_GS_VERTEX {
-	vec3 uvw; //[0,1]x[0,1]x[0,1]
-	vec4 f0123; //density values
-	vec4 f4567;
-	uint caseId; //marching cube case 0..255
+out VS_FEEDBACK_VERTEX {
+	vec3 worldPos;
 } vertex_out;
 
 uniform sampler3D density;
+uniform usampler3D histoPyramid; //triangles per voxel (level 0) up to the total (topLevel)
+uniform int topLevel;
+
+//Nombre de triangle par cas + info sur les 12 cotés
+layout (std140) uniform lookupTable {
+	uint caseToNumPolys[256]; //nb de triangle par cas
+	vec3 edgeStart[12];        //debut des cotés
+	vec3 edgeDir[12];          //direction des cotés
+	vec4 maskA0123[12];        //masques pour retrouver la densité en fonction du coté
+	vec4 maskB0123[12];
+	vec4 maskA4567[12];
+	vec4 maskB4567[12];
+};
+
+//table de triangles
+//max 5 triangle par cas
+//un triangle = int3(x,y,z) 
+//avec x,y,z les cotés du cube touchés par le triangle
+layout(std140) uniform triangleTable {
+	ivec3 triTable[1280]; //5*256
+};
 
 layout(std140) uniform generalData {
 	vec3 textureSize;
@@ -20,27 +37,38 @@ layout(std140) uniform generalData {
 
 void main(void) {
 
-	vec3 voxelLowerLeft = vec3(voxelLowerLeftXY, gl_InstanceID/voxelGridSize.z); 
+	//walk down the pyramid, children visited x first, then y, then z (HistoPyramid::find)
+	uint element = uint(gl_InstanceID);
+	ivec3 voxel = ivec3(0);
 
-	vec4 step = vec4(1.0/voxelGridSize.xyz, 0.0);
+	for(int level = topLevel - 1; level >= 0; level--) {
+		voxel *= 2;
+		for(int c = 0; c < 8; c++) {
+			ivec3 child = voxel + ivec3(c & 1, (c >> 1) & 1, c >> 2);
+			uint count = texelFetch(histoPyramid, child, level).r;
 
-	vec3 textureCoordLowerLeft = vec3(voxelLowerLeft.x + step.x/2.0,
-					  voxelLowerLeft.y + step.z/2.0,
-					  (gl_InstanceID + 0.5)/textureSize.z);
+			if(element < count || c == 7) {
+				voxel = child;
+				break;
+			}
 
+			element -= count;
+		}
+	}
 
+	//les valeurs de la densité aux 8 coins du cube
 	vec4 f0123 = vec4(
-		texture(density, textureCoordLowerLeft + step.www).x,
-		texture(density, textureCoordLowerLeft + step.wyw).x,
-		texture(density, textureCoordLowerLeft + step.xyw).x,
-		texture(density, textureCoordLowerLeft + step.xww).x
+		texelFetch(density, voxel + ivec3(0,0,0), 0).r,
+		texelFetch(density, voxel + ivec3(0,1,0), 0).r,
+		texelFetch(density, voxel + ivec3(1,1,0), 0).r,
+		texelFetch(density, voxel + ivec3(1,0,0), 0).r
 		);
 	
 	vec4 f4567 = vec4(
-		texture(density, textureCoordLowerLeft + step.wwz).x,
-		texture(density, textureCoordLowerLeft + step.wyz).x,
-		texture(density, textureCoordLowerLeft + step.xyz).x,
-		texture(density, textureCoordLowerLeft + step.xwz).x
+		texelFetch(density, voxel + ivec3(0,0,1), 0).r,
+		texelFetch(density, voxel + ivec3(0,1,1), 0).r,
+		texelFetch(density, voxel + ivec3(1,1,1), 0).r,
+		texelFetch(density, voxel + ivec3(1,0,1), 0).r
 		);
 
 	uvec4 n0123 = uvec4(clamp(f0123*99999, 0.0, 1.0));
@@ -49,9 +77,16 @@ void main(void) {
 	uint caseId = (n0123.x << 0) | (n0123.y << 1) | (n0123.z << 2) | (n0123.w << 3)
 		  | (n4567.x << 4) | (n4567.y << 5) | (n4567.z << 6) | (n4567.w << 7);
 
-	
-	vertex_out.uvw = voxelLowerLeft;
-	vertex_out.f0123 = f0123;
-	vertex_out.f4567 = f4567;
-	vertex_out.caseId = caseId;
+	//element : rank of the triangle in its voxel
+	ivec3 triangleData = triTable[5u*caseId + element];
+	int edgeNum = triangleData[int(triangleCorner)];
+
+	//interpolation linéaire entre le point A et B
+	//pour trouver le point ou la densité vaut 0
+	float dA = dot(f0123, maskA0123[edgeNum]) + dot(f4567, maskA4567[edgeNum]);
+	float dB = dot(f0123, maskB0123[edgeNum]) + dot(f4567, maskB4567[edgeNum]);
+
+	float t = clamp(dA/(dA-dB), 0.0, 1.0);
+
+	vertex_out.worldPos = (vec3(voxel) + edgeStart[edgeNum] + t*edgeDir[edgeNum])*voxelDim;
 }
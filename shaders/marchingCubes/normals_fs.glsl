@@ -1,6 +1,10 @@
 #version 330 core
 
-out vec4 normal_occlusion;
+//packed normals : octahedral normal in .xy (RG8 or RG16 texture), occlusion in its own R8 texture
+layout(location = 0) out vec4 normal_occlusion;
+layout(location = 1) out float occlusion_out;
+
+uniform int packedNormals = 0;
 
 in GS_FS_VERTEX {
 	flat int instanceID;
@@ -21,9 +25,16 @@ layout(std140) uniform poissonDistributions {
 
 uniform sampler3D density;
 
+//ambient occlusion : 0 = 32 ray marched Poisson rays, 1 = cones traced in the occupancy mipmaps
+uniform int aoMode = 0;
+uniform int coneCount = 6; //6, 14 or 26
+uniform sampler3D occupancy;
+
 
 vec3 computeGradient(vec3 pos, vec4 step);
+vec2 octEncode(vec3 n);
 float computeAmbiantOcclusion(vec3 pos);
+float computeConeTracedOcclusion(vec3 pos);
 
 void main(void)
 {
@@ -31,9 +42,23 @@ void main(void)
 	vec3 pos = vec3(gl_FragCoord.xy/textureSize.xy, vertex_in.instanceID/textureSize.z) + step.xyz/2;
 
 	vec3 normal = normalize(- computeGradient(pos, step));
-	float occlusion = computeAmbiantOcclusion(pos); 
+	float occlusion = (aoMode == 1 ? computeConeTracedOcclusion(pos) : computeAmbiantOcclusion(pos));
+
+	if(packedNormals == 1)
+		normal_occlusion = vec4(octEncode(normal)*0.5 + 0.5, 0, occlusion);
+	else
+		normal_occlusion = vec4(normal, occlusion);
+
+	occlusion_out = occlusion;
+}
 
-	normal_occlusion = vec4(normal, occlusion);
+
+//octahedral mapping of the unit sphere onto [-1,1]^2 (same as VolumeEncoding::encodeOctahedral)
+vec2 octEncode(vec3 n) {
+	vec2 uv = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+	if(n.z < 0)
+		uv = (1 - abs(uv.yx)) * vec2(uv.x >= 0 ? 1 : -1, uv.y >= 0 ? 1 : -1);
+	return uv;
 }
 
 
@@ -87,3 +112,47 @@ float computeAmbiantOcclusion(vec3 pos) {
 	return (1 - visibility/32.0);
 }
 
+
+//axes, then cube corners, then cube edges : the first 6, 14 or 26 cover the sphere
+const vec3 coneDirections[26] = vec3[26](
+	vec3(1,0,0), vec3(-1,0,0), vec3(0,1,0), vec3(0,-1,0), vec3(0,0,1), vec3(0,0,-1),
+
+	vec3( 0.57735, 0.57735, 0.57735), vec3(-0.57735, 0.57735, 0.57735),
+	vec3( 0.57735,-0.57735, 0.57735), vec3(-0.57735,-0.57735, 0.57735),
+	vec3( 0.57735, 0.57735,-0.57735), vec3(-0.57735, 0.57735,-0.57735),
+	vec3( 0.57735,-0.57735,-0.57735), vec3(-0.57735,-0.57735,-0.57735),
+
+	vec3( 0.70711, 0.70711, 0), vec3(-0.70711, 0.70711, 0), vec3( 0.70711,-0.70711, 0), vec3(-0.70711,-0.70711, 0),
+	vec3( 0.70711, 0, 0.70711), vec3(-0.70711, 0, 0.70711), vec3( 0.70711, 0,-0.70711), vec3(-0.70711, 0,-0.70711),
+	vec3( 0, 0.70711, 0.70711), vec3( 0,-0.70711, 0.70711), vec3( 0, 0.70711,-0.70711), vec3( 0,-0.70711,-0.70711)
+);
+
+//occlusion traced along a few wide cones : the sample footprint grows with the distance
+//and is read from the occupancy mip level of the same size, so each cone only needs
+//a handful of fetches to reach as far as the long range ray steps (80 voxels)
+float computeConeTracedOcclusion(vec3 pos) {
+
+	//each cone spans 4pi/coneCount steradians
+	float cosAperture = 1 - 2.0/coneCount;
+	float tanAperture = sqrt(1 - cosAperture*cosAperture)/cosAperture;
+	float maxDistance = 80; //voxels
+
+	float visibility = 0.0f;
+
+	for(int cone=0; cone<coneCount; cone++) {
+		vec3 dir = coneDirections[cone] / voxelGridSize;
+		float alpha = 0.0f;
+		float dist = 1.0f;
+
+		while(dist < maxDistance && alpha < 0.99) {
+			float diameter = max(2 * tanAperture * dist, 1);
+			float solid = textureLod(occupancy, pos + dist * dir, log2(diameter)).r;
+			alpha += (1 - alpha) * solid;
+			dist += diameter / 2;
+		}
+
+		visibility += 1 - alpha;
+	}
+
+	return (1 - visibility/coneCount);
+}
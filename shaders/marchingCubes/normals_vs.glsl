@@ -7,7 +7,10 @@ out VS_GS_VERTEX {
 	int instanceID; //pour le passer en gl_layer
 } vertex_out;
 
+//first layer to render, so that only a slice of the texture can be updated
+uniform int layerOffset = 0;
+
 void main(void) {
 	vertex_out.position = vertex_position;	
-	vertex_out.instanceID = gl_InstanceID;
+	vertex_out.instanceID = gl_InstanceID + layerOffset;
 }
@@ -0,0 +1,17 @@
+#version 330 core
+
+out float occupancy;
+
+in GS_FS_VERTEX {
+	flat int instanceID;
+} vertex_in;
+
+uniform sampler3D density;
+
+//solid (1) or empty (0) texel : the ray marched occlusion multiplies its visibility by clamp(d*9999,0,1),
+//so a texel blocks where d <= 0 and lets light through where d > 0
+//once averaged by the mipmaps, level l holds the solid fraction of 2^l voxels wide cells
+void main(void) {
+	float d = texelFetch(density, ivec3(gl_FragCoord.xy, vertex_in.instanceID), 0).r;
+	occupancy = 1 - clamp(d * 9999, 0, 1);
+}
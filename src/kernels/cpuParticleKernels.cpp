@@ -0,0 +1,1545 @@
+
+#include "cpuParticleKernels.h"
+#include "particleGroup.h"
+#include "threadPool.h"
+#include "uniformGrid.h"
+#include "densityVolume.h"
+#include "densityField.h"
+#include "constantForce.h"
+#include "springsSystem.h"
+#include "dynamicScheme.h"
+#include "simulationClock.h"
+#include "log.h"
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+extern float benchmarkAttractorGridKernel(const float *x, const float *y, const float *z, const float *m,
+		const unsigned int nParticles,
+		const float dMin, const float dMax, const float C,
+		const unsigned int nRuns);
+
+namespace {
+	//big enough ranges to hide the pool overhead (the kernels are memory bound)
+	const unsigned int grain = 8192;
+
+	void forRanges(unsigned int count, const std::function<void(unsigned int, unsigned int)> &func) {
+		ThreadPool::global().parallelFor(0, count, func, grain);
+	}
+
+#ifdef __AVX2__
+	inline __m256 set1(float x) {
+		return _mm256_set1_ps(x);
+	}
+
+	//8 unsigned char flags -> all bits set where the flag is not 0
+	inline __m256 flagMask(const unsigned char *flags) {
+		__m256i f = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) flags));
+		return _mm256_castsi256_ps(_mm256_cmpgt_epi32(f, _mm256_setzero_si256()));
+	}
+
+	inline float horizontalSum(__m256 x) {
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(x), _mm256_extractf128_ps(x, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+#endif
+}
+
+void CpuParticleKernels::constantForce(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float Fx, float Fy, float Fz) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 Fx8 = set1(Fx), Fy8 = set1(Fy), Fz8 = set1(Fz);
+		for (; i + 8 <= end; i += 8) {
+			_mm256_storeu_ps(fx + i, _mm256_add_ps(_mm256_loadu_ps(fx + i), Fx8));
+			_mm256_storeu_ps(fy + i, _mm256_add_ps(_mm256_loadu_ps(fy + i), Fy8));
+			_mm256_storeu_ps(fz + i, _mm256_add_ps(_mm256_loadu_ps(fz + i), Fz8));
+		}
+#endif
+		for (; i < end; i++) {
+			fx[i] += Fx;
+			fy[i] += Fy;
+			fz[i] += Fz;
+		}
+	});
+}
+
+void CpuParticleKernels::constantMassForce(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float mFx, float mFy, float mFz) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *m = pt->m;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 mFx8 = set1(mFx), mFy8 = set1(mFy), mFz8 = set1(mFz);
+		for (; i + 8 <= end; i += 8) {
+			__m256 m8 = _mm256_loadu_ps(m + i);
+			_mm256_storeu_ps(fx + i, _mm256_add_ps(_mm256_loadu_ps(fx + i), _mm256_mul_ps(m8, mFx8)));
+			_mm256_storeu_ps(fy + i, _mm256_add_ps(_mm256_loadu_ps(fy + i), _mm256_mul_ps(m8, mFy8)));
+			_mm256_storeu_ps(fz + i, _mm256_add_ps(_mm256_loadu_ps(fz + i), _mm256_mul_ps(m8, mFz8)));
+		}
+#endif
+		for (; i < end; i++) {
+			fx[i] += m[i]*mFx;
+			fy[i] += m[i]*mFy;
+			fz[i] += m[i]*mFz;
+		}
+	});
+}
+
+void CpuParticleKernels::pousseeArchimede(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float nx, float ny, float nz, float rho, float g) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *r = pt->r;
+	const float volumeFactor = 4.0f/3.0f*3.14f;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 rhoG = set1(rho*g*volumeFactor);
+		for (; i + 8 <= end; i += 8) {
+			__m256 r8 = _mm256_loadu_ps(r + i);
+			__m256 s = _mm256_mul_ps(rhoG, _mm256_mul_ps(r8, _mm256_mul_ps(r8, r8)));
+			_mm256_storeu_ps(fx + i, _mm256_sub_ps(_mm256_loadu_ps(fx + i), _mm256_mul_ps(set1(nx), s)));
+			_mm256_storeu_ps(fy + i, _mm256_sub_ps(_mm256_loadu_ps(fy + i), _mm256_mul_ps(set1(ny), s)));
+			_mm256_storeu_ps(fz + i, _mm256_sub_ps(_mm256_loadu_ps(fz + i), _mm256_mul_ps(set1(nz), s)));
+		}
+#endif
+		for (; i < end; i++) {
+			float s = rho*g*volumeFactor*(r[i]*(r[i]*r[i]));
+			fx[i] -= nx*s;
+			fy[i] -= ny*s;
+			fz[i] -= nz*s;
+		}
+	});
+}
+
+void CpuParticleKernels::frottementFluide(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float k1, float k2) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *vx = pt->vx, *vy = pt->vy, *vz = pt->vz;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 k18 = set1(k1), k28 = set1(k2);
+		float *f[3] = {fx, fy, fz};
+		const float *v[3] = {vx, vy, vz};
+		for (; i + 8 <= end; i += 8) {
+			for (unsigned int c = 0; c < 3; c++) {
+				__m256 v8 = _mm256_loadu_ps(v[c] + i);
+				__m256 drag = _mm256_add_ps(_mm256_mul_ps(k18, v8), _mm256_mul_ps(_mm256_mul_ps(k28, v8), v8));
+				_mm256_storeu_ps(f[c] + i, _mm256_sub_ps(_mm256_loadu_ps(f[c] + i), drag));
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			fx[i] -= k1*vx[i] + k2*vx[i]*vx[i];
+			fy[i] -= k1*vy[i] + k2*vy[i]*vy[i];
+			fz[i] -= k1*vz[i] + k2*vz[i]*vz[i];
+		}
+	});
+}
+
+void CpuParticleKernels::frottementFluideAvance(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float rho, float cx, float cy, float cz) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *vx = pt->vx, *vy = pt->vy, *vz = pt->vz, *r = pt->r;
+
+	//F = c * 1/2 rho v^2 S, with S = 4 pi r^2 (same v^2 as the CUDA kernel)
+	const float factor = 0.5f*rho*4.0f*3.14f;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 c8[3] = {set1(cx*factor), set1(cy*factor), set1(cz*factor)};
+		float *f[3] = {fx, fy, fz};
+		const float *v[3] = {vx, vy, vz};
+		for (; i + 8 <= end; i += 8) {
+			__m256 vx8 = _mm256_loadu_ps(vx + i), vy8 = _mm256_loadu_ps(vy + i), vz8 = _mm256_loadu_ps(vz + i);
+			__m256 r8 = _mm256_loadu_ps(r + i);
+			__m256 v2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx8, vx8), _mm256_mul_ps(vy8, vy8)), _mm256_mul_ps(vz8, vz8));
+			__m256 s = _mm256_mul_ps(_mm256_mul_ps(v2, v2), _mm256_mul_ps(r8, r8));
+			for (unsigned int c = 0; c < 3; c++) {
+				__m256 drag = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(v[c] + i), c8[c]), s);
+				_mm256_storeu_ps(f[c] + i, _mm256_sub_ps(_mm256_loadu_ps(f[c] + i), drag));
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			float v2 = vx[i]*vx[i] + vy[i]*vy[i] + vz[i]*vz[i];
+			float s = (v2*v2)*(r[i]*r[i]);
+			fx[i] -= vx[i]*(cx*factor)*s;
+			fy[i] -= vy[i]*(cy*factor)*s;
+			fz[i] -= vz[i]*(cz*factor)*s;
+		}
+	});
+}
+
+void CpuParticleKernels::attractor(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float dMin, float dMax, float C, UniformGrid *grid) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+
+	//cells of dMax : every neighbour closer than dMax is in the 27 cells around
+	grid->build(pt->x, pt->y, pt->z, nParticles, dMax);
+
+	std::vector<float> sortedM(nParticles);
+	grid->gather(pt->m, sortedM.data());
+
+	const float *x = grid->getSortedX(), *y = grid->getSortedY(), *z = grid->getSortedZ(), *m = sortedM.data();
+	const unsigned int *index = grid->getSortedIndices();
+
+	//sorted order : the candidates of consecutive particles are the same cells
+	ThreadPool::global().parallelFor(0, nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int id = begin; id < end; id++) {
+			float _fx = 0.0f, _fy = 0.0f, _fz = 0.0f;
+#ifdef __AVX2__
+			const __m256 x0 = set1(x[id]), y0 = set1(y[id]), z0 = set1(z[id]);
+			const __m256 Cm = set1(C*m[id]), dMin8 = set1(dMin), dMax8 = set1(dMax);
+			const __m256i self = _mm256_set1_epi32(id), lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			__m256 fx8 = _mm256_setzero_ps(), fy8 = _mm256_setzero_ps(), fz8 = _mm256_setzero_ps();
+#endif
+
+			grid->forEachCandidateRange(x[id], y[id], z[id], [&](unsigned int cellBegin, unsigned int cellEnd) {
+				unsigned int i = cellBegin;
+#ifdef __AVX2__
+				for (; i + 8 <= cellEnd; i += 8) {
+					__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), x0);
+					__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), y0);
+					__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), z0);
+					__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+					__m256 d = _mm256_sqrt_ps(d2);
+
+					__m256 inRange = _mm256_and_ps(_mm256_cmp_ps(d, dMin8, _CMP_GE_OQ), _mm256_cmp_ps(d, dMax8, _CMP_LE_OQ));
+					__m256 isSelf = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), lanes), self));
+					__m256 mask = _mm256_andnot_ps(isSelf, inRange);
+
+					__m256 c = _mm256_div_ps(_mm256_mul_ps(Cm, _mm256_loadu_ps(m + i)), _mm256_mul_ps(d2, d));
+					fx8 = _mm256_add_ps(fx8, _mm256_and_ps(mask, _mm256_mul_ps(c, dx)));
+					fy8 = _mm256_add_ps(fy8, _mm256_and_ps(mask, _mm256_mul_ps(c, dy)));
+					fz8 = _mm256_add_ps(fz8, _mm256_and_ps(mask, _mm256_mul_ps(c, dz)));
+				}
+#endif
+				for (; i < cellEnd; i++) {
+					float dx = x[i] - x[id], dy = y[i] - y[id], dz = z[i] - z[id];
+					float d2 = dx*dx + dy*dy + dz*dz;
+					float d = sqrtf(d2);
+
+					if(i == id || d < dMin || d > dMax)
+						continue;
+
+					float c = C*m[id]*m[i]/(d2*d);
+					_fx += c*dx;
+					_fy += c*dy;
+					_fz += c*dz;
+				}
+			});
+
+#ifdef __AVX2__
+			_fx += horizontalSum(fx8);
+			_fy += horizontalSum(fy8);
+			_fz += horizontalSum(fz8);
+#endif
+			unsigned int p = index[id];
+			fx[p] += _fx;
+			fy[p] += _fy;
+			fz[p] += _fz;
+		}
+	}, 256);
+}
+
+void CpuParticleKernels::attractorAllPairs(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float dMin, float dMax, float C) {
+
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *x = pt->x, *y = pt->y, *z = pt->z, *m = pt->m;
+
+	//O(n^2) : much smaller ranges than the streaming kernels
+	ThreadPool::global().parallelFor(0, nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int id = begin; id < end; id++) {
+			float _fx = 0.0f, _fy = 0.0f, _fz = 0.0f;
+			unsigned int i = 0;
+#ifdef __AVX2__
+			const __m256 x0 = set1(x[id]), y0 = set1(y[id]), z0 = set1(z[id]);
+			const __m256 Cm = set1(C*m[id]), dMin8 = set1(dMin), dMax8 = set1(dMax);
+			const __m256i self = _mm256_set1_epi32(id), lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+			__m256 fx8 = _mm256_setzero_ps(), fy8 = _mm256_setzero_ps(), fz8 = _mm256_setzero_ps();
+			for (; i + 8 <= nParticles; i += 8) {
+				__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), x0);
+				__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), y0);
+				__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), z0);
+				__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+				__m256 d = _mm256_sqrt_ps(d2);
+
+				__m256 inRange = _mm256_and_ps(_mm256_cmp_ps(d, dMin8, _CMP_GE_OQ), _mm256_cmp_ps(d, dMax8, _CMP_LE_OQ));
+				__m256 isSelf = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), lanes), self));
+				__m256 mask = _mm256_andnot_ps(isSelf, inRange);
+
+				//masked out lanes may hold inf or nan (d == 0), and_ps clears them
+				__m256 c = _mm256_div_ps(_mm256_mul_ps(Cm, _mm256_loadu_ps(m + i)), _mm256_mul_ps(d2, d));
+				fx8 = _mm256_add_ps(fx8, _mm256_and_ps(mask, _mm256_mul_ps(c, dx)));
+				fy8 = _mm256_add_ps(fy8, _mm256_and_ps(mask, _mm256_mul_ps(c, dy)));
+				fz8 = _mm256_add_ps(fz8, _mm256_and_ps(mask, _mm256_mul_ps(c, dz)));
+			}
+			_fx = horizontalSum(fx8);
+			_fy = horizontalSum(fy8);
+			_fz = horizontalSum(fz8);
+#endif
+			for (; i < nParticles; i++) {
+				if(i == id)
+					continue;
+
+				float dx = x[i] - x[id], dy = y[i] - y[id], dz = z[i] - z[id];
+				float d2 = dx*dx + dy*dy + dz*dz;
+				float d = sqrtf(d2);
+
+				if(d < dMin || d > dMax)
+					continue;
+
+				float c = C*m[id]*m[i]/(d2*d);
+				_fx += c*dx;
+				_fy += c*dy;
+				_fz += c*dz;
+			}
+
+			fx[id] += _fx;
+			fy[id] += _fy;
+			fz[id] += _fz;
+		}
+	}, 64);
+}
+
+void CpuParticleKernels::killParticles(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float vx, float vy, float vz, float maxVal) {
+
+	const float *x = pt->x, *y = pt->y, *z = pt->z;
+	unsigned char *kill = pt->kill;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 vx8 = set1(vx), vy8 = set1(vy), vz8 = set1(vz), max8 = set1(maxVal);
+		for (; i + 8 <= end; i += 8) {
+			__m256 dot = _mm256_add_ps(_mm256_add_ps(
+						_mm256_mul_ps(_mm256_loadu_ps(x + i), vx8),
+						_mm256_mul_ps(_mm256_loadu_ps(y + i), vy8)),
+						_mm256_mul_ps(_mm256_loadu_ps(z + i), vz8));
+			int killed = _mm256_movemask_ps(_mm256_cmp_ps(dot, max8, _CMP_GT_OQ));
+			for (unsigned int b = 0; killed; b++, killed >>= 1) {
+				if(killed & 1)
+					kill[i + b] = 1;
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			if(x[i]*vx + y[i]*vy + z[i]*vz > maxVal)
+				kill[i] = 1;
+		}
+	});
+}
+
+void CpuParticleKernels::dynamicScheme(const struct mappedParticlePointers *pt, unsigned int nParticles, float dt) {
+	float *x = pt->x, *y = pt->y, *z = pt->z;
+	float *vx = pt->vx, *vy = pt->vy, *vz = pt->vz;
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *im = pt->im;
+	const unsigned char *fixed = pt->fixed;
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 dt8 = set1(dt);
+		float *p[3] = {x, y, z}, *v[3] = {vx, vy, vz}, *f[3] = {fx, fy, fz};
+		for (; i + 8 <= end; i += 8) {
+			//fixed particles are left untouched (forces included)
+			__m256 isFixed = flagMask(fixed + i);
+			__m256 im8 = _mm256_loadu_ps(im + i);
+
+			for (unsigned int c = 0; c < 3; c++) {
+				__m256 f8 = _mm256_loadu_ps(f[c] + i);
+				__m256 v8 = _mm256_loadu_ps(v[c] + i);
+				__m256 p8 = _mm256_loadu_ps(p[c] + i);
+
+				__m256 newV = _mm256_add_ps(v8, _mm256_mul_ps(_mm256_mul_ps(dt8, f8), im8));
+				__m256 newP = _mm256_add_ps(p8, _mm256_mul_ps(newV, dt8));
+
+				_mm256_storeu_ps(v[c] + i, _mm256_blendv_ps(newV, v8, isFixed));
+				_mm256_storeu_ps(p[c] + i, _mm256_blendv_ps(newP, p8, isFixed));
+				_mm256_storeu_ps(f[c] + i, _mm256_and_ps(isFixed, f8));
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			if(fixed[i])
+				continue;
+
+			vx[i] += dt*fx[i]*im[i];
+			vy[i] += dt*fy[i]*im[i];
+			vz[i] += dt*fz[i]*im[i];
+
+			x[i] += vx[i]*dt;
+			y[i] += vy[i]*dt;
+			z[i] += vz[i]*dt;
+
+			fx[i] = 0.0f;
+			fy[i] = 0.0f;
+			fz[i] = 0.0f;
+		}
+	});
+}
+
+namespace {
+	template <unsigned int TERMS>
+	void fusedRange(const struct mappedParticlePointers *pt, const struct particleForceTerms &t,
+			unsigned int begin, unsigned int end) {
+
+		const bool mass = (TERMS & MASS_TERM), volume = (TERMS & VOLUME_TERM);
+		const bool drag = (TERMS & DRAG_TERM), advancedDrag = (TERMS & ADVANCED_DRAG_TERM);
+		const bool integrate = (TERMS & INTEGRATION_TERM);
+
+		float *p[3] = {pt->x, pt->y, pt->z}, *v[3] = {pt->vx, pt->vy, pt->vz}, *f[3] = {pt->fx, pt->fy, pt->fz};
+		const float *m = pt->m, *r = pt->r, *im = pt->im;
+		const unsigned char *fixed = pt->fixed;
+
+		unsigned int i = begin;
+#ifdef __AVX2__
+		const __m256 dt8 = set1(t.dt), k18 = set1(t.k1), k28 = set1(t.k2);
+		for (; i + 8 <= end; i += 8) {
+			__m256 v8[3], m8, r8, r3, s;
+			for (unsigned int c = 0; c < 3; c++)
+				v8[c] = _mm256_loadu_ps(v[c] + i);
+
+			if(mass)
+				m8 = _mm256_loadu_ps(m + i);
+			if(volume || advancedDrag)
+				r8 = _mm256_loadu_ps(r + i);
+			if(volume)
+				r3 = _mm256_mul_ps(r8, _mm256_mul_ps(r8, r8));
+			if(advancedDrag) {
+				__m256 v2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(v8[0], v8[0]), _mm256_mul_ps(v8[1], v8[1])), _mm256_mul_ps(v8[2], v8[2]));
+				s = _mm256_mul_ps(_mm256_mul_ps(v2, v2), _mm256_mul_ps(r8, r8));
+			}
+
+			__m256 isFixed, im8;
+			if(integrate) {
+				isFixed = flagMask(fixed + i);
+				im8 = _mm256_loadu_ps(im + i);
+			}
+
+			for (unsigned int c = 0; c < 3; c++) {
+				__m256 f8 = _mm256_add_ps(_mm256_loadu_ps(f[c] + i), set1(t.F[c]));
+				if(mass)
+					f8 = _mm256_add_ps(f8, _mm256_mul_ps(m8, set1(t.Fm[c])));
+				if(volume)
+					f8 = _mm256_add_ps(f8, _mm256_mul_ps(r3, set1(t.Fv[c])));
+				if(drag)
+					f8 = _mm256_sub_ps(f8, _mm256_add_ps(_mm256_mul_ps(k18, v8[c]), _mm256_mul_ps(_mm256_mul_ps(k28, v8[c]), v8[c])));
+				if(advancedDrag)
+					f8 = _mm256_sub_ps(f8, _mm256_mul_ps(_mm256_mul_ps(v8[c], set1(t.c[c])), s));
+
+				if(!integrate) {
+					_mm256_storeu_ps(f[c] + i, f8);
+					continue;
+				}
+
+				__m256 p8 = _mm256_loadu_ps(p[c] + i);
+				__m256 newV = _mm256_add_ps(v8[c], _mm256_mul_ps(_mm256_mul_ps(dt8, f8), im8));
+				__m256 newP = _mm256_add_ps(p8, _mm256_mul_ps(newV, dt8));
+
+				_mm256_storeu_ps(v[c] + i, _mm256_blendv_ps(newV, v8[c], isFixed));
+				_mm256_storeu_ps(p[c] + i, _mm256_blendv_ps(newP, p8, isFixed));
+				_mm256_storeu_ps(f[c] + i, _mm256_and_ps(isFixed, f8));
+			}
+		}
+#endif
+		for (; i < end; i++) {
+			float _v[3] = {v[0][i], v[1][i], v[2][i]};
+			float r3 = 0.0f, s = 0.0f;
+			if(volume)
+				r3 = r[i]*(r[i]*r[i]);
+			if(advancedDrag) {
+				float v2 = _v[0]*_v[0] + _v[1]*_v[1] + _v[2]*_v[2];
+				s = (v2*v2)*(r[i]*r[i]);
+			}
+
+			bool moves = integrate && !fixed[i];
+
+			for (unsigned int c = 0; c < 3; c++) {
+				float _f = f[c][i] + t.F[c];
+				if(mass)
+					_f += m[i]*t.Fm[c];
+				if(volume)
+					_f += r3*t.Fv[c];
+				if(drag)
+					_f -= t.k1*_v[c] + t.k2*_v[c]*_v[c];
+				if(advancedDrag)
+					_f -= _v[c]*t.c[c]*s;
+
+				if(!moves) {
+					f[c][i] = _f;
+					continue;
+				}
+
+				v[c][i] = _v[c] + t.dt*_f*im[i];
+				p[c][i] += v[c][i]*t.dt;
+				f[c][i] = 0.0f;
+			}
+		}
+	}
+
+	//runtime mask -> fusedRange instantiation
+	template <unsigned int TERMS>
+	struct FusedDispatch {
+		static void run(unsigned int mask, const struct mappedParticlePointers *pt, unsigned int nParticles,
+				const struct particleForceTerms &t) {
+			if(mask != TERMS) {
+				FusedDispatch<TERMS - 1>::run(mask, pt, nParticles, t);
+				return;
+			}
+			forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+				fusedRange<TERMS>(pt, t, begin, end);
+			});
+		}
+	};
+
+	template <>
+	struct FusedDispatch<0> {
+		static void run(unsigned int mask, const struct mappedParticlePointers *pt, unsigned int nParticles,
+				const struct particleForceTerms &t) {
+			forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+				fusedRange<0>(pt, t, begin, end);
+			});
+		}
+	};
+}
+
+unsigned int CpuParticleKernels::forceTermsMask(const struct particleForceTerms *terms) {
+	unsigned int mask = 0;
+	for (unsigned int c = 0; c < 3; c++) {
+		mask |= (terms->Fm[c] != 0.0f ? MASS_TERM : 0);
+		mask |= (terms->Fv[c] != 0.0f ? VOLUME_TERM : 0);
+		mask |= (terms->c[c] != 0.0f ? ADVANCED_DRAG_TERM : 0);
+	}
+	mask |= (terms->k1 != 0.0f || terms->k2 != 0.0f ? DRAG_TERM : 0);
+	mask |= (terms->integrate ? INTEGRATION_TERM : 0);
+
+	return mask;
+}
+
+void CpuParticleKernels::fusedStep(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		const struct particleForceTerms *terms) {
+	FusedDispatch<2*INTEGRATION_TERM - 1>::run(forceTermsMask(terms), pt, nParticles, *terms);
+}
+
+unsigned long CpuParticleKernels::fusedStepTraffic(const struct particleForceTerms *terms, unsigned int nParticles) {
+	unsigned int mask = forceTermsMask(terms);
+
+	//forces are read and written back (or reset)
+	unsigned long bytes = 6*sizeof(float);
+	if(mask & (DRAG_TERM | ADVANCED_DRAG_TERM | INTEGRATION_TERM))
+		bytes += 3*sizeof(float);
+	if(mask & MASS_TERM)
+		bytes += sizeof(float);
+	if(mask & (VOLUME_TERM | ADVANCED_DRAG_TERM))
+		bytes += sizeof(float);
+	//positions read, positions and velocities written, inverse mass and fixed flag read
+	if(mask & INTEGRATION_TERM)
+		bytes += 9*sizeof(float) + sizeof(float) + sizeof(unsigned char);
+
+	return bytes*nParticles;
+}
+
+void CpuParticleKernels::springs(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+		bool handleDumping, CpuSpringIncidence *incidence) {
+
+	const unsigned int *id1 = pt->id1, *id2 = pt->id2;
+	const float *x = pt->x, *y = pt->y, *z = pt->z;
+	const float *vx = pt->vx, *vy = pt->vy, *vz = pt->vz;
+	const float *k = pt->k, *Lo = pt->Lo, *d = pt->d, *Fmax = pt->Fmax;
+	const unsigned char *kill = pt->killSpring;
+	float *lines = pt->lines, *intensity = pt->intensity;
+	float *sfx = &incidence->fx[0], *sfy = &incidence->fy[0], *sfz = &incidence->fz[0];
+
+	//spring forces, line vertices and intensities
+	forRanges(nSprings, [=](unsigned int begin, unsigned int end) {
+		unsigned int s = begin;
+#ifdef __AVX2__
+		const __m256 zero = _mm256_setzero_ps(), one = set1(1.0f);
+		for (; s + 8 <= end; s += 8) {
+			__m256i i1 = _mm256_loadu_si256((const __m256i *)(id1 + s));
+			__m256i i2 = _mm256_loadu_si256((const __m256i *)(id2 + s));
+
+			__m256 x1 = _mm256_i32gather_ps(x, i1, 4), y1 = _mm256_i32gather_ps(y, i1, 4), z1 = _mm256_i32gather_ps(z, i1, 4);
+			__m256 x2 = _mm256_i32gather_ps(x, i2, 4), y2 = _mm256_i32gather_ps(y, i2, 4), z2 = _mm256_i32gather_ps(z, i2, 4);
+
+			__m256 dx = _mm256_sub_ps(x2, x1), dy = _mm256_sub_ps(y2, y1), dz = _mm256_sub_ps(z2, z1);
+			__m256 N = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+
+			//killed and degenerated springs apply no force
+			__m256 valid = _mm256_andnot_ps(flagMask(kill + s), _mm256_cmp_ps(N, set1(1.0e-4f), _CMP_GE_OQ));
+
+			//stiffness
+			__m256 dF = _mm256_sub_ps(zero, _mm256_mul_ps(_mm256_loadu_ps(k + s), _mm256_sub_ps(N, _mm256_loadu_ps(Lo + s))));
+
+			//damping
+			if(handleDumping) {
+				__m256 d8 = _mm256_loadu_ps(d + s);
+				__m256 dvx = _mm256_sub_ps(_mm256_i32gather_ps(vx, i2, 4), _mm256_i32gather_ps(vx, i1, 4));
+				__m256 dvy = _mm256_sub_ps(_mm256_i32gather_ps(vy, i2, 4), _mm256_i32gather_ps(vy, i1, 4));
+				__m256 dvz = _mm256_sub_ps(_mm256_i32gather_ps(vz, i2, 4), _mm256_i32gather_ps(vz, i1, 4));
+				__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dvx, dx), _mm256_mul_ps(dvy, dy)), _mm256_mul_ps(dvz, dz));
+				__m256 dFd = _mm256_div_ps(_mm256_mul_ps(d8, dot), N);
+				dF = _mm256_sub_ps(dF, _mm256_and_ps(_mm256_cmp_ps(d8, set1(1.0e-6f), _CMP_GT_OQ), dFd));
+			}
+
+			dF = _mm256_div_ps(dF, N);
+			_mm256_storeu_ps(sfx + s, _mm256_and_ps(valid, _mm256_mul_ps(dF, dx)));
+			_mm256_storeu_ps(sfy + s, _mm256_and_ps(valid, _mm256_mul_ps(dF, dy)));
+			_mm256_storeu_ps(sfz + s, _mm256_and_ps(valid, _mm256_mul_ps(dF, dz)));
+
+			//vbos are only updated for the springs applying a force, as on the GPU
+			float ends[6][8], ratio[8];
+			_mm256_storeu_ps(ends[0], x1);
+			_mm256_storeu_ps(ends[1], y1);
+			_mm256_storeu_ps(ends[2], z1);
+			_mm256_storeu_ps(ends[3], x2);
+			_mm256_storeu_ps(ends[4], y2);
+			_mm256_storeu_ps(ends[5], z2);
+			_mm256_storeu_ps(ratio, _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(dF, _mm256_loadu_ps(Fmax + s)), _mm256_sub_ps(zero, one)), one));
+
+			int validBits = _mm256_movemask_ps(valid);
+			for (unsigned int b = 0; b < 8; b++) {
+				if(!(validBits & (1 << b)))
+					continue;
+
+				for (unsigned int c = 0; c < 6; c++)
+					lines[6*(s + b) + c] = ends[c][b];
+				intensity[2*(s + b) + 0] = ratio[b];
+				intensity[2*(s + b) + 1] = ratio[b];
+			}
+		}
+#endif
+		for (; s < end; s++) {
+			sfx[s] = sfy[s] = sfz[s] = 0.0f;
+
+			if(kill[s])
+				continue;
+
+			unsigned int _id1 = id1[s], _id2 = id2[s];
+			float dx = x[_id2] - x[_id1], dy = y[_id2] - y[_id1], dz = z[_id2] - z[_id1];
+			float N = sqrtf(dx*dx + dy*dy + dz*dz);
+
+			if(N < 1.0e-4f)
+				continue;
+
+			float dF = -k[s]*(N - Lo[s]);
+			if(handleDumping && d[s] > 1.0e-6f) {
+				float dvx = vx[_id2] - vx[_id1], dvy = vy[_id2] - vy[_id1], dvz = vz[_id2] - vz[_id1];
+				dF -= d[s]*(dvx*dx + dvy*dy + dvz*dz)/N;
+			}
+
+			dF /= N;
+			sfx[s] = dF*dx;
+			sfy[s] = dF*dy;
+			sfz[s] = dF*dz;
+
+			lines[6*s + 0] = x[_id1];
+			lines[6*s + 1] = y[_id1];
+			lines[6*s + 2] = z[_id1];
+			lines[6*s + 3] = x[_id2];
+			lines[6*s + 4] = y[_id2];
+			lines[6*s + 5] = z[_id2];
+
+			float ratio = std::min(std::max(dF/Fmax[s], -1.0f), 1.0f);
+			intensity[2*s + 0] = ratio;
+			intensity[2*s + 1] = ratio;
+		}
+	});
+
+	//each particle sums the forces of its own springs
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const unsigned int *offsets = &incidence->offsets[0], *incident = &incidence->springs[0];
+
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int p = begin; p < end; p++) {
+			float _fx = 0.0f, _fy = 0.0f, _fz = 0.0f;
+			for (unsigned int j = offsets[p]; j < offsets[p + 1]; j++) {
+				unsigned int s = incident[j] >> 1;
+				float sign = (incident[j] & 1u ? 1.0f : -1.0f);
+				_fx += sign*sfx[s];
+				_fy += sign*sfy[s];
+				_fz += sign*sfz[s];
+			}
+			fx[p] += _fx;
+			fy[p] += _fy;
+			fz[p] += _fz;
+		}
+	});
+}
+
+void CpuParticleKernels::xpbd(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+		const SpringColouring *colouring, float dt, unsigned int nSubsteps, unsigned int nIterations, bool handleDumping,
+		XpbdState *state) {
+
+	float *x = pt->x, *y = pt->y, *z = pt->z;
+	float *vx = pt->vx, *vy = pt->vy, *vz = pt->vz;
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *im = pt->im;
+	const unsigned char *fixed = pt->fixed;
+
+	state->px.resize(nParticles + 1);
+	state->py.resize(nParticles + 1);
+	state->pz.resize(nParticles + 1);
+	state->lambda.resize(nSprings + 1);
+	float *px = &state->px[0], *py = &state->py[0], *pz = &state->pz[0], *lambda = &state->lambda[0];
+
+	//distance constraints C = |x2 - x1| - Lo, alpha = 1/(k h^2), gamma = alpha*d*h
+	//scalar : the ends are scattered, a colour never writes the same particle twice
+	const float *k = pt->k, *Lo = pt->Lo, *d = pt->d;
+	const unsigned int *id1 = pt->id1, *id2 = pt->id2;
+	const float h = dt/nSubsteps, ih = 1.0f/h, ih2 = ih*ih;
+
+	auto project = [=](unsigned int s) {
+		unsigned int _id1 = id1[s], _id2 = id2[s];
+		float w1 = (fixed[_id1] ? 0.0f : im[_id1]), w2 = (fixed[_id2] ? 0.0f : im[_id2]);
+		if(w1 + w2 <= 0.0f || k[s] <= 0.0f)
+			return;
+
+		float dx = x[_id2] - x[_id1], dy = y[_id2] - y[_id1], dz = z[_id2] - z[_id1];
+		float N = sqrtf(dx*dx + dy*dy + dz*dz);
+		if(N < 1.0e-4f)
+			return;
+
+		float nx = dx/N, ny = dy/N, nz = dz/N;
+		float alpha = ih2/k[s];
+		float gamma = (handleDumping ? alpha*d[s]*h : 0.0f);
+
+		float gradDx = 0.0f;
+		if(gamma > 0.0f) {
+			gradDx = nx*((x[_id2] - px[_id2]) - (x[_id1] - px[_id1]))
+				+ ny*((y[_id2] - py[_id2]) - (y[_id1] - py[_id1]))
+				+ nz*((z[_id2] - pz[_id2]) - (z[_id1] - pz[_id1]));
+		}
+
+		float dLambda = (-(N - Lo[s]) - alpha*lambda[s] - gamma*gradDx)/((1.0f + gamma)*(w1 + w2) + alpha);
+		lambda[s] += dLambda;
+
+		x[_id1] -= w1*dLambda*nx;
+		y[_id1] -= w1*dLambda*ny;
+		z[_id1] -= w1*dLambda*nz;
+		x[_id2] += w2*dLambda*nx;
+		y[_id2] += w2*dLambda*ny;
+		z[_id2] += w2*dLambda*nz;
+	};
+
+	const unsigned int *colourSprings = &colouring->springs[0];
+	unsigned int nColours = colouring->offsets.size() - 1;
+
+	for (unsigned int substep = 0; substep < nSubsteps; substep++) {
+		bool last = (substep == nSubsteps - 1);
+
+		//prediction with the accumulated forces, reset after the last substep
+		//(fixed particles are left untouched, as in dynamicScheme)
+		forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				px[i] = x[i];
+				py[i] = y[i];
+				pz[i] = z[i];
+
+				if(fixed[i])
+					continue;
+
+				vx[i] += h*fx[i]*im[i];
+				vy[i] += h*fy[i]*im[i];
+				vz[i] += h*fz[i]*im[i];
+				x[i] += h*vx[i];
+				y[i] += h*vy[i];
+				z[i] += h*vz[i];
+				if(last)
+					fx[i] = fy[i] = fz[i] = 0.0f;
+			}
+		});
+
+		std::fill(state->lambda.begin(), state->lambda.end(), 0.0f);
+		for (unsigned int it = 0; it < nIterations; it++) {
+			for (unsigned int c = 0; c < nColours; c++) {
+				ThreadPool::global().parallelFor(colouring->offsets[c], colouring->offsets[c + 1], [=](unsigned int begin, unsigned int end) {
+					for (unsigned int j = begin; j < end; j++)
+						project(colourSprings[j]);
+				}, grain/4);
+			}
+		}
+
+		forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++) {
+				if(fixed[i])
+					continue;
+
+				vx[i] = (x[i] - px[i])*ih;
+				vy[i] = (y[i] - py[i])*ih;
+				vz[i] = (z[i] - pz[i])*ih;
+			}
+		});
+	}
+
+	//same lines and intensity as springs, the constraint force of the last substep being lambda/h^2
+	const float *Fmax = pt->Fmax;
+	const unsigned char *kill = pt->killSpring;
+	float *lines = pt->lines, *intensity = pt->intensity;
+
+	forRanges(nSprings, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int s = begin; s < end; s++) {
+			if(kill[s])
+				continue;
+
+			unsigned int _id1 = id1[s], _id2 = id2[s];
+			float dx = x[_id2] - x[_id1], dy = y[_id2] - y[_id1], dz = z[_id2] - z[_id1];
+			float N = sqrtf(dx*dx + dy*dy + dz*dz);
+			if(N < 1.0e-4f)
+				continue;
+
+			lines[6*s + 0] = x[_id1];
+			lines[6*s + 1] = y[_id1];
+			lines[6*s + 2] = z[_id1];
+			lines[6*s + 3] = x[_id2];
+			lines[6*s + 4] = y[_id2];
+			lines[6*s + 5] = z[_id2];
+
+			float ratio = std::min(std::max(lambda[s]*ih2/N/Fmax[s], -1.0f), 1.0f);
+			intensity[2*s + 0] = ratio;
+			intensity[2*s + 1] = ratio;
+		}
+	});
+}
+
+void CpuParticleKernels::terrainCollision(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		const DensityVolume *volume, float rebound, float friction) {
+
+	float *x = pt->x, *y = pt->y, *z = pt->z, *vx = pt->vx, *vy = pt->vy, *vz = pt->vz;
+	const float *r = pt->r;
+	const unsigned char *fixed = pt->fixed;
+
+	//the distance is first order only : deep particles come out over a few steps
+	const float maxCorrection = 2.0f*volume->getVoxelSize();
+
+	//7 trilinear fetches per particle, gathers would not pay off with AVX2
+	forRanges(nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			if(fixed[i] || !volume->contains(x[i], y[i], z[i]))
+				continue;
+
+			float distance, n[3];
+			if(!volume->surface(x[i], y[i], z[i], &distance, n))
+				continue;
+
+			float penetration = r[i] - distance;
+			if(penetration <= 0.0f)
+				continue;
+
+			penetration = std::min(penetration, maxCorrection);
+			x[i] += penetration*n[0];
+			y[i] += penetration*n[1];
+			z[i] += penetration*n[2];
+
+			float vn = vx[i]*n[0] + vy[i]*n[1] + vz[i]*n[2];
+			float tx = vx[i] - vn*n[0], ty = vy[i] - vn*n[1], tz = vz[i] - vn*n[2];
+			if(vn < 0.0f)
+				vn *= -rebound;
+
+			vx[i] = vn*n[0] + (1.0f - friction)*tx;
+			vy[i] = vn*n[1] + (1.0f - friction)*ty;
+			vz[i] = vn*n[2] + (1.0f - friction)*tz;
+		}
+	});
+}
+
+void CpuParticleKernels::particleCollisions(const struct mappedParticlePointers *pt, unsigned int nParticles,
+		float maxRadius, float rebound, UniformGrid *grid) {
+
+	float *px = pt->x, *py = pt->y, *pz = pt->z, *pvx = pt->vx, *pvy = pt->vy, *pvz = pt->vz;
+
+	//cells of two radii : every overlapping sphere is in the 27 cells around
+	grid->build(pt->x, pt->y, pt->z, nParticles, 2.0f*maxRadius);
+
+	std::vector<float> sortedData(5*nParticles);
+	float *r = &sortedData[0], *vx = r + nParticles, *vy = vx + nParticles, *vz = vy + nParticles, *im = vz + nParticles;
+	grid->gather(pt->r, r);
+	grid->gather(pt->vx, vx);
+	grid->gather(pt->vy, vy);
+	grid->gather(pt->vz, vz);
+	grid->gather(pt->im, im);
+
+	const float *x = grid->getSortedX(), *y = grid->getSortedY(), *z = grid->getSortedZ();
+	const unsigned int *index = grid->getSortedIndices();
+	const unsigned char *fixed = pt->fixed;
+
+	for (unsigned int id = 0; id < nParticles; id++) {
+		if(fixed[index[id]])
+			im[id] = 0.0f;
+	}
+
+	ThreadPool::global().parallelFor(0, nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int id = begin; id < end; id++) {
+			if(im[id] == 0.0f)
+				continue;
+
+			float dpx = 0.0f, dpy = 0.0f, dpz = 0.0f, dvx = 0.0f, dvy = 0.0f, dvz = 0.0f;
+
+			grid->forEachCandidateRange(x[id], y[id], z[id], [&](unsigned int cellBegin, unsigned int cellEnd) {
+				for (unsigned int j = cellBegin; j < cellEnd; j++) {
+					float dx = x[id] - x[j], dy = y[id] - y[j], dz = z[id] - z[j];
+					float d2 = dx*dx + dy*dy + dz*dz, R = r[id] + r[j];
+					if(j == id || d2 >= R*R || d2 == 0.0f)
+						continue;
+
+					//normal from j to id, share of the correction given by the inverse masses
+					float d = sqrtf(d2);
+					float nx = dx/d, ny = dy/d, nz = dz/d;
+					float w = im[id]/(im[id] + im[j]);
+
+					float overlap = (R - d)*w;
+					dpx += overlap*nx;
+					dpy += overlap*ny;
+					dpz += overlap*nz;
+
+					float vn = (vx[id] - vx[j])*nx + (vy[id] - vy[j])*ny + (vz[id] - vz[j])*nz;
+					if(vn < 0.0f) {
+						float impulse = -(1.0f + rebound)*vn*w;
+						dvx += impulse*nx;
+						dvy += impulse*ny;
+						dvz += impulse*nz;
+					}
+				}
+			});
+
+			unsigned int p = index[id];
+			px[p] += dpx;
+			py[p] += dpy;
+			pz[p] += dpz;
+			pvx[p] += dvx;
+			pvy[p] += dvy;
+			pvz[p] += dvz;
+		}
+	}, 256);
+}
+
+//single threaded : elements only move down, so the compaction can be done in place
+void CpuParticleKernels::compact(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+		unsigned int *particleIndex, unsigned int *nAliveParticles, unsigned int *nAliveSprings) {
+
+	//exclusive scan of the alive flags
+	unsigned int nAlive = 0;
+	for (unsigned int i = 0; i < nParticles; i++) {
+		particleIndex[i] = nAlive;
+		nAlive += (pt->kill[i] ? 0 : 1);
+	}
+	particleIndex[nParticles] = nAlive;
+
+	float *particleFloats[12] = {pt->x, pt->y, pt->z, pt->vx, pt->vy, pt->vz, pt->fx, pt->fy, pt->fz, pt->m, pt->im, pt->r};
+	if(nAlive < nParticles) {
+		for (unsigned int i = 0; i < nParticles; i++) {
+			unsigned int j = particleIndex[i];
+			if(particleIndex[i+1] == j || i == j)
+				continue;
+
+			for (unsigned int a = 0; a < 12; a++)
+				particleFloats[a][j] = particleFloats[a][i];
+			pt->fixed[j] = pt->fixed[i];
+		}
+		std::fill(pt->kill, pt->kill + nAlive, 0);
+	}
+
+	unsigned int nSpringsAlive = 0;
+	float *springFloats[4] = {pt->k, pt->Lo, pt->d, pt->Fmax};
+	for (unsigned int s = 0; s < nSprings; s++) {
+		unsigned int p1 = pt->id1[s], p2 = pt->id2[s];
+		if(pt->killSpring[s]
+				|| particleIndex[p1+1] == particleIndex[p1]
+				|| particleIndex[p2+1] == particleIndex[p2])
+			continue;
+
+		unsigned int t = nSpringsAlive++;
+		pt->id1[t] = particleIndex[p1];
+		pt->id2[t] = particleIndex[p2];
+		if(t == s)
+			continue;
+
+		for (unsigned int a = 0; a < 4; a++)
+			springFloats[a][t] = springFloats[a][s];
+		std::copy(pt->lines + 6*s, pt->lines + 6*s + 6, pt->lines + 6*t);
+		std::copy(pt->intensity + 2*s, pt->intensity + 2*s + 2, pt->intensity + 2*t);
+	}
+	std::fill(pt->killSpring, pt->killSpring + nSpringsAlive, 0);
+
+	*nAliveParticles = nAlive;
+	*nAliveSprings = nSpringsAlive;
+}
+
+void CpuParticleKernels::remapAppendedSprings(const struct mappedParticlePointers *pt, const unsigned int *particleIndex,
+		unsigned int firstSpring, unsigned int nAppendedSprings,
+		unsigned int nOldParticles, unsigned int nCompactedParticles, unsigned int nAppendedParticles) {
+
+	for (unsigned int s = firstSpring; s < firstSpring + nAppendedSprings; s++) {
+		unsigned int *ends[2] = {pt->id1 + s, pt->id2 + s};
+		bool alive = true;
+
+		for (unsigned int i = 0; i < 2; i++) {
+			unsigned int p = *ends[i];
+			if(p < nOldParticles) {
+				alive = alive && (particleIndex[p+1] > particleIndex[p]);
+				p = particleIndex[p];
+			}
+			else {
+				p -= nOldParticles;
+				alive = alive && (p < nAppendedParticles);
+				p += nCompactedParticles;
+			}
+			*ends[i] = (alive ? p : 0);
+		}
+
+		pt->killSpring[s] = (alive ? 0 : 1);
+	}
+}
+
+void CpuParticleKernels::buildSpringIncidence(const unsigned int *id1, const unsigned int *id2,
+		unsigned int nParticles, unsigned int nSprings, CpuSpringIncidence *incidence) {
+
+	//counting sort of the spring ends by particle
+	incidence->offsets.assign(nParticles + 1, 0);
+	for (unsigned int s = 0; s < nSprings; s++) {
+		incidence->offsets[id1[s] + 1]++;
+		incidence->offsets[id2[s] + 1]++;
+	}
+	for (unsigned int p = 0; p < nParticles; p++) {
+		incidence->offsets[p + 1] += incidence->offsets[p];
+	}
+
+	std::vector<unsigned int> cursor(incidence->offsets.begin(), incidence->offsets.end() - 1);
+	incidence->springs.resize(2*nSprings + 1); //never empty
+	for (unsigned int s = 0; s < nSprings; s++) {
+		incidence->springs[cursor[id1[s]]++] = 2*s;
+		incidence->springs[cursor[id2[s]]++] = 2*s + 1;
+	}
+
+	incidence->fx.resize(nSprings + 1);
+	incidence->fy.resize(nSprings + 1);
+	incidence->fz.resize(nSprings + 1);
+}
+
+void CpuParticleKernels::buildSpringColouring(const unsigned int *id1, const unsigned int *id2, const unsigned char *killSpring,
+		unsigned int nParticles, unsigned int nSprings, SpringColouring *colouring) {
+
+	//greedy : each spring takes the first colour free at both of its ends
+	//(at most 2*degree - 1 colours, 2 for the seaweed strands)
+	std::vector<unsigned long long> used(nParticles, 0ull);
+	std::vector<unsigned char> colour(nSprings);
+	unsigned int nColours = 0;
+
+	for (unsigned int s = 0; s < nSprings; s++) {
+		if(killSpring[s])
+			continue;
+
+		unsigned long long taken = used[id1[s]] | used[id2[s]];
+		if(taken == ~0ull) {
+			log_console.errorStream() << "[XPBD] Particles " << id1[s] << " and " << id2[s]
+				<< " have too many springs to colour the constraints (64 colours at most) !";
+			exit(1);
+		}
+
+		unsigned int c = 0;
+		while(taken & (1ull << c))
+			c++;
+
+		colour[s] = c;
+		used[id1[s]] |= (1ull << c);
+		used[id2[s]] |= (1ull << c);
+		nColours = std::max(nColours, c + 1);
+	}
+
+	//counting sort of the springs by colour
+	colouring->offsets.assign(nColours + 1, 0);
+	for (unsigned int s = 0; s < nSprings; s++) {
+		if(!killSpring[s])
+			colouring->offsets[colour[s] + 1]++;
+	}
+	for (unsigned int c = 0; c < nColours; c++) {
+		colouring->offsets[c + 1] += colouring->offsets[c];
+	}
+
+	std::vector<unsigned int> cursor(colouring->offsets.begin(), colouring->offsets.end() - 1);
+	colouring->springs.resize(colouring->offsets[nColours] + 1); //never empty
+	for (unsigned int s = 0; s < nSprings; s++) {
+		if(!killSpring[s])
+			colouring->springs[cursor[colour[s]]++] = s;
+	}
+}
+
+void CpuParticleKernels::benchmark(unsigned int nStrands, unsigned int strandLength, unsigned int nRuns) {
+	unsigned int nParticles = nStrands*strandLength;
+	unsigned int nSprings = nStrands*(strandLength - 1);
+
+	std::vector<float> x(nParticles), y(nParticles), z(nParticles), vx(nParticles), vy(nParticles), vz(nParticles),
+		fx(nParticles, 0.0f), fy(nParticles, 0.0f), fz(nParticles, 0.0f), m(nParticles, 0.005f), im(nParticles, 200.0f), r(nParticles, 0.001f);
+	std::vector<unsigned char> kill(nParticles, 0), fixed(nParticles, 0), killSpring(nSprings, 0);
+	std::vector<float> k(nSprings), Lo(nSprings, 0.1f), d(nSprings, 0.03f), Fmax(nSprings, 0.1f),
+		lines(6*nSprings), intensity(2*nSprings);
+	std::vector<unsigned int> id1(nSprings), id2(nSprings);
+
+	//SeeweedGroup layout : vertical strands, fixed base, one spring between consecutive particles
+	for (unsigned int s = 0; s < nStrands; s++) {
+		for (unsigned int j = 0; j < strandLength; j++) {
+			unsigned int p = s*strandLength + j;
+			x[p] = 0.5f*(s % 200) + 0.3f*sinf(p);
+			y[p] = (float) j;
+			z[p] = 0.5f*(s / 200) + 0.3f*cosf(p);
+			vx[p] = 0.5f*sinf(3.0f*p);
+			vy[p] = 0.0f;
+			vz[p] = 0.5f*cosf(5.0f*p);
+			fixed[p] = (j == 0);
+
+			if(j >= 1) {
+				unsigned int spring = s*(strandLength - 1) + j - 1;
+				id1[spring] = p - 1;
+				id2[spring] = p;
+				k[spring] = 2.5f + 0.5f*sinf(spring);
+			}
+		}
+	}
+
+	struct mappedParticlePointers pt = {
+		&x[0], &y[0], &z[0], &vx[0], &vy[0], &vz[0], &fx[0], &fy[0], &fz[0], &m[0], &im[0], &r[0],
+		&kill[0], &fixed[0],
+		&k[0], &Lo[0], &d[0], &Fmax[0], &lines[0], &intensity[0],
+		&id1[0], &id2[0],
+		&killSpring[0]
+	};
+
+	CpuSpringIncidence incidence;
+	buildSpringIncidence(&id1[0], &id2[0], nParticles, nSprings, &incidence);
+
+	//best of nRuns, in ms
+	auto time = [nRuns](const std::function<void()> &kernel) -> double {
+		double bestTime = 1.0e30;
+		for (unsigned int run = 0; run < nRuns; run++) {
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			kernel();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			bestTime = std::min(bestTime, elapsed.count());
+		}
+		return bestTime;
+	};
+
+	struct Timing {
+		const char *name;
+		double ms;
+		unsigned int count;
+	};
+
+	//one substep of the simulation clock
+	const float dt = SimulationClock::global().getDt();
+	unsigned int nAttracted = std::min(nParticles, 4096u);
+	const Timing timings[] = {
+		{"ConstantForce", time([&]() { constantForce(&pt, nParticles, 0.0f, 0.3f, 0.0f); }), nParticles},
+		{"ConstantMassForce", time([&]() { constantMassForce(&pt, nParticles, 0.0f, -9.81f, 0.0f); }), nParticles},
+		{"PousseeArchimede", time([&]() { pousseeArchimede(&pt, nParticles, 0.0f, -1.0f, 0.0f, 1000.0f, 9.81f); }), nParticles},
+		{"FrottementFluide", time([&]() { frottementFluide(&pt, nParticles, 0.01f, 0.001f); }), nParticles},
+		{"FrottementFluideAvance", time([&]() { frottementFluideAvance(&pt, nParticles, 1000.0f, 0.5f, 0.5f, 0.5f); }), nParticles},
+		{"KillParticles", time([&]() { killParticles(&pt, nParticles, 0.0f, 1.0f, 0.0f, 1.0e6f); }), nParticles},
+		{"SpringsSystem", time([&]() { springs(&pt, nParticles, nSprings, true, &incidence); }), nParticles},
+		{"DynamicScheme", time([&]() { dynamicScheme(&pt, nParticles, dt); }), nParticles},
+		{"Attractor", time([&]() { attractorAllPairs(&pt, nAttracted, 0.01f, 10.0f, 1.0e-3f); }), nAttracted}
+	};
+
+	log_console.infoStream() << "[Particle Kernels Benchmark] " << nStrands << " strands of " << strandLength << " particles ("
+		<< nParticles << " particles, " << nSprings << " springs), " << ThreadPool::global().getThreadCount() << " threads, "
+#ifdef __AVX2__
+		<< "AVX2.";
+#else
+		<< "no SIMD.";
+#endif
+
+	for (unsigned int t = 0; t < sizeof(timings)/sizeof(Timing); t++) {
+		log_console.infoStream() << "[Particle Kernels Benchmark] " << timings[t].name << " : " << timings[t].ms << " ms ("
+			<< timings[t].count/(timings[t].ms*1.0e-3)/1.0e6 << " Mparticles/s)"
+			<< (t == sizeof(timings)/sizeof(Timing) - 1 ? ", all pairs on a subset" : "") << ".";
+	}
+
+	//SeeweedGroup kernels : ConstantForce, SeaFlow, SpringsSystem, DynamicScheme
+	ConstantForce weight(qglviewer::Vec(0.0f, 0.03f*9.81f, 0.0f)), flow(qglviewer::Vec(0.12f, 0.0f, 0.0f));
+	SpringsSystem springsSystem(true);
+	DynamicScheme scheme;
+
+	auto step = [&]() {
+		constantForce(&pt, nParticles, 0.0f, 0.03f*9.81f, 0.0f);
+		constantForce(&pt, nParticles, 0.12f, 0.0f, 0.0f);
+		springs(&pt, nParticles, nSprings, true, &incidence);
+		dynamicScheme(&pt, nParticles, dt);
+	};
+	unsigned long stepBytes = weight.getMemoryTraffic(nParticles, nSprings) + flow.getMemoryTraffic(nParticles, nSprings)
+		+ springsSystem.getMemoryTraffic(nParticles, nSprings) + scheme.getMemoryTraffic(nParticles, nSprings);
+
+	//same step as ParticleGroup runs it with the kernel fusion : springs, then one pass
+	struct particleForceTerms terms = {};
+	weight.fuse(&terms);
+	flow.fuse(&terms);
+	scheme.fuse(&terms);
+
+	auto fused = [&]() {
+		springs(&pt, nParticles, nSprings, true, &incidence);
+		fusedStep(&pt, nParticles, &terms);
+	};
+	unsigned long fusedBytes = springsSystem.getMemoryTraffic(nParticles, nSprings) + fusedStepTraffic(&terms, nParticles);
+
+	//both from the same state, largest position gap after one step
+	std::vector<float> *state[9] = {&x, &y, &z, &vx, &vy, &vz, &fx, &fy, &fz};
+	std::vector<float> saved[9], stepped[3];
+	for (unsigned int a = 0; a < 9; a++)
+		saved[a] = *state[a];
+	step();
+	for (unsigned int a = 0; a < 3; a++)
+		stepped[a] = *state[a];
+	for (unsigned int a = 0; a < 9; a++)
+		*state[a] = saved[a];
+	fused();
+	float maxGap = 0.0f;
+	for (unsigned int a = 0; a < 3; a++) {
+		for (unsigned int p = 0; p < nParticles; p++)
+			maxGap = std::max(maxGap, std::abs((*state[a])[p] - stepped[a][p]));
+	}
+
+	double stepTime = time(step);
+	double fusedTime = time(fused);
+
+	log_console.infoStream() << "[Particle Kernels Benchmark] SeeweedGroup step : " << stepTime << " ms ("
+		<< nParticles/(stepTime*1.0e-3)/1.0e6 << " Mparticles/s, " << 1000.0/stepTime << " steps/s, 60 Hz "
+		<< (stepTime <= 1000.0/60.0 ? "OK" : "NOT reached") << "), " << stepBytes/1.0e6 << " MB/step.";
+	log_console.infoStream() << "[Particle Kernels Benchmark] SeeweedGroup fused step : " << fusedTime << " ms ("
+		<< nParticles/(fusedTime*1.0e-3)/1.0e6 << " Mparticles/s), " << fusedBytes/1.0e6 << " MB/step ("
+		<< 100.0*fusedBytes/stepBytes << "% of the separate kernels), largest position gap " << maxGap << ".";
+}
+
+void CpuParticleKernels::gridBenchmark(unsigned int nRuns) {
+	const float dMax = 1.0f, dMin = 0.01f, C = 1.0e-3f;
+	const unsigned int sizes[4] = {10000, 100000, 300000, 1000000};
+	bool withCuda = (ParticleGroup::getDefaultBackend() == ParticleGroup::CUDA_BACKEND);
+
+	auto time = [nRuns](const std::function<void()> &kernel) -> double {
+		double bestTime = 1.0e30;
+		for (unsigned int run = 0; run < nRuns; run++) {
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			kernel();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			bestTime = std::min(bestTime, elapsed.count());
+		}
+		return bestTime;
+	};
+
+	log_console.infoStream() << "[Grid Benchmark] Attractor with dMax = " << dMax << ", uniform particles (8 per cell on average), "
+		<< ThreadPool::global().getThreadCount() << " threads.";
+
+	for (unsigned int s = 0; s < 4; s++) {
+		unsigned int n = sizes[s];
+		float side = dMax*cbrtf(n/8.0f);
+
+		std::vector<float> x(n), y(n), z(n), m(n), fx(n, 0.0f), fy(n, 0.0f), fz(n, 0.0f);
+		srand(n);
+		for (unsigned int i = 0; i < n; i++) {
+			x[i] = side*rand()/(float)RAND_MAX;
+			y[i] = side*rand()/(float)RAND_MAX;
+			z[i] = side*rand()/(float)RAND_MAX;
+			m[i] = 0.5f + rand()/(float)RAND_MAX;
+		}
+
+		struct mappedParticlePointers pt = {};
+		pt.x = &x[0]; pt.y = &y[0]; pt.z = &z[0]; pt.m = &m[0];
+		pt.fx = &fx[0]; pt.fy = &fy[0]; pt.fz = &fz[0];
+
+		UniformGrid grid;
+		double buildTime = time([&]() { grid.build(&x[0], &y[0], &z[0], n, dMax); });
+		double gridTime = time([&]() { attractor(&pt, n, dMin, dMax, C, &grid); });
+
+		std::ostringstream line;
+		line << "[Grid Benchmark] " << n << " particles : grid build " << buildTime << " ms, attractor " << gridTime << " ms ("
+			<< n/(gridTime*1.0e-3)/1.0e6 << " Mparticles/s, " << grid.getTableSize() << " hashed cells)";
+
+		//all pairs only while it stays affordable, forces compared on a clean run
+		if(n <= 100000) {
+			std::vector<float> gx(n, 0.0f), gy(n, 0.0f), gz(n, 0.0f);
+			pt.fx = &gx[0]; pt.fy = &gy[0]; pt.fz = &gz[0];
+			attractor(&pt, n, dMin, dMax, C, &grid);
+
+			std::fill(fx.begin(), fx.end(), 0.0f);
+			std::fill(fy.begin(), fy.end(), 0.0f);
+			std::fill(fz.begin(), fz.end(), 0.0f);
+			pt.fx = &fx[0]; pt.fy = &fy[0]; pt.fz = &fz[0];
+			double allPairsTime = time([&]() {
+				std::fill(fx.begin(), fx.end(), 0.0f);
+				std::fill(fy.begin(), fy.end(), 0.0f);
+				std::fill(fz.begin(), fz.end(), 0.0f);
+				attractorAllPairs(&pt, n, dMin, dMax, C);
+			});
+
+			double maxError = 0.0, maxForce = 0.0;
+			for (unsigned int i = 0; i < n; i++) {
+				maxError = std::max(maxError, (double) std::max(fabsf(gx[i] - fx[i]), std::max(fabsf(gy[i] - fy[i]), fabsf(gz[i] - fz[i]))));
+				maxForce = std::max(maxForce, (double) std::max(fabsf(fx[i]), std::max(fabsf(fy[i]), fabsf(fz[i]))));
+			}
+
+			line << ", all pairs " << allPairsTime << " ms (x" << allPairsTime/gridTime << "), max force difference "
+				<< maxError/maxForce << " relative";
+		}
+
+		if(withCuda) {
+			float cudaTime = benchmarkAttractorGridKernel(&x[0], &y[0], &z[0], &m[0], n, dMin, dMax, C, nRuns);
+			line << ", CUDA grid " << cudaTime << " ms";
+		}
+
+		log_console.infoStream() << line.str() << ".";
+	}
+}
+
+void CpuParticleKernels::collisionBenchmark(unsigned int nRuns) {
+	//main scene terrain : 128^3 samples, 100/128 voxels, translated by (-50,-65,-50)
+	const unsigned int size = 128;
+	const float voxelSize = 100.0f/size, origin[3] = {-50.0f, -65.0f, -50.0f};
+	const float maxRadius = 0.15f;
+	const unsigned int sizes[3] = {10000, 100000, 1000000};
+
+	DensityVolume volume(size, size, size, voxelSize, origin);
+	DensityField::fill(size, size, size, volume.getSamples());
+
+	auto time = [nRuns](const std::function<void()> &kernel) -> double {
+		double bestTime = 1.0e30;
+		for (unsigned int run = 0; run < nRuns; run++) {
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			kernel();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			bestTime = std::min(bestTime, elapsed.count());
+		}
+		return bestTime;
+	};
+
+	log_console.infoStream() << "[Collision Benchmark] " << size << "^3 terrain, bubbles radius up to " << maxRadius << ", "
+		<< ThreadPool::global().getThreadCount() << " threads.";
+
+	for (unsigned int s = 0; s < 3; s++) {
+		unsigned int n = sizes[s];
+		std::vector<float> x(n), y(n), z(n), vx(n), vy(n), vz(n), r(n), m(n), im(n);
+		std::vector<unsigned char> fixed(n, 0);
+
+		//uniform in the terrain box, half of them end up in the matter
+		srand(n);
+		float extent = (size - 1)*voxelSize;
+		unsigned int inMatter = 0;
+		for (unsigned int i = 0; i < n; i++) {
+			x[i] = origin[0] + extent*rand()/(float)RAND_MAX;
+			y[i] = origin[1] + extent*rand()/(float)RAND_MAX;
+			z[i] = origin[2] + extent*rand()/(float)RAND_MAX;
+			vx[i] = 0.1f*(rand()/(float)RAND_MAX - 0.5f);
+			vy[i] = 0.1f*(rand()/(float)RAND_MAX - 0.5f);
+			vz[i] = 0.1f*(rand()/(float)RAND_MAX - 0.5f);
+			r[i] = 0.04f + (maxRadius - 0.04f)*rand()/(float)RAND_MAX;
+			m[i] = 4.0f/3.0f*3.1415f*r[i]*r[i]*r[i];
+			im[i] = 1.0f/m[i];
+			inMatter += (volume.contains(x[i], y[i], z[i]) && volume.density(x[i], y[i], z[i]) > 0.0f);
+		}
+
+		struct mappedParticlePointers pt = {};
+		pt.x = &x[0]; pt.y = &y[0]; pt.z = &z[0]; pt.vx = &vx[0]; pt.vy = &vy[0]; pt.vz = &vz[0];
+		pt.r = &r[0]; pt.m = &m[0]; pt.im = &im[0]; pt.fixed = &fixed[0];
+
+		UniformGrid grid;
+		double terrainTime = time([&]() { terrainCollision(&pt, n, &volume, 0.3f, 0.1f); });
+		double spheresTime = time([&]() { particleCollisions(&pt, n, maxRadius, 0.3f, &grid); });
+
+		log_console.infoStream() << "[Collision Benchmark] " << n << " particles (" << inMatter << " in the matter at first) : terrain "
+			<< terrainTime << " ms (" << terrainTime*1.0e6/n << " ns/particle), spheres " << spheresTime << " ms ("
+			<< spheresTime*1.0e6/n << " ns/particle), step " << terrainTime + spheresTime << " ms.";
+	}
+}
+
+void CpuParticleKernels::xpbdBenchmark(unsigned int nRuns) {
+	const unsigned int strandLength = 16, nTimedStrands = 10000, nDriftStrands = 500;
+	const float simulatedTime = 10.0f;
+
+	//SeeweedGroup strands (fixed base, one spring between consecutive particles), stretched by
+	//half of their rest length and shaken. The drift runs are undamped and without the seaweed
+	//buoyancy, so that the energy should stay constant
+	struct Strands {
+		std::vector<float> x, y, z, vx, vy, vz, fx, fy, fz, m, im, r;
+		std::vector<unsigned char> kill, fixed, killSpring;
+		std::vector<float> k, Lo, d, Fmax, lines, intensity;
+		std::vector<unsigned int> id1, id2;
+		unsigned int nParticles, nSprings;
+		struct mappedParticlePointers pt;
+		CpuSpringIncidence incidence;
+		SpringColouring colouring;
+		XpbdState state;
+
+		void reset(unsigned int nStrands, unsigned int strandLength, float kScale) {
+			nParticles = nStrands*strandLength;
+			nSprings = nStrands*(strandLength - 1);
+
+			std::vector<float> *particleArrays[12] = {&x, &y, &z, &vx, &vy, &vz, &fx, &fy, &fz, &m, &im, &r};
+			for (unsigned int a = 0; a < 12; a++)
+				particleArrays[a]->assign(nParticles, 0.0f);
+			std::vector<float> *springArrays[4] = {&k, &Lo, &d, &Fmax};
+			for (unsigned int a = 0; a < 4; a++)
+				springArrays[a]->assign(nSprings, 0.0f);
+			kill.assign(nParticles, 0);
+			fixed.assign(nParticles, 0);
+			killSpring.assign(nSprings, 0);
+			lines.assign(6*nSprings, 0.0f);
+			intensity.assign(2*nSprings, 0.0f);
+			id1.assign(nSprings, 0);
+			id2.assign(nSprings, 0);
+
+			for (unsigned int s = 0; s < nStrands; s++) {
+				for (unsigned int j = 0; j < strandLength; j++) {
+					unsigned int p = s*strandLength + j;
+					x[p] = 0.5f*(s % 100);
+					y[p] = 0.15f*j;
+					z[p] = 0.5f*(s / 100);
+					vx[p] = (j == 0 ? 0.0f : 0.2f*sinf(3.0f*p));
+					vz[p] = (j == 0 ? 0.0f : 0.2f*cosf(5.0f*p));
+					m[p] = 0.005f;
+					im[p] = 200.0f;
+					r[p] = 0.001f;
+					fixed[p] = (j == 0);
+
+					if(j >= 1) {
+						unsigned int spring = s*(strandLength - 1) + j - 1;
+						id1[spring] = p - 1;
+						id2[spring] = p;
+						k[spring] = kScale*(2.5f + 0.5f*sinf(spring));
+						Lo[spring] = 0.1f;
+						Fmax[spring] = 0.1f*kScale;
+					}
+				}
+			}
+
+			struct mappedParticlePointers _pt = {
+				&x[0], &y[0], &z[0], &vx[0], &vy[0], &vz[0], &fx[0], &fy[0], &fz[0], &m[0], &im[0], &r[0],
+				&kill[0], &fixed[0],
+				&k[0], &Lo[0], &d[0], &Fmax[0], &lines[0], &intensity[0],
+				&id1[0], &id2[0],
+				&killSpring[0]
+			};
+			pt = _pt;
+
+			buildSpringIncidence(&id1[0], &id2[0], nParticles, nSprings, &incidence);
+			buildSpringColouring(&id1[0], &id2[0], &killSpring[0], nParticles, nSprings, &colouring);
+		}
+
+		//kinetic + elastic
+		double energy() const {
+			double E = 0.0;
+			for (unsigned int p = 0; p < nParticles; p++)
+				E += 0.5*m[p]*(vx[p]*vx[p] + vy[p]*vy[p] + vz[p]*vz[p]);
+			for (unsigned int s = 0; s < nSprings; s++) {
+				float dx = x[id2[s]] - x[id1[s]], dy = y[id2[s]] - y[id1[s]], dz = z[id2[s]] - z[id1[s]];
+				float stretch = sqrtf(dx*dx + dy*dy + dz*dz) - Lo[s];
+				E += 0.5*k[s]*stretch*stretch;
+			}
+
+			return E;
+		}
+	};
+
+	auto time = [nRuns](const std::function<void()> &kernel) -> double {
+		double bestTime = 1.0e30;
+		for (unsigned int run = 0; run < nRuns; run++) {
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			kernel();
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			bestTime = std::min(bestTime, elapsed.count());
+		}
+		return bestTime;
+	};
+
+	struct Solver {
+		const char *name;
+		unsigned int nSubsteps, nIterations; //0 : springs + dynamicScheme
+	};
+	const Solver solvers[4] = {
+		{"springs + DynamicScheme", 0, 0}, {"XPBD, 1 iteration", 1, 1},
+		{"XPBD, 4 iterations", 1, 4}, {"XPBD, 4 substeps of 1 iteration", 4, 1}
+	};
+
+	struct Case {
+		const char *name;
+		float kScale, stepRate;
+	};
+	const Case cases[4] = {
+		{"scene springs (k = 2-3)", 1.0f, 120.0f}, {"scene springs (k = 2-3)", 1.0f, 30.0f},
+		{"stiff springs (k = 200-300)", 100.0f, 120.0f}, {"stiff springs (k = 200-300)", 100.0f, 30.0f}
+	};
+
+	log_console.infoStream() << "[XPBD Benchmark] " << nTimedStrands << " strands of " << strandLength << " particles timed, "
+		<< nDriftStrands << " strands simulated " << simulatedTime << " s for the energy drift, "
+		<< ThreadPool::global().getThreadCount() << " threads.";
+
+	Strands strands;
+	for (unsigned int c = 0; c < 4; c++) {
+		const float dt = 1.0f/cases[c].stepRate;
+
+		for (unsigned int v = 0; v < 4; v++) {
+			unsigned int nSubsteps = solvers[v].nSubsteps, nIterations = solvers[v].nIterations;
+			float buoyancy = 0.03f*9.81f;
+			auto step = [&]() {
+				constantForce(&strands.pt, strands.nParticles, 0.0f, buoyancy, 0.0f);
+				if(nSubsteps == 0) {
+					springs(&strands.pt, strands.nParticles, strands.nSprings, false, &strands.incidence);
+					dynamicScheme(&strands.pt, strands.nParticles, dt);
+				}
+				else {
+					xpbd(&strands.pt, strands.nParticles, strands.nSprings, &strands.colouring, dt, nSubsteps, nIterations, false,
+							&strands.state);
+				}
+			};
+
+			strands.reset(nTimedStrands, strandLength, cases[c].kScale);
+			double stepTime = time(step);
+
+			//energy change after the simulated time (XPBD damps like an implicit scheme, less with substeps)
+			strands.reset(nDriftStrands, strandLength, cases[c].kScale);
+			buoyancy = 0.0f;
+			double E0 = strands.energy(), E = E0;
+			bool diverged = false;
+			unsigned int nSteps = (unsigned int) (simulatedTime/dt);
+			for (unsigned int s = 0; s < nSteps && !diverged; s++) {
+				step();
+				E = strands.energy();
+				diverged = !std::isfinite(E) || E > 1.0e3*E0;
+			}
+
+			std::stringstream driftText;
+			if(diverged)
+				driftText << "diverged";
+			else
+				driftText << "energy drift " << 100.0*(E - E0)/E0 << "%";
+
+			log_console.infoStream() << "[XPBD Benchmark] " << cases[c].name << ", " << cases[c].stepRate << " Hz, " << solvers[v].name
+				<< " : " << stepTime << " ms/step (" << nTimedStrands/stepTime << " strands/ms), " << driftText.str() << ".";
+		}
+	}
+}
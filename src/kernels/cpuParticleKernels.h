@@ -0,0 +1,141 @@
+
+#ifndef CPUPARTICLEKERNELS_H
+#define CPUPARTICLEKERNELS_H
+
+#include <vector>
+
+struct mappedParticlePointers;
+class UniformGrid;
+class DensityVolume;
+
+// Particle -> springs incidence lists (CSR), rebuilt when the springs are uploaded.
+// The spring forces are computed per spring, then gathered per particle, so that
+// no two threads ever write the forces of the same particle.
+struct CpuSpringIncidence {
+	std::vector<unsigned int> offsets;  //nParticles + 1
+	std::vector<unsigned int> springs;  //2*spring, +1 when the particle is the second end
+	std::vector<float> fx, fy, fz;      //force applied on the second end of each spring
+};
+
+// Springs grouped by colour, rebuilt when the springs change (greedy edge colouring).
+// No two springs of a colour share a particle, so the XPBD solver projects a whole
+// colour batch in parallel without atomics.
+struct SpringColouring {
+	std::vector<unsigned int> offsets;  //nColours + 1
+	std::vector<unsigned int> springs;  //spring ids, colour after colour (killed springs left out)
+};
+
+// XPBD scratch arrays : positions at the beginning of the step and Lagrange multipliers
+struct XpbdState {
+	std::vector<float> px, py, pz;
+	std::vector<float> lambda;
+};
+
+// Per particle force terms of a fused pass (ParticleGroup kernel fusion), summed over the
+// fused kernels. Componentwise : f += F + m*Fm + r^3*Fv - (k1*v + k2*v*v) - |v|^4*r^2*c*v
+// then, with integrate, the DynamicScheme step and the forces reset.
+struct particleForceTerms {
+	float F[3];     //ConstantForce, SeaFlow
+	float Fm[3];    //ConstantMassForce
+	float Fv[3];    //PousseeArchimede
+	float k1, k2;   //FrottementFluide
+	float c[3];     //FrottementFluideAvance
+	bool integrate; //DynamicScheme
+	float dt;
+};
+
+//terms that are actually evaluated (and the arrays they read), see forceTermsMask
+enum ForceTermBits {
+	MASS_TERM = 1,
+	VOLUME_TERM = 2,
+	DRAG_TERM = 4,
+	ADVANCED_DRAG_TERM = 8,
+	INTEGRATION_TERM = 16
+};
+
+// CPU versions of the kernels of particles.cu (same arguments, same math)
+// They work on host SoA arrays described by mappedParticlePointers, the particle
+// and spring ranges are split over the global ThreadPool and each range is
+// processed 8 elements at a time with AVX2 (scalar otherwise).
+class CpuParticleKernels {
+
+	public:
+		static void constantForce(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float Fx, float Fy, float Fz);
+		static void constantMassForce(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float mFx, float mFy, float mFz);
+		static void pousseeArchimede(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float nx, float ny, float nz, float rho, float g);
+		static void frottementFluide(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float k1, float k2);
+		static void frottementFluideAvance(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float rho, float cx, float cy, float cz);
+		//neighbours within dMax found with the grid (rebuilt on each call)
+		static void attractor(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float dMin, float dMax, float C, UniformGrid *grid);
+		//O(n^2) reference
+		static void attractorAllPairs(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float dMin, float dMax, float C);
+		static void killParticles(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float vx, float vy, float vz, float maxVal);
+		static void dynamicScheme(const struct mappedParticlePointers *pt, unsigned int nParticles, float dt);
+		static void springs(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+				bool handleDumping, CpuSpringIncidence *incidence);
+
+		//particles that overlap the terrain matter are projected out along the normal,
+		//their velocity into the surface is reflected (rebound) and the tangential one damped (friction)
+		static void terrainCollision(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				const DensityVolume *volume, float rebound, float friction);
+		//overlapping spheres (radius <= maxRadius) are pushed apart and their approaching velocities
+		//reflected, mass weighted. Jacobi : each particle only moves itself, from the state before the call
+		static void particleCollisions(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				float maxRadius, float rebound, UniformGrid *grid);
+
+		//XPBD step : the springs are distance constraints of compliance 1/k (damping d). Each of
+		//the nSubsteps predicts the positions, projects the constraints nIterations times colour by
+		//colour and derives the velocities from the positions. Integrates the particles and resets
+		//their forces (replaces springs + dynamicScheme)
+		static void xpbd(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+				const SpringColouring *colouring, float dt, unsigned int nSubsteps, unsigned int nIterations,
+				bool handleDumping, XpbdState *state);
+
+		//force terms then integration in one pass over the particles, one instantiation per
+		//set of used terms (fixed particles keep their position, velocity and forces, as in dynamicScheme)
+		static void fusedStep(const struct mappedParticlePointers *pt, unsigned int nParticles,
+				const struct particleForceTerms *terms);
+		static unsigned int forceTermsMask(const struct particleForceTerms *terms);
+		//global memory traffic of a fused pass, in bytes (each array read and written at most once)
+		static unsigned long fusedStepTraffic(const struct particleForceTerms *terms, unsigned int nParticles);
+
+		//stream compaction of the killed particles and of the springs that lost an end,
+		//in place (same contract as compactParticlesKernel, particleIndex has nParticles+1 entries)
+		static void compact(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+				unsigned int *particleIndex, unsigned int *nAliveParticles, unsigned int *nAliveSprings);
+		static void remapAppendedSprings(const struct mappedParticlePointers *pt, const unsigned int *particleIndex,
+				unsigned int firstSpring, unsigned int nAppendedSprings,
+				unsigned int nOldParticles, unsigned int nCompactedParticles, unsigned int nAppendedParticles);
+
+		static void buildSpringIncidence(const unsigned int *id1, const unsigned int *id2,
+				unsigned int nParticles, unsigned int nSprings, CpuSpringIncidence *incidence);
+		static void buildSpringColouring(const unsigned int *id1, const unsigned int *id2, const unsigned char *killSpring,
+				unsigned int nParticles, unsigned int nSprings, SpringColouring *colouring);
+
+		//runs each kernel nRuns times on nStrands seaweeds of strandLength particles
+		//(SeeweedGroup layout) and logs particles/s, then times a whole SeeweedGroup step,
+		//kernel by kernel and fused, with its bytes/step and the gap between both results
+		static void benchmark(unsigned int nStrands, unsigned int strandLength, unsigned int nRuns);
+
+		//attractor with the grid from 10k to 1M particles (about 8 per cell), against the
+		//O(n^2) loop while it stays affordable, and against the CUDA grid when a device is found
+		static void gridBenchmark(unsigned int nRuns);
+
+		//seaweed strands stepped with springs + dynamicScheme and with xpbd, scene and stiff springs
+		//at 120 and 30 Hz : strands/ms and energy drift over 10 simulated seconds (undamped)
+		static void xpbdBenchmark(unsigned int nRuns);
+
+		//terrain and sphere collisions from 10k to 1M particles spread in the main scene terrain
+		//(128^3 DensityField), in ms and ns/particle
+		static void collisionBenchmark(unsigned int nRuns);
+};
+
+#endif /* end of include guard: CPUPARTICLEKERNELS_H */
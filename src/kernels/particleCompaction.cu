@@ -0,0 +1,212 @@
+#include "cuda.h"
+#include "cuda_runtime.h"
+#include "stdio.h"
+
+#include <thrust/device_ptr.h>
+#include <thrust/scan.h>
+
+extern void checkKernelExecution();
+
+struct mappedParticlePointers {
+	//particules
+	float *x, *y, *z, *vx, *vy, *vz, *fx, *fy, *fz, *m, *im, *r;
+	unsigned char *kill, *fixed;
+	//ressorts
+	float *k, *Lo, *d, *Fmax, *lines, *intensity;
+	unsigned int *id1, *id2;
+	unsigned char *killSpring;
+};
+
+//one spring as drawn (GL_LINES vertices and per vertex intensity)
+struct springLine { float xyz[6]; };
+struct springIntensity { float i[2]; };
+
+//After the exclusive scans, index[i] is the new position of element i and
+//element i is alive when index[i+1] > index[i] (index[n] is the alive count).
+
+__global__ void markAliveParticles(const unsigned char *kill, unsigned int *particleIndex, const unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	particleIndex[id] = (kill[id] ? 0 : 1);
+}
+
+__global__ void markAliveSprings(const unsigned int *id1, const unsigned int *id2, const unsigned char *killSpring,
+		const unsigned int *particleIndex, unsigned int *springIndex,
+		const unsigned int nSprings) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nSprings)
+		return;
+
+	unsigned int p1 = id1[id], p2 = id2[id];
+	bool alive = !killSpring[id]
+		&& particleIndex[p1+1] > particleIndex[p1]
+		&& particleIndex[p2+1] > particleIndex[p2];
+
+	springIndex[id] = (alive ? 1 : 0);
+}
+
+template <typename T>
+__global__ void compactArray(const T *src, T *dst, const unsigned int *index, const unsigned int n) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= n)
+		return;
+
+	unsigned int newId = index[id];
+	if(index[id+1] > newId)
+		dst[newId] = src[id];
+}
+
+//spring ends follow their particles
+__global__ void compactSpringEnds(const unsigned int *src, unsigned int *dst,
+		const unsigned int *springIndex, const unsigned int *particleIndex, const unsigned int nSprings) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nSprings)
+		return;
+
+	unsigned int newId = springIndex[id];
+	if(springIndex[id+1] > newId)
+		dst[newId] = particleIndex[src[id]];
+}
+
+//appended springs were numbered before the compaction : ends below nOldParticles
+//are remapped through the scan, the others are offsets in the appended range
+__global__ void remapAppendedSprings(unsigned int *id1, unsigned int *id2, unsigned char *killSpring,
+		const unsigned int *particleIndex,
+		const unsigned int firstSpring, const unsigned int nAppendedSprings,
+		const unsigned int nOldParticles, const unsigned int nCompactedParticles, const unsigned int nAppendedParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nAppendedSprings)
+		return;
+
+	unsigned int s = firstSpring + id;
+	unsigned int *ends[2] = {id1 + s, id2 + s};
+	bool alive = true;
+
+	for (int i = 0; i < 2; i++) {
+		unsigned int p = *ends[i];
+		if(p < nOldParticles) {
+			alive = alive && (particleIndex[p+1] > particleIndex[p]);
+			p = particleIndex[p];
+		}
+		else {
+			p -= nOldParticles;
+			alive = alive && (p < nAppendedParticles);
+			p += nCompactedParticles;
+		}
+
+		//dead springs still need a valid end for the springs kernel
+		*ends[i] = (alive ? p : 0);
+	}
+
+	killSpring[s] = (alive ? 0 : 1);
+}
+
+template <typename T>
+static void compact(T *data, void *scratch, const unsigned int *index, unsigned int n, unsigned int nAlive) {
+	dim3 blockDim(512,1,1);
+	dim3 gridDim(ceil((float)n/512),1,1);
+
+	compactArray<T><<<gridDim,blockDim,0,0>>>(data, (T*) scratch, index, n);
+	cudaMemcpy(data, scratch, nAlive*sizeof(T), cudaMemcpyDeviceToDevice);
+}
+
+static unsigned int scanAliveFlags(unsigned int *index, unsigned int n) {
+	thrust::device_ptr<unsigned int> index_p(index);
+	thrust::exclusive_scan(index_p, index_p + n + 1, index_p);
+
+	//the only readback of the compaction
+	unsigned int nAlive;
+	cudaMemcpy(&nAlive, index + n, sizeof(unsigned int), cudaMemcpyDeviceToHost);
+	return nAlive;
+}
+
+//particleIndex (nParticles+1), springIndex (nSprings+1) and scratch (max(nParticles, 6*nSprings) floats)
+//are preallocated, particleIndex is kept to remap the springs appended afterwards
+void compactParticlesKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles, const unsigned int nSprings,
+		unsigned int *particleIndex, unsigned int *springIndex, void *scratch,
+		unsigned int *nAliveParticles, unsigned int *nAliveSprings) {
+
+	*nAliveParticles = 0;
+	*nAliveSprings = 0;
+
+	cudaMemset(particleIndex + nParticles, 0, sizeof(unsigned int));
+	if(nParticles == 0)
+		return;
+
+	dim3 blockDim(512,1,1);
+	dim3 gridDim(ceil((float)nParticles/512),1,1);
+
+	markAliveParticles<<<gridDim,blockDim,0,0>>>(pt->kill, particleIndex, nParticles);
+	unsigned int nAlive = scanAliveFlags(particleIndex, nParticles);
+
+	//springs, before the particles move
+	if(nSprings > 0) {
+		dim3 springGridDim(ceil((float)nSprings/512),1,1);
+
+		cudaMemset(springIndex + nSprings, 0, sizeof(unsigned int));
+		markAliveSprings<<<springGridDim,blockDim,0,0>>>(pt->id1, pt->id2, pt->killSpring, particleIndex, springIndex, nSprings);
+		*nAliveSprings = scanAliveFlags(springIndex, nSprings);
+
+		compactSpringEnds<<<springGridDim,blockDim,0,0>>>(pt->id1, (unsigned int*) scratch, springIndex, particleIndex, nSprings);
+		cudaMemcpy(pt->id1, scratch, *nAliveSprings*sizeof(unsigned int), cudaMemcpyDeviceToDevice);
+		compactSpringEnds<<<springGridDim,blockDim,0,0>>>(pt->id2, (unsigned int*) scratch, springIndex, particleIndex, nSprings);
+		cudaMemcpy(pt->id2, scratch, *nAliveSprings*sizeof(unsigned int), cudaMemcpyDeviceToDevice);
+
+		float *springFloats[4] = {pt->k, pt->Lo, pt->d, pt->Fmax};
+		for (int i = 0; i < 4; i++) {
+			compact<float>(springFloats[i], scratch, springIndex, nSprings, *nAliveSprings);
+		}
+		compact<springLine>((springLine*) pt->lines, scratch, springIndex, nSprings, *nAliveSprings);
+		compact<springIntensity>((springIntensity*) pt->intensity, scratch, springIndex, nSprings, *nAliveSprings);
+		cudaMemset(pt->killSpring, 0, *nAliveSprings*sizeof(unsigned char));
+	}
+
+	//particles
+	if(nAlive < nParticles) {
+		float *particleFloats[12] = {pt->x, pt->y, pt->z, pt->vx, pt->vy, pt->vz, pt->fx, pt->fy, pt->fz, pt->m, pt->im, pt->r};
+		for (int i = 0; i < 12; i++) {
+			compact<float>(particleFloats[i], scratch, particleIndex, nParticles, nAlive);
+		}
+		compact<unsigned char>(pt->fixed, scratch, particleIndex, nParticles, nAlive);
+		cudaMemset(pt->kill, 0, nAlive*sizeof(unsigned char));
+	}
+
+	*nAliveParticles = nAlive;
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
+
+void remapAppendedSpringsKernel(const struct mappedParticlePointers *pt,
+		const unsigned int *particleIndex,
+		const unsigned int firstSpring, const unsigned int nAppendedSprings,
+		const unsigned int nOldParticles, const unsigned int nCompactedParticles, const unsigned int nAppendedParticles) {
+
+	if(nAppendedSprings == 0)
+		return;
+
+	dim3 blockDim(512,1,1);
+	dim3 gridDim(ceil((float)nAppendedSprings/512),1,1);
+
+	remapAppendedSprings<<<gridDim,blockDim,0,0>>>(
+			pt->id1, pt->id2, pt->killSpring,
+			particleIndex,
+			firstSpring, nAppendedSprings,
+			nOldParticles, nCompactedParticles, nAppendedParticles);
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
@@ -18,6 +18,25 @@ struct mappedParticlePointers {
 	unsigned char *killSpring;
 };
 
+//same layout as in cpuParticleKernels.h
+struct particleForceTerms {
+	float F[3];
+	float Fm[3];
+	float Fv[3];
+	float k1, k2;
+	float c[3];
+	bool integrate;
+	float dt;
+};
+
+enum ForceTermBits {
+	MASS_TERM = 1,
+	VOLUME_TERM = 2,
+	DRAG_TERM = 4,
+	ADVANCED_DRAG_TERM = 8,
+	INTEGRATION_TERM = 16
+};
+
 __global__ void forceConstante(
 		float *fx, float *fy, float *fz,
 		const int nParticles, 
@@ -322,6 +341,132 @@ __global__ void dynamicScheme(
 	fz[id] = 0;
 }
 
+//force terms then integration, one instantiation per set of used terms (CpuParticleKernels::fusedStep)
+template <unsigned int TERMS>
+__global__ void fusedParticleStep(
+		float *x, float *y, float *z,
+		float *vx, float *vy, float *vz,
+		float *fx, float *fy, float *fz,
+		const float *m, const float *r, const float *im,
+		const unsigned char *fixed,
+		const struct particleForceTerms t,
+		const unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	float _vx = vx[id], _vy = vy[id], _vz = vz[id];
+	float _fx = fx[id] + t.F[0], _fy = fy[id] + t.F[1], _fz = fz[id] + t.F[2];
+
+	if(TERMS & MASS_TERM) {
+		float _m = m[id];
+		_fx += _m*t.Fm[0];
+		_fy += _m*t.Fm[1];
+		_fz += _m*t.Fm[2];
+	}
+
+	float _r = 0.0f;
+	if(TERMS & (VOLUME_TERM | ADVANCED_DRAG_TERM))
+		_r = r[id];
+
+	if(TERMS & VOLUME_TERM) {
+		float r3 = _r*_r*_r;
+		_fx += r3*t.Fv[0];
+		_fy += r3*t.Fv[1];
+		_fz += r3*t.Fv[2];
+	}
+
+	if(TERMS & DRAG_TERM) {
+		_fx -= t.k1*_vx + t.k2*_vx*_vx;
+		_fy -= t.k1*_vy + t.k2*_vy*_vy;
+		_fz -= t.k1*_vz + t.k2*_vz*_vz;
+	}
+
+	if(TERMS & ADVANCED_DRAG_TERM) {
+		float v2 = _vx*_vx + _vy*_vy + _vz*_vz;
+		float s = v2*v2*_r*_r;
+		_fx -= _vx*t.c[0]*s;
+		_fy -= _vy*t.c[1]*s;
+		_fz -= _vz*t.c[2]*s;
+	}
+
+	if(!(TERMS & INTEGRATION_TERM) || fixed[id]) {
+		fx[id] = _fx;
+		fy[id] = _fy;
+		fz[id] = _fz;
+		return;
+	}
+
+	float inverseMass = im[id];
+	_vx += t.dt*_fx*inverseMass;
+	_vy += t.dt*_fy*inverseMass;
+	_vz += t.dt*_fz*inverseMass;
+
+	vx[id] = _vx;
+	vy[id] = _vy;
+	vz[id] = _vz;
+
+	x[id] += _vx*t.dt;
+	y[id] += _vy*t.dt;
+	z[id] += _vz*t.dt;
+
+	fx[id] = 0;
+	fy[id] = 0;
+	fz[id] = 0;
+}
+
+//runtime mask -> fusedParticleStep instantiation
+template <unsigned int TERMS>
+struct FusedDispatch {
+	static void launch(unsigned int mask, dim3 gridDim, dim3 blockDim,
+			const struct mappedParticlePointers *pt, const struct particleForceTerms &t, unsigned int nParticles) {
+		if(mask != TERMS) {
+			FusedDispatch<TERMS - 1>::launch(mask, gridDim, blockDim, pt, t, nParticles);
+			return;
+		}
+
+		fusedParticleStep<TERMS><<<gridDim,blockDim,0,0>>>(
+			pt->x, pt->y, pt->z,
+			pt->vx, pt->vy, pt->vz,
+			pt->fx, pt->fy, pt->fz,
+			pt->m, pt->r, pt->im,
+			pt->fixed,
+			t, nParticles);
+	}
+};
+
+template <>
+struct FusedDispatch<0> {
+	static void launch(unsigned int mask, dim3 gridDim, dim3 blockDim,
+			const struct mappedParticlePointers *pt, const struct particleForceTerms &t, unsigned int nParticles) {
+
+		fusedParticleStep<0><<<gridDim,blockDim,0,0>>>(
+			pt->x, pt->y, pt->z,
+			pt->vx, pt->vy, pt->vz,
+			pt->fx, pt->fy, pt->fz,
+			pt->m, pt->r, pt->im,
+			pt->fixed,
+			t, nParticles);
+	}
+};
+
+void fusedStepKernel(const struct mappedParticlePointers *pt, const unsigned int nParticles,
+		const struct particleForceTerms *terms, const unsigned int termsMask) {
+
+	if(nParticles == 0)
+		return;
+
+	dim3 blockDim(512,1,1);
+	dim3 gridDim(ceil((float)nParticles/512),1,1);
+
+	FusedDispatch<2*INTEGRATION_TERM - 1>::launch(termsMask, gridDim, blockDim, pt, *terms, nParticles);
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
+
 void forceConstanteKernel(
 		const struct mappedParticlePointers *pt, const unsigned int nParticles, 
 		const float Fx, const float Fy, const float Fz) {
@@ -414,12 +559,10 @@ void frottementFluideAvanceKernel(
 	checkKernelExecution();
 }
 
-void dynamicSchemeKernel(const struct mappedParticlePointers *pt, unsigned int nParticles) { 
+void dynamicSchemeKernel(const struct mappedParticlePointers *pt, unsigned int nParticles, float dt) { 
 	dim3 blockDim(512,1,1);
 	dim3 gridDim(ceil((float)nParticles/512),1,1);
 
-	float dt = 0.01;
-
 	dynamicScheme<<<gridDim,blockDim,0,0>>>(
 		pt->x, pt->y, pt->z, 
 		pt->vx, pt->vy, pt->vz,
@@ -0,0 +1,438 @@
+#include "cuda.h"
+#include "cuda_runtime.h"
+#include "stdio.h"
+
+#include <thrust/device_ptr.h>
+#include <thrust/sort.h>
+
+extern void checkKernelExecution();
+
+struct mappedParticlePointers {
+	//particules
+	float *x, *y, *z, *vx, *vy, *vz, *fx, *fy, *fz, *m, *im, *r;
+	unsigned char *kill, *fixed;
+	//ressorts
+	float *k, *Lo, *d, *Fmax, *lines, *intensity;
+	unsigned int *id1, *id2;
+	unsigned char *killSpring;
+};
+
+//Same hashing as UniformGrid (CPU) : cells of dMax hashed to the low bits of their Morton code,
+//particles radix sorted by cell (thrust) and cell bounds found in the sorted keys.
+struct deviceUniformGrid {
+	unsigned int capacity, tableMask;
+	unsigned int *keys, *indices, *cellStart, *cellEnd;
+	float *sortedX, *sortedY, *sortedZ, *sortedM;
+	float *sortedR, *sortedVx, *sortedVy, *sortedVz, *sortedIm; //collisions only
+};
+
+#define EMPTY_CELL 0xffffffff
+
+__device__ unsigned int expandBits(unsigned int v) {
+	v &= 0x3ff;
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+__device__ unsigned int cellKey(int cx, int cy, int cz, unsigned int tableMask) {
+	unsigned int morton = (expandBits((unsigned int) cx) << 2) | (expandBits((unsigned int) cy) << 1) | expandBits((unsigned int) cz);
+	return morton & tableMask;
+}
+
+__global__ void computeCellKeys(
+		const float *x, const float *y, const float *z,
+		unsigned int *keys, unsigned int *indices,
+		const float invCellSize, const unsigned int tableMask,
+		const unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	keys[id] = cellKey((int) floorf(x[id]*invCellSize), (int) floorf(y[id]*invCellSize), (int) floorf(z[id]*invCellSize), tableMask);
+	indices[id] = id;
+}
+
+//a cell starts where the sorted key changes, the sorted positions are gathered on the way
+__global__ void findCellBounds(
+		const unsigned int *keys, const unsigned int *indices,
+		unsigned int *cellStart, unsigned int *cellEnd,
+		const float *x, const float *y, const float *z, const float *m,
+		float *sortedX, float *sortedY, float *sortedZ, float *sortedM,
+		const unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	unsigned int key = keys[id];
+	if(id == 0 || keys[id-1] != key) {
+		cellStart[key] = id;
+		if(id > 0)
+			cellEnd[keys[id-1]] = id;
+	}
+	if(id == nParticles - 1)
+		cellEnd[key] = nParticles;
+
+	unsigned int i = indices[id];
+	sortedX[id] = x[i];
+	sortedY[id] = y[i];
+	sortedZ[id] = z[i];
+	sortedM[id] = m[i];
+}
+
+//one thread per sorted particle, same force as attractors (particles.cu) restricted to the 27 cells around
+__global__ void attractorsGrid(
+		const float *sortedX, const float *sortedY, const float *sortedZ, const float *sortedM,
+		const unsigned int *indices, const unsigned int *cellStart, const unsigned int *cellEnd,
+		float *fx, float *fy, float *fz,
+		const float invCellSize, const unsigned int tableMask,
+		const unsigned int nParticles,
+		const float dMin, const float dMax,
+		const float C) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	float _x = sortedX[id], _y = sortedY[id], _z = sortedZ[id];
+	float _m1 = sortedM[id];
+	int cx = (int) floorf(_x*invCellSize), cy = (int) floorf(_y*invCellSize), cz = (int) floorf(_z*invCellSize);
+
+	unsigned int keys[27], nKeys = 0;
+	for (int dz = -1; dz <= 1; dz++) {
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				unsigned int key = cellKey(cx + dx, cy + dy, cz + dz, tableMask);
+
+				bool visited = false;
+				for (unsigned int k = 0; k < nKeys; k++)
+					visited = visited || (keys[k] == key);
+
+				if(!visited)
+					keys[nKeys++] = key;
+			}
+		}
+	}
+
+	float dx, dy, dz, d, d2;
+	float _fx=0, _fy=0, _fz=0;
+	float _C;
+
+	for (unsigned int k = 0; k < nKeys; k++) {
+		unsigned int start = cellStart[keys[k]];
+		if(start == EMPTY_CELL)
+			continue;
+
+		unsigned int end = cellEnd[keys[k]];
+		for (unsigned int i = start; i < end; i++) {
+			if(i == (unsigned int) id)
+				continue;
+
+			dx = sortedX[i] - _x;
+			dy = sortedY[i] - _y;
+			dz = sortedZ[i] - _z;
+
+			d2 = dx*dx + dy*dy + dz*dz;
+			d = sqrt(d2);
+
+			if(d < dMin || d > dMax)
+				continue;
+
+			_C = C*_m1*sortedM[i]/d2;
+
+			_fx += _C * dx/d;
+			_fy += _C * dy/d;
+			_fz += _C * dz/d;
+		}
+	}
+
+	unsigned int i = indices[id];
+	fx[i] += _fx;
+	fy[i] += _fy;
+	fz[i] += _fz;
+}
+
+__global__ void gatherCollisionData(
+		const unsigned int *indices,
+		const float *r, const float *vx, const float *vy, const float *vz, const float *im, const unsigned char *fixed,
+		float *sortedR, float *sortedVx, float *sortedVy, float *sortedVz, float *sortedIm,
+		const unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	unsigned int i = indices[id];
+	sortedR[id] = r[i];
+	sortedVx[id] = vx[i];
+	sortedVy[id] = vy[i];
+	sortedVz[id] = vz[i];
+	sortedIm[id] = (fixed[i] ? 0.0f : im[i]);
+}
+
+//same resolution as CpuParticleKernels::particleCollisions (Jacobi, mass weighted)
+__global__ void collideParticlesGrid(
+		const float *sortedX, const float *sortedY, const float *sortedZ,
+		const float *sortedR, const float *sortedVx, const float *sortedVy, const float *sortedVz, const float *sortedIm,
+		const unsigned int *indices, const unsigned int *cellStart, const unsigned int *cellEnd,
+		float *x, float *y, float *z, float *vx, float *vy, float *vz,
+		const float invCellSize, const unsigned int tableMask,
+		const unsigned int nParticles,
+		const float rebound) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	float _im = sortedIm[id];
+	if(_im == 0.0f)
+		return;
+
+	float _x = sortedX[id], _y = sortedY[id], _z = sortedZ[id], _r = sortedR[id];
+	float _vx = sortedVx[id], _vy = sortedVy[id], _vz = sortedVz[id];
+	int cx = (int) floorf(_x*invCellSize), cy = (int) floorf(_y*invCellSize), cz = (int) floorf(_z*invCellSize);
+
+	unsigned int keys[27], nKeys = 0;
+	for (int dz = -1; dz <= 1; dz++) {
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				unsigned int key = cellKey(cx + dx, cy + dy, cz + dz, tableMask);
+
+				bool visited = false;
+				for (unsigned int k = 0; k < nKeys; k++)
+					visited = visited || (keys[k] == key);
+
+				if(!visited)
+					keys[nKeys++] = key;
+			}
+		}
+	}
+
+	float dpx=0, dpy=0, dpz=0, dvx=0, dvy=0, dvz=0;
+
+	for (unsigned int k = 0; k < nKeys; k++) {
+		unsigned int start = cellStart[keys[k]];
+		if(start == EMPTY_CELL)
+			continue;
+
+		unsigned int end = cellEnd[keys[k]];
+		for (unsigned int j = start; j < end; j++) {
+			float dx = _x - sortedX[j], dy = _y - sortedY[j], dz = _z - sortedZ[j];
+			float d2 = dx*dx + dy*dy + dz*dz, R = _r + sortedR[j];
+			if(j == (unsigned int) id || d2 >= R*R || d2 == 0.0f)
+				continue;
+
+			float d = sqrtf(d2);
+			float nx = dx/d, ny = dy/d, nz = dz/d;
+			float w = _im/(_im + sortedIm[j]);
+
+			float overlap = (R - d)*w;
+			dpx += overlap*nx;
+			dpy += overlap*ny;
+			dpz += overlap*nz;
+
+			float vn = (_vx - sortedVx[j])*nx + (_vy - sortedVy[j])*ny + (_vz - sortedVz[j])*nz;
+			if(vn < 0.0f) {
+				float impulse = -(1.0f + rebound)*vn*w;
+				dvx += impulse*nx;
+				dvy += impulse*ny;
+				dvz += impulse*nz;
+			}
+		}
+	}
+
+	unsigned int i = indices[id];
+	x[i] += dpx;
+	y[i] += dpy;
+	z[i] += dpz;
+	vx[i] += dvx;
+	vy[i] += dvy;
+	vz[i] += dvz;
+}
+
+struct deviceUniformGrid *allocateDeviceGrid(unsigned int capacity) {
+	struct deviceUniformGrid *grid = new struct deviceUniformGrid;
+
+	unsigned int tableBits = 10;
+	while((1u << tableBits) < capacity && tableBits < 30)
+		tableBits++;
+
+	grid->capacity = capacity;
+	grid->tableMask = (1u << tableBits) - 1;
+
+	cudaMalloc((void**) &grid->keys, capacity*sizeof(unsigned int));
+	cudaMalloc((void**) &grid->indices, capacity*sizeof(unsigned int));
+	cudaMalloc((void**) &grid->cellStart, (1u << tableBits)*sizeof(unsigned int));
+	cudaMalloc((void**) &grid->cellEnd, (1u << tableBits)*sizeof(unsigned int));
+	cudaMalloc((void**) &grid->sortedX, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedY, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedZ, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedM, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedR, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedVx, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedVy, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedVz, capacity*sizeof(float));
+	cudaMalloc((void**) &grid->sortedIm, capacity*sizeof(float));
+	checkKernelExecution();
+
+	return grid;
+}
+
+void freeDeviceGrid(struct deviceUniformGrid *grid) {
+	cudaFree(grid->keys);
+	cudaFree(grid->indices);
+	cudaFree(grid->cellStart);
+	cudaFree(grid->cellEnd);
+	cudaFree(grid->sortedX);
+	cudaFree(grid->sortedY);
+	cudaFree(grid->sortedZ);
+	cudaFree(grid->sortedM);
+	cudaFree(grid->sortedR);
+	cudaFree(grid->sortedVx);
+	cudaFree(grid->sortedVy);
+	cudaFree(grid->sortedVz);
+	cudaFree(grid->sortedIm);
+	delete grid;
+}
+
+unsigned int getDeviceGridCapacity(const struct deviceUniformGrid *grid) {
+	return grid->capacity;
+}
+
+//keys, radix sort, cell bounds and sorted positions and masses
+static void buildDeviceGrid(const struct mappedParticlePointers *pt, const unsigned int nParticles,
+		const float cellSize, struct deviceUniformGrid *grid) {
+
+	dim3 blockDim(256,1,1);
+	dim3 gridDim(ceil((float)nParticles/256),1,1);
+
+	computeCellKeys<<<gridDim,blockDim,0,0>>>(
+			pt->x, pt->y, pt->z,
+			grid->keys, grid->indices,
+			1.0f/cellSize, grid->tableMask,
+			nParticles);
+
+	thrust::device_ptr<unsigned int> keys_p(grid->keys), indices_p(grid->indices);
+	thrust::sort_by_key(keys_p, keys_p + nParticles, indices_p);
+
+	cudaMemset(grid->cellStart, 0xff, (grid->tableMask + 1)*sizeof(unsigned int));
+	findCellBounds<<<gridDim,blockDim,0,0>>>(
+			grid->keys, grid->indices,
+			grid->cellStart, grid->cellEnd,
+			pt->x, pt->y, pt->z, pt->m,
+			grid->sortedX, grid->sortedY, grid->sortedZ, grid->sortedM,
+			nParticles);
+}
+
+void attractorGridKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles,
+		const float dMin, const float dMax, const float C,
+		struct deviceUniformGrid *grid) {
+
+	if(nParticles == 0)
+		return;
+
+	dim3 blockDim(256,1,1);
+	dim3 gridDim(ceil((float)nParticles/256),1,1);
+
+	buildDeviceGrid(pt, nParticles, dMax, grid);
+
+	attractorsGrid<<<gridDim,blockDim,0,0>>>(
+			grid->sortedX, grid->sortedY, grid->sortedZ, grid->sortedM,
+			grid->indices, grid->cellStart, grid->cellEnd,
+			pt->fx, pt->fy, pt->fz,
+			1.0f/dMax, grid->tableMask,
+			nParticles,
+			dMin, dMax, C);
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
+
+void particleCollisionsGridKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles,
+		const float maxRadius, const float rebound,
+		struct deviceUniformGrid *grid) {
+
+	if(nParticles == 0)
+		return;
+
+	dim3 blockDim(256,1,1);
+	dim3 gridDim(ceil((float)nParticles/256),1,1);
+
+	buildDeviceGrid(pt, nParticles, 2.0f*maxRadius, grid);
+
+	gatherCollisionData<<<gridDim,blockDim,0,0>>>(
+			grid->indices,
+			pt->r, pt->vx, pt->vy, pt->vz, pt->im, pt->fixed,
+			grid->sortedR, grid->sortedVx, grid->sortedVy, grid->sortedVz, grid->sortedIm,
+			nParticles);
+
+	collideParticlesGrid<<<gridDim,blockDim,0,0>>>(
+			grid->sortedX, grid->sortedY, grid->sortedZ,
+			grid->sortedR, grid->sortedVx, grid->sortedVy, grid->sortedVz, grid->sortedIm,
+			grid->indices, grid->cellStart, grid->cellEnd,
+			pt->x, pt->y, pt->z, pt->vx, pt->vy, pt->vz,
+			0.5f/maxRadius, grid->tableMask,
+			nParticles,
+			rebound);
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
+
+//best of nRuns of attractorGridKernel on host positions and masses, in ms (copies excluded)
+float benchmarkAttractorGridKernel(const float *x, const float *y, const float *z, const float *m,
+		const unsigned int nParticles,
+		const float dMin, const float dMax, const float C,
+		const unsigned int nRuns) {
+
+	struct mappedParticlePointers pt = {};
+	float **arrays[7] = {&pt.x, &pt.y, &pt.z, &pt.m, &pt.fx, &pt.fy, &pt.fz};
+	for (int i = 0; i < 7; i++) {
+		cudaMalloc((void**) arrays[i], nParticles*sizeof(float));
+	}
+	cudaMemcpy(pt.x, x, nParticles*sizeof(float), cudaMemcpyHostToDevice);
+	cudaMemcpy(pt.y, y, nParticles*sizeof(float), cudaMemcpyHostToDevice);
+	cudaMemcpy(pt.z, z, nParticles*sizeof(float), cudaMemcpyHostToDevice);
+	cudaMemcpy(pt.m, m, nParticles*sizeof(float), cudaMemcpyHostToDevice);
+	cudaMemset(pt.fx, 0, nParticles*sizeof(float));
+	cudaMemset(pt.fy, 0, nParticles*sizeof(float));
+	cudaMemset(pt.fz, 0, nParticles*sizeof(float));
+
+	struct deviceUniformGrid *grid = allocateDeviceGrid(nParticles);
+
+	cudaEvent_t start, stop;
+	cudaEventCreate(&start);
+	cudaEventCreate(&stop);
+
+	float bestTime = 1.0e30f;
+	for (unsigned int run = 0; run < nRuns; run++) {
+		cudaEventRecord(start, 0);
+		attractorGridKernel(&pt, nParticles, dMin, dMax, C, grid);
+		cudaEventRecord(stop, 0);
+		cudaEventSynchronize(stop);
+
+		float elapsed;
+		cudaEventElapsedTime(&elapsed, start, stop);
+		bestTime = fminf(bestTime, elapsed);
+	}
+
+	cudaEventDestroy(start);
+	cudaEventDestroy(stop);
+	freeDeviceGrid(grid);
+	for (int i = 0; i < 7; i++) {
+		cudaFree(*arrays[i]);
+	}
+
+	return bestTime;
+}
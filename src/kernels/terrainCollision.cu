@@ -0,0 +1,158 @@
+#include "cuda.h"
+#include "cuda_runtime.h"
+#include "stdio.h"
+
+extern void checkKernelExecution();
+
+struct mappedParticlePointers {
+	//particules
+	float *x, *y, *z, *vx, *vy, *vz, *fx, *fy, *fz, *m, *im, *r;
+	unsigned char *kill, *fixed;
+	//ressorts
+	float *k, *Lo, *d, *Fmax, *lines, *intensity;
+	unsigned int *id1, *id2;
+	unsigned char *killSpring;
+};
+
+//DensityVolume samples in a 3D texture (hardware trilinear filtering, unnormalized coordinates)
+struct deviceDensityVolume {
+	cudaArray_t array;
+	cudaTextureObject_t texture;
+	unsigned int width, height, length;
+	float voxelSize;
+	float origin[3];
+};
+
+//sample (i,j,k) is the texel center (i+0.5,j+0.5,k+0.5)
+__device__ float densityAt(cudaTextureObject_t texture, float u, float v, float w) {
+	return tex3D<float>(texture, u + 0.5f, v + 0.5f, w + 0.5f);
+}
+
+//same projection as CpuParticleKernels::terrainCollision
+__global__ void terrainCollision(
+		float *x, float *y, float *z,
+		float *vx, float *vy, float *vz,
+		const float *r, const unsigned char *fixed,
+		cudaTextureObject_t texture,
+		const unsigned int width, const unsigned int height, const unsigned int length,
+		const float ox, const float oy, const float oz,
+		const float voxelSize,
+		const unsigned int nParticles,
+		const float rebound, const float friction) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles || fixed[id])
+		return;
+
+	float _x = x[id], _y = y[id], _z = z[id];
+	float invVoxelSize = 1.0f/voxelSize;
+	float u = (_x - ox)*invVoxelSize, v = (_y - oy)*invVoxelSize, w = (_z - oz)*invVoxelSize;
+
+	if(u < 1.0f || v < 1.0f || w < 1.0f || u > width - 2.0f || v > height - 2.0f || w > length - 2.0f)
+		return;
+
+	//one voxel central differences, as the normals pass
+	float scale = 0.5f*invVoxelSize;
+	float gx = (densityAt(texture, u + 1.0f, v, w) - densityAt(texture, u - 1.0f, v, w))*scale;
+	float gy = (densityAt(texture, u, v + 1.0f, w) - densityAt(texture, u, v - 1.0f, w))*scale;
+	float gz = (densityAt(texture, u, v, w + 1.0f) - densityAt(texture, u, v, w - 1.0f))*scale;
+
+	float norm = sqrtf(gx*gx + gy*gy + gz*gz);
+	if(norm < 1.0e-6f)
+		return;
+
+	float distance = -densityAt(texture, u, v, w)/norm;
+	float penetration = r[id] - distance;
+	if(penetration <= 0.0f)
+		return;
+
+	float nx = -gx/norm, ny = -gy/norm, nz = -gz/norm;
+	penetration = fminf(penetration, 2.0f*voxelSize);
+	x[id] = _x + penetration*nx;
+	y[id] = _y + penetration*ny;
+	z[id] = _z + penetration*nz;
+
+	float _vx = vx[id], _vy = vy[id], _vz = vz[id];
+	float vn = _vx*nx + _vy*ny + _vz*nz;
+	float tx = _vx - vn*nx, ty = _vy - vn*ny, tz = _vz - vn*nz;
+	if(vn < 0.0f)
+		vn *= -rebound;
+
+	vx[id] = vn*nx + (1.0f - friction)*tx;
+	vy[id] = vn*ny + (1.0f - friction)*ty;
+	vz[id] = vn*nz + (1.0f - friction)*tz;
+}
+
+struct deviceDensityVolume *uploadDensityVolume(const float *samples,
+		const unsigned int width, const unsigned int height, const unsigned int length,
+		const float voxelSize, const float origin[3]) {
+
+	struct deviceDensityVolume *volume = new struct deviceDensityVolume;
+	volume->width = width;
+	volume->height = height;
+	volume->length = length;
+	volume->voxelSize = voxelSize;
+	for (int i = 0; i < 3; i++)
+		volume->origin[i] = origin[i];
+
+	cudaChannelFormatDesc channel = cudaCreateChannelDesc<float>();
+	cudaExtent extent = make_cudaExtent(width, height, length);
+	cudaMalloc3DArray(&volume->array, &channel, extent);
+
+	cudaMemcpy3DParms copy = {0};
+	copy.srcPtr = make_cudaPitchedPtr((void*) samples, width*sizeof(float), width, height);
+	copy.dstArray = volume->array;
+	copy.extent = extent;
+	copy.kind = cudaMemcpyHostToDevice;
+	cudaMemcpy3D(&copy);
+
+	cudaResourceDesc resource = {};
+	resource.resType = cudaResourceTypeArray;
+	resource.res.array.array = volume->array;
+
+	cudaTextureDesc texture = {};
+	texture.addressMode[0] = cudaAddressModeClamp;
+	texture.addressMode[1] = cudaAddressModeClamp;
+	texture.addressMode[2] = cudaAddressModeClamp;
+	texture.filterMode = cudaFilterModeLinear;
+	texture.readMode = cudaReadModeElementType;
+	texture.normalizedCoords = 0;
+
+	cudaCreateTextureObject(&volume->texture, &resource, &texture, 0);
+	checkKernelExecution();
+
+	return volume;
+}
+
+void freeDensityVolume(struct deviceDensityVolume *volume) {
+	cudaDestroyTextureObject(volume->texture);
+	cudaFreeArray(volume->array);
+	delete volume;
+}
+
+void terrainCollisionKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles,
+		const struct deviceDensityVolume *volume,
+		const float rebound, const float friction) {
+
+	if(nParticles == 0)
+		return;
+
+	dim3 blockDim(256,1,1);
+	dim3 gridDim(ceil((float)nParticles/256),1,1);
+
+	terrainCollision<<<gridDim,blockDim,0,0>>>(
+			pt->x, pt->y, pt->z,
+			pt->vx, pt->vy, pt->vz,
+			pt->r, pt->fixed,
+			volume->texture,
+			volume->width, volume->height, volume->length,
+			volume->origin[0], volume->origin[1], volume->origin[2],
+			volume->voxelSize,
+			nParticles,
+			rebound, friction);
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
@@ -0,0 +1,275 @@
+#include "cuda.h"
+#include "cuda_runtime.h"
+#include "stdio.h"
+
+extern void checkKernelExecution();
+
+struct mappedParticlePointers {
+	//particules
+	float *x, *y, *z, *vx, *vy, *vz, *fx, *fy, *fz, *m, *im, *r;
+	unsigned char *kill, *fixed;
+	//ressorts
+	float *k, *Lo, *d, *Fmax, *lines, *intensity;
+	unsigned int *id1, *id2;
+	unsigned char *killSpring;
+};
+
+//Same solver as CpuParticleKernels::xpbd : the springs sorted by colour (built on the host,
+//see CpuParticleKernels::buildSpringColouring) are projected one colour per launch, so that
+//no two threads of a launch move the same particle.
+struct deviceXpbdState {
+	unsigned int particleCapacity, springCapacity;
+	float *px, *py, *pz, *lambda;
+	unsigned int *colourSprings;
+};
+
+__global__ void xpbdPredict(
+		float *x, float *y, float *z,
+		float *vx, float *vy, float *vz,
+		float *fx, float *fy, float *fz,
+		float *px, float *py, float *pz,
+		float *im,
+		unsigned char *fixed,
+		float h, bool resetForces,
+		unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	px[id] = x[id];
+	py[id] = y[id];
+	pz[id] = z[id];
+
+	if(fixed[id])
+		return;
+
+	float inverseMass = im[id];
+
+	vx[id] += h*fx[id]*inverseMass;
+	vy[id] += h*fy[id]*inverseMass;
+	vz[id] += h*fz[id]*inverseMass;
+
+	x[id] += vx[id]*h;
+	y[id] += vy[id]*h;
+	z[id] += vz[id]*h;
+
+	if(resetForces) {
+		fx[id] = 0;
+		fy[id] = 0;
+		fz[id] = 0;
+	}
+}
+
+__global__ void xpbdProjectColour(
+		const unsigned int *colourSprings,
+		unsigned int *id1, unsigned int *id2,
+		float *x, float *y, float *z,
+		float *px, float *py, float *pz,
+		float *im,
+		unsigned char *fixed,
+		float *k, float *Lo, float *d,
+		float *lambda,
+		float h, bool handleDumping,
+		unsigned int nColourSprings) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nColourSprings)
+		return;
+
+	unsigned int s = colourSprings[id];
+	unsigned int _id1 = id1[s], _id2 = id2[s];
+	float w1 = (fixed[_id1] ? 0.0f : im[_id1]), w2 = (fixed[_id2] ? 0.0f : im[_id2]);
+	if(w1 + w2 <= 0.0f || k[s] <= 0.0f)
+		return;
+
+	float dx = x[_id2] - x[_id1], dy = y[_id2] - y[_id1], dz = z[_id2] - z[_id1];
+	float N = sqrtf(dx*dx + dy*dy + dz*dz);
+	if(N < 1.0e-4f)
+		return;
+
+	float nx = dx/N, ny = dy/N, nz = dz/N;
+	float alpha = 1.0f/(k[s]*h*h);
+	float gamma = (handleDumping ? alpha*d[s]*h : 0.0f);
+
+	float gradDx = 0.0f;
+	if(gamma > 0.0f) {
+		gradDx = nx*((x[_id2] - px[_id2]) - (x[_id1] - px[_id1]))
+			+ ny*((y[_id2] - py[_id2]) - (y[_id1] - py[_id1]))
+			+ nz*((z[_id2] - pz[_id2]) - (z[_id1] - pz[_id1]));
+	}
+
+	float dLambda = (-(N - Lo[s]) - alpha*lambda[s] - gamma*gradDx)/((1.0f + gamma)*(w1 + w2) + alpha);
+	lambda[s] += dLambda;
+
+	x[_id1] -= w1*dLambda*nx;
+	y[_id1] -= w1*dLambda*ny;
+	z[_id1] -= w1*dLambda*nz;
+	x[_id2] += w2*dLambda*nx;
+	y[_id2] += w2*dLambda*ny;
+	z[_id2] += w2*dLambda*nz;
+}
+
+__global__ void xpbdVelocities(
+		float *x, float *y, float *z,
+		float *vx, float *vy, float *vz,
+		float *px, float *py, float *pz,
+		unsigned char *fixed,
+		float h,
+		unsigned int nParticles) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nParticles)
+		return;
+
+	if(fixed[id])
+		return;
+
+	vx[id] = (x[id] - px[id])/h;
+	vy[id] = (y[id] - py[id])/h;
+	vz[id] = (z[id] - pz[id])/h;
+}
+
+__global__ void xpbdSpringLines(
+		unsigned int *id1, unsigned int *id2,
+		float *x, float *y, float *z,
+		float *Fmax, float *lambda,
+		unsigned char *killSpring,
+		float *intensity, float *lines,
+		float h,
+		unsigned int nSprings) {
+
+	int id = blockIdx.x*blockDim.x + threadIdx.x;
+
+	if(id >= nSprings || killSpring[id])
+		return;
+
+	unsigned int _id1 = id1[id], _id2 = id2[id];
+	float dx = x[_id2] - x[_id1], dy = y[_id2] - y[_id1], dz = z[_id2] - z[_id1];
+	float N = sqrtf(dx*dx + dy*dy + dz*dz);
+	if(N < 1.0e-4f)
+		return;
+
+	lines[6*id + 0] = x[_id1];
+	lines[6*id + 1] = y[_id1];
+	lines[6*id + 2] = z[_id1];
+	lines[6*id + 3] = x[_id2];
+	lines[6*id + 4] = y[_id2];
+	lines[6*id + 5] = z[_id2];
+
+	float ratio = fminf(fmaxf(lambda[id]/(h*h*N*Fmax[id]), -1.0f), 1.0f);
+	intensity[2*id + 0] = ratio;
+	intensity[2*id + 1] = ratio;
+}
+
+struct deviceXpbdState *allocateDeviceXpbdState(unsigned int particleCapacity, unsigned int springCapacity) {
+	struct deviceXpbdState *state = new struct deviceXpbdState;
+
+	state->particleCapacity = particleCapacity;
+	state->springCapacity = springCapacity;
+
+	cudaMalloc((void**) &state->px, particleCapacity*sizeof(float));
+	cudaMalloc((void**) &state->py, particleCapacity*sizeof(float));
+	cudaMalloc((void**) &state->pz, particleCapacity*sizeof(float));
+	cudaMalloc((void**) &state->lambda, springCapacity*sizeof(float));
+	cudaMalloc((void**) &state->colourSprings, springCapacity*sizeof(unsigned int));
+	checkKernelExecution();
+
+	return state;
+}
+
+void freeDeviceXpbdState(struct deviceXpbdState *state) {
+	cudaFree(state->px);
+	cudaFree(state->py);
+	cudaFree(state->pz);
+	cudaFree(state->lambda);
+	cudaFree(state->colourSprings);
+	delete state;
+}
+
+unsigned int getDeviceXpbdParticleCapacity(const struct deviceXpbdState *state) {
+	return state->particleCapacity;
+}
+
+unsigned int getDeviceXpbdSpringCapacity(const struct deviceXpbdState *state) {
+	return state->springCapacity;
+}
+
+void uploadXpbdColouring(struct deviceXpbdState *state, const unsigned int *colourSprings, unsigned int nColourSprings) {
+	cudaMemcpy(state->colourSprings, colourSprings, nColourSprings*sizeof(unsigned int), cudaMemcpyHostToDevice);
+	checkKernelExecution();
+}
+
+void xpbdKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles, const unsigned int nSprings,
+		struct deviceXpbdState *state, const unsigned int *colourOffsets, const unsigned int nColours,
+		const float dt, const unsigned int nSubsteps, const unsigned int nIterations,
+		const bool handleDumping) {
+
+	dim3 blockDim(512,1,1);
+	dim3 particlesGridDim(ceil((float)nParticles/512),1,1);
+	dim3 springsGridDim(ceil((float)nSprings/512),1,1);
+
+	float h = dt/nSubsteps;
+
+	for (unsigned int substep = 0; substep < nSubsteps; substep++) {
+		xpbdPredict<<<particlesGridDim,blockDim,0,0>>>(
+				pt->x, pt->y, pt->z,
+				pt->vx, pt->vy, pt->vz,
+				pt->fx, pt->fy, pt->fz,
+				state->px, state->py, state->pz,
+				pt->im,
+				pt->fixed,
+				h, substep == nSubsteps - 1,
+				nParticles);
+
+		cudaMemsetAsync(state->lambda, 0, nSprings*sizeof(float), 0);
+
+		//one launch per colour, the launches of the stream are serialized
+		for (unsigned int it = 0; it < nIterations; it++) {
+			for (unsigned int c = 0; c < nColours; c++) {
+				unsigned int nColourSprings = colourOffsets[c + 1] - colourOffsets[c];
+				if(nColourSprings == 0)
+					continue;
+
+				dim3 colourGridDim(ceil((float)nColourSprings/512),1,1);
+				xpbdProjectColour<<<colourGridDim,blockDim,0,0>>>(
+						state->colourSprings + colourOffsets[c],
+						pt->id1, pt->id2,
+						pt->x, pt->y, pt->z,
+						state->px, state->py, state->pz,
+						pt->im,
+						pt->fixed,
+						pt->k, pt->Lo, pt->d,
+						state->lambda,
+						h, handleDumping,
+						nColourSprings);
+			}
+		}
+
+		xpbdVelocities<<<particlesGridDim,blockDim,0,0>>>(
+				pt->x, pt->y, pt->z,
+				pt->vx, pt->vy, pt->vz,
+				state->px, state->py, state->pz,
+				pt->fixed,
+				h,
+				nParticles);
+	}
+
+	if(nSprings > 0) {
+		xpbdSpringLines<<<springsGridDim,blockDim,0,0>>>(
+				pt->id1, pt->id2,
+				pt->x, pt->y, pt->z,
+				pt->Fmax, state->lambda,
+				pt->killSpring,
+				pt->intensity, pt->lines,
+				h,
+				nSprings);
+	}
+
+	cudaDeviceSynchronize();
+	checkKernelExecution();
+}
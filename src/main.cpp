@@ -27,11 +27,27 @@
 #include "marchingCubes.h"
 #include "seaweedGroup.h"
 #include "bubblesGenerator.h"
+#include "cpuMarchingCubes.h"
+#include "densityField.h"
+#include "volumeEncoding.h"
+#include "cpuParticleKernels.h"
+#include "terrainChunks.h"
+#include "transvoxel.h"
+#include "terrainCollision.h"
+#include "particleCollisions.h"
+#include "simulationClock.h"
+#include "implicitSpringSolver.h"
+#include "dynamicSystem.h"
+#ifdef HAVE_EGL
+#include "headlessRenderer.h"
+#endif
+#include "matrix.h"
 
 #include <qapplication.h>
 #include <QWidget>
 #include <vector>
 #include <ctime>
+#include <string>
 
 #include <ostream>
 #include <cassert>
@@ -40,6 +56,29 @@
 using namespace std;
 using namespace log4cpp;
 
+//options can be given in any order : true when option is on the command line
+static bool hasOption(int argc, char** argv, const char *option) {
+        for (int i = 1; i < argc; i++) {
+                if(std::string(argv[i]) == option)
+                        return true;
+        }
+        return false;
+}
+
+//argument following a named option (--frames 300), defaultValue when the option is not given
+static const char *optionValue(int argc, char** argv, const char *option, const char *defaultValue) {
+        for (int i = 1; i < argc; i++) {
+                if(std::string(argv[i]) != option)
+                        continue;
+
+                if(i + 1 < argc)
+                        return argv[i+1];
+
+                log_console.warnStream() << option << " needs a value, using " << defaultValue << " !";
+        }
+        return defaultValue;
+}
+
 int main(int argc, char** argv) {
 
         //random
@@ -48,27 +87,162 @@ int main(int argc, char** argv) {
         //logs
         log4cpp::initLogs();
 
+#ifdef __AVX2__
+        //USE_AVX2 build : fail clearly rather than with SIGILL in the first kernel
+        if(!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma")) {
+                log_console.errorStream() << "This build needs an AVX2/FMA CPU, rebuild without USE_AVX2 (SIMDFLAGS) !";
+                return EXIT_FAILURE;
+        }
+#endif
+
+        //headless CPU marching cube benchmark (no GL context needed)
+        if(hasOption(argc, argv, "--bench-mc")) {
+                CpuMarchingCubes::benchmark(128, 10);
+                return EXIT_SUCCESS;
+        }
+
+        //headless CPU density field benchmark
+        if(hasOption(argc, argv, "--bench-density")) {
+                DensityField::benchmark(128, 10);
+                return EXIT_SUCCESS;
+        }
+
+        //headless CPU particle kernels benchmark (SeeweedGroup of main)
+        if(hasOption(argc, argv, "--bench-particles")) {
+                CpuParticleKernels::benchmark(20000, 11, 10);
+                return EXIT_SUCCESS;
+        }
+
+        //headless spatial hash benchmark (attractor from 10k to 1M particles, CPU and CUDA)
+        if(hasOption(argc, argv, "--bench-grid")) {
+                CpuParticleKernels::gridBenchmark(5);
+                return EXIT_SUCCESS;
+        }
+
+        //headless collisions benchmark (terrain and sphere-sphere from 10k to 1M particles)
+        if(hasOption(argc, argv, "--bench-collisions")) {
+                CpuParticleKernels::collisionBenchmark(5);
+                return EXIT_SUCCESS;
+        }
+
+        //headless seaweed strands benchmark, springs against XPBD constraints
+        if(hasOption(argc, argv, "--bench-xpbd")) {
+                CpuParticleKernels::xpbdBenchmark(5);
+                return EXIT_SUCCESS;
+        }
+
+        //headless stiff strands benchmark, explicit against implicit (backward Euler + CG) steps
+        if(hasOption(argc, argv, "--bench-implicit")) {
+                ImplicitSpringSolver::benchmark(3);
+                return EXIT_SUCCESS;
+        }
+
+        //headless DynamicSystem step benchmark (flat arrays against the former std::map step)
+        if(hasOption(argc, argv, "--bench-dynamic")) {
+                DynamicSystem::benchmark(3);
+                return EXIT_SUCCESS;
+        }
+
+        //headless fixed timestep clock check (substeps, catch-up clamp, interpolation)
+        if(hasOption(argc, argv, "--check-clock"))
+                return SimulationClock::check() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        //headless SIMD matrix kernels check (same floats as the scalar kernels) and benchmark
+        if(hasOption(argc, argv, "--check-matrix"))
+                return Matrix::check() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        if(hasOption(argc, argv, "--bench-matrix")) {
+                Matrix::benchmark(5);
+                return EXIT_SUCCESS;
+        }
+
+#ifdef CHECK_ALLOCATIONS
+        //headless render tree traversal check (transforms, no allocation per frame)
+        if(hasOption(argc, argv, "--check-allocations"))
+                return RenderTree::checkAllocations() ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+
+        //headless Transvoxel transition cells tables check (the 512 cases)
+        if(hasOption(argc, argv, "--check-transvoxel"))
+                return Transvoxel::check() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+        //headless compact volume formats round trip check and memory report
+        if(hasOption(argc, argv, "--check-formats")) {
+                bool ok = VolumeEncoding::checkRoundTrip();
+                VolumeEncoding::logMemoryReport(128);
+                return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
         //cuda
         CudaUtils::logCudaDevices(log_console);
 
+        //particles simulated on the CPU even if a CUDA device is available
+        if(hasOption(argc, argv, "--cpu-particles"))
+                ParticleGroup::setDefaultBackend(ParticleGroup::CPU_BACKEND);
+
+        //one kernel launch per particle kernel, as before the kernel fusion
+        if(hasOption(argc, argv, "--no-kernel-fusion"))
+                ParticleGroup::setDefaultKernelFusion(false);
+
+        //seaweed springs solved as XPBD distance constraints, or implicitly (on the CPU)
+        SeeweedGroup::SpringsIntegration seeweedsIntegration = SeeweedGroup::EXPLICIT_SPRINGS;
+        if(hasOption(argc, argv, "--xpbd-seaweeds"))
+                seeweedsIntegration = SeeweedGroup::XPBD_SPRINGS;
+        if(hasOption(argc, argv, "--implicit-seaweeds")) {
+                seeweedsIntegration = SeeweedGroup::IMPLICIT_SPRINGS;
+                ParticleGroup::setDefaultBackend(ParticleGroup::CPU_BACKEND);
+        }
+
+        //offscreen EGL rendering along a camera path, per node CPU/GPU times written as CSV
+        //--headless [--frames n] [--csv file] [--state QGLViewer state file], combines with the other options
+        bool headless = hasOption(argc, argv, "--headless");
+#ifdef HAVE_EGL
+        int headlessFrames = atoi(optionValue(argc, argv, "--frames", "300"));
+        if(headless && headlessFrames <= 0) {
+                log_console.errorStream() << "--frames needs a positive number of frames !";
+                return EXIT_FAILURE;
+        }
+#else
+        if(headless) {
+                log_console.errorStream() << "--headless needs EGL, this build was made without it !";
+                return EXIT_FAILURE;
+        }
+#endif
+
         log_console.infoStream() << "[Rand Init] ";
         log_console.infoStream() << "[Logs Init] ";
 
-        // glut initialisation (mandatory) 
-        glutInit(&argc, argv);
-        log_console.infoStream() << "[Glut Init] ";
+        Viewer *viewer = 0;
+#ifdef HAVE_EGL
+        HeadlessRenderer *headlessRenderer = 0;
 
-        // Read command lines arguments.
-        QApplication application(argc,argv);
+        if(headless) {
+                headlessRenderer = new HeadlessRenderer(1280, 720);
+                Globals::camera = headlessRenderer->camera();
+        }
+        else
+#endif
+        {
+                // glut initialisation (mandatory, needs a display)
+                glutInit(&argc, argv);
+                log_console.infoStream() << "[Glut Init] ";
+        }
+
+        // Read command lines arguments (no GUI in headless mode)
+        QApplication application(argc,argv,!headless);
         log_console.infoStream() << "[Qt Init] ";
 
         // Instantiate the viewer (mandatory)
-        Viewer *viewer = new Viewer();
-        viewer->setWindowTitle("Sea diver");
-        viewer->show();
-        Globals::viewer = viewer;
+        if(!headless) {
+                viewer = new Viewer();
+                viewer->setWindowTitle("Sea diver");
+                viewer->show();
+                Globals::viewer = viewer;
+                Globals::camera = viewer->camera();
+        }
 
         //glew initialisation (mandatory)
+        //with the EGL context, a GLX build of GLEW reports the missing GLX display after loading the GL entry points
         log_console.infoStream() << "[Glew Init] " << glewGetErrorString(glewInit());
 
         //openal 
@@ -102,13 +276,62 @@ int main(int argc, char** argv) {
         waves->translate(0,0,0);
         root->addChild("vagues", waves);
 
-        //Terrain
-        MarchingCubes *terrain = new MarchingCubes(128,128,128,100.0f/128);
-        terrain->translate(-50,-65,-50);
-        root->addChild("terrain", terrain);
+        //Terrain : one 128^3 volume, or 32^3 voxels bricks streamed around the camera (same field and frame)
+        bool streamingTerrain = hasOption(argc, argv, "--streaming-terrain");
+        DensityVolume *terrainVolume = 0;
+
+        if(streamingTerrain) {
+                TerrainChunks *terrain = new TerrainChunks(100.0f/128, 32, 100.0f, 256);
+                terrain->setTriangleBudget(500000);
+                terrain->subtractSphere(qglviewer::Vec(50,60,50), 8.0f);
+                terrain->translate(-50,-65,-50);
+                root->addChild("terrain", terrain);
+
+                //CPU copy of the terrain density, for the particles collisions
+                terrainVolume = terrain->makeDensityVolume(129,129,129);
+        }
+        else {
+                //GPU meshed triangle soup, or CPU meshed shared vertices (--indexed-terrain), both log their mesh memory and vertex shader invocations
+                MarchingCubes *terrain = 0;
+                if(hasOption(argc, argv, "--indexed-terrain"))
+                        terrain = new MarchingCubes(128,128,128,100.0f/128, MarchingCubes::CPU_MESHING, MarchingCubes::INDEXED_MESH);
+                else
+                        terrain = new MarchingCubes(128,128,128,100.0f/128);
+                terrain->translate(-50,-65,-50);
+                root->addChild("terrain", terrain);
+
+                //GPU density field against its CPU version
+                if(hasOption(argc, argv, "--check-density"))
+                        return terrain->checkDensityField() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+                //GPU histopyramid meshing against the CPU one
+                if(hasOption(argc, argv, "--check-histopyramid")) {
+                        MarchingCubes *gpuTerrain = new MarchingCubes(128,128,128,100.0f/128, MarchingCubes::GPU_MESHING);
+                        bool passed = gpuTerrain->checkGpuMeshing();
+                        delete gpuTerrain;
+                        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+                }
+
+                //ray marched against cone traced ambient occlusion
+                if(hasOption(argc, argv, "--bench-ao")) {
+                        terrain->benchmarkAmbientOcclusion();
+                        return EXIT_SUCCESS;
+                }
+
+                //CPU copy of the terrain density, for the particles collisions
+                terrainVolume = terrain->makeDensityVolume();
+        }
+
+        //DynamicSystem drawing, immediate mode against batched VBOs
+        if(hasOption(argc, argv, "--bench-dynamic-draw")) {
+                DynamicSystem::drawBenchmark(20);
+                return EXIT_SUCCESS;
+        }
 
         //Bulles
-        BubblesGenerator *bubbles = new BubblesGenerator(100,50,500,10);
+        BubblesGenerator *bubbles = new BubblesGenerator(100,50,20.0f,10);
+        bubbles->addKernel(new TerrainCollision(terrainVolume));
+        bubbles->addKernel(new ParticleCollisions(0.15f, 0.3f));
         root->addChild("zParticles", bubbles);
 
         //Terrain2
@@ -116,14 +339,30 @@ int main(int argc, char** argv) {
         //terrain->rotate(qglviewer::Quaternion(qglviewer::Vec(1,0,0), 3.14/2)); 
         //root->addChild("terrain", terrain);
         
-        SeeweedGroup *seeweeds = new SeeweedGroup(20000,10,1.0f);
+        SeeweedGroup *seeweeds = new SeeweedGroup(20000,10,1.0f,seeweedsIntegration);
         for (int i = 0; i < 30; i++) {
                 seeweeds->spawnGroup(qglviewer::Vec(Random::randf(-45,40),-26,Random::randf(0,25)), 100, NULL, NULL);
         }
+        seeweeds->addKernel(new TerrainCollision(terrainVolume));
         seeweeds->releaseParticles();
         root->addChild("seeweeds", seeweeds);
 
 
+#ifdef HAVE_EGL
+        //Render offscreen along the camera path and exit
+        if(headless) {
+                headlessRenderer->addRenderable(root);
+                headlessRenderer->loadCameraPath(optionValue(argc, argv, "--state", ".qglviewer.xml"));
+                headlessRenderer->benchmark(headlessFrames, optionValue(argc, argv, "--csv", "headless.csv"));
+                delete headlessRenderer;
+
+                Audible::closeOpenALContext();
+                alutExit();
+
+                return EXIT_SUCCESS;
+        }
+#endif
+
         //Configure viewer
         viewer->addRenderable(root);
 
@@ -0,0 +1,118 @@
+
+#include "brickMesher.h"
+
+#include <algorithm>
+
+BrickMesher::BrickMesher(const MeshFunction &meshFunction, unsigned int maxResults) :
+	_meshFunction(meshFunction),
+	_stop(false),
+	_results(maxResults),
+	_queueDepth(0)
+{
+	_stats.queueDepth = 0;
+	_stats.resultsWaiting = 0;
+	_stats.jobsSubmitted = 0;
+	_stats.jobsCompleted = 0;
+	_stats.lastLatency = 0.0f;
+	_stats.averageLatency = 0.0f;
+	_stats.maxLatency = 0.0f;
+
+	_worker = std::thread(&BrickMesher::workerLoop, this);
+}
+
+BrickMesher::~BrickMesher() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_jobAvailable.notify_all();
+	_worker.join();
+
+	for (unsigned int i = 0; i < _jobs.size(); i++) {
+		delete _jobs[i];
+	}
+
+	Result *result;
+	while(_results.tryPop(result))
+		delete result;
+}
+
+void BrickMesher::submit(Job *job) {
+	job->submitTime = std::chrono::high_resolution_clock::now();
+	_queueDepth++;
+	_stats.jobsSubmitted++;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(job);
+	}
+	_jobAvailable.notify_one();
+}
+
+BrickMesher::Result *BrickMesher::pollResult() {
+	Result *result = 0;
+	if(_results.tryPop(result)) {
+		std::chrono::duration<double, std::milli> latency = std::chrono::high_resolution_clock::now() - result->submitTime;
+
+		_stats.jobsCompleted++;
+		_stats.lastLatency = latency.count();
+		_stats.averageLatency += (_stats.lastLatency - _stats.averageLatency)/_stats.jobsCompleted;
+		_stats.maxLatency = std::max(_stats.maxLatency, _stats.lastLatency);
+	}
+
+	_stats.queueDepth = _queueDepth.load();
+	_stats.resultsWaiting = _results.size();
+
+	return result;
+}
+
+unsigned int BrickMesher::getQueueDepth() const {
+	return _queueDepth.load();
+}
+
+const BrickMesher::Stats &BrickMesher::getStats() const {
+	return _stats;
+}
+
+void BrickMesher::workerLoop() {
+	while(true) {
+		Job *job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while(!_stop && _jobs.empty())
+				_jobAvailable.wait(lock);
+
+			if(_stop)
+				return;
+
+			job = _jobs.front();
+			_jobs.pop_front();
+		}
+
+		Result *result = new Result;
+		result->i = job->i;
+		result->j = job->j;
+		result->k = job->k;
+		result->lod = job->lod;
+		result->seams = job->seams;
+		result->ticket = job->ticket;
+		result->submitTime = job->submitTime;
+
+		_meshFunction(*job, *result);
+		delete job;
+
+		//the render thread drains the queue every frame, wait for room
+		while(!_results.tryPush(result)) {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if(_stop) {
+					delete result;
+					return;
+				}
+			}
+			std::this_thread::yield();
+		}
+
+		_queueDepth--;
+	}
+}
@@ -0,0 +1,89 @@
+
+#ifndef BRICKMESHER_H
+#define BRICKMESHER_H
+
+#include "spscQueue.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+// Background meshing of TerrainChunks bricks
+// The render thread submits jobs (a copy of the brick density, or for a new brick the function
+// that evaluates it) to a job queue consumed by one background thread, which spreads the work of
+// each job over ThreadPool::global().
+// Finished meshes go back through a lock-free single producer single consumer queue and are
+// polled by the render thread at frame start, so a brick keeps drawing its previous mesh until
+// the new one is complete : no GL call and no lock on the render thread side.
+class BrickMesher {
+
+	public:
+		struct Job {
+			int i, j, k;
+			unsigned int lod, seams;
+			unsigned long ticket;          //latest ticket of a brick wins, older results are dropped
+			std::vector<float> density;    //brick samples, apron included
+			//new brick : density is left empty, the mesh function fills Result::density with this
+			std::function<void(std::vector<float> &density)> generateDensity;
+			std::chrono::high_resolution_clock::time_point submitTime;
+		};
+
+		struct Result {
+			int i, j, k;
+			unsigned int lod, seams;
+			unsigned long ticket;
+			std::vector<float> vertices;
+			std::vector<unsigned int> indices;
+			std::vector<float> density;    //generateDensity jobs only
+			unsigned int fullResolutionTriangles;
+			std::chrono::high_resolution_clock::time_point submitTime;
+		};
+
+		//updated by pollResult, latencies in ms from submit to poll
+		struct Stats {
+			unsigned int queueDepth;        //jobs submitted and not finished yet
+			unsigned int resultsWaiting;    //finished meshes not polled yet
+			unsigned long jobsSubmitted;
+			unsigned long jobsCompleted;
+			float lastLatency;
+			float averageLatency;
+			float maxLatency;
+		};
+
+		typedef std::function<void(const Job &job, Result &result)> MeshFunction;
+
+		//meshFunction is called on the background thread, it must only read its job
+		explicit BrickMesher(const MeshFunction &meshFunction, unsigned int maxResults = 256);
+		~BrickMesher();
+
+		//render thread only
+		void submit(Job *job); //takes ownership
+		Result *pollResult();  //0 when there is none, the caller deletes it
+
+		unsigned int getQueueDepth() const;
+		const Stats &getStats() const;
+
+	private:
+		MeshFunction _meshFunction;
+
+		std::deque<Job*> _jobs;
+		std::mutex _mutex;
+		std::condition_variable _jobAvailable;
+		bool _stop;
+
+		SpscQueue<Result*> _results;
+		std::atomic<unsigned int> _queueDepth;
+
+		Stats _stats;
+
+		std::thread _worker;
+
+		void workerLoop();
+};
+
+#endif /* end of include guard: BRICKMESHER_H */
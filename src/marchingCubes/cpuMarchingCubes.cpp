@@ -0,0 +1,585 @@
+
+#include "headers.h"
+#include "cpuMarchingCubes.h"
+#include "mc_utils.h"
+#include "threadPool.h"
+#include "histoPyramid.h"
+#include "log.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+std::once_flag CpuMarchingCubes::_initFlag;
+unsigned char CpuMarchingCubes::_edgeCornerA[12];
+unsigned char CpuMarchingCubes::_edgeCornerB[12];
+
+//same corner numbering as f0123 and f4567 in marchingCube_vs.glsl
+unsigned int CpuMarchingCubes::_cornerOffset[8][3] = {
+	{0,0,0}, {0,1,0}, {1,1,0}, {1,0,0},
+	{0,0,1}, {0,1,1}, {1,1,1}, {1,0,1}
+};
+
+//indexed mode : every edge is owned by the sample at its start (edgeStart)
+//and stored in one of the 3 slots of that sample (edge 0 = Y, 3 = X, 8 = Z)
+unsigned int CpuMarchingCubes::_edgeOwnerOffset[12][3];
+unsigned int CpuMarchingCubes::_edgeSlot[12];
+
+namespace {
+	//the vertex shader uses uint(clamp(f*99999, 0.0, 1.0))
+	inline bool isInside(float density) {
+		return density*99999.0f >= 1.0f;
+	}
+
+	//movemask bits -> one byte (0 or 1) per bit
+	uint64_t expandBits8[256];
+}
+
+CpuMarchingCubes::CpuMarchingCubes(unsigned int width, unsigned int height, unsigned int length,
+		float voxelWidth, float voxelHeight, float voxelLength) :
+	_width(width), _height(height), _length(length),
+	_voxelGridWidth(width-1), _voxelGridHeight(height-1), _voxelGridLength(length-1),
+	_voxelWidth(voxelWidth), _voxelHeight(voxelHeight), _voxelLength(voxelLength),
+	_rowStride(0)
+{
+	std::call_once(_initFlag, initTables);
+
+	//rows are read 16 bytes at a time at offset i and i+1
+	_rowStride = 16*((_width + 16)/16 + 1);
+
+	memset(&_stats, 0, sizeof(Stats));
+}
+
+CpuMarchingCubes::~CpuMarchingCubes() {
+}
+
+const CpuMarchingCubes::Stats &CpuMarchingCubes::getStats() const {
+	return _stats;
+}
+
+void CpuMarchingCubes::march(const float *density, std::vector<float> &worldPos) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	ThreadPool &pool = ThreadPool::global();
+
+	unsigned int nSlabs = std::min(_voxelGridLength, 4*(pool.getThreadCount() + 1));
+	unsigned int slabSize = (_voxelGridLength + nSlabs - 1)/nSlabs;
+	std::vector<std::vector<float> > slabs(nSlabs);
+
+	pool.parallelFor(0, nSlabs, [&](unsigned int s0, unsigned int s1) {
+		for (unsigned int s = s0; s < s1; s++) {
+			unsigned int kBegin = s*slabSize;
+			unsigned int kEnd = std::min(_voxelGridLength, kBegin + slabSize);
+			if(kBegin < kEnd)
+				marchSlab(density, kBegin, kEnd, slabs[s]);
+		}
+	});
+
+	size_t nFloats = 0;
+	for (unsigned int s = 0; s < nSlabs; s++) {
+		nFloats += slabs[s].size();
+	}
+
+	worldPos.clear();
+	worldPos.reserve(nFloats);
+	for (unsigned int s = 0; s < nSlabs; s++) {
+		worldPos.insert(worldPos.end(), slabs[s].begin(), slabs[s].end());
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	_stats.nTriangles = nFloats/9;
+	_stats.nVertices = 3*_stats.nTriangles;
+	_stats.totalTime = elapsed.count();
+	_stats.trianglesPerSecond = _stats.nTriangles/(elapsed.count()*1.0e-3);
+}
+
+void CpuMarchingCubes::marchIndexed(const float *density, std::vector<float> &vertices, std::vector<unsigned int> &indices) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	ThreadPool &pool = ThreadPool::global();
+	const size_t planeSize = _width*_height;
+
+	//vertex id of each crossed edge, 3 slots per sample (only crossed edges are written)
+	std::unique_ptr<unsigned int[]> edgeVertex(new unsigned int[3*planeSize*_length]);
+
+	//1. one vertex per crossed edge, numbered locally in each slab of sample planes
+	unsigned int nSlabs = std::min(_length, 4*(pool.getThreadCount() + 1));
+	unsigned int slabSize = (_length + nSlabs - 1)/nSlabs;
+	std::vector<std::vector<float> > slabVertices(nSlabs);
+
+	pool.parallelFor(0, nSlabs, [&](unsigned int s0, unsigned int s1) {
+		for (unsigned int s = s0; s < s1; s++) {
+			unsigned int kBegin = s*slabSize;
+			unsigned int kEnd = std::min(_length, kBegin + slabSize);
+			if(kBegin < kEnd)
+				emitSlabVertices(density, kBegin, kEnd, edgeVertex.get(), slabVertices[s]);
+		}
+	});
+
+	//2. local ids -> global ids
+	std::vector<unsigned int> slabOffset(nSlabs, 0);
+	size_t nFloats = 0;
+	for (unsigned int s = 0; s < nSlabs; s++) {
+		slabOffset[s] = nFloats/3;
+		nFloats += slabVertices[s].size();
+	}
+
+	vertices.resize(nFloats);
+	pool.parallelFor(0, nSlabs, [&](unsigned int s0, unsigned int s1) {
+		for (unsigned int s = s0; s < s1; s++) {
+			unsigned int kBegin = s*slabSize;
+			unsigned int kEnd = std::min(_length, kBegin + slabSize);
+			if(kBegin >= kEnd)
+				continue;
+
+			//entries of non crossed edges are garbage anyway
+			unsigned int *first = edgeVertex.get() + 3*kBegin*planeSize;
+			unsigned int *last = edgeVertex.get() + 3*kEnd*planeSize;
+			for (unsigned int *id = first; id != last; ++id) {
+				*id += slabOffset[s];
+			}
+
+			if(!slabVertices[s].empty())
+				memcpy(&vertices[3*slabOffset[s]], &slabVertices[s][0], slabVertices[s].size()*sizeof(float));
+		}
+	});
+
+	//3. triangles reference the vertices of the edges they cross
+	unsigned int nVoxelSlabs = std::min(_voxelGridLength, 4*(pool.getThreadCount() + 1));
+	unsigned int voxelSlabSize = (_voxelGridLength + nVoxelSlabs - 1)/nVoxelSlabs;
+	std::vector<std::vector<unsigned int> > slabIndices(nVoxelSlabs);
+
+	pool.parallelFor(0, nVoxelSlabs, [&](unsigned int s0, unsigned int s1) {
+		for (unsigned int s = s0; s < s1; s++) {
+			unsigned int kBegin = s*voxelSlabSize;
+			unsigned int kEnd = std::min(_voxelGridLength, kBegin + voxelSlabSize);
+			if(kBegin < kEnd)
+				emitSlabIndices(density, kBegin, kEnd, edgeVertex.get(), slabIndices[s]);
+		}
+	});
+
+	size_t nIndices = 0;
+	for (unsigned int s = 0; s < nVoxelSlabs; s++) {
+		nIndices += slabIndices[s].size();
+	}
+
+	indices.clear();
+	indices.reserve(nIndices);
+	for (unsigned int s = 0; s < nVoxelSlabs; s++) {
+		indices.insert(indices.end(), slabIndices[s].begin(), slabIndices[s].end());
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	_stats.nTriangles = nIndices/3;
+	_stats.nVertices = nFloats/3;
+	_stats.totalTime = elapsed.count();
+	_stats.trianglesPerSecond = _stats.nTriangles/(elapsed.count()*1.0e-3);
+}
+
+void CpuMarchingCubes::marchCompact(const float *density, std::vector<float> &worldPos) {
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+	ThreadPool &pool = ThreadPool::global();
+	const size_t nVoxels = (size_t)_voxelGridWidth*_voxelGridHeight*_voxelGridLength;
+
+	//1. classification (case per voxel) and counts
+	std::vector<unsigned char> cases(nVoxels), counts(nVoxels);
+	pool.parallelFor(0, _voxelGridLength, [&](unsigned int k0, unsigned int k1) {
+		classifySlab(density, k0, k1, &cases[(size_t)k0*_voxelGridWidth*_voxelGridHeight]);
+
+		for (size_t v = (size_t)k0*_voxelGridWidth*_voxelGridHeight; v < (size_t)k1*_voxelGridWidth*_voxelGridHeight; v++) {
+			counts[v] = MarchingCube::caseToNumPoly[4*cases[v]];
+		}
+	});
+
+	//2. reduction
+	HistoPyramid pyramid(_voxelGridWidth, _voxelGridHeight, _voxelGridLength);
+	pyramid.build(&counts[0]);
+	unsigned int nTriangles = pyramid.getTotal();
+
+	//3. one independent write per triangle
+	worldPos.resize(9*(size_t)nTriangles);
+	pool.parallelFor(0, nTriangles, [&](unsigned int t0, unsigned int t1) {
+		for (unsigned int t = t0; t < t1; t++) {
+			unsigned int voxel, rank;
+			pyramid.find(t, voxel, rank);
+
+			unsigned int i = voxel % _voxelGridWidth;
+			unsigned int j = (voxel / _voxelGridWidth) % _voxelGridHeight;
+			unsigned int k = voxel / (_voxelGridWidth*_voxelGridHeight);
+			emitTriangle(density, i, j, k, cases[voxel], rank, &worldPos[9*(size_t)t]);
+		}
+	}, 1024);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	_stats.nTriangles = nTriangles;
+	_stats.nVertices = 3*nTriangles;
+	_stats.totalTime = elapsed.count();
+	_stats.trianglesPerSecond = _stats.nTriangles/(elapsed.count()*1.0e-3);
+}
+
+void CpuMarchingCubes::classifySlab(const float *density, unsigned int kBegin, unsigned int kEnd, unsigned char *cases) const {
+
+	const size_t planeSize = _width*_height;
+	std::vector<unsigned char> insidePlanes(2*_rowStride*_height, 0);
+	std::vector<unsigned char> rowCases(_rowStride, 0);
+
+	unsigned char *inside[2] = {&insidePlanes[0], &insidePlanes[_rowStride*_height]};
+	classifyPlane(density + kBegin*planeSize, inside[0]);
+
+	for (unsigned int k = kBegin; k < kEnd; k++) {
+		classifyPlane(density + (k+1)*planeSize, inside[1]);
+
+		for (unsigned int j = 0; j < _voxelGridHeight; j++) {
+			computeCases(
+					inside[0] + j*_rowStride, inside[0] + (j+1)*_rowStride,
+					inside[1] + j*_rowStride, inside[1] + (j+1)*_rowStride,
+					&rowCases[0]);
+
+			memcpy(cases + ((k - kBegin)*_voxelGridHeight + j)*_voxelGridWidth, &rowCases[0], _voxelGridWidth);
+		}
+
+		std::swap(inside[0], inside[1]);
+	}
+}
+
+unsigned int CpuMarchingCubes::countTriangles(const float *density) const {
+
+	const size_t planeSize = _width*_height;
+	std::vector<unsigned char> insidePlanes(2*_rowStride*_height, 0);
+	std::vector<unsigned char> cases(_rowStride, 0);
+
+	unsigned char *inside[2] = {&insidePlanes[0], &insidePlanes[_rowStride*_height]};
+	classifyPlane(density, inside[0]);
+
+	unsigned int nTriangles = 0;
+	for (unsigned int k = 0; k < _voxelGridLength; k++) {
+		classifyPlane(density + (k+1)*planeSize, inside[1]);
+
+		for (unsigned int j = 0; j < _voxelGridHeight; j++) {
+			computeCases(
+					inside[0] + j*_rowStride, inside[0] + (j+1)*_rowStride,
+					inside[1] + j*_rowStride, inside[1] + (j+1)*_rowStride,
+					&cases[0]);
+
+			for (unsigned int i = 0; i < _voxelGridWidth; i++) {
+				nTriangles += MarchingCube::caseToNumPoly[4*cases[i]];
+			}
+		}
+
+		std::swap(inside[0], inside[1]);
+	}
+
+	return nTriangles;
+}
+
+void CpuMarchingCubes::marchSlab(const float *density, unsigned int kBegin, unsigned int kEnd, std::vector<float> &out) const {
+
+	const size_t planeSize = _width*_height;
+	std::vector<unsigned char> insidePlanes(2*_rowStride*_height, 0);
+	std::vector<unsigned char> cases(_rowStride, 0);
+
+	unsigned char *inside[2] = {&insidePlanes[0], &insidePlanes[_rowStride*_height]};
+	classifyPlane(density + kBegin*planeSize, inside[0]);
+
+	for (unsigned int k = kBegin; k < kEnd; k++) {
+		classifyPlane(density + (k+1)*planeSize, inside[1]);
+
+		for (unsigned int j = 0; j < _voxelGridHeight; j++) {
+			computeCases(
+					inside[0] + j*_rowStride, inside[0] + (j+1)*_rowStride,
+					inside[1] + j*_rowStride, inside[1] + (j+1)*_rowStride,
+					&cases[0]);
+
+			for (unsigned int i = 0; i < _voxelGridWidth; i++) {
+				unsigned char caseId = cases[i];
+				if(caseId != 0 && caseId != 255)
+					emitTriangles(density, i, j, k, caseId, out);
+			}
+		}
+
+		std::swap(inside[0], inside[1]);
+	}
+}
+
+void CpuMarchingCubes::emitSlabVertices(const float *density, unsigned int kBegin, unsigned int kEnd,
+		unsigned int *edgeVertex, std::vector<float> &out) const {
+
+	const size_t planeSize = _width*_height;
+	const size_t neighbour[3] = {_width, 1, planeSize}; //slots 0 (Y), 1 (X), 2 (Z)
+
+	for (unsigned int k = kBegin; k < kEnd; k++) {
+		for (unsigned int j = 0; j < _height; j++) {
+			for (unsigned int i = 0; i < _width; i++) {
+				size_t idx = k*planeSize + j*_width + i;
+				float dA = density[idx];
+				bool insideA = isInside(dA);
+				bool hasNeighbour[3] = {j+1 < _height, i+1 < _width, k+1 < _length};
+
+				for (unsigned int slot = 0; slot < 3; slot++) {
+					if(!hasNeighbour[slot])
+						continue;
+
+					float dB = density[idx + neighbour[slot]];
+					if(isInside(dB) == insideA)
+						continue;
+
+					float t = std::min(std::max(dA/(dA - dB), 0.0f), 1.0f);
+					edgeVertex[3*idx + slot] = out.size()/3;
+
+					out.push_back((i + (slot == 1 ? t : 0.0f))*_voxelWidth);
+					out.push_back((j + (slot == 0 ? t : 0.0f))*_voxelHeight);
+					out.push_back((k + (slot == 2 ? t : 0.0f))*_voxelLength);
+				}
+			}
+		}
+	}
+}
+
+void CpuMarchingCubes::emitSlabIndices(const float *density, unsigned int kBegin, unsigned int kEnd,
+		const unsigned int *edgeVertex, std::vector<unsigned int> &out) const {
+
+	const size_t planeSize = _width*_height;
+	std::vector<unsigned char> insidePlanes(2*_rowStride*_height, 0);
+	std::vector<unsigned char> cases(_rowStride, 0);
+
+	unsigned char *inside[2] = {&insidePlanes[0], &insidePlanes[_rowStride*_height]};
+	classifyPlane(density + kBegin*planeSize, inside[0]);
+
+	for (unsigned int k = kBegin; k < kEnd; k++) {
+		classifyPlane(density + (k+1)*planeSize, inside[1]);
+
+		for (unsigned int j = 0; j < _voxelGridHeight; j++) {
+			computeCases(
+					inside[0] + j*_rowStride, inside[0] + (j+1)*_rowStride,
+					inside[1] + j*_rowStride, inside[1] + (j+1)*_rowStride,
+					&cases[0]);
+
+			for (unsigned int i = 0; i < _voxelGridWidth; i++) {
+				unsigned char caseId = cases[i];
+				if(caseId == 0 || caseId == 255)
+					continue;
+
+				unsigned int numPolys = MarchingCube::caseToNumPoly[4*caseId];
+				const GLint *triangles = MarchingCube::triangleTable + 4*5*caseId;
+
+				for (unsigned int n = 0; n < 3*numPolys; n++) {
+					int edge = triangles[4*(n/3) + n%3];
+					size_t owner = (k + _edgeOwnerOffset[edge][2])*planeSize
+						+ (j + _edgeOwnerOffset[edge][1])*_width
+						+ (i + _edgeOwnerOffset[edge][0]);
+					out.push_back(edgeVertex[3*owner + _edgeSlot[edge]]);
+				}
+			}
+		}
+
+		std::swap(inside[0], inside[1]);
+	}
+}
+
+void CpuMarchingCubes::classifyPlane(const float *densityPlane, unsigned char *insidePlane) const {
+
+	for (unsigned int j = 0; j < _height; j++) {
+		const float *row = densityPlane + j*_width;
+		unsigned char *insideRow = insidePlane + j*_rowStride;
+		unsigned int i = 0;
+
+#if defined(__AVX__)
+		const __m256 scale = _mm256_set1_ps(99999.0f);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		for (; i + 8 <= _width; i += 8) {
+			__m256 d = _mm256_mul_ps(_mm256_loadu_ps(row + i), scale);
+			int mask = _mm256_movemask_ps(_mm256_cmp_ps(d, one, _CMP_GE_OQ));
+			memcpy(insideRow + i, &expandBits8[mask], 8);
+		}
+#elif defined(__SSE2__)
+		const __m128 scale = _mm_set1_ps(99999.0f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		for (; i + 4 <= _width; i += 4) {
+			__m128 d = _mm_mul_ps(_mm_loadu_ps(row + i), scale);
+			int mask = _mm_movemask_ps(_mm_cmpge_ps(d, one));
+			memcpy(insideRow + i, &expandBits8[mask], 4);
+		}
+#endif
+		for (; i < _width; i++) {
+			insideRow[i] = isInside(row[i]);
+		}
+	}
+}
+
+void CpuMarchingCubes::computeCases(const unsigned char *r0, const unsigned char *r1,
+		const unsigned char *r2, const unsigned char *r3, unsigned char *cases) const {
+
+	//r0 = (y,z) r1 = (y+1,z) r2 = (y,z+1) r3 = (y+1,z+1)
+	//bit n of the case is the inside flag of corner n
+	unsigned int i = 0;
+
+#ifdef __SSE2__
+	for (; i < _voxelGridWidth; i += 16) {
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(r0 + i));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(r1 + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(r1 + i + 1));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(r0 + i + 1));
+		__m128i a2 = _mm_loadu_si128((const __m128i*)(r2 + i));
+		__m128i a3 = _mm_loadu_si128((const __m128i*)(r3 + i));
+		__m128i b3 = _mm_loadu_si128((const __m128i*)(r3 + i + 1));
+		__m128i b2 = _mm_loadu_si128((const __m128i*)(r2 + i + 1));
+
+		//flags are 0 or 1, 16 bit shifts never carry between bytes
+		__m128i c = _mm_or_si128(
+				_mm_or_si128(
+					_mm_or_si128(a0, _mm_slli_epi16(a1, 1)),
+					_mm_or_si128(_mm_slli_epi16(b1, 2), _mm_slli_epi16(b0, 3))),
+				_mm_or_si128(
+					_mm_or_si128(_mm_slli_epi16(a2, 4), _mm_slli_epi16(a3, 5)),
+					_mm_or_si128(_mm_slli_epi16(b3, 6), _mm_slli_epi16(b2, 7))));
+
+		_mm_storeu_si128((__m128i*)(cases + i), c);
+	}
+#else
+	for (; i < _voxelGridWidth; i++) {
+		cases[i] = (r0[i] << 0) | (r1[i] << 1) | (r1[i+1] << 2) | (r0[i+1] << 3)
+			| (r2[i] << 4) | (r3[i] << 5) | (r3[i+1] << 6) | (r2[i+1] << 7);
+	}
+#endif
+}
+
+void CpuMarchingCubes::emitTriangles(const float *density, unsigned int i, unsigned int j, unsigned int k,
+		unsigned char caseId, std::vector<float> &out) const {
+
+	float f[8];
+	for (unsigned int c = 0; c < 8; c++) {
+		f[c] = density[((k + _cornerOffset[c][2])*_height + j + _cornerOffset[c][1])*_width + i + _cornerOffset[c][0]];
+	}
+
+	unsigned int numPolys = MarchingCube::caseToNumPoly[4*caseId];
+	const GLint *triangles = MarchingCube::triangleTable + 4*5*caseId;
+
+	for (unsigned int n = 0; n < numPolys; n++) {
+		for (unsigned int v = 0; v < 3; v++) {
+			int edge = triangles[4*n + v];
+
+			float dA = f[_edgeCornerA[edge]];
+			float dB = f[_edgeCornerB[edge]];
+			float t = std::min(std::max(dA/(dA - dB), 0.0f), 1.0f);
+
+			out.push_back((i + MarchingCube::edgeStart[4*edge+0] + t*MarchingCube::edgeDir[4*edge+0])*_voxelWidth);
+			out.push_back((j + MarchingCube::edgeStart[4*edge+1] + t*MarchingCube::edgeDir[4*edge+1])*_voxelHeight);
+			out.push_back((k + MarchingCube::edgeStart[4*edge+2] + t*MarchingCube::edgeDir[4*edge+2])*_voxelLength);
+		}
+	}
+}
+
+void CpuMarchingCubes::emitTriangle(const float *density, unsigned int i, unsigned int j, unsigned int k,
+		unsigned char caseId, unsigned int rank, float *out) const {
+
+	float f[8];
+	for (unsigned int c = 0; c < 8; c++) {
+		f[c] = density[((k + _cornerOffset[c][2])*_height + j + _cornerOffset[c][1])*_width + i + _cornerOffset[c][0]];
+	}
+
+	const GLint *triangle = MarchingCube::triangleTable + 4*5*caseId + 4*rank;
+
+	for (unsigned int v = 0; v < 3; v++) {
+		int edge = triangle[v];
+
+		float dA = f[_edgeCornerA[edge]];
+		float dB = f[_edgeCornerB[edge]];
+		float t = std::min(std::max(dA/(dA - dB), 0.0f), 1.0f);
+
+		out[3*v+0] = (i + MarchingCube::edgeStart[4*edge+0] + t*MarchingCube::edgeDir[4*edge+0])*_voxelWidth;
+		out[3*v+1] = (j + MarchingCube::edgeStart[4*edge+1] + t*MarchingCube::edgeDir[4*edge+1])*_voxelHeight;
+		out[3*v+2] = (k + MarchingCube::edgeStart[4*edge+2] + t*MarchingCube::edgeDir[4*edge+2])*_voxelLength;
+	}
+}
+
+void CpuMarchingCubes::initTables() {
+
+	//edge extremities are given by the density masks of the geometry shader
+	for (unsigned int e = 0; e < 12; e++) {
+		for (unsigned int c = 0; c < 4; c++) {
+			if(MarchingCube::maskA0123[4*e+c] != 0.0f) _edgeCornerA[e] = c;
+			if(MarchingCube::maskA4567[4*e+c] != 0.0f) _edgeCornerA[e] = 4+c;
+			if(MarchingCube::maskB0123[4*e+c] != 0.0f) _edgeCornerB[e] = c;
+			if(MarchingCube::maskB4567[4*e+c] != 0.0f) _edgeCornerB[e] = 4+c;
+		}
+	}
+
+	for (unsigned int e = 0; e < 12; e++) {
+		for (unsigned int c = 0; c < 3; c++) {
+			_edgeOwnerOffset[e][c] = (unsigned int) MarchingCube::edgeStart[4*e+c];
+		}
+		_edgeSlot[e] = MarchingCube::edgeDir[4*e+0] != 0.0f ? 1 : (MarchingCube::edgeDir[4*e+1] != 0.0f ? 0 : 2);
+	}
+
+	for (unsigned int mask = 0; mask < 256; mask++) {
+		uint64_t bytes = 0;
+		for (unsigned int b = 0; b < 8; b++) {
+			if(mask & (1u << b))
+				bytes |= (uint64_t)1 << (8*b);
+		}
+		expandBits8[mask] = bytes; //little endian
+	}
+}
+
+void CpuMarchingCubes::benchmark(unsigned int size, unsigned int nRuns) {
+
+	//ground + caves like field
+	std::vector<float> density(size*size*size);
+	for (unsigned int k = 0; k < size; k++) {
+		for (unsigned int j = 0; j < size; j++) {
+			for (unsigned int i = 0; i < size; i++) {
+				float x = (float)i/size - 0.5f, y = (float)j/size - 0.5f, z = (float)k/size - 0.5f;
+				density[(k*size + j)*size + i] = -y
+					+ 0.20f*sinf(13.0f*x)*cosf(11.0f*z)
+					+ 0.05f*sinf(41.0f*x + 7.0f*y)*sinf(37.0f*z)
+					- 0.30f*expf(-(x*x + (y+0.1f)*(y+0.1f))*40.0f);
+			}
+		}
+	}
+
+	CpuMarchingCubes mc(size, size, size, 100.0f/size, 100.0f/size, 100.0f/size);
+	std::vector<float> worldPos;
+
+	double bestTime = 1.0e30, totalTime = 0.0;
+	for (unsigned int r = 0; r < nRuns; r++) {
+		mc.march(&density[0], worldPos);
+		bestTime = std::min(bestTime, mc.getStats().totalTime);
+		totalTime += mc.getStats().totalTime;
+	}
+
+	unsigned int nTriangles = mc.getStats().nTriangles;
+	log_console.infoStream() << "[Marching Cube Benchmark] " << size << "^3 field, "
+		<< ThreadPool::global().getThreadCount() << " threads, " << nTriangles << " triangles.";
+	log_console.infoStream() << "[Marching Cube Benchmark] best " << bestTime << " ms, mean " << totalTime/nRuns << " ms, "
+		<< nTriangles/(bestTime*1.0e-3)/1.0e6 << " Mtriangles/s.";
+
+	//histopyramid pipeline, must give the very same triangles (in another order)
+	std::vector<float> compactPos;
+	bestTime = 1.0e30;
+	for (unsigned int r = 0; r < nRuns; r++) {
+		mc.marchCompact(&density[0], compactPos);
+		bestTime = std::min(bestTime, mc.getStats().totalTime);
+	}
+
+	typedef std::vector<float> Triangle;
+	std::vector<Triangle> reference, compact;
+	for (size_t t = 0; t < worldPos.size()/9; t++) {
+		reference.push_back(Triangle(worldPos.begin() + 9*t, worldPos.begin() + 9*(t+1)));
+	}
+	for (size_t t = 0; t < compactPos.size()/9; t++) {
+		compact.push_back(Triangle(compactPos.begin() + 9*t, compactPos.begin() + 9*(t+1)));
+	}
+	std::sort(reference.begin(), reference.end());
+	std::sort(compact.begin(), compact.end());
+
+	log_console.infoStream() << "[Marching Cube Benchmark] histopyramid : best " << bestTime << " ms, " 
+		<< mc.getStats().nTriangles << " triangles, " << (reference == compact ? "same" : "DIFFERENT") << " triangles as march().";
+}
@@ -0,0 +1,85 @@
+
+#ifndef CPUMARCHINGCUBES_H
+#define CPUMARCHINGCUBES_H
+
+#include <vector>
+#include <mutex>
+
+// CPU implementation of the marching cube shaders (marchingCube_vs.glsl)
+// Uses the same lookup tables (mc_utils.h) and outputs the same worldPos triangle stream
+// as the transform feedback of MarchingCubes::marchCubes().
+// Voxels are classified 8 (AVX) or 4 (SSE) samples at a time, cases are built
+// 16 voxels at a time, and Z slabs are processed in parallel by the global ThreadPool.
+class CpuMarchingCubes {
+
+	public:
+		struct Stats {
+			unsigned int nTriangles;
+			unsigned int nVertices;         //indexed mode only (3*nTriangles for triangle soups)
+			double totalTime;               //ms
+			double trianglesPerSecond;
+		};
+
+		//density grid of width*height*length samples (x first, then y, then z)
+		//=> (width-1)*(height-1)*(length-1) voxels
+		CpuMarchingCubes(unsigned int width, unsigned int height, unsigned int length,
+				float voxelWidth, float voxelHeight, float voxelLength);
+		~CpuMarchingCubes();
+
+		//triangle soup, 3 vertices per triangle, 3 floats per vertex
+		void march(const float *density, std::vector<float> &worldPos);
+
+		//shared vertices : each edge crossing is emitted once (3 floats per vertex)
+		//and identified by (sample, edge 0/3/8), triangles are 32 bits indices
+		void marchIndexed(const float *density, std::vector<float> &vertices, std::vector<unsigned int> &indices);
+
+		//same triangles as march(), extracted with the histopyramid pipeline :
+		//one classification pass, count reduction, then every triangle is written at its final offset
+		//(HistoPyramid traversal order, not march() order, the order of the GPU meshing)
+		void marchCompact(const float *density, std::vector<float> &worldPos);
+
+		//number of triangles march() would generate (cases only, single threaded)
+		unsigned int countTriangles(const float *density) const;
+
+		const Stats &getStats() const;
+
+		//mesh a size^3 synthetic field nRuns times and log triangles/s
+		static void benchmark(unsigned int size, unsigned int nRuns);
+
+	private:
+		unsigned int _width, _height, _length;
+		unsigned int _voxelGridWidth, _voxelGridHeight, _voxelGridLength;
+		float _voxelWidth, _voxelHeight, _voxelLength;
+
+		unsigned int _rowStride; //padded row size of the inside/outside planes
+		Stats _stats;
+
+		void marchSlab(const float *density, unsigned int kBegin, unsigned int kEnd, std::vector<float> &out) const;
+
+		void classifyPlane(const float *densityPlane, unsigned char *insidePlane) const;
+		void computeCases(const unsigned char *r0, const unsigned char *r1,
+				const unsigned char *r2, const unsigned char *r3, unsigned char *cases) const;
+
+		void emitTriangles(const float *density, unsigned int i, unsigned int j, unsigned int k,
+				unsigned char caseId, std::vector<float> &out) const;
+
+		//histopyramid pipeline
+		void classifySlab(const float *density, unsigned int kBegin, unsigned int kEnd, unsigned char *cases) const;
+		void emitTriangle(const float *density, unsigned int i, unsigned int j, unsigned int k,
+				unsigned char caseId, unsigned int rank, float *out) const;
+
+		//indexed mode
+		void emitSlabVertices(const float *density, unsigned int kBegin, unsigned int kEnd,
+				unsigned int *edgeVertex, std::vector<float> &out) const;
+		void emitSlabIndices(const float *density, unsigned int kBegin, unsigned int kEnd,
+				const unsigned int *edgeVertex, std::vector<unsigned int> &out) const;
+
+		//filled once, the meshers are built on the pool and brick mesher threads
+		static std::once_flag _initFlag;
+		static unsigned char _edgeCornerA[12], _edgeCornerB[12];
+		static unsigned int _cornerOffset[8][3];
+		static unsigned int _edgeOwnerOffset[12][3], _edgeSlot[12];
+		static void initTables();
+};
+
+#endif /* end of include guard: CPUMARCHINGCUBES_H */
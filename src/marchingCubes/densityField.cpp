@@ -0,0 +1,543 @@
+
+#include "densityField.h"
+#include "threadPool.h"
+#include "log.h"
+
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+//the AVX2 kernels are compiled with a target attribute, SSE2 builds dispatch to them at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DENSITY_FIELD_AVX2
+#define AVX2_FMA __attribute__((target("avx2,fma")))
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	//webgl-noise helpers, same constants as the shader
+	inline float mod289(float x) {
+		return x - floorf(x * (1.0f/289.0f)) * 289.0f;
+	}
+
+	inline float permute(float x) {
+		return mod289((x*34.0f + 1.0f)*x);
+	}
+
+	inline float clamp(float x, float a, float b) {
+		return std::min(std::max(x, a), b);
+	}
+
+	float ellipsoide(float x, float y, float z, const float center[3], const float r[3]) {
+		float vx = (x - center[0])/r[0], vy = (y - center[1])/r[1], vz = (z - center[2])/r[2];
+		return 1.0f - (vx*vx + vy*vy + vz*vz);
+	}
+
+	float pillar(float x, float y, float z, const float axe[3], const float origin[3], float r, float zmin, float zmax) {
+		float bx = x - origin[0], by = y - origin[1], bz = z - origin[2];
+		float length = sqrtf(axe[0]*axe[0] + axe[1]*axe[1] + axe[2]*axe[2]);
+		float cx = by*axe[2] - bz*axe[1], cy = bz*axe[0] - bx*axe[2], cz = bx*axe[1] - by*axe[0];
+		float dr = sqrtf(cx*cx + cy*cy + cz*cz)/length;
+		float dz = (bx*axe[0] + by*axe[1] + bz*axe[2])/length;
+
+		if(dr < r && dz >= zmin && dz <= zmax)
+			return 1.0f - dr*dr/(r*r);
+		else
+			return -10.0f;
+	}
+
+	//shader constants
+	const float ellipsoideCenter[3] = {0.0f, -0.2f, -0.25f};
+	const float ellipsoideRadius[3] = {0.45f, 0.2f, 0.2f};
+	const float pillarAxe[3] = {0.0f, -0.5f, -1.0f};
+	const float pillarOrigin[3] = {0.0f, -0.05f, 0.0f};
+	const unsigned int octaves = 9;
+
+#ifdef DENSITY_FIELD_AVX2
+	//8 lanes versions, built for AVX2/FMA whatever the build flags and only called on CPUs supporting
+	//them (see fillRows). Same steps as the scalar path but with fused multiply-adds : results differ
+	//from the scalar path by a few float roundings (see benchmark), the GPU rounds differently anyway (see compare).
+	//The noise is a long chain of dependent floor/mul/add : laneGroups groups of 8 samples go through
+	//each step together so that the CPU always has independent instructions to issue.
+	const unsigned int laneGroups = 2;
+
+	AVX2_FMA inline __m256 set1(float x) {
+		return _mm256_set1_ps(x);
+	}
+
+	AVX2_FMA inline __m256 mod289(__m256 x) {
+		return _mm256_fnmadd_ps(_mm256_floor_ps(_mm256_mul_ps(x, set1(1.0f/289.0f))), set1(289.0f), x);
+	}
+
+	AVX2_FMA inline __m256 permute(__m256 x) {
+		return mod289(_mm256_mul_ps(_mm256_fmadd_ps(x, set1(34.0f), set1(1.0f)), x));
+	}
+
+	AVX2_FMA inline __m256 absolute(__m256 x) {
+		return _mm256_andnot_ps(set1(-0.0f), x);
+	}
+
+	//+-1 with the sign of x
+	AVX2_FMA inline __m256 sign(__m256 x) {
+		return _mm256_or_ps(_mm256_and_ps(set1(-0.0f), x), set1(1.0f));
+	}
+
+	AVX2_FMA inline __m256 dot3(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz) {
+		return _mm256_fmadd_ps(az, bz, _mm256_fmadd_ps(ay, by, _mm256_mul_ps(ax, bx)));
+	}
+
+	//contribution of one simplex corner : p is its permutation, (x,y,z) the offset to it
+	AVX2_FMA inline __m256 cornerContribution(__m256 p, __m256 x, __m256 y, __m256 z) {
+		const float n_ = 0.142857142857f;
+		__m256 nsx = set1(n_*2.0f), nsy = set1(n_*0.5f - 1.0f), nsz = set1(n_);
+
+		__m256 j = _mm256_fnmadd_ps(set1(49.0f), _mm256_floor_ps(_mm256_mul_ps(_mm256_mul_ps(p, nsz), nsz)), p);
+		__m256 gx_ = _mm256_floor_ps(_mm256_mul_ps(j, nsz));
+		//j and gx_ are integers : j - 7*gx_ is exact, no floor needed
+		__m256 gy_ = _mm256_fnmadd_ps(set1(7.0f), gx_, j);
+
+		__m256 gx = _mm256_fmadd_ps(gx_, nsx, nsy);
+		__m256 gy = _mm256_fmadd_ps(gy_, nsx, nsy);
+		__m256 h = _mm256_sub_ps(_mm256_sub_ps(set1(1.0f), absolute(gx)), absolute(gy));
+
+		//g += (floor(g)*2 + 1)*sh with sh = -step(h, 0) : |g| < 1 so floor(g)*2 + 1 is the sign of g,
+		//subtracted where h <= 0
+		__m256 flip = _mm256_cmp_ps(h, _mm256_setzero_ps(), _CMP_LE_OQ);
+		gx = _mm256_sub_ps(gx, _mm256_and_ps(flip, sign(gx)));
+		gy = _mm256_sub_ps(gy, _mm256_and_ps(flip, sign(gy)));
+
+		__m256 norm = _mm256_fnmadd_ps(set1(0.85373472095314f), dot3(gx, gy, h, gx, gy, h), set1(1.79284291400159f));
+
+		__m256 m = _mm256_max_ps(_mm256_sub_ps(set1(0.6f), dot3(x, y, z, x, y, z)), _mm256_setzero_ps());
+		m = _mm256_mul_ps(m, m);
+
+		return _mm256_mul_ps(_mm256_mul_ps(m, m), _mm256_mul_ps(norm, dot3(gx, gy, h, x, y, z)));
+	}
+
+	//adds the contribution of one corner to the G groups : (ox,oy,oz) is the corner offset in the lattice
+	//(null for the first corner), (x,y,z) the offset from the corner
+	template <unsigned int G>
+	AVX2_FMA inline void addCorner(const __m256 *ix, const __m256 *iy, const __m256 *iz,
+			const __m256 *ox, const __m256 *oy, const __m256 *oz,
+			const __m256 *x, const __m256 *y, const __m256 *z, __m256 *noise) {
+		__m256 p[G];
+		for (unsigned int g = 0; g < G; g++)
+			p[g] = permute(ox ? _mm256_add_ps(iz[g], oz[g]) : iz[g]);
+		for (unsigned int g = 0; g < G; g++)
+			p[g] = permute(_mm256_add_ps(p[g], ox ? _mm256_add_ps(iy[g], oy[g]) : iy[g]));
+		for (unsigned int g = 0; g < G; g++)
+			p[g] = permute(_mm256_add_ps(p[g], ox ? _mm256_add_ps(ix[g], ox[g]) : ix[g]));
+		for (unsigned int g = 0; g < G; g++)
+			noise[g] = _mm256_add_ps(noise[g], cornerContribution(p[g], x[g], y[g], z[g]));
+	}
+
+	template <unsigned int G>
+	AVX2_FMA inline void snoise8(const __m256 *vx, const __m256 *vy, const __m256 *vz, __m256 *noise) {
+		const __m256 one = set1(1.0f), zero = _mm256_setzero_ps();
+		const __m256 Cx = set1(1.0f/6.0f), Cy = set1(1.0f/3.0f);
+
+		__m256 ix[G], iy[G], iz[G], x0[G], y0[G], z0[G];
+		__m256 i1x[G], i1y[G], i1z[G], i2x[G], i2y[G], i2z[G];
+		__m256 x[G], y[G], z[G], ones[G];
+
+		for (unsigned int g = 0; g < G; g++) {
+			//first corner
+			__m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(vx[g], vy[g]), vz[g]), Cy);
+			ix[g] = _mm256_floor_ps(_mm256_add_ps(vx[g], s));
+			iy[g] = _mm256_floor_ps(_mm256_add_ps(vy[g], s));
+			iz[g] = _mm256_floor_ps(_mm256_add_ps(vz[g], s));
+			__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(ix[g], iy[g]), iz[g]), Cx);
+			x0[g] = _mm256_add_ps(_mm256_sub_ps(vx[g], ix[g]), t);
+			y0[g] = _mm256_add_ps(_mm256_sub_ps(vy[g], iy[g]), t);
+			z0[g] = _mm256_add_ps(_mm256_sub_ps(vz[g], iz[g]), t);
+		}
+
+		for (unsigned int g = 0; g < G; g++) {
+			//other corners, g = step(x0.yzx, x0.xyz)
+			__m256 gx = _mm256_and_ps(_mm256_cmp_ps(x0[g], y0[g], _CMP_GE_OQ), one);
+			__m256 gy = _mm256_and_ps(_mm256_cmp_ps(y0[g], z0[g], _CMP_GE_OQ), one);
+			__m256 gz = _mm256_and_ps(_mm256_cmp_ps(z0[g], x0[g], _CMP_GE_OQ), one);
+			__m256 lx = _mm256_sub_ps(one, gx), ly = _mm256_sub_ps(one, gy), lz = _mm256_sub_ps(one, gz);
+
+			i1x[g] = _mm256_min_ps(gx, lz), i1y[g] = _mm256_min_ps(gy, lx), i1z[g] = _mm256_min_ps(gz, ly);
+			i2x[g] = _mm256_max_ps(gx, lz), i2y[g] = _mm256_max_ps(gy, lx), i2z[g] = _mm256_max_ps(gz, ly);
+
+			//permutations
+			ix[g] = mod289(ix[g]);
+			iy[g] = mod289(iy[g]);
+			iz[g] = mod289(iz[g]);
+
+			ones[g] = one;
+			noise[g] = zero;
+		}
+
+		//summed in the scalar loop order
+		addCorner<G>(ix, iy, iz, 0, 0, 0, x0, y0, z0, noise);
+
+		for (unsigned int g = 0; g < G; g++) {
+			x[g] = _mm256_add_ps(_mm256_sub_ps(x0[g], i1x[g]), Cx);
+			y[g] = _mm256_add_ps(_mm256_sub_ps(y0[g], i1y[g]), Cx);
+			z[g] = _mm256_add_ps(_mm256_sub_ps(z0[g], i1z[g]), Cx);
+		}
+		addCorner<G>(ix, iy, iz, i1x, i1y, i1z, x, y, z, noise);
+
+		for (unsigned int g = 0; g < G; g++) {
+			x[g] = _mm256_add_ps(_mm256_sub_ps(x0[g], i2x[g]), Cy);
+			y[g] = _mm256_add_ps(_mm256_sub_ps(y0[g], i2y[g]), Cy);
+			z[g] = _mm256_add_ps(_mm256_sub_ps(z0[g], i2z[g]), Cy);
+		}
+		addCorner<G>(ix, iy, iz, i2x, i2y, i2z, x, y, z, noise);
+
+		for (unsigned int g = 0; g < G; g++) {
+			x[g] = _mm256_sub_ps(x0[g], set1(0.5f));
+			y[g] = _mm256_sub_ps(y0[g], set1(0.5f));
+			z[g] = _mm256_sub_ps(z0[g], set1(0.5f));
+		}
+		addCorner<G>(ix, iy, iz, ones, ones, ones, x, y, z, noise);
+
+		for (unsigned int g = 0; g < G; g++)
+			noise[g] = _mm256_mul_ps(set1(42.0f), noise[g]);
+	}
+
+	//noise of the G groups at (f*x, f*y, f*z)
+	template <unsigned int G>
+	AVX2_FMA inline void snoise8(float f, const __m256 *x, const __m256 *y, const __m256 *z, __m256 *noise) {
+		__m256 fx[G], fy[G], fz[G];
+		for (unsigned int g = 0; g < G; g++) {
+			fx[g] = _mm256_mul_ps(set1(f), x[g]);
+			fy[g] = _mm256_mul_ps(set1(f), y[g]);
+			fz[g] = _mm256_mul_ps(set1(f), z[g]);
+		}
+		snoise8<G>(fx, fy, fz, noise);
+	}
+
+	AVX2_FMA inline __m256 ellipsoide8(__m256 x, __m256 y, __m256 z) {
+		__m256 vx = _mm256_div_ps(_mm256_sub_ps(x, set1(ellipsoideCenter[0])), set1(ellipsoideRadius[0]));
+		__m256 vy = _mm256_div_ps(_mm256_sub_ps(y, set1(ellipsoideCenter[1])), set1(ellipsoideRadius[1]));
+		__m256 vz = _mm256_div_ps(_mm256_sub_ps(z, set1(ellipsoideCenter[2])), set1(ellipsoideRadius[2]));
+		return _mm256_sub_ps(set1(1.0f), dot3(vx, vy, vz, vx, vy, vz));
+	}
+
+	AVX2_FMA inline __m256 pillar8(__m256 x, __m256 y, __m256 z, float r, float zmin, float zmax) {
+		const float *axe = pillarAxe;
+		float length = sqrtf(axe[0]*axe[0] + axe[1]*axe[1] + axe[2]*axe[2]);
+
+		__m256 bx = _mm256_sub_ps(x, set1(pillarOrigin[0]));
+		__m256 by = _mm256_sub_ps(y, set1(pillarOrigin[1]));
+		__m256 bz = _mm256_sub_ps(z, set1(pillarOrigin[2]));
+		__m256 ax = set1(axe[0]), ay = set1(axe[1]), az = set1(axe[2]);
+
+		__m256 cx = _mm256_fmsub_ps(by, az, _mm256_mul_ps(bz, ay));
+		__m256 cy = _mm256_fmsub_ps(bz, ax, _mm256_mul_ps(bx, az));
+		__m256 cz = _mm256_fmsub_ps(bx, ay, _mm256_mul_ps(by, ax));
+		__m256 dr = _mm256_div_ps(_mm256_sqrt_ps(dot3(cx, cy, cz, cx, cy, cz)), set1(length));
+		__m256 dz = _mm256_div_ps(dot3(bx, by, bz, ax, ay, az), set1(length));
+
+		__m256 inside = _mm256_and_ps(_mm256_cmp_ps(dr, set1(r), _CMP_LT_OQ),
+				_mm256_and_ps(_mm256_cmp_ps(dz, set1(zmin), _CMP_GE_OQ), _mm256_cmp_ps(dz, set1(zmax), _CMP_LE_OQ)));
+		__m256 value = _mm256_fnmadd_ps(_mm256_mul_ps(dr, dr), set1(1.0f/(r*r)), set1(1.0f));
+
+		return _mm256_blendv_ps(set1(-10.0f), value, inside);
+	}
+
+	AVX2_FMA inline __m256 clamp8(__m256 x, float a, float b) {
+		return _mm256_min_ps(_mm256_max_ps(x, set1(a)), set1(b));
+	}
+
+	//same steps as DensityField::evaluate, on G groups
+	template <unsigned int G>
+	AVX2_FMA inline void evaluate8(const __m256 *vx, const __m256 *vy, const __m256 *vz, __m256 *density) {
+		__m256 x[G], y[G], z[G], ox[G], oy[G], oz[G], n[G], n1[G];
+
+		for (unsigned int g = 0; g < G; g++) {
+			ox[g] = _mm256_sub_ps(vx[g], set1(0.5f));
+			oy[g] = _mm256_sub_ps(vy[g], set1(0.5f));
+			oz[g] = _mm256_sub_ps(vz[g], set1(0.5f));
+			density[g] = _mm256_sub_ps(_mm256_setzero_ps(), oy[g]);
+		}
+
+		snoise8<G>(0.004f, ox, oy, oz, n);
+		for (unsigned int g = 0; g < G; g++) {
+			__m256 offset = _mm256_mul_ps(set1(8.0f), n[g]);
+			x[g] = _mm256_add_ps(ox[g], offset);
+			y[g] = _mm256_add_ps(oy[g], offset);
+			z[g] = _mm256_add_ps(oz[g], offset);
+		}
+
+		float amp = 0.25f, freq = 1.0f;
+		for (unsigned int i = 0; i < octaves; i++) {
+			snoise8<G>(freq, x, y, z, n);
+			for (unsigned int g = 0; g < G; g++)
+				density[g] = _mm256_fmadd_ps(set1(amp), n[g], density[g]);
+			amp /= 2;
+			freq *= 2;
+		}
+
+		for (unsigned int g = 0; g < G; g++)
+			density[g] = _mm256_fmadd_ps(clamp8(_mm256_sub_ps(set1(-0.1f), oy[g]), 0.0f, 1.0f), set1(10.0f), density[g]);
+
+		const float scales[4] = {10.0f, 20.0f, 40.0f, 100.0f};
+		const float amps[4] = {0.1f, 0.05f, 0.025f, 0.01f};
+		for (unsigned int i = 0; i < 4; i++) {
+			snoise8<G>(scales[i], ox, oy, oz, n);
+			for (unsigned int g = 0; g < G; g++)
+				n1[g] = (i == 0 ? _mm256_mul_ps(set1(amps[i]), n[g]) : _mm256_fmadd_ps(set1(amps[i]), n[g], n1[g]));
+		}
+		snoise8<G>(5.0f, ox, oy, oz, n);
+
+		for (unsigned int g = 0; g < G; g++) {
+			__m256 n2 = _mm256_fmadd_ps(set1(0.2f), n[g], n1[g]);
+
+			density[g] = _mm256_min_ps(density[g], _mm256_sub_ps(n2, ellipsoide8(ox[g], oy[g], oz[g])));
+			density[g] = _mm256_min_ps(density[g], _mm256_fmadd_ps(set1(-0.2f), pillar8(ox[g], oy[g], oz[g], 0.025f, -0.1f, 0.3f), n1[g]));
+			density[g] = _mm256_fmadd_ps(clamp8(_mm256_sub_ps(set1(-0.3f), oy[g]), 0.0f, 1.0f), set1(10.0f), density[g]);
+		}
+	}
+
+	//samples x = origin + (i + pixelCenter)*step of one row, returns how many were computed (a multiple of 8)
+	AVX2_FMA unsigned int fillRow8(float *row, unsigned int width, float origin, float pixelCenter, float step, float y, float z) {
+		const unsigned int G = laneGroups;
+		const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		__m256 vx[G], vy[G], vz[G], density[G];
+
+		for (unsigned int g = 0; g < G; g++) {
+			vy[g] = set1(y);
+			vz[g] = set1(z);
+		}
+
+		//same rounding as the scalar coordinates (no FMA)
+		unsigned int i = 0;
+		for (; i + 8*G <= width; i += 8*G) {
+			for (unsigned int g = 0; g < G; g++) {
+				__m256 index = _mm256_add_ps(set1(i + 8*g + pixelCenter), lane);
+				vx[g] = _mm256_add_ps(set1(origin), _mm256_mul_ps(index, set1(step)));
+			}
+			evaluate8<G>(vx, vy, vz, density);
+			for (unsigned int g = 0; g < G; g++)
+				_mm256_storeu_ps(row + i + 8*g, density[g]);
+		}
+
+		for (; i + 8 <= width; i += 8) {
+			__m256 index = _mm256_add_ps(set1(i + pixelCenter), lane);
+			vx[0] = _mm256_add_ps(set1(origin), _mm256_mul_ps(index, set1(step)));
+			evaluate8<1>(vx, vy, vz, density);
+			_mm256_storeu_ps(row + i, density[0]);
+		}
+
+		return i;
+	}
+#endif
+
+	bool cpuHasAVX2() {
+#ifdef DENSITY_FIELD_AVX2
+		static const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+		return avx2;
+#else
+		return false;
+#endif
+	}
+}
+
+float DensityField::snoise(float vx, float vy, float vz) {
+	const float Cx = 1.0f/6.0f, Cy = 1.0f/3.0f;
+
+	//first corner
+	float s = (vx + vy + vz)*Cy;
+	float i[3] = {floorf(vx + s), floorf(vy + s), floorf(vz + s)};
+	float t = (i[0] + i[1] + i[2])*Cx;
+	float x0[3] = {vx - i[0] + t, vy - i[1] + t, vz - i[2] + t};
+
+	//other corners
+	float g[3] = {x0[0] >= x0[1] ? 1.0f : 0.0f, x0[1] >= x0[2] ? 1.0f : 0.0f, x0[2] >= x0[0] ? 1.0f : 0.0f};
+	float l[3] = {1.0f - g[0], 1.0f - g[1], 1.0f - g[2]};
+	float i1[3] = {std::min(g[0], l[2]), std::min(g[1], l[0]), std::min(g[2], l[1])};
+	float i2[3] = {std::max(g[0], l[2]), std::max(g[1], l[0]), std::max(g[2], l[1])};
+
+	float x[4][3];
+	for (unsigned int c = 0; c < 3; c++) {
+		x[0][c] = x0[c];
+		x[1][c] = x0[c] - i1[c] + Cx;
+		x[2][c] = x0[c] - i2[c] + Cy;
+		x[3][c] = x0[c] - 0.5f;
+	}
+
+	//permutations
+	for (unsigned int c = 0; c < 3; c++) {
+		i[c] = mod289(i[c]);
+	}
+	const float cornerOffset[4][3] = {
+		{0.0f, 0.0f, 0.0f}, {i1[0], i1[1], i1[2]}, {i2[0], i2[1], i2[2]}, {1.0f, 1.0f, 1.0f}
+	};
+
+	//gradients : 7x7 points over a square, mapped onto an octahedron
+	const float n_ = 0.142857142857f;
+	const float ns[3] = {n_*2.0f, n_*0.5f - 1.0f, n_};
+
+	float noise = 0.0f;
+	for (unsigned int c = 0; c < 4; c++) {
+		float p = permute(permute(permute(i[2] + cornerOffset[c][2]) + i[1] + cornerOffset[c][1]) + i[0] + cornerOffset[c][0]);
+
+		float j = p - 49.0f*floorf(p*ns[2]*ns[2]);
+		float gx_ = floorf(j*ns[2]);
+		float gy_ = floorf(j - 7.0f*gx_);
+
+		float gx = gx_*ns[0] + ns[1];
+		float gy = gy_*ns[0] + ns[1];
+		float h = 1.0f - fabsf(gx) - fabsf(gy);
+
+		float sh = (h <= 0.0f ? -1.0f : 0.0f);
+		gx = gx + (floorf(gx)*2.0f + 1.0f)*sh;
+		gy = gy + (floorf(gy)*2.0f + 1.0f)*sh;
+
+		float norm = 1.79284291400159f - 0.85373472095314f*(gx*gx + gy*gy + h*h);
+
+		float m = std::max(0.6f - (x[c][0]*x[c][0] + x[c][1]*x[c][1] + x[c][2]*x[c][2]), 0.0f);
+		m = m*m;
+		noise += m*m*(norm*(gx*x[c][0] + gy*x[c][1] + h*x[c][2]));
+	}
+
+	return 42.0f*noise;
+}
+
+float DensityField::evaluate(float x, float y, float z) {
+	x -= 0.5f;
+	y -= 0.5f;
+	z -= 0.5f;
+	float ox = x, oy = y, oz = z;
+
+	float density = -y;
+
+	float warp = snoise(x*0.004f, y*0.004f, z*0.004f);
+	x += 8*warp;
+	y += 8*warp;
+	z += 8*warp;
+
+	float amp = 0.25f, freq = 1.0f;
+	for (unsigned int i = 0; i < octaves; i++) {
+		density += amp*snoise(freq*x, freq*y, freq*z);
+		amp /= 2;
+		freq *= 2;
+	}
+
+	density += clamp(-0.1f - oy, 0.0f, 1.0f)*10;
+
+	float n1 = 0.1f*snoise(10*ox, 10*oy, 10*oz) + 0.05f*snoise(20*ox, 20*oy, 20*oz)
+		+ 0.025f*snoise(40*ox, 40*oy, 40*oz) + 0.01f*snoise(100*ox, 100*oy, 100*oz);
+	float n2 = 0.2f*snoise(5*ox, 5*oy, 5*oz) + n1;
+
+	density = std::min(density, -ellipsoide(ox, oy, oz, ellipsoideCenter, ellipsoideRadius) + n2);
+	density = std::min(density, -0.2f*pillar(ox, oy, oz, pillarAxe, pillarOrigin, 0.025f, -0.1f, 0.3f) + n1);
+	density += clamp(-0.3f - oy, 0.0f, 1.0f)*10;
+
+	return density;
+}
+
+void DensityField::fill(unsigned int width, unsigned int height, unsigned int length,
+		const float origin[3], const float step[3], float *out) {
+	const float pixelCenter[3] = {0.0f, 0.0f, 0.0f};
+
+	ThreadPool::global().parallelFor(0, length, [&](unsigned int k0, unsigned int k1) {
+		fillRows(width, height, k0, k1, origin, step, pixelCenter, out, true);
+	});
+}
+
+void DensityField::fill(unsigned int width, unsigned int height, unsigned int length, float *out) {
+	const float origin[3] = {0.0f, 0.0f, 0.0f};
+	const float step[3] = {1.0f/width, 1.0f/height, 1.0f/(length - 1)};
+	const float pixelCenter[3] = {0.5f, 0.5f, 0.0f};
+
+	ThreadPool::global().parallelFor(0, length, [&](unsigned int k0, unsigned int k1) {
+		fillRows(width, height, k0, k1, origin, step, pixelCenter, out, true);
+	});
+}
+
+void DensityField::fillRows(unsigned int width, unsigned int height, unsigned int k0, unsigned int k1,
+		const float origin[3], const float step[3], const float pixelCenter[3], float *out, bool simd) {
+
+	for (unsigned int k = k0; k < k1; k++) {
+		float z = origin[2] + (k + pixelCenter[2])*step[2];
+
+		for (unsigned int j = 0; j < height; j++) {
+			float y = origin[1] + (j + pixelCenter[1])*step[1];
+			float *row = out + ((size_t)k*height + j)*width;
+
+			unsigned int i = 0;
+#ifdef DENSITY_FIELD_AVX2
+			if(simd && cpuHasAVX2())
+				i = fillRow8(row, width, origin[0], pixelCenter[0], step[0], y, z);
+#endif
+			for (; i < width; i++) {
+				row[i] = evaluate(origin[0] + (i + pixelCenter[0])*step[0], y, z);
+			}
+		}
+	}
+}
+
+bool DensityField::compare(const float *gpu, unsigned int width, unsigned int height, unsigned int length,
+		float tolerance, float saturation) {
+
+	std::vector<float> cpu((size_t)width*height*length);
+	fill(width, height, length, &cpu[0]);
+
+	if(saturation > 0.0f) {
+		for (size_t s = 0; s < cpu.size(); s++)
+			cpu[s] = std::min(std::max(cpu[s], -saturation), saturation);
+	}
+
+	double maxError = 0.0, totalError = 0.0;
+	size_t nSignMismatches = 0, worst = 0;
+	for (size_t s = 0; s < cpu.size(); s++) {
+		double error = fabs(gpu[s] - cpu[s])/std::max(fabs(cpu[s]), 1.0);
+		totalError += error;
+		if(error > maxError) {
+			maxError = error;
+			worst = s;
+		}
+
+		//the mesh only depends on the sign (marching cube inside test)
+		if((gpu[s]*99999 >= 1) != (cpu[s]*99999 >= 1))
+			nSignMismatches++;
+	}
+
+	bool ok = (maxError <= tolerance);
+
+	log_console.infoStream() << "[Density Field] CPU vs GPU " << width << "x" << height << "x" << length << " : max error " << maxError
+		<< " (sample " << worst << ", gpu " << gpu[worst] << ", cpu " << cpu[worst] << "), mean error " << totalError/cpu.size()
+		<< ", " << nSignMismatches << " inside/outside mismatches, tolerance " << tolerance << (ok ? " : OK" : " : FAILED");
+
+	return ok;
+}
+
+void DensityField::benchmark(unsigned int size, unsigned int nRuns) {
+	std::vector<float> density((size_t)size*size*size), reference((size_t)size*size*size);
+	const float origin[3] = {0.0f, 0.0f, 0.0f};
+	const float step[3] = {1.0f/size, 1.0f/size, 1.0f/(size - 1)};
+	const float pixelCenter[3] = {0.5f, 0.5f, 0.0f};
+
+	//scalar reference
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	ThreadPool::global().parallelFor(0, size, [&](unsigned int k0, unsigned int k1) {
+		fillRows(size, size, k0, k1, origin, step, pixelCenter, &reference[0], false);
+	});
+	std::chrono::duration<double, std::milli> scalarTime = std::chrono::high_resolution_clock::now() - start;
+
+	double bestTime = 1.0e30;
+	for (unsigned int r = 0; r < nRuns; r++) {
+		start = std::chrono::high_resolution_clock::now();
+		fill(size, size, size, &density[0]);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		bestTime = std::min(bestTime, elapsed.count());
+	}
+
+	double maxError = 0.0;
+	for (size_t s = 0; s < density.size(); s++) {
+		maxError = std::max(maxError, (double) fabs(density[s] - reference[s]));
+	}
+
+	double nSamples = (double)size*size*size;
+	log_console.infoStream() << "[Density Field Benchmark] " << size << "^3 field, " << ThreadPool::global().getThreadCount() << " threads.";
+	log_console.infoStream() << "[Density Field Benchmark] scalar " << scalarTime.count() << " ms ("
+		<< nSamples/(scalarTime.count()*1.0e-3)/1.0e6 << " Msamples/s), "
+		<< (cpuHasAVX2() ? "AVX2 " : "no SIMD ") << bestTime << " ms (" << nSamples/(bestTime*1.0e-3)/1.0e6 << " Msamples/s), max difference " << maxError << ".";
+}
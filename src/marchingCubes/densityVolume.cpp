@@ -0,0 +1,96 @@
+
+#include "densityVolume.h"
+
+#include <cmath>
+#include <algorithm>
+
+DensityVolume::DensityVolume(unsigned int width, unsigned int height, unsigned int length,
+		float voxelSize, const float origin[3]) :
+	_width(width), _height(height), _length(length),
+	_voxelSize(voxelSize), _invVoxelSize(1.0f/voxelSize),
+	_samples(width*height*length, 0.0f)
+{
+	std::copy(origin, origin + 3, _origin);
+}
+
+unsigned int DensityVolume::getWidth() const {
+	return _width;
+}
+unsigned int DensityVolume::getHeight() const {
+	return _height;
+}
+unsigned int DensityVolume::getLength() const {
+	return _length;
+}
+float DensityVolume::getVoxelSize() const {
+	return _voxelSize;
+}
+const float *DensityVolume::getOrigin() const {
+	return _origin;
+}
+
+float *DensityVolume::getSamples() {
+	return &_samples[0];
+}
+const float *DensityVolume::getSamples() const {
+	return &_samples[0];
+}
+
+bool DensityVolume::contains(float x, float y, float z) const {
+	float u = (x - _origin[0])*_invVoxelSize;
+	float v = (y - _origin[1])*_invVoxelSize;
+	float w = (z - _origin[2])*_invVoxelSize;
+
+	return u >= 1.0f && v >= 1.0f && w >= 1.0f
+		&& u <= _width - 2.0f && v <= _height - 2.0f && w <= _length - 2.0f;
+}
+
+//trilinear, (u,v,w) in samples and inside [0,size-1]
+float DensityVolume::sample(float u, float v, float w) const {
+	unsigned int i = std::min((unsigned int) u, _width - 2);
+	unsigned int j = std::min((unsigned int) v, _height - 2);
+	unsigned int k = std::min((unsigned int) w, _length - 2);
+	float fu = u - i, fv = v - j, fw = w - k;
+
+	const float *s = &_samples[(k*_height + j)*_width + i];
+	unsigned int dy = _width, dz = _width*_height;
+
+	float c00 = s[0]       + fu*(s[1]       - s[0]);
+	float c10 = s[dy]      + fu*(s[dy+1]    - s[dy]);
+	float c01 = s[dz]      + fu*(s[dz+1]    - s[dz]);
+	float c11 = s[dz+dy]   + fu*(s[dz+dy+1] - s[dz+dy]);
+
+	float c0 = c00 + fv*(c10 - c00);
+	float c1 = c01 + fv*(c11 - c01);
+	return c0 + fw*(c1 - c0);
+}
+
+float DensityVolume::density(float x, float y, float z) const {
+	return sample((x - _origin[0])*_invVoxelSize, (y - _origin[1])*_invVoxelSize, (z - _origin[2])*_invVoxelSize);
+}
+
+void DensityVolume::gradient(float x, float y, float z, float grad[3]) const {
+	float u = (x - _origin[0])*_invVoxelSize;
+	float v = (y - _origin[1])*_invVoxelSize;
+	float w = (z - _origin[2])*_invVoxelSize;
+	float scale = 0.5f*_invVoxelSize;
+
+	grad[0] = (sample(u + 1.0f, v, w) - sample(u - 1.0f, v, w))*scale;
+	grad[1] = (sample(u, v + 1.0f, w) - sample(u, v - 1.0f, w))*scale;
+	grad[2] = (sample(u, v, w + 1.0f) - sample(u, v, w - 1.0f))*scale;
+}
+
+bool DensityVolume::surface(float x, float y, float z, float *distance, float normal[3]) const {
+	float grad[3];
+	gradient(x, y, z, grad);
+
+	float norm = sqrtf(grad[0]*grad[0] + grad[1]*grad[1] + grad[2]*grad[2]);
+	if(norm < 1.0e-6f)
+		return false;
+
+	*distance = -density(x, y, z)/norm;
+	normal[0] = -grad[0]/norm;
+	normal[1] = -grad[1]/norm;
+	normal[2] = -grad[2]/norm;
+	return true;
+}
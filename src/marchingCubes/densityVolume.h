@@ -0,0 +1,48 @@
+
+#ifndef DENSITYVOLUME_H
+#define DENSITYVOLUME_H
+
+#include <vector>
+
+// CPU copy of a terrain density field, for the particles collisions
+// Sample (i,j,k) is at origin + (i,j,k)*voxelSize in world coordinates (MarchingCubes mesh mapping),
+// density > 0 is matter. The field is trilinearly interpolated and the gradient is taken with
+// one voxel central differences, as the normals pass does (normal = -gradient/|gradient|).
+class DensityVolume {
+
+	public:
+		DensityVolume(unsigned int width, unsigned int height, unsigned int length,
+				float voxelSize, const float origin[3]);
+
+		unsigned int getWidth() const;
+		unsigned int getHeight() const;
+		unsigned int getLength() const;
+		float getVoxelSize() const;
+		const float *getOrigin() const;
+
+		//width*height*length samples, x first, then y, then z
+		float *getSamples();
+		const float *getSamples() const;
+
+		//false outside of the volume (one voxel margin for the gradient)
+		bool contains(float x, float y, float z) const;
+
+		float density(float x, float y, float z) const;
+
+		//density gradient per world unit
+		void gradient(float x, float y, float z, float grad[3]) const;
+
+		//first order distance to the surface, > 0 in the water : -density/|gradient|
+		//normal points out of the matter, returns false where the gradient vanishes
+		bool surface(float x, float y, float z, float *distance, float normal[3]) const;
+
+	private:
+		unsigned int _width, _height, _length;
+		float _voxelSize, _invVoxelSize;
+		float _origin[3];
+		std::vector<float> _samples;
+
+		float sample(float u, float v, float w) const;
+};
+
+#endif /* end of include guard: DENSITYVOLUME_H */
@@ -0,0 +1,95 @@
+
+#include "histoPyramid.h"
+#include "threadPool.h"
+
+#include <algorithm>
+
+HistoPyramid::HistoPyramid(unsigned int width, unsigned int height, unsigned int length) :
+	_width(width), _height(height), _length(length), _size(1)
+{
+	unsigned int maxSize = std::max(width, std::max(height, length));
+	while(_size < maxSize)
+		_size *= 2;
+
+	for (unsigned int size = _size; size >= 1; size /= 2) {
+		_levels.push_back(std::vector<unsigned int>((size_t)size*size*size, 0u));
+	}
+}
+
+HistoPyramid::~HistoPyramid() {
+}
+
+void HistoPyramid::build(const unsigned char *counts) {
+	std::vector<unsigned int> &base = _levels[0];
+
+	ThreadPool::global().parallelFor(0, _length, [&](unsigned int k0, unsigned int k1) {
+		for (unsigned int k = k0; k < k1; k++) {
+			for (unsigned int j = 0; j < _height; j++) {
+				const unsigned char *src = counts + ((size_t)k*_height + j)*_width;
+				unsigned int *dst = &base[((size_t)k*_size + j)*_size];
+				for (unsigned int i = 0; i < _width; i++) {
+					dst[i] = src[i];
+				}
+			}
+		}
+	});
+
+	for (unsigned int level = 1; level < _levels.size(); level++) {
+		reduceLevel(level);
+	}
+}
+
+void HistoPyramid::reduceLevel(unsigned int level) {
+	const std::vector<unsigned int> &below = _levels[level-1];
+	std::vector<unsigned int> &current = _levels[level];
+	unsigned int size = _size >> level;
+	unsigned int belowSize = 2*size;
+
+	ThreadPool::global().parallelFor(0, size, [&](unsigned int k0, unsigned int k1) {
+		for (unsigned int k = k0; k < k1; k++) {
+			for (unsigned int j = 0; j < size; j++) {
+				for (unsigned int i = 0; i < size; i++) {
+					unsigned int sum = 0;
+					for (unsigned int c = 0; c < 8; c++) {
+						unsigned int x = 2*i + (c&1), y = 2*j + ((c>>1)&1), z = 2*k + (c>>2);
+						sum += below[((size_t)z*belowSize + y)*belowSize + x];
+					}
+					current[((size_t)k*size + j)*size + i] = sum;
+				}
+			}
+		}
+	}, 1);
+}
+
+unsigned int HistoPyramid::getTotal() const {
+	return _levels.back()[0];
+}
+
+unsigned int HistoPyramid::getLevelCount() const {
+	return _levels.size();
+}
+
+void HistoPyramid::find(unsigned int element, unsigned int &cell, unsigned int &rank) const {
+	unsigned int i = 0, j = 0, k = 0;
+
+	//children are visited in the same order at each level : x, then y, then z
+	for (int level = _levels.size() - 2; level >= 0; level--) {
+		const std::vector<unsigned int> &counts = _levels[level];
+		unsigned int size = _size >> level;
+
+		for (unsigned int c = 0; c < 8; c++) {
+			unsigned int x = 2*i + (c&1), y = 2*j + ((c>>1)&1), z = 2*k + (c>>2);
+			unsigned int count = counts[((size_t)z*size + y)*size + x];
+
+			if(element < count || c == 7) {
+				i = x; j = y; k = z;
+				break;
+			}
+
+			element -= count;
+		}
+	}
+
+	cell = (k*_height + j)*_width + i;
+	rank = element;
+}
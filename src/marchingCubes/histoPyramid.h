@@ -0,0 +1,36 @@
+
+#ifndef HISTOPYRAMID_H
+#define HISTOPYRAMID_H
+
+#include <vector>
+
+// CPU reference of the histopyramid stream compaction (count -> reduce -> traverse)
+// Level 0 holds one element count per cell of a size^3 grid (size = next power of two),
+// each upper level the sum of the 2x2x2 cells below, up to the 1x1x1 total.
+// Output element e is found by walking down the levels : no atomic, no append buffer,
+// every output can be written independently at its final offset.
+// No OpenGL dependency, so it can be used to check the GPU results.
+class HistoPyramid {
+
+	public:
+		HistoPyramid(unsigned int width, unsigned int height, unsigned int length);
+		~HistoPyramid();
+
+		//counts : width*height*length counts (x first, then y, then z)
+		void build(const unsigned char *counts);
+
+		unsigned int getTotal() const;
+		unsigned int getLevelCount() const;
+
+		//output element -> cell (x first index in the width*height*length grid) and rank inside the cell
+		void find(unsigned int element, unsigned int &cell, unsigned int &rank) const;
+
+	private:
+		unsigned int _width, _height, _length;
+		unsigned int _size;
+		std::vector<std::vector<unsigned int> > _levels; //level l is (size>>l)^3
+
+		void reduceLevel(unsigned int level);
+};
+
+#endif /* end of include guard: HISTOPYRAMID_H */
@@ -6,22 +6,41 @@
 #include "perlinTexture3D.h"
 #include "perlin.h"
 #include "utils.h"
+#include "cpuMarchingCubes.h"
+#include "densityField.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
 
 bool MarchingCubes::_init = false;
 unsigned int MarchingCubes::_triTableUBO = 0;
 unsigned int MarchingCubes::_lookupTableUBO = 0;
 unsigned int MarchingCubes::_poissonDistributionsUBO = 0;
 
-MarchingCubes::MarchingCubes(unsigned int width, unsigned int height, unsigned int length, float voxelSize) :
-		_density(0), _normals_occlusion(0), _terrain_texture(0),
+MarchingCubes::MarchingCubes(unsigned int width, unsigned int height, unsigned int length, float voxelSize,
+		MeshingBackend meshingBackend, MeshLayout meshLayout, NormalsFormat normalsFormat, DensityFormat densityFormat) :
+		_density(0), _normals_occlusion(0), _occupancy(0), _occlusion(0), _terrain_texture(0), _histoPyramid(0),
         _textureWidth(width), _textureHeight(height), _textureLength(length),
         _voxelGridWidth(width-1), _voxelGridHeight(height-1), _voxelGridLength(length-1), 
         _voxelWidth(voxelSize), _voxelHeight(voxelSize), _voxelLength(voxelSize),
-        _drawProgram(0), _densityProgram(0), _normalOcclusionProgram(0), _marchingCubesProgram(0),
-		_vertexVBO(0), _fullscreenQuadVBO(0), _marchingCubesLowerLeftXY_VBO(0),           
-		_marchingCubesFeedbackVertexTBO(0), _nTriangles(0),
-		_generalDataUBO(0)
+        _drawProgram(0), _densityProgram(0), _normalOcclusionProgram(0), _occupancyProgram(0), _marchingCubesProgram(0),
+		_histoPyramidCountProgram(0), _histoPyramidReduceProgram(0),
+		_frameBuffer(0), _aoMode(RAY_MARCHED_AO), _aoQuality(1),
+		_vertexVBO(0), _fullscreenQuadVBO(0), _triangleCornerVBO(0),           
+		_histoPyramidSize(1), _histoPyramidTopLevel(0),
+		_marchingCubesFeedbackVertexTBO(0), _feedbackCapacity(0),
+		_marchingCubesIndexBuffer(0), _nTriangles(0), _nVertices(0),
+		_vertexShaderInvocationsQuery(0), _vertexShaderInvocationsLogged(false),
+		_generalDataUBO(0),
+		_meshingBackend(meshingBackend), _meshLayout(meshLayout),
+		_normalsFormat(normalsFormat), _densityFormat(densityFormat),
+		_densityScale(densityFormat == R8_SNORM_DENSITY ? 8.0f : 1.0f)
 {
+        if(_meshLayout == INDEXED_MESH && _meshingBackend == GPU_MESHING) {
+                log_console.warnStream() << "[Marching Cube] Indexed meshes are only generated by the CPU mesher, switching to CPU meshing !";
+                _meshingBackend = CPU_MESHING;
+        }
 
         if(!_init) {
                 generateUniformBlockBuffers();
@@ -41,7 +60,8 @@ MarchingCubes::MarchingCubes(unsigned int width, unsigned int height, unsigned i
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
         //create textures
-        _density = new Texture3D(_textureWidth, _textureHeight,_textureLength, GL_R16F, 0, GL_RED, GL_FLOAT);
+        _density = new Texture3D(_textureWidth, _textureHeight,_textureLength, 
+				_densityFormat == R8_SNORM_DENSITY ? GL_R8_SNORM : GL_R16F, 0, GL_RED, GL_FLOAT);
         _density->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP));
         _density->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP));
         _density->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP));
@@ -49,7 +69,9 @@ MarchingCubes::MarchingCubes(unsigned int width, unsigned int height, unsigned i
         _density->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR));
         _density->bindAndApplyParameters(0); //allocate texture and apply parameters
 
-        _normals_occlusion = new Texture3D(_textureWidth, _textureHeight,_textureLength, GL_RGBA32F, 0, GL_RGBA, GL_FLOAT);
+        static const GLenum normalsInternalFormats[3] = {GL_RGBA32F, GL_RG16, GL_RG8};
+        _normals_occlusion = new Texture3D(_textureWidth, _textureHeight,_textureLength, normalsInternalFormats[_normalsFormat], 0, 
+				_normalsFormat == RGBA32F_NORMALS ? GL_RGBA : GL_RG, GL_FLOAT);
         _normals_occlusion->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP));
         _normals_occlusion->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP));
         _normals_occlusion->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP));
@@ -57,6 +79,52 @@ MarchingCubes::MarchingCubes(unsigned int width, unsigned int height, unsigned i
         _normals_occlusion->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR));
         _normals_occlusion->bindAndApplyParameters(1); //allocate texture and apply parameters
 
+        //the octahedral normals only have two channels, the occlusion goes to the second draw buffer
+        if(_normalsFormat != RGBA32F_NORMALS) {
+                _occlusion = new Texture3D(_textureWidth, _textureHeight,_textureLength, GL_R8, 0, GL_RED, GL_UNSIGNED_BYTE);
+                _occlusion->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP));
+                _occlusion->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP));
+                _occlusion->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP));
+                _occlusion->addParameter(Parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+                _occlusion->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+                _occlusion->bindAndApplyParameters(Texture::requestTextures(1)[0]); //allocate texture and apply parameters
+        }
+
+        //solid fraction pyramid for the cone traced occlusion, levels are generated after each update
+        _occupancy = new Texture3D(_textureWidth, _textureHeight,_textureLength, GL_R8, 0, GL_RED, GL_UNSIGNED_BYTE);
+        _occupancy->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+        _occupancy->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+        _occupancy->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+        _occupancy->addParameter(Parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+        _occupancy->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+        _occupancy->bindAndApplyParameters(2); //allocate texture and apply parameters
+
+        //triangle counts pyramid, every level is rendered into and read with texelFetch (no filtering)
+        if(_meshingBackend == GPU_MESHING) {
+                unsigned int maxSize = std::max(_voxelGridWidth, std::max(_voxelGridHeight, _voxelGridLength));
+                while(_histoPyramidSize < maxSize) {
+                        _histoPyramidSize *= 2;
+                        _histoPyramidTopLevel++;
+                }
+
+                _histoPyramid = new Texture3D(_histoPyramidSize, _histoPyramidSize, _histoPyramidSize, GL_R32UI, 0, GL_RED_INTEGER, GL_UNSIGNED_INT);
+                _histoPyramid->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+                _histoPyramid->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+                _histoPyramid->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
+                _histoPyramid->addParameter(Parameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+                _histoPyramid->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+                _histoPyramid->bindAndApplyParameters(Texture::requestTextures(1)[0]); //allocate level 0 and apply parameters
+
+                //integer textures have no generated mipmaps, the upper levels are allocated here
+                for (unsigned int level = 1; level <= _histoPyramidTopLevel; level++) {
+                        unsigned int size = _histoPyramidSize >> level;
+                        glTexImage3D(GL_TEXTURE_3D, level, GL_R32UI, size, size, size, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, 0);
+                }
+                glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, _histoPyramidTopLevel);
+        }
+
+        glGenFramebuffers(1, &_frameBuffer);
+
 		_terrain_texture = new Texture2D("textures/terrain/striation.png", "png");
         _terrain_texture->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_REPEAT));
         _terrain_texture->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_REPEAT));
@@ -67,34 +135,47 @@ MarchingCubes::MarchingCubes(unsigned int width, unsigned int height, unsigned i
 
         generateQuads();
         generateFullScreenQuad();
-        generateMarchingCubesPoints();
+        generateTriangleCorners();
 
         makeDensityProgram();
         makeNormalOcclusionProgram();
-        makeMarchingCubesProgram();
+        makeOccupancyProgram();
+        if(_meshingBackend == GPU_MESHING) {
+                makeHistoPyramidPrograms();
+                makeMarchingCubesProgram();
+        }
         makeDrawProgram();
 
-		computeDensitiesAndNormals();
+		logTextureMemory();
+
+		computeDensities();
+		computeNormals();
 		marchCubes();
 }
 
 MarchingCubes::~MarchingCubes() {
-		Texture *textures[] = {_density, _normals_occlusion, _terrain_texture};
-		Program *programs[] = {_drawProgram, _densityProgram, _normalOcclusionProgram, _marchingCubesProgram};
-		unsigned int buffers[] = {_vertexVBO, _fullscreenQuadVBO, _marchingCubesLowerLeftXY_VBO, _marchingCubesFeedbackVertexTBO, _generalDataUBO};
+		Texture *textures[] = {_density, _normals_occlusion, _occupancy, _occlusion, _terrain_texture, _histoPyramid};
+		Program *programs[] = {_drawProgram, _densityProgram, _normalOcclusionProgram, _occupancyProgram, _marchingCubesProgram,
+			_histoPyramidCountProgram, _histoPyramidReduceProgram};
+		unsigned int buffers[] = {_vertexVBO, _fullscreenQuadVBO, _triangleCornerVBO, _marchingCubesFeedbackVertexTBO, _marchingCubesIndexBuffer, _generalDataUBO};
 
-		for (int i = 0; i < 3; i++) {
+		for (int i = 0; i < 6; i++) {
 			delete textures[i];
 		}
 		
-		for (int i = 0; i < 4; i++) {
+		for (int i = 0; i < 7; i++) {
 			delete programs[i];
 		}
 
-		for (int i = 0; i < 5; i++) {
+		glDeleteFramebuffers(1, &_frameBuffer);
+
+		for (int i = 0; i < 6; i++) {
 			if(glIsBuffer(buffers[i]))
 				glDeleteBuffers(1, &buffers[i]);
 		}
+
+		if(glIsQuery(_vertexShaderInvocationsQuery))
+			glDeleteQueries(1, &_vertexShaderInvocationsQuery);
 }
 
 void MarchingCubes::drawDownwards(const float *currentTransformationMatrix) {
@@ -103,25 +184,95 @@ void MarchingCubes::drawDownwards(const float *currentTransformationMatrix) {
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0,  Globals::projectionViewUniformBlock);
 	glBindBufferBase(GL_UNIFORM_BUFFER, 1, _generalDataUBO);
 	glUniformMatrix4fv(_drawUniformLocs["modelMatrix"], 1, GL_TRUE, currentTransformationMatrix);
+	glUniform1i(_drawUniformLocs["packedNormals"], _normalsFormat == RGBA32F_NORMALS ? 0 : 1);
+	glUniform3f(_drawUniformLocs["terrainSize"], _textureWidth*_voxelWidth, _textureHeight*_voxelHeight, _textureLength*_voxelLength);
 	
 
 	glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesFeedbackVertexTBO);           
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	//count vertex shader invocations of the first draw only
+	bool measureInvocations = GLEW_ARB_pipeline_statistics_query && _vertexShaderInvocationsQuery == 0;
+	if(measureInvocations) {
+		glGenQueries(1, &_vertexShaderInvocationsQuery);
+		glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, _vertexShaderInvocationsQuery);
+	}
 	
-    glDrawArrays(GL_TRIANGLES, 0, _nTriangles*3);
+	switch(_meshLayout) {
+		case TRIANGLE_SOUP:
+			glDrawArrays(GL_TRIANGLES, 0, _nTriangles*3);
+			break;
+		case INDEXED_MESH:
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _marchingCubesIndexBuffer);
+			glDrawElements(GL_TRIANGLES, _nTriangles*3, GL_UNSIGNED_INT, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			break;
+	}
+
+	if(measureInvocations)
+		glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+	else 
+		logVertexShaderInvocations();
 	
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glUseProgram(0);
 }
+
+void MarchingCubes::logVertexShaderInvocations() {
+	if(_vertexShaderInvocationsLogged || !glIsQuery(_vertexShaderInvocationsQuery))
+		return;
+
+	//do not stall the pipeline, try again next frame
+	unsigned int available = 0;
+	glGetQueryObjectuiv(_vertexShaderInvocationsQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+	if(!available)
+		return;
+
+	unsigned int invocations = 0;
+	glGetQueryObjectuiv(_vertexShaderInvocationsQuery, GL_QUERY_RESULT, &invocations);
+	log_console.infoStream() << "[Marching Cube] Terrain draw : " << invocations << " vertex shader invocations for " 
+		<< _nTriangles << " triangles (" << (_nTriangles ? invocations/(float)_nTriangles : 0.0f) << " per triangle).";
+
+	_vertexShaderInvocationsLogged = true;
+}
+
+void MarchingCubes::logMeshMemory() const {
+	//the GPU mesher keeps its transform feedback buffer when the mesh shrinks
+	unsigned long soupBytes = (unsigned long)(_meshingBackend == GPU_MESHING ? _feedbackCapacity : _nTriangles)*3*3*sizeof(GLfloat);
+	unsigned long indexedBytes = (unsigned long)_nVertices*3*sizeof(GLfloat) + (unsigned long)_nTriangles*3*sizeof(GLuint);
+
+	switch(_meshLayout) {
+		case TRIANGLE_SOUP:
+			log_console.infoStream() << "[Marching Cube] Triangle soup : " << _nTriangles*3 << " vertices, " 
+				<< soupBytes/1024 << " kB, " << _nTriangles*3 << " vertex shader invocations per draw.";
+			break;
+		case INDEXED_MESH:
+			log_console.infoStream() << "[Marching Cube] Indexed mesh : " << _nVertices << " vertices + " 
+				<< _nTriangles*3 << " indices, " << indexedBytes/1024 << " kB (triangle soup would be " 
+				<< soupBytes/1024 << " kB), at least " << _nVertices << " vertex shader invocations per draw (instead of " 
+				<< _nTriangles*3 << ").";
+			break;
+	}
+}
+
+void MarchingCubes::logTextureMemory() const {
+		static const char *densityNames[2] = {"R16F", "R8_SNORM"};
+		static const char *normalsNames[3] = {"RGBA32F", "RG16 octahedral + R8 occlusion", "RG8 octahedral + R8 occlusion"};
+		static const unsigned int densityBytes[2] = {2, 1};
+		static const unsigned int normalsBytes[3] = {16, 2*2 + 1, 2*1 + 1};
+
+		unsigned long nVoxels = (unsigned long)_textureWidth*_textureHeight*_textureLength;
+		log_console.infoStream() << "[Marching Cube] Density " << densityNames[_densityFormat] << " : " 
+			<< nVoxels*densityBytes[_densityFormat]/1024 << " kB, normals " << normalsNames[_normalsFormat] << " : " 
+			<< nVoxels*normalsBytes[_normalsFormat]/1024 << " kB (" << densityBytes[_densityFormat] + normalsBytes[_normalsFormat] 
+			<< " bytes per voxel, " << 8*normalsBytes[_normalsFormat] << " bytes per trilinear normal fetch).";
+}
 		
-void MarchingCubes::computeDensitiesAndNormals() {
+void MarchingCubes::computeDensities() {
         
 		//The framebuffer, which regroups 0, 1, or more textures, and 0 or 1 depth buffer.
-        GLuint frameBuffer = 0;
-        glGenFramebuffers(1, &frameBuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, _frameBuffer);
         glDisable(GL_DEPTH_TEST);
 
         glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _density->getTextureId(), 0); //level 0 
@@ -138,6 +289,7 @@ void MarchingCubes::computeDensitiesAndNormals() {
         _densityProgram->use();
         glUniform1i(_densityUniformLocs["totalLayers"], _textureLength);
         glUniform2f(_densityUniformLocs["textureSize"], _textureWidth, _textureHeight);
+        glUniform1f(_densityUniformLocs["densityScale"], _densityScale);
 
         glBindBuffer(GL_ARRAY_BUFFER, _fullscreenQuadVBO);           
         glEnableVertexAttribArray(0);
@@ -146,13 +298,83 @@ void MarchingCubes::computeDensitiesAndNormals() {
 
         glDrawArraysInstanced(GL_TRIANGLES, 0, 6, _textureLength);
 
+        glBindBuffer(GL_ARRAY_BUFFER, 0);           
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+
+        glUseProgram(0);
+
+        glPopAttrib();
+}
+
+void MarchingCubes::computeOccupancy() {
+        glBindFramebuffer(GL_FRAMEBUFFER, _frameBuffer);
+        glDisable(GL_DEPTH_TEST);
+
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _occupancy->getTextureId(), 0); //level 0 
+
+        static const GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
+        glDrawBuffers(1, DrawBuffers); 
+
+		Utils::checkFrameBufferStatus();
+
+        glPushAttrib(GL_VIEWPORT_BIT);
+        glViewport(0,0,_textureWidth,_textureHeight); 
+
+		_occupancyProgram->use();
+
+        glBindBuffer(GL_ARRAY_BUFFER, _fullscreenQuadVBO);           
+        glEnableVertexAttribArray(0);
+        glVertexAttribDivisor(0,0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, _textureLength);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);           
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+
+        glUseProgram(0);
+
+        glPopAttrib();
+
+		//box filtered levels : solid fraction of 2^l voxels wide cells
+		if(!_occupancy->isBinded())
+			_occupancy->bindAndApplyParameters(Texture::requestTextures(1)[0]);
+		glActiveTexture(GL_TEXTURE0 + _occupancy->getLastKnownLocation());
+		glBindTexture(GL_TEXTURE_3D, _occupancy->getTextureId());
+		glGenerateMipmap(GL_TEXTURE_3D);
+}
+
+void MarchingCubes::computeNormals() {
+		static const int coneCounts[3] = {6, 14, 26};
+
+		if(_aoMode == CONE_TRACED_AO)
+			computeOccupancy();
+
         //Render full screen triangle to generate normals and occlusion texture
+        glBindFramebuffer(GL_FRAMEBUFFER, _frameBuffer);
+        glDisable(GL_DEPTH_TEST);
+
         glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _normals_occlusion->getTextureId(), 0); 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        static const GLenum DrawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+		if(_occlusion) {
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, _occlusion->getTextureId(), 0); 
+			glDrawBuffers(2, DrawBuffers); 
+		}
+		else {
+			glDrawBuffers(1, DrawBuffers); 
+		}
 		
 		Utils::checkFrameBufferStatus();
         
+        glPushAttrib(GL_VIEWPORT_BIT);
+        glViewport(0,0,_textureWidth,_textureHeight); 
+
 		_normalOcclusionProgram->use();
+		glUniform1i(_normalOcclusionUniformLocs["aoMode"], _aoMode == CONE_TRACED_AO ? 1 : 0);
+		glUniform1i(_normalOcclusionUniformLocs["coneCount"], coneCounts[_aoQuality]);
+		glUniform1i(_normalOcclusionUniformLocs["packedNormals"], _occlusion ? 1 : 0);
 
         glBindBufferBase(GL_UNIFORM_BUFFER, 0 , _poissonDistributionsUBO);
         glBindBufferBase(GL_UNIFORM_BUFFER, 1 , _generalDataUBO);
@@ -164,6 +386,8 @@ void MarchingCubes::computeDensitiesAndNormals() {
         glDrawArraysInstanced(GL_TRIANGLES, 0, 6, _textureLength);
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);           
+		if(_occlusion)
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, 0, 0); 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glEnable(GL_DEPTH_TEST);
 
@@ -172,11 +396,195 @@ void MarchingCubes::computeDensitiesAndNormals() {
         glPopAttrib();
 }
 
+void MarchingCubes::setAmbientOcclusion(AmbientOcclusion mode, unsigned int quality) {
+		_aoMode = mode;
+		_aoQuality = std::min(quality, 2u);
+
+		computeNormals();
+}
+
+void MarchingCubes::benchmarkAmbientOcclusion(unsigned int nRuns) {
+		static const char *names[4] = {"32 rays", "6 cones", "14 cones", "26 cones"};
+		AmbientOcclusion modes[4] = {RAY_MARCHED_AO, CONE_TRACED_AO, CONE_TRACED_AO, CONE_TRACED_AO};
+		unsigned int qualities[4] = {0, 0, 1, 2};
+
+		AmbientOcclusion previousMode = _aoMode;
+		unsigned int previousQuality = _aoQuality;
+
+		unsigned int nSamples = _textureWidth*_textureHeight*_textureLength;
+		std::vector<float> occlusion(nSamples), reference(nSamples);
+
+		unsigned int timeQuery;
+		glGenQueries(1, &timeQuery);
+
+		for (unsigned int m = 0; m < 4; m++) {
+			_aoMode = modes[m];
+			_aoQuality = qualities[m];
+
+			GLuint64 bestTime = ~(GLuint64)0;
+			for (unsigned int r = 0; r < nRuns; r++) {
+				glBeginQuery(GL_TIME_ELAPSED, timeQuery);
+				computeNormals();
+				glEndQuery(GL_TIME_ELAPSED);
+
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(timeQuery, GL_QUERY_RESULT, &elapsed); //waits for the GPU
+				bestTime = std::min(bestTime, elapsed);
+			}
+
+			//alpha channel of the RGBA32F normals, or the separate R8 texture
+			glBindTexture(GL_TEXTURE_3D, (_occlusion ? _occlusion : _normals_occlusion)->getTextureId());
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glGetTexImage(GL_TEXTURE_3D, 0, _occlusion ? GL_RED : GL_ALPHA, GL_FLOAT, &occlusion[0]);
+			glBindTexture(GL_TEXTURE_3D, 0);
+
+			double totalError = 0.0, maxError = 0.0;
+			for (unsigned int s = 0; s < nSamples; s++) {
+				if(m == 0) {
+					reference[s] = occlusion[s];
+					continue;
+				}
+
+				double error = fabs(occlusion[s] - reference[s]);
+				totalError += error;
+				maxError = std::max(maxError, error);
+			}
+
+			log_console.infoStream() << "[Marching Cube AO Benchmark] " << names[m] << " : " << bestTime*1.0e-6 << " ms, mean absolute error "
+				<< totalError/nSamples << ", max error " << maxError << ".";
+		}
+
+		glDeleteQueries(1, &timeQuery);
+
+		setAmbientOcclusion(previousMode, previousQuality);
+}
+
+
 void MarchingCubes::marchCubes() {
-        unsigned int query[2];
-        glGenQueries(2, query);
+		switch(_meshingBackend) {
+			case GPU_MESHING:
+				marchCubesGPU();
+				break;
+			case CPU_MESHING:
+				marchCubesCPU();
+				break;
+		}
+}
+
+bool MarchingCubes::checkDensityField(float tolerance) const {
+		std::vector<float> density(_textureWidth*_textureHeight*_textureLength);
+
+		glBindTexture(GL_TEXTURE_3D, _density->getTextureId());
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, &density[0]);
+		glBindTexture(GL_TEXTURE_3D, 0);
+
+		if(_densityFormat == R16F_DENSITY)
+			return DensityField::compare(&density[0], _textureWidth, _textureHeight, _textureLength, tolerance);
+
+		//8 bits : back to the field unit, saturated outside of [-1/scale, 1/scale], half a step of error at best
+		for (unsigned int s = 0; s < density.size(); s++)
+			density[s] /= _densityScale;
+		return DensityField::compare(&density[0], _textureWidth, _textureHeight, _textureLength, 
+				std::max(tolerance, 0.5f/(127.0f*_densityScale) + 1.0e-4f), 1.0f/_densityScale);
+}
+
+DensityVolume *MarchingCubes::makeDensityVolume() const {
+		const float *modelMatrix = getRelativeModelMatrix();
+		float origin[3] = {modelMatrix[3], modelMatrix[7], modelMatrix[11]};
+
+		DensityVolume *volume = new DensityVolume(_textureWidth, _textureHeight, _textureLength, _voxelWidth*modelMatrix[0], origin);
+		float *density = volume->getSamples();
+
+		glBindTexture(GL_TEXTURE_3D, _density->getTextureId());
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, density);
+		glBindTexture(GL_TEXTURE_3D, 0);
+
+		if(_densityFormat == R8_SNORM_DENSITY) {
+			for (unsigned int s = 0; s < _textureWidth*_textureHeight*_textureLength; s++)
+				density[s] /= _densityScale;
+		}
+
+		return volume;
+}
+
+void MarchingCubes::marchCubesCPU() {
+		std::vector<float> density(_textureWidth*_textureHeight*_textureLength);
+
+		glBindTexture(GL_TEXTURE_3D, _density->getTextureId());
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, &density[0]);
+		glBindTexture(GL_TEXTURE_3D, 0);
+
+		CpuMarchingCubes mc(_textureWidth, _textureHeight, _textureLength, _voxelWidth, _voxelHeight, _voxelLength);
+		std::vector<float> worldPos;
+		std::vector<unsigned int> indices;
+
+		switch(_meshLayout) {
+			case TRIANGLE_SOUP:
+				mc.march(&density[0], worldPos);
+				break;
+			case INDEXED_MESH:
+				mc.marchIndexed(&density[0], worldPos, indices);
+				break;
+		}
+
+		const CpuMarchingCubes::Stats &stats = mc.getStats();
+		log_console.infoStream() << "[Marching Cube] CPU mesher generated " << stats.nTriangles << " primitives in "
+			<< stats.totalTime << " ms (" << stats.trianglesPerSecond/1.0e6 << " Mtriangles/s).";
+		_nTriangles = stats.nTriangles;
+		_nVertices = stats.nVertices;
+		logMeshMemory();
+
+		if(glIsBuffer(_marchingCubesFeedbackVertexTBO))
+			glDeleteBuffers(1, &_marchingCubesFeedbackVertexTBO);
+        glGenBuffers(1, &_marchingCubesFeedbackVertexTBO);
+        glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesFeedbackVertexTBO);
+        glBufferData(GL_ARRAY_BUFFER, worldPos.size()*sizeof(GLfloat), worldPos.empty() ? 0 : &worldPos[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		if(glIsBuffer(_marchingCubesIndexBuffer))
+			glDeleteBuffers(1, &_marchingCubesIndexBuffer);
+		_marchingCubesIndexBuffer = 0;
+
+		if(_meshLayout == INDEXED_MESH) {
+			glGenBuffers(1, &_marchingCubesIndexBuffer);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _marchingCubesIndexBuffer);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLuint), indices.empty() ? 0 : &indices[0], GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		}
+}
+
+//Histopyramid stream compaction (count -> reduce -> traverse), same layout as HistoPyramid :
+//the triangle counts are reduced level by level in fragment shaders, the total read back from
+//the 1x1x1 top level sizes the transform feedback buffer exactly, then each triangle is one
+//instance of the traversal vertex shader, which walks down the levels to find its voxel.
+void MarchingCubes::marchCubesGPU() {
+		unsigned int nTriangles = buildHistoPyramid();
+
+		if(nTriangles > _feedbackCapacity || !glIsBuffer(_marchingCubesFeedbackVertexTBO)) {
+			if(glIsBuffer(_marchingCubesFeedbackVertexTBO))
+				glDeleteBuffers(1, &_marchingCubesFeedbackVertexTBO);
+			_feedbackCapacity = nTriangles;
+
+			glGenBuffers(1, &_marchingCubesFeedbackVertexTBO);
+			glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesFeedbackVertexTBO);
+			glBufferData(GL_ARRAY_BUFFER, std::max(_feedbackCapacity, 1u)*3*3*sizeof(GLfloat), 0, GL_DYNAMIC_COPY);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		_nTriangles = nTriangles;
+		_nVertices = 3*nTriangles;
+		log_console.infoStream() << "[Marching Cube] Histopyramid : " << nTriangles << " triangles in " 
+			<< _histoPyramidTopLevel + 1 << " levels.";
+		logMeshMemory();
+
+		if(nTriangles == 0)
+			return;
 
         _marchingCubesProgram->use();
+        glUniform1i(_marchingCubesUniformLocs["topLevel"], _histoPyramidTopLevel);
 		
 		glEnable(GL_RASTERIZER_DISCARD);
 
@@ -184,60 +592,120 @@ void MarchingCubes::marchCubes() {
         glBindBufferBase(GL_UNIFORM_BUFFER, 1 , _triTableUBO);
         glBindBufferBase(GL_UNIFORM_BUFFER, 2 , _generalDataUBO);
 
-        glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesLowerLeftXY_VBO);           
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, _triangleCornerVBO);           
+        glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, 0);
         glVertexAttribDivisor(0,0);
         glEnableVertexAttribArray(0);
 
-        glBeginQuery(GL_PRIMITIVES_GENERATED, query[0]);
-        glDrawArraysInstanced(GL_POINTS, 0, _voxelGridWidth*_voxelGridHeight, _voxelGridLength);
-        glFlush();
-        glEndQuery(GL_PRIMITIVES_GENERATED);
-
-        unsigned int primitivesGenerated;
-        glGetQueryObjectuiv(query[0], GL_QUERY_RESULT, &primitivesGenerated);
-
-		if(glIsBuffer(_marchingCubesFeedbackVertexTBO))
-			glDeleteBuffers(1, &_marchingCubesFeedbackVertexTBO);
-        glGenBuffers(1, &_marchingCubesFeedbackVertexTBO);
-        glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesFeedbackVertexTBO);
-        glBufferData(GL_ARRAY_BUFFER, primitivesGenerated*4*3*sizeof(GLfloat), 0, GL_STATIC_READ);
-
-        const GLchar* feedbackVaryings[] = { "GS_FS_VERTEX.worldPos" };
-        
         glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, _marchingCubesFeedbackVertexTBO);
-        glTransformFeedbackVaryings(_marchingCubesProgram->getProgramId(), 1, feedbackVaryings, GL_SEPARATE_ATTRIBS);
-
-		//update program
-		_marchingCubesProgram->link();
-		_marchingCubesProgram->use();
         
-        glBeginQuery(GL_PRIMITIVES_GENERATED, query[0]);
-        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query[1]);
         glBeginTransformFeedback(GL_TRIANGLES);
-		glDrawArraysInstanced(GL_POINTS, 0, _voxelGridWidth*_voxelGridHeight, _voxelGridLength);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 3, nTriangles);
         glEndTransformFeedback();
-        glFlush();
-        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
-        glEndQuery(GL_PRIMITIVES_GENERATED);
-        
-        unsigned int primitivesWritten;
-        glGetQueryObjectuiv(query[0], GL_QUERY_RESULT, &primitivesGenerated);
-        glGetQueryObjectuiv(query[1], GL_QUERY_RESULT, &primitivesWritten);
-        
-		
-		log_console.infoStream() << "[Marching Cube] Generated " <<  primitivesGenerated << " primitives.";
-		log_console.infoStream() << "[Marching Cube] Wrote " <<  primitivesGenerated << " primitives.";
-		_nTriangles = primitivesWritten;
         
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, 0);
         glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
 		glDisable(GL_RASTERIZER_DISCARD);
-        glTransformFeedbackVaryings(_marchingCubesProgram->getProgramId(), 0, 0, GL_SEPARATE_ATTRIBS);
         glUseProgram(0);
+}
+
+unsigned int MarchingCubes::buildHistoPyramid() {
+        glBindFramebuffer(GL_FRAMEBUFFER, _frameBuffer);
+        glDisable(GL_DEPTH_TEST);
+
+        static const GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
+        glDrawBuffers(1, DrawBuffers); 
+
+        glPushAttrib(GL_VIEWPORT_BIT);
+
+        glBindBuffer(GL_ARRAY_BUFFER, _fullscreenQuadVBO);           
+        glEnableVertexAttribArray(0);
+        glVertexAttribDivisor(0,0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+		//level 0 : triangles per voxel, 0 outside of the voxel grid
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _histoPyramid->getTextureId(), 0); 
+		Utils::checkFrameBufferStatus();
+
+        glViewport(0,0,_histoPyramidSize,_histoPyramidSize); 
+        _histoPyramidCountProgram->use();
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0 , _lookupTableUBO);
+        glBindBufferBase(GL_UNIFORM_BUFFER, 1 , _generalDataUBO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, _histoPyramidSize);
+
+		//level l : sum of the 2x2x2 cells of level l-1, the only level the sampler can reach 
+		//(base = max = l-1), so that rendering into level l is not a feedback loop
+        _histoPyramidReduceProgram->use();
+		glActiveTexture(GL_TEXTURE0 + _histoPyramid->getLastKnownLocation());
+		glBindTexture(GL_TEXTURE_3D, _histoPyramid->getTextureId());
+
+		for (unsigned int level = 1; level <= _histoPyramidTopLevel; level++) {
+			unsigned int size = _histoPyramidSize >> level;
+
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, level-1);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, level-1);
+
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, _histoPyramid->getTextureId(), level); 
+			Utils::checkFrameBufferStatus();
+
+			glViewport(0,0,size,size); 
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, size);
+		}
+
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, _histoPyramidTopLevel);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);           
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glEnable(GL_DEPTH_TEST);
+        glUseProgram(0);
+        glPopAttrib();
+
+		//4 bytes, the draw count has to be known on the CPU without indirect draws (GL 4.0)
+		unsigned int total = 0;
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_3D, _histoPyramidTopLevel, GL_RED_INTEGER, GL_UNSIGNED_INT, &total);
+		glBindTexture(GL_TEXTURE_3D, 0);
 
-        glDeleteQueries(2, query);
+		return total;
+}
+
+bool MarchingCubes::checkGpuMeshing(float tolerance) const {
+		if(_meshingBackend != GPU_MESHING) {
+			log_console.warnStream() << "[Marching Cube] Only the GPU meshing can be checked against the CPU !";
+			return false;
+		}
+
+		std::vector<float> density(_textureWidth*_textureHeight*_textureLength);
+		glBindTexture(GL_TEXTURE_3D, _density->getTextureId());
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_3D, 0, GL_RED, GL_FLOAT, &density[0]);
+		glBindTexture(GL_TEXTURE_3D, 0);
+
+		std::vector<float> reference;
+		CpuMarchingCubes mesher(_textureWidth, _textureHeight, _textureLength, _voxelWidth, _voxelHeight, _voxelLength);
+		mesher.marchCompact(&density[0], reference);
+
+		std::vector<float> worldPos(9*(size_t)_nTriangles);
+		if(_nTriangles > 0) {
+			glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesFeedbackVertexTBO);
+			glGetBufferSubData(GL_ARRAY_BUFFER, 0, worldPos.size()*sizeof(GLfloat), &worldPos[0]);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		double maxError = 0.0;
+		for (size_t v = 0; v < std::min(worldPos.size(), reference.size()); v++) {
+			maxError = std::max(maxError, (double)fabs(worldPos[v] - reference[v]));
+		}
+
+		bool passed = (worldPos.size() == reference.size() && maxError <= tolerance);
+		log_console.infoStream() << "[Marching Cube] GPU histopyramid : " << _nTriangles << " triangles, CPU : " 
+			<< reference.size()/9 << " triangles, max vertex error " << maxError << " (tolerance " << tolerance << ") : " 
+			<< (passed ? "passed" : "FAILED") << ".";
+
+		return passed;
 }
 
 void MarchingCubes::generateQuads() {
@@ -270,30 +738,14 @@ void MarchingCubes::generateFullScreenQuad() {
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void MarchingCubes::generateMarchingCubesPoints() {
-
-        float *lowerLeftXY = new float[2*_voxelGridWidth*_voxelGridHeight];
-
-        float stepX = 1.0f/_voxelGridWidth;
-        float stepY = 1.0f/_voxelGridHeight;
-
-        float posY = 0;
-        for (unsigned int j = 0; j < _voxelGridHeight; j++) {
-                float posX = 0;
-                for (unsigned int i = 0; i < _voxelGridWidth; i++) {
-                        lowerLeftXY[2*(j*_voxelGridWidth + i) + 0] = posX;
-                        lowerLeftXY[2*(j*_voxelGridWidth + i) + 1] = posY;
-                        posX += stepX;
-                }
-                posY += stepY;
-        }
+void MarchingCubes::generateTriangleCorners() {
+        //corner of the triangle, one instance per triangle in the histopyramid traversal
+        float corners[3] = {0, 1, 2};
 
-        glGenBuffers(1, &_marchingCubesLowerLeftXY_VBO);
-        glBindBuffer(GL_ARRAY_BUFFER, _marchingCubesLowerLeftXY_VBO);
-        glBufferData(GL_ARRAY_BUFFER, 2*_voxelGridWidth*_voxelGridHeight*sizeof(float), lowerLeftXY, GL_STATIC_DRAW);
+        glGenBuffers(1, &_triangleCornerVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, _triangleCornerVBO);
+        glBufferData(GL_ARRAY_BUFFER, 3*sizeof(float), corners, GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        delete [] lowerLeftXY;
 }
 
 void MarchingCubes::makeDrawProgram() {
@@ -306,7 +758,7 @@ void MarchingCubes::makeDrawProgram() {
         _drawProgram->attachShader(Shader("shaders/marchingCubes/draw_fs.glsl", GL_FRAGMENT_SHADER));
 
         _drawProgram->link();
-        _drawUniformLocs = _drawProgram->getUniformLocationsMap("modelMatrix", true);
+        _drawUniformLocs = _drawProgram->getUniformLocationsMap("modelMatrix packedNormals terrainSize", true);
         
 		Texture *tex[] = {_terrain_texture, _normals_occlusion};
 		_drawProgram->bindTextures(tex, "terrain_texture normals_occlusion", false);
@@ -323,7 +775,7 @@ void MarchingCubes::makeDensityProgram() {
 
         _densityProgram->link();
 
-        _densityUniformLocs = _densityProgram->getUniformLocationsMap("totalLayers textureSize", true);
+        _densityUniformLocs = _densityProgram->getUniformLocationsMap("totalLayers textureSize densityScale", true);
 }
 
 void MarchingCubes::makeNormalOcclusionProgram() {
@@ -338,20 +790,88 @@ void MarchingCubes::makeNormalOcclusionProgram() {
 
         _normalOcclusionProgram->link();
 
-        _normalOcclusionProgram->bindTextures(&_density, "density", true);
+        Texture *textures[] = {_density, _occupancy};
+        _normalOcclusionProgram->bindTextures(textures, "density occupancy", true);
+
+        _normalOcclusionUniformLocs = _normalOcclusionProgram->getUniformLocationsMap("aoMode coneCount packedNormals", true);
+}
+
+void MarchingCubes::makeOccupancyProgram() {
+        _occupancyProgram = new Program("MC Occupancy");
+        _occupancyProgram->bindAttribLocations("0", "vertex_position");
+        _occupancyProgram->bindFragDataLocation(0, "occupancy");
+
+        _occupancyProgram->attachShader(Shader("shaders/marchingCubes/normals_vs.glsl", GL_VERTEX_SHADER));
+        _occupancyProgram->attachShader(Shader("shaders/marchingCubes/normals_gs.glsl", GL_GEOMETRY_SHADER));
+        _occupancyProgram->attachShader(Shader("shaders/marchingCubes/occupancy_fs.glsl", GL_FRAGMENT_SHADER));
+
+        _occupancyProgram->link();
+
+        _occupancyProgram->bindTextures(&_density, "density", true);
 }
 
 void MarchingCubes::makeMarchingCubesProgram() {
         _marchingCubesProgram = new Program("MC Marching Cube");
-        _marchingCubesProgram->bindAttribLocations("0", "voxelLowerLeftXY");
+        _marchingCubesProgram->bindAttribLocations("0", "triangleCorner");
         _marchingCubesProgram->bindUniformBufferLocations("0 1 2", "lookupTable triangleTable generalData");
 
         _marchingCubesProgram->attachShader(Shader("shaders/marchingCubes/marchingCube_vs.glsl", GL_VERTEX_SHADER));
-        _marchingCubesProgram->attachShader(Shader("shaders/marchingCubes/marchingCube_gs.glsl", GL_GEOMETRY_SHADER));
+
+        //captured varyings are set once, before the only link
+        const GLchar* feedbackVaryings[] = { "VS_FEEDBACK_VERTEX.worldPos" };
+        glTransformFeedbackVaryings(_marchingCubesProgram->getProgramId(), 1, feedbackVaryings, GL_SEPARATE_ATTRIBS);
 
         _marchingCubesProgram->link();
 
-        _marchingCubesProgram->bindTextures(&_density, "density");
+        Texture *textures[] = {_density, _histoPyramid};
+        _marchingCubesProgram->bindTextures(textures, "density histoPyramid", true);
+
+        _marchingCubesUniformLocs = _marchingCubesProgram->getUniformLocationsMap("topLevel", true);
+}
+
+void MarchingCubes::makeHistoPyramidPrograms() {
+        _histoPyramidCountProgram = new Program("MC HistoPyramid Count");
+        _histoPyramidCountProgram->bindAttribLocations("0", "vertex_position");
+        _histoPyramidCountProgram->bindFragDataLocation(0, "triangleCount");
+        _histoPyramidCountProgram->bindUniformBufferLocations("0 1", "lookupTable generalData");
+
+        _histoPyramidCountProgram->attachShader(Shader("shaders/marchingCubes/normals_vs.glsl", GL_VERTEX_SHADER));
+        _histoPyramidCountProgram->attachShader(Shader("shaders/marchingCubes/normals_gs.glsl", GL_GEOMETRY_SHADER));
+        _histoPyramidCountProgram->attachShader(Shader("shaders/marchingCubes/histoPyramidCount_fs.glsl", GL_FRAGMENT_SHADER));
+
+        _histoPyramidCountProgram->link();
+
+        _histoPyramidCountProgram->bindTextures(&_density, "density", true);
+
+        _histoPyramidReduceProgram = new Program("MC HistoPyramid Reduce");
+        _histoPyramidReduceProgram->bindAttribLocations("0", "vertex_position");
+        _histoPyramidReduceProgram->bindFragDataLocation(0, "triangleCount");
+
+        _histoPyramidReduceProgram->attachShader(Shader("shaders/marchingCubes/normals_vs.glsl", GL_VERTEX_SHADER));
+        _histoPyramidReduceProgram->attachShader(Shader("shaders/marchingCubes/normals_gs.glsl", GL_GEOMETRY_SHADER));
+        _histoPyramidReduceProgram->attachShader(Shader("shaders/marchingCubes/histoPyramidReduce_fs.glsl", GL_FRAGMENT_SHADER));
+
+        _histoPyramidReduceProgram->link();
+
+        _histoPyramidReduceProgram->bindTextures(&_histoPyramid, "histoPyramid", true);
+}
+
+unsigned int MarchingCubes::getLookupTableUBO() {
+        if(!_init)
+                generateUniformBlockBuffers();
+        return _lookupTableUBO;
+}
+
+unsigned int MarchingCubes::getTriTableUBO() {
+        if(!_init)
+                generateUniformBlockBuffers();
+        return _triTableUBO;
+}
+
+unsigned int MarchingCubes::getPoissonDistributionsUBO() {
+        if(!_init)
+                generateUniformBlockBuffers();
+        return _poissonDistributionsUBO;
 }
 
 void MarchingCubes::generateUniformBlockBuffers() {
@@ -387,4 +907,6 @@ void MarchingCubes::generateUniformBlockBuffers() {
         glBufferSubData(GL_UNIFORM_BUFFER, (256+128+64)*4*sizeof(GLfloat),  32*4*sizeof(GLfloat), MarchingCube::poissonRayDirs_32);
 
         glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        _init = true;
 }
@@ -7,6 +7,7 @@
 #include "consts.h"
 #include "texture2D.h"
 #include "texture3D.h"
+#include "densityVolume.h"
 
 //Les struct à envoyer en uniform
 namespace MarchingCube {
@@ -54,40 +55,117 @@ namespace MarchingCube {
 class MarchingCubes : public RenderTree {
 
 	public:
-		MarchingCubes(unsigned int width, unsigned int height, unsigned int length, float voxelSize);	
+		//GPU_MESHING : histopyramid built by fragment shader reductions, traversed by a vertex shader + transform feedback
+		//CPU_MESHING : CpuMarchingCubes on the density field read back from the GPU
+		enum MeshingBackend { GPU_MESHING, CPU_MESHING };
+
+		//TRIANGLE_SOUP : 3 vertices per triangle, drawn with glDrawArrays
+		//INDEXED_MESH  : shared vertices + 32 bits index buffer, drawn with glDrawElements (CPU meshing only)
+		enum MeshLayout { TRIANGLE_SOUP, INDEXED_MESH };
+
+		//RAY_MARCHED_AO : 32 Poisson rays, 20 density fetches each (reference)
+		//CONE_TRACED_AO : 6, 14 or 26 cones (quality 0, 1, 2) traced in the mipmaps of an occupancy texture
+		enum AmbientOcclusion { RAY_MARCHED_AO, CONE_TRACED_AO };
+
+		//RGBA32F_NORMALS         : normal + occlusion, 16 bytes per voxel
+		//RG16_OCTAHEDRAL_NORMALS : octahedral normal (RG16) + occlusion in a separate R8 texture, 5 bytes per voxel
+		//RG8_OCTAHEDRAL_NORMALS  : octahedral normal (RG8) + occlusion in a separate R8 texture, 3 bytes per voxel
+		enum NormalsFormat { RGBA32F_NORMALS, RG16_OCTAHEDRAL_NORMALS, RG8_OCTAHEDRAL_NORMALS };
+
+		//R16F_DENSITY     : 2 bytes per voxel
+		//R8_SNORM_DENSITY : 1 byte per voxel, the field is scaled by 8 before being saturated to [-1,1]
+		enum DensityFormat { R16F_DENSITY, R8_SNORM_DENSITY };
+
+		MarchingCubes(unsigned int width, unsigned int height, unsigned int length, float voxelSize,
+				MeshingBackend meshingBackend = GPU_MESHING, MeshLayout meshLayout = TRIANGLE_SOUP,
+				NormalsFormat normalsFormat = RGBA32F_NORMALS, DensityFormat densityFormat = R16F_DENSITY);	
 		~MarchingCubes();	
 
+		//recomputes the normals and occlusion texture (the mesh is kept)
+		void setAmbientOcclusion(AmbientOcclusion mode, unsigned int quality = 1);
+
+		//times the normals pass for each occlusion mode and logs the mean absolute
+		//occlusion error against RAY_MARCHED_AO, the current mode is restored afterwards
+		void benchmarkAmbientOcclusion(unsigned int nRuns = 5);
+
+		//reads the density texture back and compares it to the CPU evaluation (DensityField::compare)
+		bool checkDensityField(float tolerance = 2.0e-3f) const;
+
+		//reads the GPU mesh back and compares it to CpuMarchingCubes::marchCompact on the read back density
+		//(same histopyramid layout, so the very same triangles in the same order), GPU_MESHING only
+		bool checkGpuMeshing(float tolerance = 1.0e-4f) const;
+
+		//CPU copy of the density field (field units, world coordinates) for the particles collisions
+		//the terrain is expected to be a child of the root, translated and uniformly scaled only
+		DensityVolume *makeDensityVolume() const;
+
+		//static uniform blocks, shared with the terrain bricks (TerrainChunks)
+		static unsigned int getLookupTableUBO();
+		static unsigned int getTriTableUBO();
+		static unsigned int getPoissonDistributionsUBO();
+
 	private:
 		Texture *_density;
 		Texture *_normals_occlusion;
+		Texture *_occupancy;
+		Texture *_occlusion; //packed normals formats only
 		Texture *_terrain_texture;
+		Texture *_histoPyramid; //GPU meshing only, level l holds the triangle counts of (2^l)^3 voxels
 
 		unsigned int _textureWidth, _textureHeight, _textureLength;
 		unsigned int _voxelGridWidth, _voxelGridHeight, _voxelGridLength;
 		float _voxelWidth, _voxelHeight, _voxelLength;
 
-		Program *_drawProgram, *_densityProgram, *_normalOcclusionProgram, *_marchingCubesProgram;
+		Program *_drawProgram, *_densityProgram, *_normalOcclusionProgram, *_occupancyProgram, *_marchingCubesProgram;
+		Program *_histoPyramidCountProgram, *_histoPyramidReduceProgram;
 		std::map<std::string,int> _drawUniformLocs, _densityUniformLocs, _normalOcclusionUniformLocs, _marchingCubesUniformLocs; 
 
-		unsigned int _vertexVBO, _fullscreenQuadVBO, _marchingCubesLowerLeftXY_VBO;           
+		unsigned int _frameBuffer;
+		AmbientOcclusion _aoMode;
+		unsigned int _aoQuality;
+
+		unsigned int _vertexVBO, _fullscreenQuadVBO, _triangleCornerVBO;           
 		
+		unsigned int _histoPyramidSize, _histoPyramidTopLevel; //next power of two of the voxel grid, log2 of it
+
 		unsigned int _marchingCubesFeedbackVertexTBO;
-		unsigned int _nTriangles;
+		unsigned int _feedbackCapacity;      //triangles
+		unsigned int _marchingCubesIndexBuffer;
+		unsigned int _nTriangles, _nVertices;
+
+		unsigned int _vertexShaderInvocationsQuery; //GL_ARB_pipeline_statistics_query, measured on the first draw
+		bool _vertexShaderInvocationsLogged;
 
 		unsigned int _generalDataUBO;
 
-		void computeDensitiesAndNormals();
+		MeshingBackend _meshingBackend;
+		MeshLayout _meshLayout;
+		NormalsFormat _normalsFormat;
+		DensityFormat _densityFormat;
+		float _densityScale;
+
+		void computeDensities();
+		void computeNormals();
+		void computeOccupancy();
 		void marchCubes();
+		void marchCubesGPU();
+		unsigned int buildHistoPyramid();
+		void marchCubesCPU();
+		void logMeshMemory() const;
+		void logTextureMemory() const;
+		void logVertexShaderInvocations();
 		void drawDownwards(const float *currentTransformationMatrix = consts::identity4);
 
 		void makeDrawProgram();
 		void makeDensityProgram();
 		void makeNormalOcclusionProgram();
+		void makeOccupancyProgram();
 		void makeMarchingCubesProgram();
+		void makeHistoPyramidPrograms();
 
 		void generateQuads();
 		void generateFullScreenQuad();
-		void generateMarchingCubesPoints();
+		void generateTriangleCorners();
 		
 		static void generateUniformBlockBuffers();
 		static bool _init;
@@ -0,0 +1,188 @@
+
+#include "headers.h"
+#include "terrainBrick.h"
+
+#include <algorithm>
+
+TerrainBrick::TerrainBrick(int i, int j, int k, unsigned int samples) :
+	_i(i), _j(j), _k(k), _samples(samples),
+	_density(0), _normalsOcclusion(0),
+	_vertexVBO(0), _indexBuffer(0),
+	_nTriangles(0), _nVertices(0),
+	_fullResolutionTriangles(0),
+	_lod(0), _seams(0),
+	_cpuDensity(samples*samples*samples, 0.0f),
+	_lastUsedFrame(0)
+{
+	_density = new Texture3D(samples, samples, samples, GL_R16F, 0, GL_RED, GL_FLOAT);
+	_density->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP));
+	_density->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP));
+	_density->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP));
+	_density->addParameter(Parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	_density->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+
+	_normalsOcclusion = new Texture3D(samples, samples, samples, GL_RGBA32F, 0, GL_RGBA, GL_FLOAT);
+	_normalsOcclusion->addParameter(Parameter(GL_TEXTURE_WRAP_S, GL_CLAMP));
+	_normalsOcclusion->addParameter(Parameter(GL_TEXTURE_WRAP_T, GL_CLAMP));
+	_normalsOcclusion->addParameter(Parameter(GL_TEXTURE_WRAP_R, GL_CLAMP));
+	_normalsOcclusion->addParameter(Parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	_normalsOcclusion->addParameter(Parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+
+	glGenBuffers(1, &_vertexVBO);
+	glGenBuffers(1, &_indexBuffer);
+}
+
+TerrainBrick::~TerrainBrick() {
+	delete _density;
+	delete _normalsOcclusion;
+
+	glDeleteBuffers(1, &_vertexVBO);
+	glDeleteBuffers(1, &_indexBuffer);
+}
+
+int TerrainBrick::getI() const {
+	return _i;
+}
+
+int TerrainBrick::getJ() const {
+	return _j;
+}
+
+int TerrainBrick::getK() const {
+	return _k;
+}
+
+Texture3D *TerrainBrick::getDensity() const {
+	return _density;
+}
+
+Texture3D *TerrainBrick::getNormalsOcclusion() const {
+	return _normalsOcclusion;
+}
+
+std::vector<float> &TerrainBrick::getCpuDensity() {
+	return _cpuDensity;
+}
+
+const std::vector<float> &TerrainBrick::getCpuDensity() const {
+	return _cpuDensity;
+}
+
+void TerrainBrick::markDirty(const unsigned int min[3], const unsigned int max[3]) {
+	for (unsigned int c = 0; c < 3; c++) {
+		_dirtyMin[c] = (_dirty ? std::min(_dirtyMin[c], min[c]) : min[c]);
+		_dirtyMax[c] = (_dirty ? std::max(_dirtyMax[c], max[c]) : max[c]);
+	}
+
+	_dirty = true;
+}
+
+bool TerrainBrick::isDirty() const {
+	return _dirty;
+}
+
+void TerrainBrick::getDirtyBox(unsigned int min[3], unsigned int max[3]) const {
+	for (unsigned int c = 0; c < 3; c++) {
+		min[c] = _dirtyMin[c];
+		max[c] = _dirtyMax[c];
+	}
+}
+
+void TerrainBrick::clearDirty() {
+	_dirty = false;
+}
+
+void TerrainBrick::setMesh(const std::vector<float> &vertices, const std::vector<unsigned int> &indices,
+		unsigned int lod, unsigned int seams) {
+	_nVertices = vertices.size()/3;
+	_nTriangles = indices.size()/3;
+	_lod = lod;
+	_seams = seams;
+	_meshPending = false;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexVBO);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(GLfloat), vertices.empty() ? 0 : &vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLuint), indices.empty() ? 0 : &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void TerrainBrick::drawMesh() const {
+	if(_nTriangles == 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexVBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+	glDrawElements(GL_TRIANGLES, _nTriangles*3, GL_UNSIGNED_INT, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+unsigned int TerrainBrick::getLod() const {
+	return _lod;
+}
+
+unsigned int TerrainBrick::getSeams() const {
+	return _seams;
+}
+
+void TerrainBrick::requestMesh(unsigned long ticket, unsigned int lod, unsigned int seams) {
+	_meshPending = true;
+	_pendingTicket = ticket;
+	_requestedLod = lod;
+	_requestedSeams = seams;
+}
+
+bool TerrainBrick::isMeshPending() const {
+	return _meshPending;
+}
+
+unsigned long TerrainBrick::getPendingTicket() const {
+	return _pendingTicket;
+}
+
+unsigned int TerrainBrick::getRequestedLod() const {
+	return _meshPending ? _requestedLod : _lod;
+}
+
+unsigned int TerrainBrick::getRequestedSeams() const {
+	return _meshPending ? _requestedSeams : _seams;
+}
+
+unsigned int TerrainBrick::getTriangleCount() const {
+	return _nTriangles;
+}
+
+unsigned int TerrainBrick::getVertexCount() const {
+	return _nVertices;
+}
+
+unsigned int TerrainBrick::getFullResolutionTriangleCount() const {
+	return _fullResolutionTriangles;
+}
+
+void TerrainBrick::setFullResolutionTriangleCount(unsigned int nTriangles) {
+	_fullResolutionTriangles = nTriangles;
+}
+
+unsigned long TerrainBrick::getMemoryUsage() const {
+	unsigned long nSamples = (unsigned long)_samples*_samples*_samples;
+	unsigned long textures = nSamples*(1*sizeof(GLhalf) + 4*sizeof(GLfloat)) + _cpuDensity.size()*sizeof(float);
+	unsigned long mesh = (unsigned long)_nVertices*3*sizeof(GLfloat) + (unsigned long)_nTriangles*3*sizeof(GLuint);
+
+	return textures + mesh;
+}
+
+unsigned long TerrainBrick::getLastUsedFrame() const {
+	return _lastUsedFrame;
+}
+
+void TerrainBrick::setLastUsedFrame(unsigned long frame) {
+	_lastUsedFrame = frame;
+}
@@ -0,0 +1,89 @@
+
+#ifndef TERRAINBRICK_H
+#define TERRAINBRICK_H
+
+#include "texture3D.h"
+#include <vector>
+
+// One brick of a TerrainChunks streaming terrain
+// Owns its density and normals/occlusion textures (samples^3, apron included),
+// a CPU copy of the density (for re-meshing) and its indexed mesh, expressed in
+// the brick texture frame and generated at some level of detail.
+class TerrainBrick {
+
+	public:
+		TerrainBrick(int i, int j, int k, unsigned int samples);
+		~TerrainBrick();
+
+		int getI() const;
+		int getJ() const;
+		int getK() const;
+
+		Texture3D *getDensity() const;
+		Texture3D *getNormalsOcclusion() const;
+
+		//density evaluated with the first mesh, edits included (x first, then y, then z)
+		std::vector<float> &getCpuDensity();
+		const std::vector<float> &getCpuDensity() const;
+
+		//edited samples not uploaded yet : inclusive box in the brick texture frame,
+		//grown to contain every box marked since the last clearDirty
+		void markDirty(const unsigned int min[3], const unsigned int max[3]);
+		bool isDirty() const;
+		void getDirtyBox(unsigned int min[3], unsigned int max[3]) const;
+		void clearDirty();
+
+		//uploads the mesh (3 floats per vertex, 32 bits indices), ends the pending request if any
+		//lod : voxel stride is 2^lod, seams : TerrainChunks seam key the mesh was stitched for
+		void setMesh(const std::vector<float> &vertices, const std::vector<unsigned int> &indices,
+				unsigned int lod = 0, unsigned int seams = 0);
+
+		unsigned int getLod() const;
+		unsigned int getSeams() const;
+
+		//background meshing : the current mesh is drawn until the one of the latest ticket is set
+		void requestMesh(unsigned long ticket, unsigned int lod, unsigned int seams);
+		bool isMeshPending() const;
+		unsigned long getPendingTicket() const;
+		unsigned int getRequestedLod() const;   //pending mesh ones, or current ones
+		unsigned int getRequestedSeams() const;
+
+		//draw with the current program, vertex_position is attribute 0
+		void drawMesh() const;
+
+		unsigned int getTriangleCount() const;
+		unsigned int getVertexCount() const;
+
+		//triangles of the full resolution mesh (lod 0, no transition cells)
+		unsigned int getFullResolutionTriangleCount() const;
+		void setFullResolutionTriangleCount(unsigned int nTriangles);
+
+		//textures + CPU density + mesh buffers
+		unsigned long getMemoryUsage() const;
+
+		unsigned long getLastUsedFrame() const;
+		void setLastUsedFrame(unsigned long frame);
+
+	private:
+		int _i, _j, _k;
+		unsigned int _samples;
+
+		Texture3D *_density, *_normalsOcclusion;
+		unsigned int _vertexVBO, _indexBuffer;
+		unsigned int _nTriangles, _nVertices;
+		unsigned int _fullResolutionTriangles;
+		unsigned int _lod, _seams;
+
+		bool _meshPending;
+		unsigned long _pendingTicket;
+		unsigned int _requestedLod, _requestedSeams;
+
+		std::vector<float> _cpuDensity;
+
+		bool _dirty;
+		unsigned int _dirtyMin[3], _dirtyMax[3];
+
+		unsigned long _lastUsedFrame;
+};
+
+#endif /* end of include guard: TERRAINBRICK_H */
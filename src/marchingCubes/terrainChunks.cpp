@@ -0,0 +1,744 @@
+
+#include "headers.h"
+#include "terrainChunks.h"
+#include "marchingCubes.h"
+#include "cpuMarchingCubes.h"
+#include "transvoxel.h"
+#include "densityField.h"
+#include "globals.h"
+#include "matrix.h"
+#include "utils.h"
+#include "log.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	//bricks share the programs so their textures are not linked to them :
+	//ask the texture manager for a unit at each use, returns the unit
+	unsigned int bindBrickTexture(Texture *texture) {
+		if(!texture->isBinded())
+			texture->bindAndApplyParameters(Texture::requestTextures(1)[0]);
+
+		return texture->getLastKnownLocation();
+	}
+
+	//faces order : -X +X -Y +Y -Z +Z
+	const int faceNormal[6][3] = {
+		{-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}
+	};
+}
+
+TerrainChunks::TerrainChunks(float voxelSize, unsigned int brickSize,
+		float viewDistance, unsigned int maxResidentBricks) :
+	_voxelSize(voxelSize), _brickSize(brickSize), _apron(1), _samples(brickSize + 1 + 2*_apron),
+	_viewDistance(viewDistance),
+	_maxResidentBricks(maxResidentBricks), _maxBricksPerFrame(4),
+	_minHeight(0.0f), _maxHeight(100.0f),
+	_fieldSize(100.0f),
+	_lodDistance(viewDistance/4), _targetLodDistance(viewDistance/4), _maxLod(3), _triangleBudget(0),
+	_samplesEdited(0), _mesher(0), _meshTicket(0), _frame(0),
+	_drawProgram(0), _normalOcclusionProgram(0),
+	_fullscreenQuadVBO(0), _generalDataUBO(0), _frameBuffer(0)
+{
+	_stats.residentBricks = 0;
+	_stats.visibleBricks = 0;
+	_stats.bricksGeneratedLastFrame = 0;
+	_stats.bricksEvictedLastFrame = 0;
+	_stats.bricksRemeshedLastFrame = 0;
+	_stats.bricksEditedLastFrame = 0;
+	_stats.samplesEdited = 0;
+	_stats.meshesSwappedLastFrame = 0;
+	_stats.meshingQueueDepth = 0;
+	_stats.meshingLatency = 0.0f;
+	_stats.maxMeshingLatency = 0.0f;
+	_stats.totalBricksGenerated = 0;
+	_stats.residentMemory = 0;
+	_stats.trianglesSubmitted = 0;
+	_stats.fullResolutionTriangles = 0;
+
+	setLod(_lodDistance, _maxLod);
+	_stats.lodDistance = _lodDistance;
+
+	//same layout as MarchingCubes general data, for one brick texture
+	GLfloat generalData[12] = {
+		(GLfloat)_samples,     (GLfloat)_samples,     (GLfloat)_samples,     0.0f,
+		(GLfloat)(_samples-1), (GLfloat)(_samples-1), (GLfloat)(_samples-1), 0.0f,
+		_voxelSize,            _voxelSize,            _voxelSize,            0.0f
+	};
+
+	glGenBuffers(1, &_generalDataUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, _generalDataUBO);
+	glBufferData(GL_UNIFORM_BUFFER, 12*sizeof(GLfloat), generalData, GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glGenFramebuffers(1, &_frameBuffer);
+
+	generateFullScreenQuad();
+
+	makeNormalOcclusionProgram();
+	makeDrawProgram();
+
+	_mesher = new BrickMesher([this](const BrickMesher::Job &job, BrickMesher::Result &result) {
+		buildBrickMesh(job, result);
+	});
+
+	log_console.infoStream() << "[Terrain Chunks] Bricks of " << _brickSize << "^3 voxels (" << _samples << "^3 samples), view distance "
+		<< _viewDistance << ", at most " << _maxResidentBricks << " resident bricks.";
+}
+
+TerrainChunks::~TerrainChunks() {
+	//joins the mesher thread before the bricks go away
+	delete _mesher;
+
+	std::map<BrickId, TerrainBrick*>::iterator it;
+	for (it = _bricks.begin(); it != _bricks.end(); ++it) {
+		delete it->second;
+	}
+
+	delete _drawProgram;
+	delete _normalOcclusionProgram;
+
+	glDeleteBuffers(1, &_fullscreenQuadVBO);
+	glDeleteBuffers(1, &_generalDataUBO);
+	glDeleteFramebuffers(1, &_frameBuffer);
+}
+
+void TerrainChunks::setHeightRange(float minHeight, float maxHeight) {
+	_minHeight = minHeight;
+	_maxHeight = maxHeight;
+}
+
+void TerrainChunks::setGenerationBudget(unsigned int maxBricksPerFrame) {
+	_maxBricksPerFrame = maxBricksPerFrame;
+}
+
+void TerrainChunks::setLod(float lodDistance, unsigned int maxLod) {
+	//not under a brick : neighbour bricks are then at most one level apart, as the transition cells require
+	_lodDistance = std::max(lodDistance, _brickSize*_voxelSize);
+	_targetLodDistance = _lodDistance;
+
+	//the coarsest stride must divide the brick size and leave two voxels (transition cells on opposite faces)
+	_maxLod = maxLod;
+	while(_maxLod > 0 && ((2u << _maxLod) > _brickSize || _brickSize % (1u << _maxLod) != 0))
+		_maxLod--;
+}
+
+void TerrainChunks::setTriangleBudget(unsigned long maxTriangles) {
+	_triangleBudget = maxTriangles;
+}
+
+void TerrainChunks::addSphere(const qglviewer::Vec &center, float radius) {
+	applyBrush(center, radius, ADD_MATTER);
+}
+
+void TerrainChunks::subtractSphere(const qglviewer::Vec &center, float radius) {
+	applyBrush(center, radius, REMOVE_MATTER);
+}
+
+void TerrainChunks::applyBrush(const qglviewer::Vec &center, float radius, BrushOperation operation) {
+	Brush brush;
+	brush.center = center;
+	brush.radius = radius;
+	brush.operation = operation;
+	_edits.push_back(brush);
+	unsigned int edit = _edits.size() - 1;
+
+	//bricks whose samples (apron included) intersect the brush bounding box
+	float extent = radius + _voxelSize;
+	float apron = _apron*_voxelSize;
+	float brickWorldSize = _brickSize*_voxelSize;
+	int min[3], max[3];
+	for (unsigned int c = 0; c < 3; c++) {
+		min[c] = (int) ceilf((center[c] - extent - apron)/brickWorldSize) - 1;
+		max[c] = (int) floorf((center[c] + extent + apron)/brickWorldSize);
+	}
+
+	for (int k = min[2]; k <= max[2]; k++) {
+		for (int j = min[1]; j <= max[1]; j++) {
+			for (int i = min[0]; i <= max[0]; i++) {
+				_brickEdits[BrickId(i,j,k)].push_back(edit);
+
+				//bricks waiting for their density get the edit when it arrives
+				std::map<BrickId, TerrainBrick*>::iterator found = _bricks.find(BrickId(i,j,k));
+				if(found != _bricks.end() && _pendingDensities.count(found->first) == 0 && applyBrushToBrick(brush, found->second))
+					_dirtyBricks.insert(found->first);
+			}
+		}
+	}
+}
+
+const TerrainChunks::Stats &TerrainChunks::getStats() const {
+	return _stats;
+}
+
+DensityVolume *TerrainChunks::makeDensityVolume(unsigned int width, unsigned int height, unsigned int length) const {
+	const float *modelMatrix = getRelativeModelMatrix();
+	float origin[3] = {modelMatrix[3], modelMatrix[7], modelMatrix[11]};
+
+	DensityVolume *volume = new DensityVolume(width, height, length, _voxelSize*modelMatrix[0], origin);
+	float *density = volume->getSamples();
+
+	//same mapping as the bricks samples
+	float fieldOrigin[3] = {0.0f, 0.0f, 0.0f};
+	float step[3] = {_voxelSize/_fieldSize, _voxelSize/_fieldSize, _voxelSize/_fieldSize};
+	DensityField::fill(width, height, length, fieldOrigin, step, density);
+
+	unsigned int size[3] = {width, height, length};
+	unsigned int min[3], max[3];
+	std::vector<Brush>::const_iterator it;
+	for (it = _edits.begin(); it != _edits.end(); ++it) {
+		applyBrushToSamples(*it, qglviewer::Vec(0.0f, 0.0f, 0.0f), size, density, min, max);
+	}
+
+	return volume;
+}
+
+void TerrainChunks::drawDownwards(const float *currentTransformationMatrix) {
+
+	//camera position in the terrain frame
+	qglviewer::Vec worldCameraPos = Globals::camera->position();
+	float inverse[16];
+	Matrix::inverseMat4f(currentTransformationMatrix, inverse);
+	qglviewer::Vec cameraPos(
+			inverse[0]*worldCameraPos.x + inverse[1]*worldCameraPos.y + inverse[2]*worldCameraPos.z + inverse[3],
+			inverse[4]*worldCameraPos.x + inverse[5]*worldCameraPos.y + inverse[6]*worldCameraPos.z + inverse[7],
+			inverse[8]*worldCameraPos.x + inverse[9]*worldCameraPos.y + inverse[10]*worldCameraPos.z + inverse[11]);
+
+	std::vector<TerrainBrick*> visibleBricks;
+	updateResidentBricks(cameraPos, visibleBricks);
+
+	_drawProgram->use();
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0,  Globals::projectionViewUniformBlock);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1, _generalDataUBO);
+	glUniformMatrix4fv(_drawUniformLocs["modelMatrix"], 1, GL_TRUE, currentTransformationMatrix);
+	glUniform3f(_drawUniformLocs["terrainSize"], _fieldSize, _fieldSize, _fieldSize);
+
+	std::vector<TerrainBrick*>::const_iterator it;
+	for (it = visibleBricks.begin(); it != visibleBricks.end(); ++it) {
+		TerrainBrick *brick = *it;
+		if(brick->getTriangleCount() == 0)
+			continue;
+
+		qglviewer::Vec origin = getBrickOrigin(brick->getI(), brick->getJ(), brick->getK());
+		glUniform3f(_drawUniformLocs["brickOrigin"], origin.x, origin.y, origin.z);
+		glUniform1i(_drawUniformLocs["normals_occlusion"], bindBrickTexture(brick->getNormalsOcclusion()));
+
+		brick->drawMesh();
+	}
+
+	glUseProgram(0);
+}
+
+void TerrainChunks::updateResidentBricks(const qglviewer::Vec &cameraPos, std::vector<TerrainBrick*> &visibleBricks) {
+	_frame++;
+	_stats.bricksGeneratedLastFrame = 0;
+	_stats.bricksEvictedLastFrame = 0;
+	_stats.bricksRemeshedLastFrame = 0;
+
+	swapMeshes();
+	updateEditedBricks();
+
+	float brickWorldSize = _brickSize*_voxelSize;
+	float halfDiagonal = 0.5f*sqrtf(3.0f)*brickWorldSize;
+	int radius = (int) ceilf(_viewDistance/brickWorldSize);
+
+	int ci = (int) floorf(cameraPos.x/brickWorldSize);
+	int cj = (int) floorf(cameraPos.y/brickWorldSize);
+	int ck = (int) floorf(cameraPos.z/brickWorldSize);
+
+	int jMin = std::max(cj - radius, (int) floorf(_minHeight/brickWorldSize));
+	int jMax = std::min(cj + radius, (int) ceilf(_maxHeight/brickWorldSize) - 1);
+
+	//bricks intersecting the view sphere, closest first
+	std::vector<std::pair<float, BrickId> > wanted;
+	for (int k = ck - radius; k <= ck + radius; k++) {
+		for (int j = jMin; j <= jMax; j++) {
+			for (int i = ci - radius; i <= ci + radius; i++) {
+				qglviewer::Vec center((i+0.5f)*brickWorldSize, (j+0.5f)*brickWorldSize, (k+0.5f)*brickWorldSize);
+				float distance = (center - cameraPos).norm();
+				if(distance <= _viewDistance + halfDiagonal)
+					wanted.push_back(std::pair<float, BrickId>(distance, BrickId(i,j,k)));
+			}
+		}
+	}
+	std::sort(wanted.begin(), wanted.end());
+
+	//resident bricks are marked first so that they can not be evicted this frame
+	std::vector<BrickId> missing;
+	std::vector<std::pair<float, BrickId> >::const_iterator it;
+	for (it = wanted.begin(); it != wanted.end(); ++it) {
+		std::map<BrickId, TerrainBrick*>::iterator found = _bricks.find(it->second);
+		if(found == _bricks.end()) {
+			missing.push_back(it->second);
+			continue;
+		}
+
+		TerrainBrick *brick = found->second;
+		brick->setLastUsedFrame(_frame);
+
+		//closest bricks first, the others keep their previous mesh until next frames
+		if(_stats.bricksRemeshedLastFrame < 4*_maxBricksPerFrame && _pendingDensities.count(it->second) == 0) {
+			int i = std::get<0>(it->second), j = std::get<1>(it->second), k = std::get<2>(it->second);
+			unsigned int lod = computeLod(i, j, k, cameraPos);
+			unsigned int seams = computeSeams(i, j, k, lod, cameraPos);
+
+			if(lod != brick->getRequestedLod() || seams != brick->getRequestedSeams()) {
+				meshBrick(brick, lod, seams);
+				_stats.bricksRemeshedLastFrame++;
+			}
+		}
+	}
+
+	std::vector<BrickId>::const_iterator id;
+	//do not pile up jobs faster than the mesher can process them
+	unsigned int maxQueueDepth = 4*_maxBricksPerFrame;
+	for (id = missing.begin(); id != missing.end() && _stats.bricksGeneratedLastFrame < _maxBricksPerFrame
+			&& _mesher->getQueueDepth() < maxQueueDepth; ++id) {
+		if(_bricks.size() >= _maxResidentBricks && !evictLeastRecentlyUsedBrick())
+			break; //every resident brick is visible
+
+		int i = std::get<0>(*id), j = std::get<1>(*id), k = std::get<2>(*id);
+		unsigned int lod = computeLod(i, j, k, cameraPos);
+
+		TerrainBrick *brick = generateBrick(i, j, k, lod, computeSeams(i, j, k, lod, cameraPos));
+		brick->setLastUsedFrame(_frame);
+		_bricks[*id] = brick;
+
+		_stats.bricksGeneratedLastFrame++;
+		_stats.totalBricksGenerated++;
+	}
+
+	//draw order : closest first
+	_stats.trianglesSubmitted = 0;
+	_stats.fullResolutionTriangles = 0;
+	for (it = wanted.begin(); it != wanted.end(); ++it) {
+		std::map<BrickId, TerrainBrick*>::iterator found = _bricks.find(it->second);
+		if(found == _bricks.end())
+			continue;
+
+		visibleBricks.push_back(found->second);
+		_stats.trianglesSubmitted += found->second->getTriangleCount();
+		_stats.fullResolutionTriangles += found->second->getFullResolutionTriangleCount();
+	}
+
+	updateLodDistance();
+
+	_stats.residentBricks = _bricks.size();
+	_stats.visibleBricks = visibleBricks.size();
+	_stats.residentMemory = 0;
+	std::map<BrickId, TerrainBrick*>::const_iterator brick;
+	for (brick = _bricks.begin(); brick != _bricks.end(); ++brick) {
+		_stats.residentMemory += brick->second->getMemoryUsage();
+	}
+
+	const BrickMesher::Stats &mesherStats = _mesher->getStats();
+	_stats.meshingQueueDepth = _mesher->getQueueDepth();
+	_stats.meshingLatency = mesherStats.averageLatency;
+	_stats.maxMeshingLatency = mesherStats.maxLatency;
+
+	if(_stats.bricksGeneratedLastFrame > 0 || _stats.bricksRemeshedLastFrame > 0 || _stats.bricksEditedLastFrame > 0) {
+		log_console.infoStream() << "[Terrain Chunks] Frame " << _frame << " : generated " << _stats.bricksGeneratedLastFrame
+			<< " bricks, re-meshed " << _stats.bricksRemeshedLastFrame << ", edited " << _stats.bricksEditedLastFrame
+			<< " (" << _stats.samplesEdited << " samples), evicted " << _stats.bricksEvictedLastFrame 
+			<< " (" << _stats.residentBricks << " resident, " << _stats.visibleBricks << " visible, " 
+			<< _stats.residentMemory/(1024*1024) << " MB).";
+		log_console.infoStream() << "[Terrain Chunks] Submitted " << _stats.trianglesSubmitted << " triangles ("
+			<< _stats.fullResolutionTriangles << " at full resolution), lod distance " << _stats.lodDistance << ".";
+		log_console.infoStream() << "[Terrain Chunks] Meshing : " << _stats.meshingQueueDepth << " jobs queued, "
+			<< _stats.meshesSwappedLastFrame << " meshes swapped, latency " << _stats.meshingLatency << " ms (max " 
+			<< _stats.maxMeshingLatency << " ms).";
+	}
+}
+
+unsigned int TerrainChunks::computeLod(int i, int j, int k, const qglviewer::Vec &cameraPos) const {
+	float brickWorldSize = _brickSize*_voxelSize;
+	qglviewer::Vec center((i+0.5f)*brickWorldSize, (j+0.5f)*brickWorldSize, (k+0.5f)*brickWorldSize);
+	float distance = (center - cameraPos).norm();
+
+	unsigned int lod = 0;
+	while(lod < _maxLod && distance > _lodDistance*(1u << lod))
+		lod++;
+
+	return lod;
+}
+
+unsigned int TerrainChunks::computeSeams(int i, int j, int k, unsigned int lod, const qglviewer::Vec &cameraPos) const {
+	unsigned int seams = 0;
+
+	for (unsigned int face = 0; face < 6; face++) {
+		unsigned int neighbourLod = computeLod(i + faceNormal[face][0], j + faceNormal[face][1], k + faceNormal[face][2], cameraPos);
+		if(neighbourLod < lod)
+			seams |= 1u << face;
+	}
+
+	return seams;
+}
+
+void TerrainChunks::updateLodDistance() {
+	float minLodDistance = _brickSize*_voxelSize;
+
+	if(_triangleBudget != 0) {
+		if(_stats.trianglesSubmitted > _triangleBudget)
+			_lodDistance = std::max(minLodDistance, 0.9f*_lodDistance);
+		else if(_stats.trianglesSubmitted < 0.8f*_triangleBudget)
+			_lodDistance = std::min(_targetLodDistance, 1.1f*_lodDistance);
+	}
+	else {
+		_lodDistance = _targetLodDistance;
+	}
+
+	_stats.lodDistance = _lodDistance;
+}
+
+bool TerrainChunks::evictLeastRecentlyUsedBrick() {
+	std::map<BrickId, TerrainBrick*>::iterator it, lru = _bricks.end();
+	for (it = _bricks.begin(); it != _bricks.end(); ++it) {
+		if(it->second->getLastUsedFrame() == _frame)
+			continue;
+
+		if(lru == _bricks.end() || it->second->getLastUsedFrame() < lru->second->getLastUsedFrame())
+			lru = it;
+	}
+
+	if(lru == _bricks.end())
+		return false;
+
+	delete lru->second;
+	_dirtyBricks.erase(lru->first);
+	_pendingDensities.erase(lru->first);
+	_bricks.erase(lru);
+	_stats.bricksEvictedLastFrame++;
+
+	return true;
+}
+
+void TerrainChunks::updateEditedBricks() {
+	_stats.bricksEditedLastFrame = 0;
+
+	std::set<BrickId>::const_iterator it;
+	for (it = _dirtyBricks.begin(); it != _dirtyBricks.end(); ++it) {
+		TerrainBrick *brick = _bricks[*it];
+
+		unsigned int min[3], max[3];
+		brick->getDirtyBox(min, max);
+		uploadDensity(brick, min, max);
+
+		//the gradient and occlusion of the samples next to the edited ones changed too
+		for (unsigned int c = 0; c < 3; c++) {
+			min[c] = (min[c] > 0 ? min[c] - 1 : 0);
+			max[c] = std::min(max[c] + 1, _samples - 1);
+		}
+		computeBrickNormals(brick, min, max);
+
+		meshBrick(brick, brick->getRequestedLod(), brick->getRequestedSeams());
+		brick->clearDirty();
+
+		_stats.bricksEditedLastFrame++;
+	}
+
+	_dirtyBricks.clear();
+	_stats.samplesEdited = _samplesEdited;
+	_samplesEdited = 0;
+}
+
+void TerrainChunks::swapMeshes() {
+	_stats.meshesSwappedLastFrame = 0;
+
+	BrickMesher::Result *result;
+	while((result = _mesher->pollResult()) != 0) {
+		std::map<BrickId, TerrainBrick*>::iterator found = _bricks.find(BrickId(result->i, result->j, result->k));
+
+		//evicted brick, or a newer mesh was requested since
+		if(found != _bricks.end() && found->second->isMeshPending() && found->second->getPendingTicket() == result->ticket) {
+			TerrainBrick *brick = found->second;
+			bool outdated = (!result->density.empty() && setGeneratedDensity(brick, result->density));
+
+			brick->setMesh(result->vertices, result->indices, result->lod, result->seams);
+			brick->setFullResolutionTriangleCount(result->fullResolutionTriangles);
+			_stats.meshesSwappedLastFrame++;
+
+			if(outdated)
+				meshBrick(brick, result->lod, result->seams);
+		}
+
+		delete result;
+	}
+}
+
+TerrainBrick *TerrainChunks::generateBrick(int i, int j, int k, unsigned int lod, unsigned int seams) {
+	TerrainBrick *brick = new TerrainBrick(i, j, k, _samples);
+
+	//density and first mesh on the mesher thread, the textures are filled when they come back (swapMeshes)
+	_pendingDensities[BrickId(i,j,k)] = _edits.size();
+	meshBrick(brick, lod, seams, true);
+
+	return brick;
+}
+
+bool TerrainChunks::setGeneratedDensity(TerrainBrick *brick, std::vector<float> &density) {
+	BrickId id(brick->getI(), brick->getJ(), brick->getK());
+	brick->getCpuDensity().swap(density);
+
+	//edits applied after the job was submitted
+	unsigned int firstEdit = _pendingDensities[id];
+	_pendingDensities.erase(id);
+
+	std::map<BrickId, std::vector<unsigned int> >::const_iterator edits = _brickEdits.find(id);
+	if(edits != _brickEdits.end()) {
+		std::vector<unsigned int>::const_iterator it;
+		for (it = edits->second.begin(); it != edits->second.end(); ++it) {
+			if(*it >= firstEdit)
+				applyBrushToBrick(_edits[*it], brick);
+		}
+	}
+
+	//allocate the normals texture before rendering into it
+	bindBrickTexture(brick->getNormalsOcclusion());
+
+	unsigned int min[3] = {0, 0, 0}, max[3] = {_samples-1, _samples-1, _samples-1};
+	uploadDensity(brick, min, max);
+	computeBrickNormals(brick, min, max);
+
+	bool outdated = brick->isDirty();
+	brick->clearDirty();
+
+	return outdated;
+}
+
+void TerrainChunks::computeBrickNormals(TerrainBrick *brick, const unsigned int min[3], const unsigned int max[3]) {
+
+	glBindFramebuffer(GL_FRAMEBUFFER, _frameBuffer);
+	glDisable(GL_DEPTH_TEST);
+
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, brick->getNormalsOcclusion()->getTextureId(), 0);
+
+	static const GLenum DrawBuffers[1] = {GL_COLOR_ATTACHMENT0};
+	glDrawBuffers(1, DrawBuffers);
+
+	Utils::checkFrameBufferStatus();
+
+	//only the layers of the box are rendered, and only its rectangle in each of them
+	glPushAttrib(GL_VIEWPORT_BIT | GL_SCISSOR_BIT);
+	glViewport(0,0,_samples,_samples);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(min[0], min[1], max[0] - min[0] + 1, max[1] - min[1] + 1);
+
+	_normalOcclusionProgram->use();
+	glUniform1i(_normalOcclusionUniformLocs["density"], bindBrickTexture(brick->getDensity()));
+	glUniform1i(_normalOcclusionUniformLocs["layerOffset"], min[2]);
+
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0 , MarchingCubes::getPoissonDistributionsUBO());
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1 , _generalDataUBO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, _fullscreenQuadVBO);
+	glEnableVertexAttribArray(0);
+	glVertexAttribDivisor(0,0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, max[2] - min[2] + 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glEnable(GL_DEPTH_TEST);
+
+	glUseProgram(0);
+
+	glPopAttrib();
+}
+
+void TerrainChunks::uploadDensity(TerrainBrick *brick, const unsigned int min[3], const unsigned int max[3]) {
+	const std::vector<float> &density = brick->getCpuDensity();
+	unsigned int size[3] = {max[0] - min[0] + 1, max[1] - min[1] + 1, max[2] - min[2] + 1};
+
+	std::vector<float> box(size[0]*size[1]*size[2]);
+	for (unsigned int k = 0; k < size[2]; k++) {
+		for (unsigned int j = 0; j < size[1]; j++) {
+			const float *src = &density[((min[2]+k)*_samples + (min[1]+j))*_samples + min[0]];
+			std::copy(src, src + size[0], &box[(k*size[1] + j)*size[0]]);
+		}
+	}
+
+	glActiveTexture(GL_TEXTURE0 + bindBrickTexture(brick->getDensity()));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, min[0], min[1], min[2], size[0], size[1], size[2], GL_RED, GL_FLOAT, &box[0]);
+}
+
+bool TerrainChunks::applyBrushToBrick(const Brush &brush, TerrainBrick *brick) {
+	qglviewer::Vec origin = getBrickOrigin(brick->getI(), brick->getJ(), brick->getK());
+	unsigned int size[3] = {_samples, _samples, _samples};
+	unsigned int min[3], max[3];
+
+	if(!applyBrushToSamples(brush, origin, size, &brick->getCpuDensity()[0], min, max))
+		return false;
+
+	brick->markDirty(min, max);
+	_samplesEdited += (unsigned long)(max[0] - min[0] + 1)*(max[1] - min[1] + 1)*(max[2] - min[2] + 1);
+
+	return true;
+}
+
+bool TerrainChunks::applyBrushToSamples(const Brush &brush, const qglviewer::Vec &origin, const unsigned int size[3],
+		float *density, unsigned int min[3], unsigned int max[3]) const {
+
+	//samples of the brush bounding box, one voxel margin so that the surface crossing at the
+	//sphere boundary is not cut by the box
+	float extent = brush.radius + _voxelSize;
+	for (unsigned int c = 0; c < 3; c++) {
+		float lo = ceilf((brush.center[c] - extent - origin[c])/_voxelSize);
+		float hi = floorf((brush.center[c] + extent - origin[c])/_voxelSize);
+		if(hi < 0.0f || lo > size[c] - 1.0f)
+			return false;
+
+		min[c] = (unsigned int) std::max(lo, 0.0f);
+		max[c] = (unsigned int) std::min(hi, size[c] - 1.0f);
+	}
+
+	//the density is roughly minus the height in field units : the sphere is a signed distance in the
+	//same units, positive inside, and is merged with a max (add) or carved with a min (remove)
+	for (unsigned int k = min[2]; k <= max[2]; k++) {
+		for (unsigned int j = min[1]; j <= max[1]; j++) {
+			float *row = &density[(k*size[1] + j)*size[0]];
+			for (unsigned int i = min[0]; i <= max[0]; i++) {
+				qglviewer::Vec p = origin + _voxelSize*qglviewer::Vec(i, j, k);
+				float sphere = (brush.radius - (p - brush.center).norm())/_fieldSize;
+
+				if(brush.operation == ADD_MATTER)
+					row[i] = std::max(row[i], sphere);
+				else
+					row[i] = std::min(row[i], -sphere);
+			}
+		}
+	}
+
+	return true;
+}
+
+void TerrainChunks::meshBrick(TerrainBrick *brick, unsigned int lod, unsigned int seams, bool generateDensity) {
+	BrickMesher::Job *job = new BrickMesher::Job;
+	job->i = brick->getI();
+	job->j = brick->getJ();
+	job->k = brick->getK();
+	job->lod = lod;
+	job->seams = seams;
+	job->ticket = ++_meshTicket;
+
+	if(generateDensity) {
+		//same mapping as makeDensityVolume, with the edits reaching the brick so far (copied)
+		qglviewer::Vec origin = getBrickOrigin(job->i, job->j, job->k);
+		std::vector<Brush> brushes;
+		std::map<BrickId, std::vector<unsigned int> >::const_iterator edits = _brickEdits.find(BrickId(job->i, job->j, job->k));
+		if(edits != _brickEdits.end()) {
+			std::vector<unsigned int>::const_iterator it;
+			for (it = edits->second.begin(); it != edits->second.end(); ++it) {
+				brushes.push_back(_edits[*it]);
+			}
+		}
+
+		job->generateDensity = [this, origin, brushes](std::vector<float> &density) {
+			float fieldOrigin[3] = {(float)(origin.x/_fieldSize), (float)(origin.y/_fieldSize), (float)(origin.z/_fieldSize)};
+			float step[3] = {_voxelSize/_fieldSize, _voxelSize/_fieldSize, _voxelSize/_fieldSize};
+			density.resize(_samples*_samples*_samples);
+			DensityField::fill(_samples, _samples, _samples, fieldOrigin, step, &density[0]);
+
+			unsigned int size[3] = {_samples, _samples, _samples};
+			unsigned int min[3], max[3];
+			std::vector<Brush>::const_iterator it;
+			for (it = brushes.begin(); it != brushes.end(); ++it) {
+				applyBrushToSamples(*it, origin, size, &density[0], min, max);
+			}
+		};
+	}
+	else {
+		job->density = brick->getCpuDensity(); //copy, edits keep going on the brick one
+	}
+
+	brick->requestMesh(job->ticket, lod, seams);
+	_mesher->submit(job);
+}
+
+void TerrainChunks::buildBrickMesh(const BrickMesher::Job &job, BrickMesher::Result &result) const {
+	//new brick : its density is evaluated here, off the render thread, and goes back with the mesh
+	if(job.generateDensity)
+		job.generateDensity(result.density);
+	const std::vector<float> &density = (job.generateDensity ? result.density : job.density);
+	unsigned int lod = job.lod, seams = job.seams;
+
+	//full resolution samples without the apron, also the reference of the lod statistics
+	unsigned int m = _brickSize + 1;
+	std::vector<float> inner(m*m*m);
+	for (unsigned int k = 0; k < m; k++) {
+		for (unsigned int j = 0; j < m; j++) {
+			const float *src = &density[((k+_apron)*_samples + (j+_apron))*_samples + _apron];
+			std::copy(src, src + m, &inner[(k*m + j)*m]);
+		}
+	}
+
+	CpuMarchingCubes fullResolution(m, m, m, _voxelSize, _voxelSize, _voxelSize);
+	result.fullResolutionTriangles = fullResolution.countTriangles(&inner[0]);
+
+	//only the brickSize^3 voxels inside the apron are meshed, one sample every 2^lod, with
+	//transition cells on the faces next to a finer brick
+	std::vector<float> &vertices = result.vertices;
+	std::vector<unsigned int> &indices = result.indices;
+	Transvoxel::march(&inner[0], m, 1u << lod, _voxelSize, seams, vertices, indices);
+
+	//back to the brick texture frame
+	float offset = _apron*_voxelSize;
+	for (unsigned int i = 0; i < vertices.size(); i++) {
+		vertices[i] += offset;
+	}
+}
+
+qglviewer::Vec TerrainChunks::getBrickOrigin(int i, int j, int k) const {
+	float brickWorldSize = _brickSize*_voxelSize;
+	float apron = _apron*_voxelSize;
+
+	return qglviewer::Vec(i*brickWorldSize - apron, j*brickWorldSize - apron, k*brickWorldSize - apron);
+}
+
+void TerrainChunks::generateFullScreenQuad() {
+	float buffer[] = {
+		-1.0f, -1.0f, 0.0f,
+		1.0f, -1.0f, 0.0f,
+		1.0f, 1.0f, 0.0f,
+
+		-1.0f, 1.0f, 0.0f,
+		-1.0f, -1.0f, 0.0f,
+		1.0f, 1.0f, 0.0f,
+	};
+
+	glGenBuffers(1, &_fullscreenQuadVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, _fullscreenQuadVBO);
+	glBufferData(GL_ARRAY_BUFFER, 6*3*sizeof(float), buffer, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void TerrainChunks::makeDrawProgram() {
+	_drawProgram = new Program("Terrain Chunks Draw");
+	_drawProgram->bindAttribLocation(0, "vertex_position");
+	_drawProgram->bindFragDataLocation(0, "out_colour");
+	_drawProgram->bindUniformBufferLocations("0 1", "projectionView generalData");
+
+	_drawProgram->attachShader(Shader("shaders/marchingCubes/draw_vs.glsl", GL_VERTEX_SHADER));
+	_drawProgram->attachShader(Shader("shaders/marchingCubes/draw_fs.glsl", GL_FRAGMENT_SHADER));
+
+	_drawProgram->link();
+	_drawUniformLocs = _drawProgram->getUniformLocationsMap("modelMatrix brickOrigin normals_occlusion terrainSize", true);
+}
+
+void TerrainChunks::makeNormalOcclusionProgram() {
+	_normalOcclusionProgram = new Program("Terrain Chunks Normal & Occlusion");
+	_normalOcclusionProgram->bindAttribLocations("0", "vertex_position");
+	_normalOcclusionProgram->bindFragDataLocation(0, "out_colour");
+	_normalOcclusionProgram->bindUniformBufferLocations("0 1", "poissonDistributions generalData");
+
+	_normalOcclusionProgram->attachShader(Shader("shaders/marchingCubes/normals_vs.glsl", GL_VERTEX_SHADER));
+	_normalOcclusionProgram->attachShader(Shader("shaders/marchingCubes/normals_gs.glsl", GL_GEOMETRY_SHADER));
+	_normalOcclusionProgram->attachShader(Shader("shaders/marchingCubes/normals_fs.glsl", GL_FRAGMENT_SHADER));
+
+	_normalOcclusionProgram->link();
+
+	_normalOcclusionUniformLocs = _normalOcclusionProgram->getUniformLocationsMap("density layerOffset", true);
+}
@@ -0,0 +1,155 @@
+
+#ifndef TERRAINCHUNKS_H
+#define TERRAINCHUNKS_H
+
+#include "renderTree.h"
+#include "program.h"
+#include "terrainBrick.h"
+#include "brickMesher.h"
+#include "densityVolume.h"
+
+#include <map>
+#include <set>
+#include <vector>
+#include <tuple>
+
+// Streaming version of the MarchingCubes terrain
+// The density field is tiled into bricks of brickSize^3 voxels, each one stored in
+// a (brickSize+1+2*apron)^3 texture so that normals and occlusion match across seams.
+// Bricks around the camera (Globals::viewer) are generated on the fly (density with DensityField and
+// indexed mesh on a BrickMesher background thread, swapped in at frame start, then density uploaded and
+// normals computed on the GPU) and the least recently used ones are evicted when more than maxResidentBricks
+// are resident, so memory stays constant whatever the world size.
+// Level of detail : farther bricks are meshed with a 2, 4 or 8 voxels stride. Neighbour bricks are at most
+// one level apart, and the faces of a brick next to a finer brick get Transvoxel transition cells (Transvoxel::march).
+// Terrain frame : the [0,fieldSize]^3 cube matches the 128^3 MarchingCubes terrain.
+// Editing : brushes only touch the samples of the resident bricks inside their bounding box. Those
+// bricks are marked dirty and, next frame, only the edited part of their density texture and the normals
+// and occlusion of the samples around it are recomputed, before the bricks are re-meshed.
+// Edits are kept, and indexed by the bricks their bounding box reaches (resident or not), so that bricks
+// generated later (or again after an eviction) only replay the edits that touch them.
+class TerrainChunks : public RenderTree {
+
+	public:
+		enum BrushOperation {
+			ADD_MATTER,
+			REMOVE_MATTER
+		};
+
+		struct Stats {
+			unsigned int residentBricks;
+			unsigned int visibleBricks;
+			unsigned int bricksGeneratedLastFrame;
+			unsigned int bricksEvictedLastFrame;
+			unsigned int bricksRemeshedLastFrame;   //lod or seams changes
+			unsigned int bricksEditedLastFrame;
+			unsigned long samplesEdited;            //since the last frame
+			unsigned int meshesSwappedLastFrame;    //background meshes made visible
+			unsigned int meshingQueueDepth;         //meshing jobs not finished yet
+			float meshingLatency;                   //ms from submit to swap, average
+			float maxMeshingLatency;
+			unsigned long totalBricksGenerated;
+			unsigned long residentMemory; //bytes
+			unsigned long trianglesSubmitted;       //last frame
+			unsigned long fullResolutionTriangles;  //same bricks, all meshed at lod 0
+			float lodDistance;                      //current one, see setTriangleBudget
+		};
+
+		TerrainChunks(float voxelSize, unsigned int brickSize = 32,
+				float viewDistance = 100.0f, unsigned int maxResidentBricks = 256);
+		~TerrainChunks();
+
+		//bricks are only generated between those heights (terrain frame)
+		void setHeightRange(float minHeight, float maxHeight);
+
+		//max number of bricks generated in one frame (and 4 times more re-meshed)
+		void setGenerationBudget(unsigned int maxBricksPerFrame);
+
+		//bricks whose center is farther than lodDistance*2^(l-1) are meshed with a 2^l voxels stride (l <= maxLod)
+		//lodDistance is at least the brick size
+		void setLod(float lodDistance, unsigned int maxLod = 3);
+
+		//0 = unbounded. Otherwise the lod distance is lowered while the submitted triangles exceed
+		//the budget, and raised back (up to the setLod one) when there is room again
+		void setTriangleBudget(unsigned long maxTriangles);
+
+		//spheres in the terrain frame, visible from the next frame
+		void addSphere(const qglviewer::Vec &center, float radius);
+		void subtractSphere(const qglviewer::Vec &center, float radius);
+		void applyBrush(const qglviewer::Vec &center, float radius, BrushOperation operation);
+
+		const Stats &getStats() const;
+
+		//CPU copy of the width*height*length samples from the terrain frame origin (edits included),
+		//placed with the current relative model matrix, for the particles collisions
+		DensityVolume *makeDensityVolume(unsigned int width, unsigned int height, unsigned int length) const;
+
+	private:
+		typedef std::tuple<int,int,int> BrickId;
+
+		struct Brush {
+			qglviewer::Vec center;
+			float radius;
+			BrushOperation operation;
+		};
+
+		float _voxelSize;
+		unsigned int _brickSize, _apron, _samples;
+		float _viewDistance;
+		unsigned int _maxResidentBricks, _maxBricksPerFrame;
+		float _minHeight, _maxHeight;
+		float _fieldSize;
+
+		float _lodDistance, _targetLodDistance;
+		unsigned int _maxLod;
+		unsigned long _triangleBudget;
+
+		std::map<BrickId, TerrainBrick*> _bricks;
+		std::set<BrickId> _dirtyBricks;
+		std::vector<Brush> _edits;
+		std::map<BrickId, std::vector<unsigned int> > _brickEdits; //indices in _edits, in edit order
+		std::map<BrickId, unsigned int> _pendingDensities; //bricks waiting for their density -> edits count at submit
+		unsigned long _samplesEdited;
+
+		BrickMesher *_mesher;
+		unsigned long _meshTicket;
+		unsigned long _frame;
+		Stats _stats;
+
+		Program *_drawProgram, *_normalOcclusionProgram;
+		std::map<std::string,int> _drawUniformLocs, _normalOcclusionUniformLocs;
+
+		unsigned int _fullscreenQuadVBO;
+		unsigned int _generalDataUBO;
+		unsigned int _frameBuffer;
+
+		void drawDownwards(const float *currentTransformationMatrix = consts::identity4);
+
+		void updateResidentBricks(const qglviewer::Vec &cameraPos, std::vector<TerrainBrick*> &visibleBricks);
+		bool evictLeastRecentlyUsedBrick();
+		void updateEditedBricks();
+		void swapMeshes();
+
+		unsigned int computeLod(int i, int j, int k, const qglviewer::Vec &cameraPos) const;
+		unsigned int computeSeams(int i, int j, int k, unsigned int lod, const qglviewer::Vec &cameraPos) const; //bit per face next to a finer brick
+		void updateLodDistance();
+
+		TerrainBrick *generateBrick(int i, int j, int k, unsigned int lod, unsigned int seams);
+		bool setGeneratedDensity(TerrainBrick *brick, std::vector<float> &density); //true if edits came meanwhile
+		void computeBrickNormals(TerrainBrick *brick, const unsigned int min[3], const unsigned int max[3]); //inclusive sample box
+		void uploadDensity(TerrainBrick *brick, const unsigned int min[3], const unsigned int max[3]);
+		bool applyBrushToBrick(const Brush &brush, TerrainBrick *brick); //false if no sample is touched
+		bool applyBrushToSamples(const Brush &brush, const qglviewer::Vec &origin, const unsigned int size[3],
+				float *density, unsigned int min[3], unsigned int max[3]) const; //grid at origin, voxelSize spacing
+		//submits a BrickMesher job, generateDensity : the density is evaluated by the job (new brick)
+		void meshBrick(TerrainBrick *brick, unsigned int lod, unsigned int seams, bool generateDensity = false);
+		void buildBrickMesh(const BrickMesher::Job &job, BrickMesher::Result &result) const; //mesher thread
+
+		qglviewer::Vec getBrickOrigin(int i, int j, int k) const; //terrain frame, apron included
+
+		void makeDrawProgram();
+		void makeNormalOcclusionProgram();
+		void generateFullScreenQuad();
+};
+
+#endif /* end of include guard: TERRAINCHUNKS_H */
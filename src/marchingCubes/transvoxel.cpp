@@ -0,0 +1,558 @@
+
+#include "headers.h"
+#include "transvoxel.h"
+#include "cpuMarchingCubes.h"
+#include "log.h"
+
+#include <cmath>
+#include <map>
+#include <set>
+#include <algorithm>
+
+std::once_flag Transvoxel::_initFlag;
+unsigned char Transvoxel::_cellClass[512];
+std::vector<Transvoxel::TransitionCellData> Transvoxel::_cellData;
+unsigned char Transvoxel::_vertexData[512][12];
+
+namespace {
+	//same classification as CpuMarchingCubes
+	inline bool isInside(float density) {
+		return density*99999.0f >= 1.0f;
+	}
+
+	//the regular cells along a transition face are squeezed from one voxel to voxelSize - width
+	void squeeze(float p[3], unsigned int transitionFaces, float extent, float voxelSize, float width) {
+		float scale = (voxelSize - width)/voxelSize;
+
+		for (unsigned int axis = 0; axis < 3; axis++) {
+			if(((transitionFaces >> (2*axis)) & 1u) && p[axis] < voxelSize)
+				p[axis] = width + p[axis]*scale;
+			if(((transitionFaces >> (2*axis+1)) & 1u) && p[axis] > extent - voxelSize)
+				p[axis] = extent - width - (extent - p[axis])*scale;
+		}
+	}
+
+	//high resolution sample -> bit of the case code
+	const unsigned int sampleBit[9] = {0, 1, 2, 7, 8, 3, 6, 5, 4};
+
+	//low resolution sample (9..C) -> high resolution sample it copies
+	const unsigned int lowToHigh[4] = {0, 2, 6, 8};
+
+	//faces of the cell : the 4 high resolution squares, the low resolution one, then the 4 sides
+	const unsigned int nFaces = 9;
+	const unsigned int faceSize[9] = {4, 4, 4, 4, 4, 5, 5, 5, 5};
+	const unsigned int cellFaces[9][5] = {
+		{0, 1, 4, 3, 0}, {1, 2, 5, 4, 0}, {3, 4, 7, 6, 0}, {4, 5, 8, 7, 0},
+		{9, 10, 12, 11, 0},
+		{0, 1, 2, 10, 9}, {2, 5, 8, 12, 10}, {8, 7, 6, 11, 12}, {6, 3, 0, 9, 11}
+	};
+
+	inline unsigned char edgeCode(unsigned int a, unsigned int b) {
+		return (unsigned char) (std::min(a, b) << 4 | std::max(a, b));
+	}
+
+	//canonical cell : high resolution samples 0.5 apart on the z = 0 face, low resolution face at z = 0.5
+	void samplePosition(unsigned int s, float p[3]) {
+		unsigned int h = (s < 9 ? s : lowToHigh[s-9]);
+		p[0] = 0.5f*(h%3);
+		p[1] = 0.5f*(h/3);
+		p[2] = (s < 9 ? 0.0f : 0.5f);
+	}
+
+	//middle of the edge, and the outside sample minus the inside one
+	void edgeMiddle(unsigned char code, const bool inside[13], float p[3], float outward[3]) {
+		float a[3], b[3];
+		samplePosition(code >> 4, a);
+		samplePosition(code & 15, b);
+
+		float sign = (inside[code >> 4] ? 1.0f : -1.0f);
+		for (unsigned int c = 0; c < 3; c++) {
+			p[c] = 0.5f*(a[c] + b[c]);
+			outward[c] = sign*(b[c] - a[c]);
+		}
+	}
+
+	void caseInside(unsigned int caseCode, bool inside[13]) {
+		for (unsigned int s = 0; s < 9; s++) {
+			inside[s] = ((caseCode >> sampleBit[s]) & 1u) != 0;
+		}
+		for (unsigned int l = 0; l < 4; l++) {
+			inside[9+l] = inside[lowToHigh[l]];
+		}
+	}
+
+	//the 8 symmetries of the square, odd ones are reflections
+	unsigned int transformSample(unsigned int s, unsigned int symmetry) {
+		if(s >= 9) {
+			unsigned int h = transformSample(lowToHigh[s-9], symmetry);
+			return 9 + (h == 0 ? 0 : (h == 2 ? 1 : (h == 6 ? 2 : 3)));
+		}
+
+		int a = s%3, b = s/3, x, y;
+		switch(symmetry) {
+			case 0: x = a;   y = b;   break;
+			case 1: x = 2-a; y = b;   break;
+			case 2: x = 2-a; y = 2-b; break;
+			case 3: x = a;   y = 2-b; break;
+			case 4: x = 2-b; y = a;   break;
+			case 5: x = b;   y = a;   break;
+			case 6: x = b;   y = 2-a; break;
+			default: x = 2-b; y = 2-a; break;
+		}
+
+		return 3*y + x;
+	}
+
+	unsigned int inverseTransformSample(unsigned int s, unsigned int symmetry) {
+		for (unsigned int t = 0; t < 13; t++) {
+			if(transformSample(t, symmetry) == s)
+				return t;
+		}
+		return s;
+	}
+
+	unsigned int transformCase(unsigned int caseCode, unsigned int symmetry, bool inversion) {
+		unsigned int image = 0;
+		for (unsigned int s = 0; s < 9; s++) {
+			bool inside = ((caseCode >> sampleBit[s]) & 1u) != 0;
+			if(inside != inversion)
+				image |= 1u << sampleBit[transformSample(s, symmetry)];
+		}
+		return image;
+	}
+
+	unsigned int insideCount(unsigned int caseCode) {
+		unsigned int n = 0;
+		for (unsigned int b = 0; b < 9; b++) {
+			n += (caseCode >> b) & 1u;
+		}
+		return n;
+	}
+
+	//outward normals of the faces of the canonical cell
+	const float faceNormal[9][3] = {
+		{0, 0, -1}, {0, 0, -1}, {0, 0, -1}, {0, 0, -1},
+		{0, 0, 1},
+		{0, -1, 0}, {1, 0, 0}, {0, 1, 0}, {-1, 0, 0}
+	};
+
+	//true if a segment of face f from a to b goes the way of the loops : with the surface normal
+	//facing the outside of the matter, the surface is on its left. Inside to outside direction on
+	//the face : from the inside corners to the outside ones, or between the corner cut off and the face
+	//center when the face is crossed 4 times (a side face can have its inside corner on an edge)
+	bool isForward(unsigned int f, unsigned char a, unsigned char b, const bool inside[13]) {
+		unsigned int n = faceSize[f], nCrossings = 0;
+		float center[3] = {0.0f, 0.0f, 0.0f}, insideCenter[3] = {0.0f, 0.0f, 0.0f}, outsideCenter[3] = {0.0f, 0.0f, 0.0f};
+		float nInside = 0.0f, nOutside = 0.0f;
+
+		for (unsigned int c = 0; c < n; c++) {
+			unsigned int sample = cellFaces[f][c];
+			float p[3];
+			samplePosition(sample, p);
+
+			float *sum = (inside[sample] ? insideCenter : outsideCenter);
+			for (unsigned int i = 0; i < 3; i++) {
+				center[i] += p[i]/n;
+				sum[i] += p[i];
+			}
+			(inside[sample] ? nInside : nOutside) += 1.0f;
+
+			nCrossings += (inside[sample] != inside[cellFaces[f][(c+1)%n]]);
+		}
+
+		float outward[3];
+		if(nCrossings == 4) {
+			unsigned int corner = ((a >> 4) == (b >> 4) || (a >> 4) == (b & 15u) ? a >> 4 : a & 15u);
+			float p[3];
+			samplePosition(corner, p);
+			float sign = (inside[corner] ? 1.0f : -1.0f);
+			for (unsigned int i = 0; i < 3; i++) {
+				outward[i] = sign*(center[i] - p[i]);
+			}
+		}
+		else {
+			for (unsigned int i = 0; i < 3; i++) {
+				outward[i] = outsideCenter[i]/nOutside - insideCenter[i]/nInside;
+			}
+		}
+
+		float pa[3], pb[3], unused[3];
+		edgeMiddle(a, inside, pa, unused);
+		edgeMiddle(b, inside, pb, unused);
+
+		const float *normal = faceNormal[f];
+		float direction[3] = {
+			outward[1]*normal[2] - outward[2]*normal[1],
+			outward[2]*normal[0] - outward[0]*normal[2],
+			outward[0]*normal[1] - outward[1]*normal[0]
+		};
+
+		return (pb[0]-pa[0])*direction[0] + (pb[1]-pa[1])*direction[1] + (pb[2]-pa[2])*direction[2] > 0.0f;
+	}
+
+	void addSegment(unsigned int f, unsigned char a, unsigned char b, const bool inside[13],
+			std::map<unsigned char, unsigned char> &next) {
+		if(isForward(f, a, b, inside))
+			next[a] = b;
+		else
+			next[b] = a;
+	}
+
+	//crossed edges linked face by face into closed oriented loops. A square crossed 4 times
+	//gets one segment around each of its inside corners
+	void traceLoops(const bool inside[13], std::vector<std::vector<unsigned char> > &loops) {
+		std::map<unsigned char, unsigned char> next;
+
+		for (unsigned int f = 0; f < nFaces; f++) {
+			unsigned int n = faceSize[f];
+
+			std::vector<unsigned char> crossings;
+			for (unsigned int e = 0; e < n; e++) {
+				unsigned int a = cellFaces[f][e], b = cellFaces[f][(e+1)%n];
+				if(inside[a] != inside[b])
+					crossings.push_back(edgeCode(a, b));
+			}
+
+			if(crossings.size() == 2) {
+				addSegment(f, crossings[0], crossings[1], inside, next);
+			}
+			else if(crossings.size() == 4) {
+				for (unsigned int c = 0; c < n; c++) {
+					unsigned int corner = cellFaces[f][c];
+					if(inside[corner])
+						addSegment(f, edgeCode(cellFaces[f][(c+n-1)%n], corner), edgeCode(corner, cellFaces[f][(c+1)%n]), inside, next);
+				}
+			}
+		}
+
+		std::set<unsigned char> visited;
+		std::map<unsigned char, unsigned char>::const_iterator it;
+		for (it = next.begin(); it != next.end(); ++it) {
+			if(visited.count(it->first))
+				continue;
+
+			std::vector<unsigned char> loop;
+			unsigned char current = it->first;
+			do {
+				loop.push_back(current);
+				visited.insert(current);
+				current = next[current];
+			} while(current != it->first);
+
+			loops.push_back(loop);
+		}
+	}
+
+	//ears with the shortest diagonal are cut first (lowest vertex on ties), the loop orientation is kept
+	void triangulateLoop(std::vector<unsigned char> loop, const bool inside[13], std::vector<unsigned char> &triangles) {
+		while(loop.size() > 3) {
+			unsigned int m = loop.size(), best = 0;
+			float bestLength = 0.0f;
+			for (unsigned int v = 0; v < m; v++) {
+				float a[3], b[3], unused[3];
+				edgeMiddle(loop[(v+m-1)%m], inside, a, unused);
+				edgeMiddle(loop[(v+1)%m], inside, b, unused);
+				float length = (a[0]-b[0])*(a[0]-b[0]) + (a[1]-b[1])*(a[1]-b[1]) + (a[2]-b[2])*(a[2]-b[2]);
+
+				if(v == 0 || length < bestLength - 1.0e-6f || (length < bestLength + 1.0e-6f && loop[v] < loop[best])) {
+					best = v;
+					bestLength = length;
+				}
+			}
+
+			triangles.push_back(loop[(best+m-1)%m]);
+			triangles.push_back(loop[best]);
+			triangles.push_back(loop[(best+1)%m]);
+			loop.erase(loop.begin() + best);
+		}
+
+		triangles.insert(triangles.end(), loop.begin(), loop.end());
+	}
+}
+
+unsigned int Transvoxel::TransitionCellData::getVertexCount() const {
+	return geometryCounts >> 4;
+}
+
+unsigned int Transvoxel::TransitionCellData::getTriangleCount() const {
+	return geometryCounts & 0x0F;
+}
+
+void Transvoxel::init() {
+	std::call_once(_initFlag, initTables);
+}
+
+unsigned int Transvoxel::getCaseCode(const bool inside[9]) {
+	unsigned int caseCode = 0;
+	for (unsigned int s = 0; s < 9; s++) {
+		if(inside[s])
+			caseCode |= 1u << sampleBit[s];
+	}
+	return caseCode;
+}
+
+unsigned char Transvoxel::getCellClass(unsigned int caseCode) {
+	return _cellClass[caseCode];
+}
+
+const Transvoxel::TransitionCellData &Transvoxel::getCellData(unsigned char cellClass) {
+	return _cellData[cellClass & 0x7F];
+}
+
+const unsigned char *Transvoxel::getVertexData(unsigned int caseCode) {
+	return _vertexData[caseCode];
+}
+
+unsigned int Transvoxel::getClassCount() {
+	return _cellData.size();
+}
+
+void Transvoxel::initTables() {
+	std::map<unsigned int, unsigned char> classOfCase;
+	std::vector<std::vector<unsigned char> > classVertices;
+
+	for (unsigned int caseCode = 0; caseCode < 512; caseCode++) {
+
+		//case of the class : the image with the fewest inside samples (lowest code on ties)
+		unsigned int classCase = caseCode, symmetry = 0;
+		bool inversion = false;
+		for (unsigned int s = 0; s < 8; s++) {
+			for (unsigned int i = 0; i < 2; i++) {
+				unsigned int image = transformCase(caseCode, s, i == 1);
+				if(insideCount(image) < insideCount(classCase)
+						|| (insideCount(image) == insideCount(classCase) && image < classCase)) {
+					classCase = image;
+					symmetry = s;
+					inversion = (i == 1);
+				}
+			}
+		}
+
+		std::map<unsigned int, unsigned char>::const_iterator found = classOfCase.find(classCase);
+		unsigned char cellClass;
+
+		if(found == classOfCase.end()) {
+			bool inside[13];
+			caseInside(classCase, inside);
+
+			std::vector<std::vector<unsigned char> > loops;
+			traceLoops(inside, loops);
+
+			std::vector<unsigned char> triangles, vertices;
+			for (unsigned int l = 0; l < loops.size(); l++) {
+				triangulateLoop(loops[l], inside, triangles);
+				vertices.insert(vertices.end(), loops[l].begin(), loops[l].end());
+			}
+			std::sort(vertices.begin(), vertices.end());
+
+			TransitionCellData data;
+			data.geometryCounts = (unsigned char) (vertices.size() << 4 | triangles.size()/3);
+			std::fill(data.vertexIndex, data.vertexIndex + 36, 0);
+			for (unsigned int v = 0; v < triangles.size(); v++) {
+				data.vertexIndex[v] = std::lower_bound(vertices.begin(), vertices.end(), triangles[v]) - vertices.begin();
+			}
+
+			cellClass = _cellData.size();
+			_cellData.push_back(data);
+			classVertices.push_back(vertices);
+			classOfCase[classCase] = cellClass;
+		}
+		else {
+			cellClass = found->second;
+		}
+
+		//class vertices brought back on this case, a reflection or an inversion turns the triangles over
+		const std::vector<unsigned char> &vertices = classVertices[cellClass];
+		std::fill(_vertexData[caseCode], _vertexData[caseCode] + 12, 0);
+		for (unsigned int v = 0; v < vertices.size(); v++) {
+			_vertexData[caseCode][v] = edgeCode(
+					inverseTransformSample(vertices[v] >> 4, symmetry),
+					inverseTransformSample(vertices[v] & 15, symmetry));
+		}
+
+		_cellClass[caseCode] = cellClass | ((symmetry%2 == 1) != inversion ? 0x80 : 0x00);
+	}
+}
+
+void Transvoxel::march(const float *density, unsigned int size, unsigned int stride, float voxelSize,
+		unsigned int transitionFaces, std::vector<float> &vertices, std::vector<unsigned int> &indices) {
+	init();
+
+	unsigned int n = (size-1)/stride + 1;
+	float coarseVoxelSize = stride*voxelSize;
+
+	std::vector<float> grid(n*n*n);
+	for (unsigned int k = 0; k < n; k++) {
+		for (unsigned int j = 0; j < n; j++) {
+			for (unsigned int i = 0; i < n; i++) {
+				grid[(k*n + j)*n + i] = density[((k*stride)*size + j*stride)*size + i*stride];
+			}
+		}
+	}
+
+	CpuMarchingCubes mc(n, n, n, coarseVoxelSize, coarseVoxelSize, coarseVoxelSize);
+	mc.marchIndexed(&grid[0], vertices, indices);
+
+	if(transitionFaces == 0)
+		return;
+
+	float extent = (n-1)*coarseVoxelSize;
+	for (unsigned int v = 0; v < vertices.size()/3; v++) {
+		squeeze(&vertices[3*v], transitionFaces, extent, coarseVoxelSize, 0.5f*coarseVoxelSize);
+	}
+
+	for (unsigned int face = 0; face < 6; face++) {
+		if((transitionFaces >> face) & 1u)
+			marchTransitionFace(density, size, stride, voxelSize, face, transitionFaces, vertices, indices);
+	}
+}
+
+void Transvoxel::marchTransitionFace(const float *density, unsigned int size, unsigned int stride, float voxelSize,
+		unsigned int face, unsigned int transitionFaces, std::vector<float> &vertices, std::vector<unsigned int> &indices) {
+
+	unsigned int n = (size-1)/stride + 1, half = stride/2;
+	float coarseVoxelSize = stride*voxelSize;
+	float extent = (n-1)*coarseVoxelSize;
+
+	//(u, v, inward normal) is direct, like the canonical cell
+	unsigned int axis = face/2;
+	unsigned int uAxis = (axis+1)%3, vAxis = (axis+2)%3;
+	if(face%2 == 1)
+		std::swap(uAxis, vAxis);
+
+	unsigned int coord[3];
+	coord[axis] = (face%2 == 0 ? 0 : size-1);
+
+	for (unsigned int cv = 0; cv < n-1; cv++) {
+		for (unsigned int cu = 0; cu < n-1; cu++) {
+
+			//samples 0..8 in coarse voxels, 9..C share the values of 0, 2, 6 and 8
+			float value[13], position[13][3];
+			bool inside[9];
+			for (unsigned int s = 0; s < 13; s++) {
+				unsigned int h = (s < 9 ? s : lowToHigh[s-9]);
+				coord[uAxis] = cu*stride + (h%3)*half;
+				coord[vAxis] = cv*stride + (h/3)*half;
+				value[s] = density[(coord[2]*size + coord[1])*size + coord[0]];
+
+				position[s][axis] = (float) (face%2 == 0 ? 0 : n-1);
+				position[s][uAxis] = (s < 9 ? cu + 0.5f*(h%3) : (float) (cu + h%3/2));
+				position[s][vAxis] = (s < 9 ? cv + 0.5f*(h/3) : (float) (cv + h/3/2));
+
+				if(s < 9)
+					inside[s] = isInside(value[s]);
+			}
+
+			unsigned int caseCode = getCaseCode(inside);
+			unsigned char cellClass = getCellClass(caseCode);
+			const TransitionCellData &data = getCellData(cellClass);
+			if(data.getTriangleCount() == 0)
+				continue;
+
+			//interpolated from the lowest sample of the edge, as in CpuMarchingCubes
+			unsigned int first = vertices.size()/3;
+			const unsigned char *edges = getVertexData(caseCode);
+			for (unsigned int v = 0; v < data.getVertexCount(); v++) {
+				unsigned int a = edges[v] >> 4, b = edges[v] & 15u;
+				if(position[b][uAxis] < position[a][uAxis] || position[b][vAxis] < position[a][vAxis])
+					std::swap(a, b);
+
+				float t = std::min(std::max(value[a]/(value[a] - value[b]), 0.0f), 1.0f);
+				float p[3];
+				for (unsigned int c = 0; c < 3; c++) {
+					p[c] = (position[a][c] + t*(position[b][c] - position[a][c]))*coarseVoxelSize;
+				}
+
+				//the low resolution face is the squeezed face of the regular cell behind
+				if(a >= 9)
+					squeeze(p, transitionFaces, extent, coarseVoxelSize, 0.5f*coarseVoxelSize);
+
+				vertices.insert(vertices.end(), p, p + 3);
+			}
+
+			for (unsigned int t = 0; t < data.getTriangleCount(); t++) {
+				unsigned int v0 = data.vertexIndex[3*t], v1 = data.vertexIndex[3*t+1], v2 = data.vertexIndex[3*t+2];
+				if(cellClass & 0x80)
+					std::swap(v1, v2);
+
+				indices.push_back(first + v0);
+				indices.push_back(first + v1);
+				indices.push_back(first + v2);
+			}
+		}
+	}
+}
+
+bool Transvoxel::check() {
+	init();
+
+	unsigned int failures = 0;
+	for (unsigned int caseCode = 0; caseCode < 512; caseCode++) {
+		bool inside[13];
+		caseInside(caseCode, inside);
+
+		unsigned char cellClass = getCellClass(caseCode);
+		const TransitionCellData &data = getCellData(cellClass);
+		const unsigned char *vertices = getVertexData(caseCode);
+		unsigned int nVertices = data.getVertexCount(), nTriangles = data.getTriangleCount();
+		bool ok = true;
+
+		//the vertices are the crossed edges
+		std::set<unsigned char> crossed, used(vertices, vertices + nVertices);
+		for (unsigned int f = 0; f < nFaces; f++) {
+			for (unsigned int e = 0; e < faceSize[f]; e++) {
+				unsigned int a = cellFaces[f][e], b = cellFaces[f][(e+1)%faceSize[f]];
+				if(inside[a] != inside[b])
+					crossed.insert(edgeCode(a, b));
+			}
+		}
+		ok = ok && (used.size() == nVertices) && (used == crossed);
+
+		//each directed edge once, inner edges in both directions, border edges on a cell face
+		//and going the way of the loops there (surface facing the outside)
+		std::map<std::pair<unsigned int, unsigned int>, unsigned int> edges;
+		for (unsigned int t = 0; t < nTriangles; t++) {
+			unsigned int v[3] = {data.vertexIndex[3*t], data.vertexIndex[3*t+1], data.vertexIndex[3*t+2]};
+			if(cellClass & 0x80)
+				std::swap(v[1], v[2]);
+
+			for (unsigned int c = 0; c < 3; c++) {
+				edges[std::make_pair(v[c], v[(c+1)%3])]++;
+			}
+		}
+
+		std::vector<unsigned int> borderDegree(nVertices, 0);
+		std::map<std::pair<unsigned int, unsigned int>, unsigned int>::const_iterator it;
+		for (it = edges.begin(); it != edges.end(); ++it) {
+			ok = ok && (it->second == 1);
+			if(edges.count(std::make_pair(it->first.second, it->first.first)))
+				continue;
+
+			unsigned char a = vertices[it->first.first], b = vertices[it->first.second];
+			bool onFace = false;
+			for (unsigned int f = 0; f < nFaces && !onFace; f++) {
+				unsigned int count = 0;
+				for (unsigned int s = 0; s < faceSize[f]; s++) {
+					unsigned int sample = cellFaces[f][s];
+					count += (sample == (a >> 4u)) + (sample == (a & 15u)) + (sample == (b >> 4u)) + (sample == (b & 15u));
+				}
+				onFace = (count == 4 && isForward(f, a, b, inside));
+			}
+			ok = ok && onFace;
+
+			borderDegree[it->first.first]++;
+			borderDegree[it->first.second]++;
+		}
+		for (unsigned int v = 0; v < nVertices; v++) {
+			ok = ok && (borderDegree[v] == 2);
+		}
+
+		if(!ok)
+			failures++;
+	}
+
+	log_console.infoStream() << "[Transvoxel] 512 transition cell cases in " << getClassCount() << " classes, "
+		<< failures << " failing the polygonization check.";
+
+	return failures == 0;
+}
@@ -0,0 +1,72 @@
+#ifndef TRANSVOXEL_H
+#define TRANSVOXEL_H
+
+#include <vector>
+#include <mutex>
+
+// Transvoxel transition cells (Eric Lengyel, "Voxel-Based Terrain for Real-Time Virtual Simulations", 2010)
+// A transition cell joins the 3x3 samples (0..8) of a face of a grid to the 2x2 samples (9..C)
+// of the twice coarser cell behind it. Low resolution samples take the values of 0, 2, 6 and 8 :
+//
+//   6 7 8       B . C
+//   3 4 5       . . .
+//   0 1 2       9 . A
+//
+// Same layout as Lengyel's tables : the case code of the 9 high resolution samples gives a cell
+// class (bit 7 : triangles wound the other way), the class gives the vertex and triangle counts
+// and the vertex indices of the triangles, and the case gives the edge of each vertex.
+// The tables are built once by polygonizing the faces of the cell for one case of each class
+// (rotations, reflections and inversion of the 9 samples). On an ambiguous face, the inside
+// corners of the class case are cut off, the side faces of a cell are never ambiguous.
+// Triangles face the outside (density <= 0), like CpuMarchingCubes.
+// march() meshes a grid with CpuMarchingCubes and, along the faces next to a twice finer grid, squeezes
+// the regular cells by half a voxel and fills the gap with transition cells (vertices are not shared
+// between cells, Lengyel's vertex reuse is left out).
+class Transvoxel {
+
+	public:
+		struct TransitionCellData {
+			unsigned char geometryCounts;   //high nibble : vertices, low nibble : triangles
+			unsigned char vertexIndex[36];
+
+			unsigned int getVertexCount() const;
+			unsigned int getTriangleCount() const;
+		};
+
+		//builds the tables (thread safe, once)
+		static void init();
+
+		//bit 0 : sample 0, 1 : 1, 2 : 2, 3 : 5, 4 : 8, 5 : 7, 6 : 6, 7 : 3, 8 : 4 (set when inside)
+		static unsigned int getCaseCode(const bool inside[9]);
+
+		static unsigned char getCellClass(unsigned int caseCode);
+		static const TransitionCellData &getCellData(unsigned char cellClass); //bit 7 ignored
+
+		//one code per vertex of the case : the two samples (0..C) of its edge, lowest one in the high nibble
+		static const unsigned char *getVertexData(unsigned int caseCode);
+
+		static unsigned int getClassCount();
+
+		//size^3 samples voxelSize apart (x first, then y, then z), meshed one sample every 'stride'.
+		//Bit f of transitionFaces (faces order : -X +X -Y +Y -Z +Z) : face f is next to a grid
+		//meshed every stride/2 samples, and gets transition cells
+		static void march(const float *density, unsigned int size, unsigned int stride, float voxelSize,
+				unsigned int transitionFaces, std::vector<float> &vertices, std::vector<unsigned int> &indices);
+
+		//every case polygonized through the tables on the canonical cell : the vertices are exactly the
+		//crossed edges, the mesh is an oriented manifold whose border lies on the cell faces, facing the outside
+		static bool check();
+
+	private:
+		static std::once_flag _initFlag;
+		static unsigned char _cellClass[512];
+		static std::vector<TransitionCellData> _cellData;
+		static unsigned char _vertexData[512][12];
+
+		static void initTables();
+
+		static void marchTransitionFace(const float *density, unsigned int size, unsigned int stride, float voxelSize,
+				unsigned int face, unsigned int transitionFaces, std::vector<float> &vertices, std::vector<unsigned int> &indices);
+};
+
+#endif /* end of include guard: TRANSVOXEL_H */
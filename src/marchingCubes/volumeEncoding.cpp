@@ -0,0 +1,201 @@
+
+#include "volumeEncoding.h"
+#include "log.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	inline float signNotZero(float x) {
+		return (x >= 0.0f ? 1.0f : -1.0f);
+	}
+
+	inline float clamp(float x, float a, float b) {
+		return std::min(std::max(x, a), b);
+	}
+
+	//angle between two vectors, in degrees (atan2 stays accurate for tiny angles, acos does not)
+	inline double angle(const float a[3], const float b[3]) {
+		double cx = (double)a[1]*b[2] - (double)a[2]*b[1];
+		double cy = (double)a[2]*b[0] - (double)a[0]*b[2];
+		double cz = (double)a[0]*b[1] - (double)a[1]*b[0];
+		double d = (double)a[0]*b[0] + (double)a[1]*b[1] + (double)a[2]*b[2];
+		return atan2(sqrt(cx*cx + cy*cy + cz*cz), d)*180.0/M_PI;
+	}
+}
+
+void VolumeEncoding::encodeOctahedral(const float normal[3], float uv[2]) {
+	float l1 = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+	float u = normal[0]/l1, v = normal[1]/l1;
+
+	//lower hemisphere folded over the diagonals
+	if(normal[2] < 0.0f) {
+		float foldedU = (1.0f - fabsf(v))*signNotZero(u);
+		float foldedV = (1.0f - fabsf(u))*signNotZero(v);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	uv[0] = u;
+	uv[1] = v;
+}
+
+void VolumeEncoding::decodeOctahedral(const float uv[2], float normal[3]) {
+	float x = uv[0], y = uv[1];
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	if(z < 0.0f) {
+		float unfoldedX = (1.0f - fabsf(y))*signNotZero(x);
+		float unfoldedY = (1.0f - fabsf(x))*signNotZero(y);
+		x = unfoldedX;
+		y = unfoldedY;
+	}
+
+	float norm = sqrtf(x*x + y*y + z*z);
+	normal[0] = x/norm;
+	normal[1] = y/norm;
+	normal[2] = z/norm;
+}
+
+unsigned char VolumeEncoding::packUnorm8(float x) {
+	return (unsigned char) floorf(clamp(x, 0.0f, 1.0f)*255.0f + 0.5f);
+}
+
+float VolumeEncoding::unpackUnorm8(unsigned char x) {
+	return x/255.0f;
+}
+
+unsigned short VolumeEncoding::packUnorm16(float x) {
+	return (unsigned short) floorf(clamp(x, 0.0f, 1.0f)*65535.0f + 0.5f);
+}
+
+float VolumeEncoding::unpackUnorm16(unsigned short x) {
+	return x/65535.0f;
+}
+
+signed char VolumeEncoding::packSnorm8(float x) {
+	return (signed char) floorf(clamp(x, -1.0f, 1.0f)*127.0f + 0.5f);
+}
+
+float VolumeEncoding::unpackSnorm8(signed char x) {
+	return std::max(x/127.0f, -1.0f);
+}
+
+void VolumeEncoding::packNormal8(const float normal[3], unsigned char packed[2]) {
+	float uv[2];
+	encodeOctahedral(normal, uv);
+	packed[0] = packUnorm8(0.5f*uv[0] + 0.5f);
+	packed[1] = packUnorm8(0.5f*uv[1] + 0.5f);
+}
+
+void VolumeEncoding::unpackNormal8(const unsigned char packed[2], float normal[3]) {
+	float uv[2] = {2.0f*unpackUnorm8(packed[0]) - 1.0f, 2.0f*unpackUnorm8(packed[1]) - 1.0f};
+	decodeOctahedral(uv, normal);
+}
+
+void VolumeEncoding::packNormal16(const float normal[3], unsigned short packed[2]) {
+	float uv[2];
+	encodeOctahedral(normal, uv);
+	packed[0] = packUnorm16(0.5f*uv[0] + 0.5f);
+	packed[1] = packUnorm16(0.5f*uv[1] + 0.5f);
+}
+
+void VolumeEncoding::unpackNormal16(const unsigned short packed[2], float normal[3]) {
+	float uv[2] = {2.0f*unpackUnorm16(packed[0]) - 1.0f, 2.0f*unpackUnorm16(packed[1]) - 1.0f};
+	decodeOctahedral(uv, normal);
+}
+
+signed char VolumeEncoding::packDensity(float density, float scale) {
+	return packSnorm8(density*scale);
+}
+
+float VolumeEncoding::unpackDensity(signed char packed, float scale) {
+	return unpackSnorm8(packed)/scale;
+}
+
+bool VolumeEncoding::checkRoundTrip(unsigned int nSamples) {
+
+	//normals : Fibonacci sphere, plus the axes (octahedron vertices and folds)
+	double maxError8 = 0.0, totalError8 = 0.0, maxError16 = 0.0, totalError16 = 0.0;
+	const float axes[6][3] = {{1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}};
+	const double goldenAngle = M_PI*(3.0 - sqrt(5.0));
+
+	for (unsigned int s = 0; s < nSamples + 6; s++) {
+		float normal[3];
+		if(s < 6) {
+			std::copy(axes[s], axes[s] + 3, normal);
+		}
+		else {
+			double z = 1.0 - 2.0*(s - 6 + 0.5)/nSamples;
+			double r = sqrt(1.0 - z*z), phi = goldenAngle*(s - 6);
+			normal[0] = r*cos(phi);
+			normal[1] = r*sin(phi);
+			normal[2] = z;
+		}
+
+		unsigned char packed8[2];
+		unsigned short packed16[2];
+		float unpacked[3];
+
+		packNormal8(normal, packed8);
+		unpackNormal8(packed8, unpacked);
+		double error = angle(normal, unpacked);
+		maxError8 = std::max(maxError8, error);
+		totalError8 += error;
+
+		packNormal16(normal, packed16);
+		unpackNormal16(packed16, unpacked);
+		error = angle(normal, unpacked);
+		maxError16 = std::max(maxError16, error);
+		totalError16 += error;
+	}
+
+	//scalars : whole input range
+	const float densityScale = 8.0f;
+	double maxOcclusionError = 0.0, maxDensityError = 0.0;
+	for (unsigned int s = 0; s <= 10000; s++) {
+		float occlusion = s/10000.0f;
+		maxOcclusionError = std::max(maxOcclusionError, (double) fabsf(unpackUnorm8(packUnorm8(occlusion)) - occlusion));
+
+		//unsaturated range only
+		float density = (2.0f*s/10000.0f - 1.0f)/densityScale;
+		maxDensityError = std::max(maxDensityError, (double) fabsf(unpackDensity(packDensity(density, densityScale), densityScale) - density));
+	}
+
+	//expected quantization bounds : half a step for the scalars
+	bool ok = maxError8 < 2.0 && maxError16 < 0.02
+		&& maxOcclusionError <= 0.5/255.0 + 1.0e-6
+		&& maxDensityError <= 0.5/(127.0*densityScale) + 1.0e-6;
+
+	log_console.infoStream() << "[Volume Encoding] Octahedral RG8 normals : max error " << maxError8 << " deg, mean " << totalError8/(nSamples + 6) << " deg.";
+	log_console.infoStream() << "[Volume Encoding] Octahedral RG16 normals : max error " << maxError16 << " deg, mean " << totalError16/(nSamples + 6) << " deg.";
+	log_console.infoStream() << "[Volume Encoding] R8 occlusion : max error " << maxOcclusionError
+		<< ", R8_SNORM density (scale " << densityScale << ") : max error " << maxDensityError << (ok ? ". OK" : ". FAILED");
+
+	return ok;
+}
+
+void VolumeEncoding::logMemoryReport(unsigned int size) {
+	struct Format {
+		const char *name;
+		unsigned int bytesPerVoxel;
+	};
+
+	//normals formats include the occlusion (alpha channel or separate R8 texture)
+	const Format formats[5] = {
+		{"normals+AO RGBA32F", 16},
+		{"normals RG16 + AO R8", 2*2 + 1},
+		{"normals RG8 + AO R8", 2*1 + 1},
+		{"density R16F", 2},
+		{"density R8_SNORM", 1}
+	};
+
+	double nVoxels = (double)size*size*size;
+	log_console.infoStream() << "[Volume Encoding] Memory and bandwidth for a " << size << "^3 volume :";
+	for (unsigned int f = 0; f < 5; f++) {
+		//written once by the generation pass, 8 texels read per trilinear fetch
+		log_console.infoStream() << "[Volume Encoding]   " << formats[f].name << " : " << formats[f].bytesPerVoxel << " B/voxel, "
+			<< nVoxels*formats[f].bytesPerVoxel/(1024.0*1024.0) << " MB (written once per generation), "
+			<< 8*formats[f].bytesPerVoxel << " B per trilinear fetch.";
+	}
+}
@@ -0,0 +1,42 @@
+
+#ifndef VOLUMEENCODING_H
+#define VOLUMEENCODING_H
+
+// CPU side of the compact terrain volume formats (same conversions as OpenGL and the shaders)
+// Normals : octahedral mapping of the unit sphere onto [-1,1]^2, stored as 2 x 8 or 2 x 16 bits UNORM
+// Occlusion : 8 bits UNORM
+// Density : 8 bits SNORM, the field is scaled first so that the range around the surface keeps its precision
+class VolumeEncoding {
+
+	public:
+		//unit normal <-> octahedral coordinates in [-1,1]^2
+		static void encodeOctahedral(const float normal[3], float uv[2]);
+		static void decodeOctahedral(const float uv[2], float normal[3]);
+
+		//OpenGL normalized integers conversions (round to nearest)
+		static unsigned char packUnorm8(float x);
+		static float unpackUnorm8(unsigned char x);
+		static unsigned short packUnorm16(float x);
+		static float unpackUnorm16(unsigned short x);
+		static signed char packSnorm8(float x);
+		static float unpackSnorm8(signed char x);
+
+		//octahedral normals as stored in RG8 and RG16 textures
+		static void packNormal8(const float normal[3], unsigned char packed[2]);
+		static void unpackNormal8(const unsigned char packed[2], float normal[3]);
+		static void packNormal16(const float normal[3], unsigned short packed[2]);
+		static void unpackNormal16(const unsigned short packed[2], float normal[3]);
+
+		//R8_SNORM density texture : density*scale, saturated to [-1,1]
+		static signed char packDensity(float density, float scale);
+		static float unpackDensity(signed char packed, float scale);
+
+		//round trip errors on nSamples normals spread over the sphere and on the scalar
+		//formats, logged and checked against the expected quantization bounds
+		static bool checkRoundTrip(unsigned int nSamples = 100000);
+
+		//bytes per voxel and total size of each format for a size^3 volume
+		static void logMemoryReport(unsigned int size);
+};
+
+#endif /* end of include guard: VOLUMEENCODING_H */
@@ -8,9 +8,24 @@ class ParticleGroup;
 class ParticleGroupKernel {
 
 	public:
+		//how a group may fuse the kernel with its neighbours (ParticleGroup::setKernelFusion)
+		enum Fusion {
+			NO_FUSION,         //runs on its own, may move the particles
+			FORCES_ONLY,       //runs on its own, only adds forces or flags particles
+			FUSED_FORCE,       //per particle force term, added by fuse()
+			FUSED_INTEGRATION  //integration scheme, ends a fused pass
+		};
+
 		virtual ~ParticleGroupKernel() {};
 		virtual void operator()(const ParticleGroup *particleGroup) = 0;
 		virtual void animate() {};
+
+		virtual Fusion getFusion() const { return NO_FUSION; };
+		//adds the kernel terms of this step, called instead of operator() when fused
+		virtual void fuse(struct particleForceTerms *terms) {};
+
+		//estimated global memory traffic of one call, in bytes (0 if unknown)
+		virtual unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const { return 0; };
 		
 	protected:
 		ParticleGroupKernel() {};
@@ -4,17 +4,36 @@
 #include "globals.h"
 #include "kernelHeaders.h"
 
+#include <algorithm>
+
 #define N_BUFFERS 8
+#define STAGING_SLOT_SIZE 4096
+
+extern void compactParticlesKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles, const unsigned int nSprings,
+		unsigned int *particleIndex, unsigned int *springIndex, void *scratch,
+		unsigned int *nAliveParticles, unsigned int *nAliveSprings);
+extern void remapAppendedSpringsKernel(const struct mappedParticlePointers *pt,
+		const unsigned int *particleIndex,
+		const unsigned int firstSpring, const unsigned int nAppendedSprings,
+		const unsigned int nOldParticles, const unsigned int nCompactedParticles, const unsigned int nAppendedParticles);
+extern void fusedStepKernel(const struct mappedParticlePointers *pt, const unsigned int nParticles,
+		const struct particleForceTerms *terms, const unsigned int termsMask);
 
 Program *ParticleGroup::_particlesDebugProgram = 0;
 Program *ParticleGroup::_springsDebugProgram = 0;
 std::map<std::string, int> ParticleGroup::_particleUniformLocs;
 std::map<std::string, int> ParticleGroup::_springsUniformLocs;
+ParticleGroup::Backend ParticleGroup::_defaultBackend = ParticleGroup::CUDA_BACKEND;
+bool ParticleGroup::_defaultBackendChosen = false;
+bool ParticleGroup::_defaultKernelFusion = true;
 
 ParticleGroup::ParticleGroup(unsigned int maxParticles, unsigned int maxSprings) :
 	maxParticles(maxParticles), nParticles(0), nWaitingParticles(0),
 	maxSprings(maxSprings), nSprings(0), nWaitingSprings(0),
 
+	_stagesDirty(true), _kernelFusion(_defaultKernelFusion), _bytesPerStep(0),
+
 	x_b(0), y_b(0), z_b(0), 
 	r_b(0), kill_b(0),
 	springs_lines_b(0), springs_intensity_b(0),
@@ -32,7 +51,13 @@ ParticleGroup::ParticleGroup(unsigned int maxParticles, unsigned int maxSprings)
 
 	kill_d(0), fixed_d(0), springs_kill_d(0),
 
-	_mapped(false)
+	particles_index_d(0), springs_index_d(0),
+	compaction_scratch_d(0),
+	_host(), particles_index_h(0),
+	_uploadStream(0), _nextStagingSlot(0),
+
+	_mapped(false),
+	_backend(getDefaultBackend()), _hostArraysDirty(false), _springIncidence(0), _springTopology(0)
 {
 
 	//OPENGL MEMORY (WILL BE SHARED WITH CUDA)
@@ -65,6 +90,13 @@ ParticleGroup::ParticleGroup(unsigned int maxParticles, unsigned int maxSprings)
 	glBindBuffer(GL_ARRAY_BUFFER, buffers[7]);
 	glBufferData(GL_ARRAY_BUFFER, maxSprings*sizeof(unsigned char), 0, GL_DYNAMIC_DRAW);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//CPU MEMORY (COPIED TO THE OPENGL BUFFERS BEFORE DRAWING)
+	if(_backend == CPU_BACKEND) {
+		ressources = 0;
+		allocateHostArrays();
+		return;
+	}
 	
 	//CUDA MEMORY (CAN'T BE SHARED WITH OPENGL)
 	//particles//
@@ -87,6 +119,12 @@ ParticleGroup::ParticleGroup(unsigned int maxParticles, unsigned int maxSprings)
 	CHECK_CUDA_ERRORS(cudaMalloc((void**) &springs_d_d, maxSprings*sizeof(float)));
 	CHECK_CUDA_ERRORS(cudaMalloc((void**) &springs_Fmax_d, maxSprings*sizeof(float)));
 
+	//compaction//
+	CHECK_CUDA_ERRORS(cudaMalloc((void**) &particles_index_d, (maxParticles+1)*sizeof(unsigned int)));
+	CHECK_CUDA_ERRORS(cudaMalloc((void**) &springs_index_d, (maxSprings+1)*sizeof(unsigned int)));
+	CHECK_CUDA_ERRORS(cudaMalloc(&compaction_scratch_d, std::max(maxParticles, 6*maxSprings)*sizeof(float)));
+
+	allocateStagingRing();
 	
 	//CREATE BINDINGS BETWEEN CUDA AND OPENGL
 	ressources = new cudaGraphicsResource*[N_BUFFERS];
@@ -111,38 +149,46 @@ ParticleGroup::ParticleGroup(unsigned int maxParticles, unsigned int maxSprings)
 
 ParticleGroup::~ParticleGroup() {
 
-	//delete links
-	for (int i = 0; i < N_BUFFERS; i++) {
-		cudaGraphicsUnregisterResource(ressources[i]);
+	if(_backend == CUDA_BACKEND) {
+		//delete links
+		for (int i = 0; i < N_BUFFERS; i++) {
+			cudaGraphicsUnregisterResource(ressources[i]);
+		}
+
+		//shared memory that has already been freed before
+		//cudaFree(x_d); cudaFree(y_d); cudaFree(z_d); cudaFree(r_d); cudaFree(kill_d);
+		//cudaFree(springs_lines_d); cudaFree(springs_intensity_d); cudaFree(springs_kill_d);
+
+		//cuda memory
+		CHECK_CUDA_ERRORS(cudaFree(vx_d));
+		CHECK_CUDA_ERRORS(cudaFree(vy_d));
+		CHECK_CUDA_ERRORS(cudaFree(vz_d));
+		CHECK_CUDA_ERRORS(cudaFree(fx_d));
+		CHECK_CUDA_ERRORS(cudaFree(fy_d));
+		CHECK_CUDA_ERRORS(cudaFree(fz_d));
+		CHECK_CUDA_ERRORS(cudaFree(m_d));
+		CHECK_CUDA_ERRORS(cudaFree(im_d));
+		CHECK_CUDA_ERRORS(cudaFree(r_d));
+		CHECK_CUDA_ERRORS(cudaFree(fixed_d));
+
+		CHECK_CUDA_ERRORS(cudaFree(springs_id1_d));
+		CHECK_CUDA_ERRORS(cudaFree(springs_id2_d));
+		CHECK_CUDA_ERRORS(cudaFree(springs_k_d));
+		CHECK_CUDA_ERRORS(cudaFree(springs_Lo_d));
+		CHECK_CUDA_ERRORS(cudaFree(springs_d_d));
+		CHECK_CUDA_ERRORS(cudaFree(springs_Fmax_d));
+
+		CHECK_CUDA_ERRORS(cudaFree(particles_index_d));
+		CHECK_CUDA_ERRORS(cudaFree(springs_index_d));
+		CHECK_CUDA_ERRORS(cudaFree(compaction_scratch_d));
+		freeStagingRing();
 	}
 
 	//openGL memory
 	glDeleteBuffers(N_BUFFERS, buffers);
 
-	//shared memory that has already been freed before
-	//cudaFree(x_d); cudaFree(y_d); cudaFree(z_d); cudaFree(r_d); cudaFree(kill_d);
-	//cudaFree(springs_lines_d); cudaFree(springs_intensity_d); cudaFree(springs_kill_d);
-
-	//cuda memory
-	CHECK_CUDA_ERRORS(cudaFree(vx_d));
-	CHECK_CUDA_ERRORS(cudaFree(vy_d));
-	CHECK_CUDA_ERRORS(cudaFree(vz_d));
-	CHECK_CUDA_ERRORS(cudaFree(fx_d));
-	CHECK_CUDA_ERRORS(cudaFree(fy_d));
-	CHECK_CUDA_ERRORS(cudaFree(fz_d));
-	CHECK_CUDA_ERRORS(cudaFree(m_d));
-	CHECK_CUDA_ERRORS(cudaFree(im_d));
-	CHECK_CUDA_ERRORS(cudaFree(r_d));
-	CHECK_CUDA_ERRORS(cudaFree(fixed_d));
-	
-	CHECK_CUDA_ERRORS(cudaFree(springs_id1_d));
-	CHECK_CUDA_ERRORS(cudaFree(springs_id2_d));
-	CHECK_CUDA_ERRORS(cudaFree(springs_k_d));
-	CHECK_CUDA_ERRORS(cudaFree(springs_Lo_d));
-	CHECK_CUDA_ERRORS(cudaFree(springs_d_d));
-	CHECK_CUDA_ERRORS(cudaFree(springs_Fmax_d));
-	
 	//cpu memory
+	freeHostArrays();
 	delete [] buffers;
 	delete [] ressources;
 		
@@ -159,7 +205,8 @@ void ParticleGroup::addParticle(Particule *p) {
 	}
 	else if(nWaitingParticles + nParticles >= maxParticles) {
 		log_console.warnStream()
-		<< "Waiting CPU particles count + GPU particles count > maxParticles (" << maxParticles << "), just hope they'll die !";
+		<< "Waiting CPU particles count + GPU particles count > maxParticles (" << maxParticles << "), "
+		<< "the extra ones will be dropped unless enough particles die before they are released !";
 	}
 
 	particlesWaitList.push_back(p);	
@@ -186,7 +233,8 @@ void ParticleGroup::addSpring(unsigned int particleId1, unsigned int particleId2
 	}
 	else if(nWaitingSprings + nSprings >= maxSprings) {
 		log_console.warnStream()
-		<< "Waiting CPU springs count + GPU springs count > maxSprings (" << maxSprings << "), just hope they'll die !";
+		<< "Waiting CPU springs count + GPU springs count > maxSprings (" << maxSprings << "), "
+		<< "the extra ones will be dropped unless enough springs die before they are released !";
 	}
 
 	Ressort *ressort = new Ressort(particleId1, particleId2, k, Lo, d, Fmax);
@@ -196,11 +244,14 @@ void ParticleGroup::addSpring(unsigned int particleId1, unsigned int particleId2
 
 void ParticleGroup::addKernel(ParticleGroupKernel *kernel) {
 	kernels.push_back(kernel);
+	_stagesDirty = true;
 }
 	
 void ParticleGroup::drawDownwards(const float *modelMatrix) {
 
 	static float *proj = new float[16], *view = new float[16];
+	updateBuffers();
+
     glGetFloatv(GL_MODELVIEW_MATRIX, view);
     glGetFloatv(GL_PROJECTION_MATRIX, proj);
 
@@ -292,205 +343,283 @@ void ParticleGroup::drawDownwards(const float *modelMatrix) {
 void ParticleGroup::animateDownwards() {
 	mapRessources();
 
-	std::list<ParticleGroupKernel *>::iterator it = kernels.begin();
-	for (; it != kernels.end(); ++it) {
-		(*it)->animate();
-		(**it)(this);
+	if(_stagesDirty)
+		buildStages();
+
+	_bytesPerStep = 0;
+
+	std::vector<KernelStage>::const_iterator it = _stages.begin();
+	for (; it != _stages.end(); ++it) {
+		if(it->kernel) {
+			it->kernel->animate();
+			(*it->kernel)(this);
+			_bytesPerStep += it->kernel->getMemoryTraffic(nParticles, nSprings);
+		}
+		else {
+			runFusedStage(*it);
+		}
 	}
 
 	unmapRessources();
 }
 
-void ParticleGroup::fromDevice() {
-	
-	float *x_h=0, *y_h=0, *z_h=0, *vx_h=0, *vy_h=0, *vz_h=0, *m_h=0, *r_h=0; //8
-	float *springs_k_h=0, *springs_Lo_h=0, *springs_d_h=0, *springs_Fmax_h=0; //4
-	unsigned int *springs_id1_h=0, *springs_id2_h=0; //2
-	unsigned char *kill_h=0, *fixed_h=0, *springs_kill_h=0; //3
-
-	unsigned int nRessources = 17;
-	void **data_p_h[17] = {
-						(void**)&x_h, (void**)&y_h, (void**)&z_h, 
-						(void**)&vx_h, (void**)&vy_h, (void**)&vz_h, (void**)&m_h, (void**)&r_h, //particles float
-						(void**)&kill_h, (void**)&fixed_h, //particles unsigned char
-						(void**)&springs_k_h, (void**)&springs_Lo_h, (void**)&springs_d_h, (void**)&springs_Fmax_h, //springs float
-						(void**)&springs_id1_h, (void**)&springs_id2_h, //springs unsigned int
-						(void**)&springs_kill_h //springs unsigned char
-						};
-	
-	size_t fs = sizeof(float), bs = sizeof(unsigned char), is = sizeof(unsigned int);
-	size_t ps = nParticles, ss = nSprings;
-	size_t dataSize[17] = {
-						ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs,
-						ps*bs, ps*bs,
-						ss*fs, ss*fs, ss*fs, ss*fs,
-						ss*is, ss*is, 
-						ss*bs
-						};
-
-	for (unsigned int i = 0; i < nRessources; i++) {
-		CHECK_CUDA_ERRORS(cudaMallocHost(data_p_h[i], dataSize[i]));
-	}
-	
-	mapRessources();
-	{
-		void *data_d[17] = {
-						x_d, y_d, z_d, 
-						vx_d, vy_d, vz_d, m_d, r_d, //particles float
-						kill_d, fixed_d, //particles unsigned char
-						springs_k_d, springs_Lo_d, springs_d_d, springs_Fmax_d, //springs float
-						springs_id1_d, springs_id2_d, //springs unsigned int
-						springs_kill_d //springs unsigned char
-						};
-
-		for (unsigned int i = 0; i < nRessources; i++) {
-			CHECK_CUDA_ERRORS(cudaMemcpy(data_p_h[i][0], data_d[i], dataSize[i], cudaMemcpyDeviceToHost));
+//Fused force terms are evaluated after the FORCES_ONLY kernels that follow them (the forces
+//are summed, and these kernels do not move the particles), the pass ends with the integration
+//or before the first kernel that may move the particles.
+void ParticleGroup::buildStages() {
+	_stages.clear();
+
+	KernelStage pending;
+	pending.kernel = 0;
+
+	std::list<ParticleGroupKernel *>::iterator it = kernels.begin();
+	for (; it != kernels.end(); ++it) {
+		ParticleGroupKernel::Fusion fusion = (*it)->getFusion();
+
+		if(_kernelFusion && (fusion == ParticleGroupKernel::FUSED_FORCE || fusion == ParticleGroupKernel::FUSED_INTEGRATION)) {
+			pending.fused.push_back(*it);
+
+			if(fusion == ParticleGroupKernel::FUSED_INTEGRATION) {
+				_stages.push_back(pending);
+				pending.fused.clear();
+			}
+			continue;
 		}
-	}
-	unmapRessources();
 
-	for (unsigned int i = 0; i < nParticles; i++) {
-		if(!kill_h[i]) {
-			particlesWaitList.push_back(new Particule(Vec(x_h[i], y_h[i], z_h[i]), Vec(vx_h[i], vy_h[i], vz_h[i]), m_h[i], r_h[i], fixed_h[i]));
-			nWaitingParticles++;
+		if(fusion != ParticleGroupKernel::FORCES_ONLY && !pending.fused.empty()) {
+			_stages.push_back(pending);
+			pending.fused.clear();
 		}
+
+		KernelStage stage;
+		stage.kernel = *it;
+		_stages.push_back(stage);
 	}
 
-	//TODO
-	//for (unsigned int i = 0; i < nParticles; i++) {
-		//if(!springs_kill_h[i]) {
-			//springsWaitList.push_back(new Ressort());
-			//nWaitingParticles++;
-		//}
-	//}
+	if(!pending.fused.empty())
+		_stages.push_back(pending);
 
-	for (unsigned int i = 0; i < nRessources; i++) {
-		CHECK_CUDA_ERRORS(cudaFreeHost(*(data_p_h[i])));
-	}
-	
-	nParticles = 0;
-	nSprings = 0;
+	_stagesDirty = false;
 }
 
-void ParticleGroup::toDevice() {
-	
+void ParticleGroup::runFusedStage(const KernelStage &stage) {
+	struct particleForceTerms terms = {};
 
-	//Alloc CPU arrays
-	float *x_h=0, *y_h=0, *z_h=0, *vx_h=0, *vy_h=0, *vz_h=0, *m_h=0, *im_h, *r_h=0; //9
-	unsigned char *fixed_h=0; //1
-	float *springs_k_h=0, *springs_Lo_h=0, *springs_d_h=0, *springs_Fmax_h=0; //4
-	unsigned int *springs_id1_h=0, *springs_id2_h=0; //2
-
-	unsigned int nRessources = 16;
-	void **data_p_h[16] = {
-						(void**)&x_h, (void**)&y_h, (void**)&z_h, 
-						(void**)&vx_h, (void**)&vy_h, (void**)&vz_h, 
-						(void**)&m_h, (void**)&im_h, (void**)&r_h, //particles float
-						(void**)&fixed_h, //particle unsigned chars
-						(void**)&springs_k_h, (void**)&springs_Lo_h, 
-						(void**)&springs_d_h, (void**)&springs_Fmax_h, //springs float
-						(void**)&springs_id1_h, (void**)&springs_id2_h, //springs unsigned int
-						};
-	
-	size_t fs = sizeof(float), is = sizeof(unsigned int), bs = sizeof(unsigned char);
-	size_t ps = nWaitingParticles, ss = nWaitingSprings;
-	size_t dataSize[16] = {
-						ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs, ps*fs,
-						ps*bs,
-						ss*fs, ss*fs, ss*fs, ss*fs,
-						ss*is, ss*is, 
-						};
-	
-	for (unsigned int i = 0; i < nRessources; i++) {
-		CHECK_CUDA_ERRORS(cudaMallocHost(data_p_h[i], dataSize[i]));
+	std::vector<ParticleGroupKernel *>::const_iterator it = stage.fused.begin();
+	for (; it != stage.fused.end(); ++it) {
+		(*it)->animate();
+		(*it)->fuse(&terms);
 	}
 
-	//AoS to SoA
-	assert(nParticles == 0);
-	assert(nSprings == 0);
+	if(_backend == CPU_BACKEND)
+		CpuParticleKernels::fusedStep(&_mappedPointers, nParticles, &terms);
+	else
+		fusedStepKernel(&_mappedPointers, nParticles, &terms, CpuParticleKernels::forceTermsMask(&terms));
 
-	{
-		std::list<Particule*>::iterator it = particlesWaitList.begin();
-		int i = 0;
-		for (; it != particlesWaitList.end(); it++) {
-			Particule *p = *it;
-			Vec pos = p->getPosition();	
-			x_h[i] = pos.x;
-			y_h[i] = pos.y;
-			z_h[i] = pos.z;
+	_bytesPerStep += CpuParticleKernels::fusedStepTraffic(&terms, nParticles);
+}
 
-			Vec vel = p->getVelocity();	
-			vx_h[i] = vel.x;
-			vy_h[i] = vel.y;
-			vz_h[i] = vel.z;
+void ParticleGroup::compactParticles() {
+	struct mappedParticlePointers pt = mappedPointers();
+	unsigned int nAliveParticles, nAliveSprings;
 
-			m_h[i] = p->getMass();
-			im_h[i] = p->getInvMass();
-			r_h[i] = p->getRadius();
+	if(_backend == CPU_BACKEND) {
+		CpuParticleKernels::compact(&pt, nParticles, nSprings, particles_index_h, &nAliveParticles, &nAliveSprings);
+	}
+	else {
+		compactParticlesKernel(&pt, nParticles, nSprings, 
+				particles_index_d, springs_index_d, compaction_scratch_d,
+				&nAliveParticles, &nAliveSprings);
+	}
 
-			fixed_h[i] = p->isFixed();
+	nParticles = nAliveParticles;
+	nSprings = nAliveSprings;
+}
 
-			nParticles++;
-			i++;
-		}
+void ParticleGroup::appendWaitingParticles() {
+	unsigned int count = std::min(nWaitingParticles, maxParticles - nParticles);
+	if(count < nWaitingParticles) {
+		log_console.warnStream() << "Dropping " << nWaitingParticles - count 
+			<< " waiting particles, maxParticles (" << maxParticles << ") reached !";
 	}
 
-	{
-		std::list<Ressort*>::iterator it = springsWaitList.begin();
-		int i = 0;
-		for (; it != springsWaitList.end(); it++) {
-			Ressort *r = *it;
-			springs_id1_h[i] = r->IdP1;
-			springs_id2_h[i] = r->IdP2;
-			springs_k_h[i] = r->k;
-			springs_Lo_h[i] = r->Lo;
-			springs_d_h[i] = r->d;
-			springs_Fmax_h[i] = r->Fmax;
-
-			nSprings++;
-			i++;
+	if(_backend == CPU_BACKEND) {
+		popWaitingParticles(count, _host, nParticles);
+		std::fill(_host.kill + nParticles, _host.kill + nParticles + count, 0);
+		std::fill(_host.fx + nParticles, _host.fx + nParticles + count, 0.0f);
+		std::fill(_host.fy + nParticles, _host.fy + nParticles + count, 0.0f);
+		std::fill(_host.fz + nParticles, _host.fz + nParticles + count, 0.0f);
+	}
+	else {
+		for (unsigned int done = 0; done < count; ) {
+			unsigned int chunk = std::min(count - done, (unsigned int) STAGING_SLOT_SIZE);
+			unsigned int slot = nextStagingSlot();
+			const struct mappedParticlePointers &s = _stagingPointers[slot];
+			unsigned int offset = nParticles + done;
+
+			//AoS to SoA while the previous slot is being copied
+			popWaitingParticles(chunk, s, 0);
+
+			float *src[9] = {s.x, s.y, s.z, s.vx, s.vy, s.vz, s.m, s.im, s.r};
+			float *dst[9] = {x_d, y_d, z_d, vx_d, vy_d, vz_d, m_d, im_d, r_d};
+			for (unsigned int i = 0; i < 9; i++) {
+				CHECK_CUDA_ERRORS(cudaMemcpyAsync(dst[i] + offset, src[i], chunk*sizeof(float), cudaMemcpyHostToDevice, _uploadStream));
+			}
+			CHECK_CUDA_ERRORS(cudaMemcpyAsync(fixed_d + offset, s.fixed, chunk*sizeof(unsigned char), cudaMemcpyHostToDevice, _uploadStream));
+			CHECK_CUDA_ERRORS(cudaEventRecord(_stagingEvents[slot], _uploadStream));
+
+			done += chunk;
 		}
+
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(kill_d + nParticles, 0, count*sizeof(unsigned char), _uploadStream));
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(fx_d + nParticles, 0, count*sizeof(float), _uploadStream));
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(fy_d + nParticles, 0, count*sizeof(float), _uploadStream));
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(fz_d + nParticles, 0, count*sizeof(float), _uploadStream));
 	}
 
-	//on libère les ressources de la liste
 	while(!particlesWaitList.empty()) delete particlesWaitList.front(), particlesWaitList.pop_front();
-	while(!springsWaitList.empty()) delete springsWaitList.front(), springsWaitList.pop_front();
-	nWaitingSprings = 0;
 	nWaitingParticles = 0;
+	nParticles += count;
+}
 
-	//send to GPU
-	mapRessources();
-	{
-		void *data_d[16] = {
-						x_d, y_d, z_d, 
-						vx_d, vy_d, vz_d, m_d, im_d, r_d, //particles float
-						fixed_d, //particle unsigned chars
-						springs_k_d, springs_Lo_d, springs_d_d, springs_Fmax_d, //springs float
-						springs_id1_d, springs_id2_d, //springs unsigned int
-						};
-
-		for (unsigned int i = 0; i < nRessources; i++) {
-			CHECK_CUDA_ERRORS(cudaMemcpy(data_d[i], data_p_h[i][0], dataSize[i], cudaMemcpyHostToDevice));
+void ParticleGroup::appendWaitingSprings() {
+	unsigned int count = std::min(nWaitingSprings, maxSprings - nSprings);
+	if(count < nWaitingSprings) {
+		log_console.warnStream() << "Dropping " << nWaitingSprings - count 
+			<< " waiting springs, maxSprings (" << maxSprings << ") reached !";
+	}
+
+	if(_backend == CPU_BACKEND) {
+		popWaitingSprings(count, _host, nSprings);
+		std::fill(_host.lines + 6*nSprings, _host.lines + 6*(nSprings + count), 0.0f);
+		std::fill(_host.intensity + 2*nSprings, _host.intensity + 2*(nSprings + count), 0.0f);
+		std::fill(_host.killSpring + nSprings, _host.killSpring + nSprings + count, 0);
+	}
+	else {
+		for (unsigned int done = 0; done < count; ) {
+			unsigned int chunk = std::min(count - done, (unsigned int) STAGING_SLOT_SIZE);
+			unsigned int slot = nextStagingSlot();
+			const struct mappedParticlePointers &s = _stagingPointers[slot];
+			unsigned int offset = nSprings + done;
+
+			popWaitingSprings(chunk, s, 0);
+
+			float *src[4] = {s.k, s.Lo, s.d, s.Fmax};
+			float *dst[4] = {springs_k_d, springs_Lo_d, springs_d_d, springs_Fmax_d};
+			for (unsigned int i = 0; i < 4; i++) {
+				CHECK_CUDA_ERRORS(cudaMemcpyAsync(dst[i] + offset, src[i], chunk*sizeof(float), cudaMemcpyHostToDevice, _uploadStream));
+			}
+			CHECK_CUDA_ERRORS(cudaMemcpyAsync(springs_id1_d + offset, s.id1, chunk*sizeof(unsigned int), cudaMemcpyHostToDevice, _uploadStream));
+			CHECK_CUDA_ERRORS(cudaMemcpyAsync(springs_id2_d + offset, s.id2, chunk*sizeof(unsigned int), cudaMemcpyHostToDevice, _uploadStream));
+			CHECK_CUDA_ERRORS(cudaEventRecord(_stagingEvents[slot], _uploadStream));
+
+			done += chunk;
 		}
 
-		//set memory to 0
-		CHECK_CUDA_ERRORS(cudaMemset(kill_d, 0, nParticles*sizeof(unsigned char)));
-		CHECK_CUDA_ERRORS(cudaMemset(fx_d, 0, nParticles*sizeof(float)));
-		CHECK_CUDA_ERRORS(cudaMemset(fy_d, 0, nParticles*sizeof(float)));
-		CHECK_CUDA_ERRORS(cudaMemset(fz_d, 0, nParticles*sizeof(float)));
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(springs_lines_d + 6*nSprings, 0, 6*count*sizeof(float), _uploadStream));
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(springs_intensity_d + 2*nSprings, 0, 2*count*sizeof(float), _uploadStream));
+		CHECK_CUDA_ERRORS(cudaMemsetAsync(springs_kill_d + nSprings, 0, count*sizeof(unsigned char), _uploadStream));
+	}
+
+	while(!springsWaitList.empty()) delete springsWaitList.front(), springsWaitList.pop_front();
+	nWaitingSprings = 0;
+	nSprings += count;
+}
+
+void ParticleGroup::popWaitingParticles(unsigned int count, const struct mappedParticlePointers &dst, unsigned int offset) {
+	for (unsigned int i = offset; i < offset + count; i++) {
+		Particule *p = particlesWaitList.front();
 		
-		CHECK_CUDA_ERRORS(cudaMemset(springs_lines_d, 0, 6*nSprings*sizeof(float)));
-		CHECK_CUDA_ERRORS(cudaMemset(springs_intensity_d, 0, nSprings*sizeof(float)));
-		CHECK_CUDA_ERRORS(cudaMemset(springs_kill_d, 0, nSprings*sizeof(unsigned char)));
+		Vec pos = p->getPosition();	
+		dst.x[i] = pos.x;
+		dst.y[i] = pos.y;
+		dst.z[i] = pos.z;
+
+		Vec vel = p->getVelocity();	
+		dst.vx[i] = vel.x;
+		dst.vy[i] = vel.y;
+		dst.vz[i] = vel.z;
+
+		dst.m[i] = p->getMass();
+		dst.im[i] = p->getInvMass();
+		dst.r[i] = p->getRadius();
+
+		dst.fixed[i] = p->isFixed();
+
+		delete p;
+		particlesWaitList.pop_front();
 	}
-	unmapRessources();
+}
+
+void ParticleGroup::popWaitingSprings(unsigned int count, const struct mappedParticlePointers &dst, unsigned int offset) {
+	for (unsigned int i = offset; i < offset + count; i++) {
+		Ressort *r = springsWaitList.front();
+
+		dst.id1[i] = r->IdP1;
+		dst.id2[i] = r->IdP2;
+		dst.k[i] = r->k;
+		dst.Lo[i] = r->Lo;
+		dst.d[i] = r->d;
+		dst.Fmax[i] = r->Fmax;
 
-	for (unsigned int i = 0; i < nRessources; i++) {
-		CHECK_CUDA_ERRORS(cudaFreeHost(data_p_h[i][0]));
+		delete r;
+		springsWaitList.pop_front();
 	}
 }
 
+//STAGING_SLOT_SIZE particles (9 floats + fixed) and springs (4 floats + 2 ids) per slot
+void ParticleGroup::allocateStagingRing() {
+	size_t n = STAGING_SLOT_SIZE;
+	size_t slotSize = n*(13*sizeof(float) + 2*sizeof(unsigned int) + sizeof(unsigned char));
+
+	for (unsigned int i = 0; i < N_STAGING_SLOTS; i++) {
+		CHECK_CUDA_ERRORS(cudaMallocHost((void**) &_stagingSlots[i], slotSize));
+		CHECK_CUDA_ERRORS(cudaEventCreateWithFlags(&_stagingEvents[i], cudaEventDisableTiming));
+
+		float *f = (float*) _stagingSlots[i];
+		unsigned int *ids = (unsigned int*) (f + 13*n);
+		unsigned char *fixed = (unsigned char*) (ids + 2*n);
+
+		struct mappedParticlePointers &s = _stagingPointers[i];
+		s = mappedParticlePointers();
+		s.x = f; s.y = f + n; s.z = f + 2*n;
+		s.vx = f + 3*n; s.vy = f + 4*n; s.vz = f + 5*n;
+		s.m = f + 6*n; s.im = f + 7*n; s.r = f + 8*n;
+		s.k = f + 9*n; s.Lo = f + 10*n; s.d = f + 11*n; s.Fmax = f + 12*n;
+		s.id1 = ids; s.id2 = ids + n;
+		s.fixed = fixed;
+	}
+
+	CHECK_CUDA_ERRORS(cudaStreamCreate(&_uploadStream));
+}
+
+void ParticleGroup::freeStagingRing() {
+	CHECK_CUDA_ERRORS(cudaStreamSynchronize(_uploadStream));
+	CHECK_CUDA_ERRORS(cudaStreamDestroy(_uploadStream));
+
+	for (unsigned int i = 0; i < N_STAGING_SLOTS; i++) {
+		CHECK_CUDA_ERRORS(cudaEventDestroy(_stagingEvents[i]));
+		CHECK_CUDA_ERRORS(cudaFreeHost(_stagingSlots[i]));
+	}
+}
+
+//the slot can be refilled once its last copy has been done
+unsigned int ParticleGroup::nextStagingSlot() {
+	unsigned int slot = _nextStagingSlot;
+	_nextStagingSlot = (_nextStagingSlot + 1) % N_STAGING_SLOTS;
+
+	CHECK_CUDA_ERRORS(cudaEventSynchronize(_stagingEvents[slot]));
+	return slot;
+}
+
 void ParticleGroup::mapRessources() {
+	//host arrays are always accessible
+	if(_backend == CPU_BACKEND) {
+		_mappedPointers = mappedPointers();
+		_mapped = true;
+		return;
+	}
+
 	CHECK_CUDA_ERRORS(cudaGraphicsMapResources(N_BUFFERS, ressources, 0));
 
 	size_t size;
@@ -504,10 +633,18 @@ void ParticleGroup::mapRessources() {
 	CHECK_CUDA_ERRORS(cudaGraphicsResourceGetMappedPointer((void**) &springs_intensity_d, &size, springs_intensity_r));	
 	CHECK_CUDA_ERRORS(cudaGraphicsResourceGetMappedPointer((void**) &springs_kill_d, &size, springs_kill_r));	
 
+	_mappedPointers = mappedPointers();
 	_mapped = true;
 }
 
 void ParticleGroup::unmapRessources() {
+	//several substeps can run between two frames, the VBOs are updated once when drawing
+	if(_backend == CPU_BACKEND) {
+		_hostArraysDirty = true;
+		_mapped = false;
+		return;
+	}
+
 	CHECK_CUDA_ERRORS(cudaGraphicsUnmapResources(N_BUFFERS, ressources, 0));
 
 	x_d = 0;
@@ -524,6 +661,80 @@ void ParticleGroup::unmapRessources() {
 }
 
 
+void ParticleGroup::allocateHostArrays() {
+	float **particleArrays[12] = {&_host.x, &_host.y, &_host.z, &_host.vx, &_host.vy, &_host.vz,
+		&_host.fx, &_host.fy, &_host.fz, &_host.m, &_host.im, &_host.r};
+	for (unsigned int i = 0; i < 12; i++) {
+		*particleArrays[i] = new float[maxParticles]();
+	}
+	_host.kill = new unsigned char[maxParticles]();
+	_host.fixed = new unsigned char[maxParticles]();
+
+	float **springArrays[4] = {&_host.k, &_host.Lo, &_host.d, &_host.Fmax};
+	for (unsigned int i = 0; i < 4; i++) {
+		*springArrays[i] = new float[maxSprings]();
+	}
+	_host.lines = new float[6*maxSprings]();
+	_host.intensity = new float[2*maxSprings]();
+	_host.id1 = new unsigned int[maxSprings]();
+	_host.id2 = new unsigned int[maxSprings]();
+	_host.killSpring = new unsigned char[maxSprings]();
+	particles_index_h = new unsigned int[maxParticles+1]();
+
+	_springIncidence = new CpuSpringIncidence;
+	CpuParticleKernels::buildSpringIncidence(_host.id1, _host.id2, 0, 0, _springIncidence);
+}
+
+//nothing to free on the CUDA backend, the host pointers stay null
+void ParticleGroup::freeHostArrays() {
+	float *floatArrays[18] = {_host.x, _host.y, _host.z, _host.vx, _host.vy, _host.vz,
+		_host.fx, _host.fy, _host.fz, _host.m, _host.im, _host.r,
+		_host.k, _host.Lo, _host.d, _host.Fmax, _host.lines, _host.intensity};
+	for (unsigned int i = 0; i < 18; i++) {
+		delete [] floatArrays[i];
+	}
+
+	delete [] _host.kill;
+	delete [] _host.fixed;
+	delete [] _host.id1;
+	delete [] _host.id2;
+	delete [] _host.killSpring;
+	delete [] particles_index_h;
+	delete _springIncidence;
+
+	_host = mappedParticlePointers();
+	particles_index_h = 0;
+	_springIncidence = 0;
+}
+
+//the kernels ran on the host arrays, only the rendered ones go to the VBOs
+void ParticleGroup::uploadHostArrays() {
+	unsigned int vbos[8] = {x_b, y_b, z_b, r_b, kill_b, springs_lines_b, springs_intensity_b, springs_kill_b};
+	const void *data[8] = {_host.x, _host.y, _host.z, _host.r, _host.kill, _host.lines, _host.intensity, _host.killSpring};
+	size_t sizes[8] = {
+		nParticles*sizeof(float), nParticles*sizeof(float), nParticles*sizeof(float), nParticles*sizeof(float),
+		nParticles*sizeof(unsigned char),
+		6*nSprings*sizeof(float), 2*nSprings*sizeof(float), nSprings*sizeof(unsigned char)
+	};
+
+	for (unsigned int i = 0; i < 8; i++) {
+		if(sizes[i] == 0)
+			continue;
+
+		glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizes[i], data[i]);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleGroup::updateBuffers() {
+	if(!_hostArraysDirty)
+		return;
+
+	uploadHostArrays();
+	_hostArraysDirty = false;
+}
+
 void ParticleGroup::makeDebugPrograms() {
 
 	_particlesDebugProgram = new Program("Particle");
@@ -549,18 +760,46 @@ void ParticleGroup::makeDebugPrograms() {
 }
 
 void ParticleGroup::releaseParticles() {
-	fromDevice();
-	toDevice();
+	mapRessources();
+
+	//the waiting springs were numbered before the compaction, they are remapped once appended
+	unsigned int nOldParticles = nParticles;
+	compactParticles();
+
+	unsigned int nCompactedParticles = nParticles, firstNewSpring = nSprings;
+	appendWaitingParticles();
+	appendWaitingSprings();
+
+	struct mappedParticlePointers pt = mappedPointers();
+	if(_backend == CPU_BACKEND) {
+		CpuParticleKernels::remapAppendedSprings(&pt, particles_index_h, firstNewSpring, nSprings - firstNewSpring,
+				nOldParticles, nCompactedParticles, nParticles - nCompactedParticles);
+		CpuParticleKernels::buildSpringIncidence(_host.id1, _host.id2, nParticles, nSprings, _springIncidence);
+	}
+	else {
+		CHECK_CUDA_ERRORS(cudaStreamSynchronize(_uploadStream));
+		remapAppendedSpringsKernel(&pt, particles_index_d, firstNewSpring, nSprings - firstNewSpring,
+				nOldParticles, nCompactedParticles, nParticles - nCompactedParticles);
+	}
+	_springTopology++;
+
+	unmapRessources();
 }
 
-struct mappedParticlePointers *ParticleGroup::getMappedRessources() const {
+const struct mappedParticlePointers *ParticleGroup::getMappedRessources() const {
 	if(!_mapped) {
 		log_console.errorStream() << "Trying to get ressources that have not been mapped !";	
 		exit(1);
 	}
 
-	struct mappedParticlePointers *pt = new struct mappedParticlePointers;
-	*pt = {
+	return &_mappedPointers;
+}
+
+struct mappedParticlePointers ParticleGroup::mappedPointers() const {
+	if(_backend == CPU_BACKEND)
+		return _host;
+
+	struct mappedParticlePointers pt = {
 		x_d, y_d, z_d, vx_d, vy_d, vz_d, fx_d, fy_d, fz_d, m_d, im_d, r_d,
 		kill_d, fixed_d,
 		springs_k_d, springs_Lo_d, springs_d_d, springs_Fmax_d, springs_lines_d, springs_intensity_d,
@@ -572,6 +811,52 @@ struct mappedParticlePointers *ParticleGroup::getMappedRessources() const {
 }
 
 
+ParticleGroup::Backend ParticleGroup::getBackend() const {
+	return _backend;
+}
+
+CpuSpringIncidence *ParticleGroup::getSpringIncidence() const {
+	return _springIncidence;
+}
+
+void ParticleGroup::setDefaultBackend(Backend backend) {
+	_defaultBackend = backend;
+	_defaultBackendChosen = true;
+}
+
+ParticleGroup::Backend ParticleGroup::getDefaultBackend() {
+	if(!_defaultBackendChosen) {
+		int nDevices = 0;
+		if(cudaGetDeviceCount(&nDevices) != cudaSuccess || nDevices == 0) {
+			log_console.warnStream() << "[Particles] No CUDA device found, particles are simulated on the CPU !";
+			_defaultBackend = CPU_BACKEND;
+		}
+		else {
+			_defaultBackend = CUDA_BACKEND;
+		}
+		_defaultBackendChosen = true;
+	}
+
+	return _defaultBackend;
+}
+
+void ParticleGroup::setKernelFusion(bool fusion) {
+	_kernelFusion = fusion;
+	_stagesDirty = true;
+}
+
+bool ParticleGroup::getKernelFusion() const {
+	return _kernelFusion;
+}
+
+void ParticleGroup::setDefaultKernelFusion(bool fusion) {
+	_defaultKernelFusion = fusion;
+}
+
+unsigned long ParticleGroup::getBytesPerStep() const {
+	return _bytesPerStep;
+}
+
 unsigned int ParticleGroup::getParticleCount() const {
 	return nParticles;
 }
@@ -591,3 +876,6 @@ unsigned int ParticleGroup::getSpringWaitingCount() const {
 unsigned int ParticleGroup::getMaxSprings() const {
 	return maxSprings;
 }
+unsigned int ParticleGroup::getSpringTopology() const {
+	return _springTopology;
+}
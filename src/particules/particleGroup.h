@@ -8,8 +8,10 @@
 #include "ressort.h"
 #include "renderTree.h"
 #include "particleGroupKernel.h"
+#include "cpuParticleKernels.h"
 #include <list>
 #include <map>
+#include <vector>
 
 struct mappedParticlePointers {
 	//particules
@@ -26,9 +28,29 @@ class ParticleGroupKernel;
 class ParticleGroup : public RenderTree {
 
 	public:
+		//CUDA_BACKEND : device arrays, the rendered ones are shared with OpenGL
+		//CPU_BACKEND  : host arrays updated by CpuParticleKernels, copied to the VBOs once before drawing
+		enum Backend { CUDA_BACKEND, CPU_BACKEND };
+
 		ParticleGroup(unsigned int maxParticles, unsigned int maxSprings);
 		virtual ~ParticleGroup();
 
+		Backend getBackend() const;
+		CpuSpringIncidence *getSpringIncidence() const;
+
+		//backend of the groups created afterwards (CUDA when a device is found, by default)
+		static void setDefaultBackend(Backend backend);
+		static Backend getDefaultBackend();
+
+		//kernel fusion : consecutive per particle force kernels and the integration scheme
+		//run as one pass over the particles (on by default)
+		void setKernelFusion(bool fusion);
+		bool getKernelFusion() const;
+		static void setDefaultKernelFusion(bool fusion);
+
+		//estimated global memory traffic of the last animateDownwards, in bytes
+		unsigned long getBytesPerStep() const;
+
 		unsigned int getParticleCount() const;
 		unsigned int getParticleWaitingCount() const;
 		unsigned int getMaxParticles() const;
@@ -36,6 +58,8 @@ class ParticleGroup : public RenderTree {
 		unsigned int getSpringCount() const;
 		unsigned int getSpringWaitingCount() const;
 		unsigned int getMaxSprings() const;
+		//changes each time the springs are compacted or appended (releaseParticles)
+		unsigned int getSpringTopology() const;
 		
 		void addParticle(Particule *p);
 		void addSpring(unsigned int particleId_1, unsigned int particleId_2, float k, float Lo, float d, float Fmax=-1.0f);
@@ -46,7 +70,8 @@ class ParticleGroup : public RenderTree {
 		virtual void drawDownwards(const float *modelMatrix = consts::identity4);
 		virtual void animateDownwards();
 		
-		struct mappedParticlePointers *getMappedRessources() const;
+		//valid between mapRessources and unmapRessources
+		const struct mappedParticlePointers *getMappedRessources() const;
 
 	protected:
 		unsigned int maxParticles, nParticles, nWaitingParticles;
@@ -56,6 +81,15 @@ class ParticleGroup : public RenderTree {
 		std::list<Ressort *> springsWaitList;
 
 		std::list<ParticleGroupKernel *> kernels;
+
+		//kernels in execution order : one kernel on its own, or the fused ones in a single pass
+		struct KernelStage {
+			ParticleGroupKernel *kernel;
+			std::vector<ParticleGroupKernel *> fused;
+		};
+		std::vector<KernelStage> _stages;
+		bool _stagesDirty, _kernelFusion;
+		unsigned long _bytesPerStep;
 		
 		//VBOs 
 		unsigned int *buffers;
@@ -79,16 +113,64 @@ class ParticleGroup : public RenderTree {
 
 		unsigned int *springs_id1_d, *springs_id2_d;
 		unsigned char *kill_d, *fixed_d, *springs_kill_d;
+
+		//stream compaction : new index of each particle and spring (exclusive scan of the alive flags)
+		unsigned int *particles_index_d, *springs_index_d;
+		void *compaction_scratch_d;
+
+		//host arrays (CPU backend only, null otherwise), handed to the kernels by mappedPointers()
+		struct mappedParticlePointers _host;
+		unsigned int *particles_index_h;
+
+		//CUDA backend uploads : ring of pinned staging slots, copied asynchronously to the tail of the live range
+		static const unsigned int N_STAGING_SLOTS = 2;
+		unsigned char *_stagingSlots[N_STAGING_SLOTS];
+		struct mappedParticlePointers _stagingPointers[N_STAGING_SLOTS];
+		cudaEvent_t _stagingEvents[N_STAGING_SLOTS];
+		cudaStream_t _uploadStream;
+		unsigned int _nextStagingSlot;
 		
 		//funcs
 		bool _mapped;
+		struct mappedParticlePointers _mappedPointers;
 
-		void fromDevice();
-		void toDevice();
+		Backend _backend;
+		bool _hostArraysDirty;
+		CpuSpringIncidence *_springIncidence;
+		unsigned int _springTopology;
+
+		struct mappedParticlePointers mappedPointers() const;
+
+		//removes the killed particles and the springs that lost an end, on the device
+		void compactParticles();
+
+		//waiting particles and springs go after the live ones, O(waiting) and no readback
+		void appendWaitingParticles();
+		void appendWaitingSprings();
+		void popWaitingParticles(unsigned int count, const struct mappedParticlePointers &dst, unsigned int offset);
+		void popWaitingSprings(unsigned int count, const struct mappedParticlePointers &dst, unsigned int offset);
+
+		void allocateStagingRing();
+		void freeStagingRing();
+		unsigned int nextStagingSlot();
+
+		void buildStages();
+		void runFusedStage(const KernelStage &stage);
 
 		void mapRessources();
 		void unmapRessources();
 
+		void allocateHostArrays();
+		void freeHostArrays();
+		void uploadHostArrays();
+
+		//CPU backend : uploads the host arrays if a step changed them since the last draw
+		void updateBuffers();
+
+		static Backend _defaultBackend;
+		static bool _defaultBackendChosen;
+		static bool _defaultKernelFusion;
+
 		static Program *_particlesDebugProgram, *_springsDebugProgram;
 		static std::map<std::string, int> _particleUniformLocs, _springsUniformLocs;
 		static void makeDebugPrograms();
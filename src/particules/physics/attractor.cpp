@@ -1,20 +1,51 @@
 
 #include "attractor.h"
 
-extern void attractorKernel(const struct mappedParticlePointers *pt, 
+extern struct deviceUniformGrid *allocateDeviceGrid(unsigned int capacity);
+extern void freeDeviceGrid(struct deviceUniformGrid *grid);
+extern unsigned int getDeviceGridCapacity(const struct deviceUniformGrid *grid);
+extern void attractorGridKernel(const struct mappedParticlePointers *pt,
 		const unsigned int nParticles,
-		const float dMin, const float dMax, const float C);
+		const float dMin, const float dMax, const float C,
+		struct deviceUniformGrid *grid);
 
 Attractor::Attractor(float dMin, float dMax, float C) :
-	C(C), dMin(dMin), dMax(dMax)
+	C(C), dMin(dMin), dMax(dMax),
+	_deviceGrid(0)
 {
 }
 
 Attractor::~Attractor() {
+	if(_deviceGrid)
+		freeDeviceGrid(_deviceGrid);
 }
 
 void Attractor::operator()(const ParticleGroup *particleGroup) {
-	attractorKernel(
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::attractor(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				dMin, dMax, C, &_grid);
+		return;
+	}
+
+	if(_deviceGrid && getDeviceGridCapacity(_deviceGrid) < particleGroup->getMaxParticles()) {
+		freeDeviceGrid(_deviceGrid);
+		_deviceGrid = 0;
+	}
+	if(!_deviceGrid)
+		_deviceGrid = allocateDeviceGrid(particleGroup->getMaxParticles());
+
+	attractorGridKernel(
 			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
-			dMin, dMax, C);
+			dMin, dMax, C, _deviceGrid);
+}
+
+ParticleGroupKernel::Fusion Attractor::getFusion() const {
+	return FORCES_ONLY;
+}
+
+//grid build (positions and masses read, sorted copies, keys and indices written), forces
+//read and written, the neighbours reads are assumed to hit the cache
+unsigned long Attractor::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*(8*sizeof(float) + 3*sizeof(unsigned int) + 6*sizeof(float));
 }
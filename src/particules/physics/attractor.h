@@ -4,6 +4,9 @@
 #define ATTRACTORS_H
 
 #include "particleGroupKernel.h"
+#include "uniformGrid.h"
+
+struct deviceUniformGrid;
 
 class Attractor : public ParticleGroupKernel {
 
@@ -13,9 +16,16 @@ class Attractor : public ParticleGroupKernel {
 
 		void operator ()(const ParticleGroup *particleGroup);
 
+		Fusion getFusion() const;
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
 	private:
 		float C;
 		float dMin, dMax;
+
+		//neighbours within dMax, one grid per backend
+		UniformGrid _grid;
+		struct deviceUniformGrid *_deviceGrid;
 };
 
 #endif /* end of include guard: ATTRACTORS_H */
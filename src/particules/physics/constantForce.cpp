@@ -15,7 +15,29 @@ ConstantForce::~ConstantForce() {
 
 void ConstantForce::operator()(const ParticleGroup *particleGroup) {
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::constantForce(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				f.x, f.y, f.z);
+		return;
+	}
+
 	forceConstanteKernel(
 			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
 			f.x, f.y, f.z);
 }
+
+ParticleGroupKernel::Fusion ConstantForce::getFusion() const {
+	return FUSED_FORCE;
+}
+
+void ConstantForce::fuse(struct particleForceTerms *terms) {
+	terms->F[0] += f.x;
+	terms->F[1] += f.y;
+	terms->F[2] += f.z;
+}
+
+//forces read and written
+unsigned long ConstantForce::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*6*sizeof(float);
+}
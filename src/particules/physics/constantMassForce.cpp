@@ -15,7 +15,29 @@ ConstantMassForce::~ConstantMassForce() {
 
 void ConstantMassForce::operator()(const ParticleGroup *particleGroup) {
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::constantMassForce(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				Fm.x, Fm.y, Fm.z);
+		return;
+	}
+
 	forceMassiqueConstanteKernel(
 			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
 			Fm.x, Fm.y, Fm.z);
 }
+
+ParticleGroupKernel::Fusion ConstantMassForce::getFusion() const {
+	return FUSED_FORCE;
+}
+
+void ConstantMassForce::fuse(struct particleForceTerms *terms) {
+	terms->Fm[0] += Fm.x;
+	terms->Fm[1] += Fm.y;
+	terms->Fm[2] += Fm.z;
+}
+
+//forces read and written, masses read
+unsigned long ConstantMassForce::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*7*sizeof(float);
+}
@@ -13,6 +13,10 @@ class ConstantMassForce : public ParticleGroupKernel {
 
 		void operator ()(const ParticleGroup *particleGroup);
 
+		Fusion getFusion() const;
+		void fuse(struct particleForceTerms *terms);
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
 	private:
 		qglviewer::Vec Fm;
 };
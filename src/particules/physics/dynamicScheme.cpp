@@ -1,8 +1,9 @@
 
 #include "dynamicScheme.h"
 #include "kernelHeaders.h"
+#include "simulationClock.h"
 
-extern void dynamicSchemeKernel(const struct mappedParticlePointers *pt, unsigned int nParticles);
+extern void dynamicSchemeKernel(const struct mappedParticlePointers *pt, unsigned int nParticles, float dt);
 
 DynamicScheme::DynamicScheme() {
 }
@@ -11,5 +12,26 @@ DynamicScheme::~DynamicScheme() {
 }
 
 void DynamicScheme::operator()(const ParticleGroup *particleGroup) {
-	dynamicSchemeKernel(particleGroup->getMappedRessources(), particleGroup->getParticleCount());
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::dynamicScheme(particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				SimulationClock::global().getDt());
+		return;
+	}
+
+	dynamicSchemeKernel(particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+			SimulationClock::global().getDt());
+}
+
+ParticleGroupKernel::Fusion DynamicScheme::getFusion() const {
+	return FUSED_INTEGRATION;
+}
+
+void DynamicScheme::fuse(struct particleForceTerms *terms) {
+	terms->integrate = true;
+	terms->dt = SimulationClock::global().getDt();
+}
+
+//positions, velocities and forces read and written, inverse mass and fixed flag read
+unsigned long DynamicScheme::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*(19*sizeof(float) + sizeof(unsigned char));
 }
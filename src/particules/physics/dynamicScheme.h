@@ -11,6 +11,10 @@ class DynamicScheme : public ParticleGroupKernel {
 		~DynamicScheme();
 
 		void operator ()(const ParticleGroup *particleGroup);
+
+		Fusion getFusion() const;
+		void fuse(struct particleForceTerms *terms);
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
 };
 
 
@@ -16,7 +16,28 @@ FrottementFluide::~FrottementFluide() {
 
 void FrottementFluide::operator()(const ParticleGroup *particleGroup) {
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::frottementFluide(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				k1, k2);
+		return;
+	}
+
 	frottementFluideKernel(
 			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
 			k1, k2);
 }
+
+ParticleGroupKernel::Fusion FrottementFluide::getFusion() const {
+	return FUSED_FORCE;
+}
+
+void FrottementFluide::fuse(struct particleForceTerms *terms) {
+	terms->k1 += k1;
+	terms->k2 += k2;
+}
+
+//forces read and written, velocities read
+unsigned long FrottementFluide::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*9*sizeof(float);
+}
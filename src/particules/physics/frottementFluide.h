@@ -14,6 +14,10 @@ class FrottementFluide : public ParticleGroupKernel {
 
 		void operator ()(const ParticleGroup *particleGroup);
 
+		Fusion getFusion() const;
+		void fuse(struct particleForceTerms *terms);
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
 	private:
 		float k1, k2;
 };
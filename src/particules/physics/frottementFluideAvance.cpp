@@ -17,7 +17,32 @@ FrottementFluideAvance::~FrottementFluideAvance() {
 
 void FrottementFluideAvance::operator()(const ParticleGroup *particleGroup) {
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::frottementFluideAvance(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				rho, cx, cy, cz);
+		return;
+	}
+
 	frottementFluideAvanceKernel(
 			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
 			rho, cx, cy, cz);
 }
+
+ParticleGroupKernel::Fusion FrottementFluideAvance::getFusion() const {
+	return FUSED_FORCE;
+}
+
+//c * 1/2 rho S, with S = 4 pi r^2
+void FrottementFluideAvance::fuse(struct particleForceTerms *terms) {
+	float factor = 0.5f*rho*4.0f*3.14f;
+
+	terms->c[0] += cx*factor;
+	terms->c[1] += cy*factor;
+	terms->c[2] += cz*factor;
+}
+
+//forces read and written, velocities and radius read
+unsigned long FrottementFluideAvance::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*10*sizeof(float);
+}
@@ -15,6 +15,10 @@ class FrottementFluideAvance : public ParticleGroupKernel {
 
 		void operator ()(const ParticleGroup *particleGroup);
 
+		Fusion getFusion() const;
+		void fuse(struct particleForceTerms *terms);
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
 	private:
 		float rho;
 		float cx, cy, cz;
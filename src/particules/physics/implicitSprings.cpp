@@ -0,0 +1,47 @@
+
+#include "implicitSprings.h"
+#include "simulationClock.h"
+#include "log.h"
+
+ImplicitSprings::ImplicitSprings(bool dumping, float tolerance, unsigned int maxIterations) :
+	dumping(dumping),
+	_solver(tolerance, maxIterations),
+	_group(0), _springTopology(0)
+{
+}
+
+ImplicitSprings::~ImplicitSprings() {
+}
+
+void ImplicitSprings::operator()(const ParticleGroup *particleGroup) {
+	if(particleGroup->getBackend() != ParticleGroup::CPU_BACKEND) {
+		log_console.errorStream() << "[Implicit Springs] Only the CPU backend is supported !";
+		exit(1);
+	}
+
+	const struct mappedParticlePointers *pt = particleGroup->getMappedRessources();
+	unsigned int nParticles = particleGroup->getParticleCount(), nSprings = particleGroup->getSpringCount();
+
+	if(particleGroup != _group || particleGroup->getSpringTopology() != _springTopology) {
+		_solver.setTopology(pt->id1, pt->id2, nParticles, nSprings);
+		_group = particleGroup;
+		_springTopology = particleGroup->getSpringTopology();
+	}
+
+	_solver.step(pt, nParticles, nSprings, SimulationClock::global().getDt(), 0.0f, dumping);
+}
+
+//spring terms (ends, parameters, both ends positions and velocities read, force, stiffness and
+//block written, line and intensity written), block rows assembly (blocks written, particle state
+//and spring terms read), then per CG iteration of the last step the product (blocks, columns and
+//gathered vector read) and five vector passes, and the integration
+unsigned long ImplicitSprings::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	unsigned long nBlocks = nParticles + 2ul*nSprings;
+	unsigned long springs = nSprings*(2*sizeof(unsigned int) + 5*sizeof(float) + sizeof(unsigned char) + 12*sizeof(float)
+			+ 21*sizeof(float) + 8*sizeof(float));
+	unsigned long assembly = nBlocks*(9*sizeof(float) + 2*sizeof(unsigned int)) + nParticles*(11*sizeof(float) + sizeof(unsigned char))
+		+ 2ul*nSprings*21*sizeof(float);
+	unsigned long iteration = nBlocks*(9*sizeof(float) + sizeof(unsigned int) + 3*sizeof(float)) + 5*3ul*nParticles*3*sizeof(float);
+	unsigned long integration = nParticles*(15*sizeof(float) + sizeof(unsigned char));
+	return springs + assembly + _solver.getIterations()*iteration + integration;
+}
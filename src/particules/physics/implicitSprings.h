@@ -0,0 +1,30 @@
+
+#ifndef IMPLICITSPRINGS_H
+#define IMPLICITSPRINGS_H
+
+#include "particleGroupKernel.h"
+#include "implicitSpringSolver.h"
+
+// Backward Euler alternative to SpringsSystem + DynamicScheme (ImplicitSpringSolver) : large
+// steps on stiff springs for a CG solve per step. It integrates the particles, so it replaces
+// both kernels and is added after the force kernels. CPU backend only.
+class ImplicitSprings : public ParticleGroupKernel {
+
+	public:
+		ImplicitSprings(bool dumping, float tolerance = 1.0e-4f, unsigned int maxIterations = 200);
+		~ImplicitSprings();
+
+		void operator ()(const ParticleGroup *particleGroup);
+
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
+	private:
+		bool dumping;
+
+		//matrix pattern of the springs of the last group, rebuilt when its springs change
+		ImplicitSpringSolver _solver;
+		const ParticleGroup *_group;
+		unsigned int _springTopology;
+};
+
+#endif /* end of include guard: IMPLICITSPRINGS_H */
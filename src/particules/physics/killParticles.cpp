@@ -15,9 +15,26 @@ KillParticles::~KillParticles() {
 
 void KillParticles::operator()(const ParticleGroup *particleGroup) {
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::killParticles(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				vx, vy, vz, 
+				maxVal);
+		return;
+	}
+
 	killParticleKernel(
 			particleGroup->getMappedRessources(), 
 			vx, vy, vz, 
 			particleGroup->getParticleCount(), 
 			maxVal);
 }
+
+ParticleGroupKernel::Fusion KillParticles::getFusion() const {
+	return FORCES_ONLY;
+}
+
+//positions read, kill flag written
+unsigned long KillParticles::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*(3*sizeof(float) + sizeof(unsigned char));
+}
@@ -0,0 +1,48 @@
+
+#include "particleCollisions.h"
+
+extern struct deviceUniformGrid *allocateDeviceGrid(unsigned int capacity);
+extern void freeDeviceGrid(struct deviceUniformGrid *grid);
+extern unsigned int getDeviceGridCapacity(const struct deviceUniformGrid *grid);
+extern void particleCollisionsGridKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles,
+		const float maxRadius, const float rebound,
+		struct deviceUniformGrid *grid);
+
+ParticleCollisions::ParticleCollisions(float maxRadius, float rebound) :
+	maxRadius(maxRadius), rebound(rebound),
+	_deviceGrid(0)
+{
+}
+
+ParticleCollisions::~ParticleCollisions() {
+	if(_deviceGrid)
+		freeDeviceGrid(_deviceGrid);
+}
+
+void ParticleCollisions::operator()(const ParticleGroup *particleGroup) {
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::particleCollisions(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				maxRadius, rebound, &_grid);
+		return;
+	}
+
+	if(_deviceGrid && getDeviceGridCapacity(_deviceGrid) < particleGroup->getMaxParticles()) {
+		freeDeviceGrid(_deviceGrid);
+		_deviceGrid = 0;
+	}
+	if(!_deviceGrid)
+		_deviceGrid = allocateDeviceGrid(particleGroup->getMaxParticles());
+
+	particleCollisionsGridKernel(
+			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+			maxRadius, rebound, _deviceGrid);
+}
+
+//grid build (positions read, sorted copies, keys and indices written), radius, velocities
+//and inverse mass gathered, positions and velocities written, the neighbours reads are
+//assumed to hit the cache
+unsigned long ParticleCollisions::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*(6*sizeof(float) + 3*sizeof(unsigned int) + 10*sizeof(float) + sizeof(unsigned char) + 6*sizeof(float));
+}
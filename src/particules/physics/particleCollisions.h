@@ -0,0 +1,31 @@
+
+#ifndef PARTICLECOLLISIONS_H
+#define PARTICLECOLLISIONS_H
+
+#include "particleGroupKernel.h"
+#include "uniformGrid.h"
+
+struct deviceUniformGrid;
+
+// Sphere-sphere collisions inside a group, on the spatial hash (cells of 2*maxRadius)
+// Overlapping particles are pushed apart and their approaching velocities reflected,
+// mass weighted (fixed particles do not move). Added after DynamicScheme.
+class ParticleCollisions : public ParticleGroupKernel {
+
+	public:
+		ParticleCollisions(float maxRadius, float rebound = 0.5f);
+		~ParticleCollisions();
+
+		void operator ()(const ParticleGroup *particleGroup);
+
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
+	private:
+		float maxRadius, rebound;
+
+		//one grid per backend
+		UniformGrid _grid;
+		struct deviceUniformGrid *_deviceGrid;
+};
+
+#endif /* end of include guard: PARTICLECOLLISIONS_H */
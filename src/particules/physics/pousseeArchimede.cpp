@@ -20,7 +20,34 @@ void PousseeArchimede::operator()(const ParticleGroup *particleGroup) {
 	float gn = g.norm();
 	qglviewer::Vec gv = g.unit();
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::pousseeArchimede(particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				gv.x, gv.y, gv.z,
+				rho, gn);
+		return;
+	}
+
 	pousseeArchimedeKernel(particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
 			gv.x, gv.y, gv.z,
 			rho, gn);
 }
+
+ParticleGroupKernel::Fusion PousseeArchimede::getFusion() const {
+	return FUSED_FORCE;
+}
+
+//f = -n rho g 4/3 pi r^3
+void PousseeArchimede::fuse(struct particleForceTerms *terms) {
+	float gn = g.norm();
+	qglviewer::Vec gv = g.unit();
+	float s = rho*gn*4.0f/3.0f*3.14f;
+
+	terms->Fv[0] -= gv.x*s;
+	terms->Fv[1] -= gv.y*s;
+	terms->Fv[2] -= gv.z*s;
+}
+
+//forces read and written, radius read
+unsigned long PousseeArchimede::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*7*sizeof(float);
+}
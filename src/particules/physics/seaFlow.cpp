@@ -1,13 +1,14 @@
 
 
 #include "seaFlow.h"
+#include "simulationClock.h"
 
 extern void forceConstanteKernel(
 		const struct mappedParticlePointers *pt, const unsigned int nParticles, 
 		const float Fx, const float Fy, const float Fz);
 
-SeaFlow::SeaFlow(qglviewer::Vec flowDir, float force, float deltaT) :
-	flowDir(flowDir), force(force), deltaT(deltaT), t(0.0f)
+SeaFlow::SeaFlow(qglviewer::Vec flowDir, float force, float pulsation) :
+	flowDir(flowDir), force(force), pulsation(pulsation), t(0.0f)
 {
 }
 
@@ -17,9 +18,35 @@ SeaFlow::~SeaFlow() {
 void SeaFlow::operator()(const ParticleGroup *particleGroup) {
 	qglviewer::Vec flow = force*flowDir*sin(t);
 
-	forceConstanteKernel(
-			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
-			flow.x, flow.y, flow.z);
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::constantForce(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				flow.x, flow.y, flow.z);
+	}
+	else {
+		forceConstanteKernel(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				flow.x, flow.y, flow.z);
+	}
 	
-	t+= deltaT;
+	t+= pulsation*SimulationClock::global().getDt();
+}
+
+ParticleGroupKernel::Fusion SeaFlow::getFusion() const {
+	return FUSED_FORCE;
+}
+
+void SeaFlow::fuse(struct particleForceTerms *terms) {
+	qglviewer::Vec flow = force*flowDir*sin(t);
+
+	terms->F[0] += flow.x;
+	terms->F[1] += flow.y;
+	terms->F[2] += flow.z;
+	
+	t+= pulsation*SimulationClock::global().getDt();
+}
+
+//forces read and written
+unsigned long SeaFlow::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*6*sizeof(float);
 }
@@ -7,15 +7,20 @@
 class SeaFlow : public ParticleGroupKernel {
 
 	public:
-		SeaFlow(qglviewer::Vec flowDir, float force, float deltaT);
+		//the flow is force*flowDir*sin(pulsation*t), pulsation in rad per simulated second
+		SeaFlow(qglviewer::Vec flowDir, float force, float pulsation);
 		~SeaFlow();
 
 		void operator()(const ParticleGroup *particleGroup);
 
+		Fusion getFusion() const;
+		void fuse(struct particleForceTerms *terms);
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
 	private:
 		qglviewer::Vec flowDir;
 		float force;
-		float deltaT;
+		float pulsation;
 		float t;
 };
 
@@ -16,8 +16,30 @@ SpringsSystem::~SpringsSystem() {
 
 void SpringsSystem::operator()(const ParticleGroup *particleGroup) {
 
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::springs(
+				particleGroup->getMappedRessources(), 
+				particleGroup->getParticleCount(), 
+				particleGroup->getSpringCount(), 
+				dumping, 
+				particleGroup->getSpringIncidence());
+		return;
+	}
+
 	springKernel(
 			particleGroup->getMappedRessources(), 
 			particleGroup->getSpringCount(), 
 			dumping);
 }
+
+ParticleGroupKernel::Fusion SpringsSystem::getFusion() const {
+	return FORCES_ONLY;
+}
+
+//per spring : ends, parameters and kill flag read, both ends positions (and velocities when
+//damped) read, both ends forces read and written, line and intensity written
+unsigned long SpringsSystem::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	unsigned long perSpring = 2*sizeof(unsigned int) + 4*sizeof(float) + sizeof(unsigned char)
+		+ (dumping ? 12 : 6)*sizeof(float) + 12*sizeof(float) + 8*sizeof(float);
+	return nSprings*perSpring;
+}
@@ -0,0 +1,47 @@
+
+#include "terrainCollision.h"
+
+extern struct deviceDensityVolume *uploadDensityVolume(const float *samples,
+		const unsigned int width, const unsigned int height, const unsigned int length,
+		const float voxelSize, const float origin[3]);
+extern void freeDensityVolume(struct deviceDensityVolume *volume);
+extern void terrainCollisionKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles,
+		const struct deviceDensityVolume *volume,
+		const float rebound, const float friction);
+
+TerrainCollision::TerrainCollision(const DensityVolume *volume, float rebound, float friction) :
+	volume(volume), rebound(rebound), friction(friction),
+	_deviceVolume(0)
+{
+}
+
+TerrainCollision::~TerrainCollision() {
+	if(_deviceVolume)
+		freeDensityVolume(_deviceVolume);
+}
+
+void TerrainCollision::operator()(const ParticleGroup *particleGroup) {
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::terrainCollision(
+				particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+				volume, rebound, friction);
+		return;
+	}
+
+	if(!_deviceVolume) {
+		_deviceVolume = uploadDensityVolume(volume->getSamples(),
+				volume->getWidth(), volume->getHeight(), volume->getLength(),
+				volume->getVoxelSize(), volume->getOrigin());
+	}
+
+	terrainCollisionKernel(
+			particleGroup->getMappedRessources(), particleGroup->getParticleCount(), 
+			_deviceVolume, rebound, friction);
+}
+
+//positions, velocities, radius and fixed flag read, positions and velocities written,
+//the density samples are assumed to hit the cache
+unsigned long TerrainCollision::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	return nParticles*(13*sizeof(float) + sizeof(unsigned char));
+}
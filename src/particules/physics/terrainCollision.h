@@ -0,0 +1,31 @@
+
+#ifndef TERRAINCOLLISION_H
+#define TERRAINCOLLISION_H
+
+#include "particleGroupKernel.h"
+#include "densityVolume.h"
+
+struct deviceDensityVolume;
+
+// Particles against the terrain density field (MarchingCubes::makeDensityVolume)
+// Added after DynamicScheme : penetrating particles are projected out along the
+// terrain normal, their velocity into the surface is reflected and the tangential one damped.
+// CUDA groups sample the field from a 3D texture, uploaded on first use.
+class TerrainCollision : public ParticleGroupKernel {
+
+	public:
+		TerrainCollision(const DensityVolume *volume, float rebound = 0.3f, float friction = 0.1f);
+		~TerrainCollision();
+
+		void operator ()(const ParticleGroup *particleGroup);
+
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
+	private:
+		const DensityVolume *volume;
+		float rebound, friction;
+
+		struct deviceDensityVolume *_deviceVolume;
+};
+
+#endif /* end of include guard: TERRAINCOLLISION_H */
@@ -0,0 +1,100 @@
+
+#include "xpbdSprings.h"
+#include "simulationClock.h"
+#include "cudaUtils.h"
+
+extern struct deviceXpbdState *allocateDeviceXpbdState(unsigned int particleCapacity, unsigned int springCapacity);
+extern void freeDeviceXpbdState(struct deviceXpbdState *state);
+extern unsigned int getDeviceXpbdParticleCapacity(const struct deviceXpbdState *state);
+extern unsigned int getDeviceXpbdSpringCapacity(const struct deviceXpbdState *state);
+extern void uploadXpbdColouring(struct deviceXpbdState *state, const unsigned int *colourSprings, unsigned int nColourSprings);
+extern void xpbdKernel(const struct mappedParticlePointers *pt,
+		const unsigned int nParticles, const unsigned int nSprings,
+		struct deviceXpbdState *state, const unsigned int *colourOffsets, const unsigned int nColours,
+		const float dt, const unsigned int nSubsteps, const unsigned int nIterations,
+		const bool handleDumping);
+
+XpbdSprings::XpbdSprings(bool dumping, unsigned int nSubsteps, unsigned int nIterations) :
+	dumping(dumping), nSubsteps(nSubsteps), nIterations(nIterations),
+	_group(0), _springTopology(0),
+	_deviceState(0)
+{
+	if(nSubsteps == 0 || nIterations == 0) {
+		log_console.errorStream() << "[XPBD] At least one substep and one iteration are needed !";
+		exit(1);
+	}
+}
+
+XpbdSprings::~XpbdSprings() {
+	if(_deviceState)
+		freeDeviceXpbdState(_deviceState);
+}
+
+void XpbdSprings::operator()(const ParticleGroup *particleGroup) {
+	updateColouring(particleGroup);
+
+	const float dt = SimulationClock::global().getDt();
+
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::xpbd(
+				particleGroup->getMappedRessources(), 
+				particleGroup->getParticleCount(), 
+				particleGroup->getSpringCount(), 
+				&_colouring, dt, nSubsteps, nIterations, dumping, &_state);
+		return;
+	}
+
+	xpbdKernel(
+			particleGroup->getMappedRessources(), 
+			particleGroup->getParticleCount(), 
+			particleGroup->getSpringCount(), 
+			_deviceState, &_colouring.offsets[0], _colouring.offsets.size() - 1,
+			dt, nSubsteps, nIterations, dumping);
+}
+
+//the colouring is built on the host, the CUDA backend reads the spring ends back once per change
+void XpbdSprings::updateColouring(const ParticleGroup *particleGroup) {
+	if(particleGroup == _group && particleGroup->getSpringTopology() == _springTopology)
+		return;
+
+	_group = particleGroup;
+	_springTopology = particleGroup->getSpringTopology();
+
+	const struct mappedParticlePointers *pt = particleGroup->getMappedRessources();
+	unsigned int nParticles = particleGroup->getParticleCount(), nSprings = particleGroup->getSpringCount();
+
+	if(particleGroup->getBackend() == ParticleGroup::CPU_BACKEND) {
+		CpuParticleKernels::buildSpringColouring(pt->id1, pt->id2, pt->killSpring, nParticles, nSprings, &_colouring);
+		return;
+	}
+
+	std::vector<unsigned int> id1(nSprings + 1), id2(nSprings + 1);
+	std::vector<unsigned char> killSpring(nSprings + 1);
+	CHECK_CUDA_ERRORS(cudaMemcpy(&id1[0], pt->id1, nSprings*sizeof(unsigned int), cudaMemcpyDeviceToHost));
+	CHECK_CUDA_ERRORS(cudaMemcpy(&id2[0], pt->id2, nSprings*sizeof(unsigned int), cudaMemcpyDeviceToHost));
+	CHECK_CUDA_ERRORS(cudaMemcpy(&killSpring[0], pt->killSpring, nSprings*sizeof(unsigned char), cudaMemcpyDeviceToHost));
+	CpuParticleKernels::buildSpringColouring(&id1[0], &id2[0], &killSpring[0], nParticles, nSprings, &_colouring);
+
+	if(_deviceState && (getDeviceXpbdParticleCapacity(_deviceState) < particleGroup->getMaxParticles()
+				|| getDeviceXpbdSpringCapacity(_deviceState) < particleGroup->getMaxSprings())) {
+		freeDeviceXpbdState(_deviceState);
+		_deviceState = 0;
+	}
+	if(!_deviceState)
+		_deviceState = allocateDeviceXpbdState(particleGroup->getMaxParticles(), particleGroup->getMaxSprings());
+
+	uploadXpbdColouring(_deviceState, &_colouring.springs[0], _colouring.offsets.back());
+}
+
+//per substep : positions, velocities, forces, inverse mass and fixed flag read, start positions
+//and velocities written (prediction), then per iteration and spring the ends, parameters, both
+//ends positions read and written, inverse masses, flags and multiplier read, multiplier written,
+//then the velocities derived. Lines and intensity written once
+unsigned long XpbdSprings::getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const {
+	unsigned long predict = nParticles*(16*sizeof(float) + sizeof(unsigned char));
+	unsigned long project = nSprings*(3*sizeof(unsigned int) + (dumping ? 3 : 2)*sizeof(float) + 12*sizeof(float)
+			+ (dumping ? 6 : 0)*sizeof(float) + 2*sizeof(float) + 2*sizeof(unsigned char) + 2*sizeof(float));
+	unsigned long velocities = nParticles*(9*sizeof(float) + sizeof(unsigned char));
+	unsigned long lines = nSprings*(2*sizeof(unsigned int) + 6*sizeof(float) + 2*sizeof(float) + sizeof(unsigned char) + 8*sizeof(float));
+	return nSubsteps*(predict + nIterations*project + velocities) + lines;
+}
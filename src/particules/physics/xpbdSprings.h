@@ -0,0 +1,39 @@
+
+#ifndef XPBDSPRINGS_H
+#define XPBDSPRINGS_H
+
+#include "particleGroupKernel.h"
+
+struct deviceXpbdState;
+
+// XPBD alternative to SpringsSystem + DynamicScheme : the springs of the group are distance
+// constraints (compliance 1/k, damping d) projected colour batch by colour batch, stable at
+// large steps with a few iterations. It integrates the particles, so it replaces both kernels
+// and is added after the force kernels.
+class XpbdSprings : public ParticleGroupKernel {
+
+	public:
+		XpbdSprings(bool dumping, unsigned int nSubsteps = 1, unsigned int nIterations = 4);
+		~XpbdSprings();
+
+		void operator ()(const ParticleGroup *particleGroup);
+
+		unsigned long getMemoryTraffic(unsigned int nParticles, unsigned int nSprings) const;
+
+	private:
+		bool dumping;
+		unsigned int nSubsteps, nIterations;
+
+		//colouring of the springs of the last group, rebuilt when its springs change
+		const ParticleGroup *_group;
+		unsigned int _springTopology;
+		SpringColouring _colouring;
+
+		//one scratch per backend
+		XpbdState _state;
+		struct deviceXpbdState *_deviceState;
+
+		void updateColouring(const ParticleGroup *particleGroup);
+};
+
+#endif /* end of include guard: XPBDSPRINGS_H */
@@ -9,8 +9,10 @@
 #include "seaFlow.h"
 #include "dynamicScheme.h"
 #include "springsSystem.h"
+#include "xpbdSprings.h"
+#include "implicitSprings.h"
 
-SeeweedGroup::SeeweedGroup(unsigned int maxSeeweeds, unsigned int maxSubdivisions, float seeweedWidth) :
+SeeweedGroup::SeeweedGroup(unsigned int maxSeeweeds, unsigned int maxSubdivisions, float seeweedWidth, SpringsIntegration integration) :
 	ParticleGroup(maxSeeweeds*(1+maxSubdivisions), maxSeeweeds*maxSubdivisions), 
 	_maxSeeweeds(maxSeeweeds), _maxSubdivisions(maxSubdivisions),
 	_seeweedWidth(seeweedWidth)
@@ -18,9 +20,18 @@ SeeweedGroup::SeeweedGroup(unsigned int maxSeeweeds, unsigned int maxSubdivision
 	makeSeeweedsProgram();
 
 	this->addKernel(new ConstantForce(0.03*qglviewer::Vec(0,9.81,0)));
-	this->addKernel(new SeaFlow(qglviewer::Vec(1,0,0), 0.12f, 0.01));
-	this->addKernel(new SpringsSystem(true));
-	this->addKernel(new DynamicScheme());
+	this->addKernel(new SeaFlow(qglviewer::Vec(1,0,0), 0.12f, 0.25f));
+	switch(integration) {
+		case XPBD_SPRINGS:
+			this->addKernel(new XpbdSprings(true));
+			break;
+		case IMPLICIT_SPRINGS:
+			this->addKernel(new ImplicitSprings(true));
+			break;
+		default:
+			this->addKernel(new SpringsSystem(true));
+			this->addKernel(new DynamicScheme());
+	}
 }
 
 SeeweedGroup::~SeeweedGroup() {
@@ -51,6 +62,8 @@ void SeeweedGroup::spawnGroup(const qglviewer::Vec &pos, unsigned int nSeeweeds,
 
 
 void SeeweedGroup::drawDownwards(const float *modelMatrix) {
+	updateBuffers();
+
 	_seeweedsProgram->use();
 
 	glUniformMatrix4fv(_seeweedsUniformLocs["modelMatrix"], 1, GL_TRUE, modelMatrix);
@@ -8,7 +8,11 @@ typedef unsigned int (*subdivisionFunc)(const qglviewer::Vec &pos);
 class SeeweedGroup : public ParticleGroup {
 
 	public:
-		SeeweedGroup(unsigned int maxSeeweeds, unsigned int maxSubdivisions, float seeweedWidth);
+		//how the springs are integrated : SpringsSystem + DynamicScheme, XpbdSprings or ImplicitSprings (CPU backend)
+		enum SpringsIntegration { EXPLICIT_SPRINGS, XPBD_SPRINGS, IMPLICIT_SPRINGS };
+
+		SeeweedGroup(unsigned int maxSeeweeds, unsigned int maxSubdivisions, float seeweedWidth,
+				SpringsIntegration integration = EXPLICIT_SPRINGS);
 		~SeeweedGroup();
 
 		void spawnGroup(const qglviewer::Vec &pos, unsigned int nSeeweeds, subdivisionFunc getSubdivisions, randPosFunc generatePos);
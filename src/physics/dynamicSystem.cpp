@@ -1,11 +1,17 @@
 #include <cmath>
 #include <iostream>
 #include <map>
+#include <algorithm>
+#include <chrono>
 
 #include <vector>
 
 #include "dynamicSystem.h"
 #include "viewer.h"
+#include "simulationClock.h"
+#include "particleGroup.h"
+#include "threadPool.h"
+#include "log.h"
 
 DynamicSystem::DynamicSystem()
 {
@@ -16,7 +22,7 @@ DynamicSystem::DynamicSystem()
     defaultMediumViscosity = 1.0;
     mediumViscosity = defaultMediumViscosity;
     handleCollisions = true;
-    dt = 0.1;
+    dt = SimulationClock::global().getDt();
     groundPosition = Vec(0.0, 0.0, 0.0);
     groundNormal = Vec(0.0, 0.0, 1.0);
     rebound = 0.5;
@@ -32,6 +38,21 @@ DynamicSystem::DynamicSystem()
     toggleGravity = true;
     toggleViscosity = true;
     toggleCollisions = true;
+    // empty system
+    topology = 0;
+    incidenceTopology = ~0u;
+    // symplectic Euler by default
+    implicitIntegration = false;
+    implicitTopology = ~0u;
+    // batched drawing by default
+    batchedDrawing = true;
+    rendererTopology = ~0u;
+}
+
+
+namespace {
+    // big enough ranges to hide the pool overhead
+    const unsigned int grain = 8192;
 }
 
 DynamicSystem::~DynamicSystem()
@@ -42,34 +63,122 @@ DynamicSystem::~DynamicSystem()
 
 void DynamicSystem::clear()
 {
-    std::vector<Particle *>::iterator itF;
-    for (itF = fixe.begin(); itF != fixe.end(); ++itF) {
-        delete(*itF);
-    }
+    vector<float> *particleArrays[] = {&posX, &posY, &posZ, &velX, &velY, &velZ, &forceX, &forceY, &forceZ,
+                                       &mass, &invMass, &radius, &colors};
+    for (unsigned int a = 0; a < sizeof(particleArrays) / sizeof(particleArrays[0]); ++a)
+        particleArrays[a]->clear();
+    killParticle.clear();
+    fixedParticle.clear();
     fixe.clear();
 
-    std::vector<Particle *>::iterator itP;
-    for (itP = particles.begin(); itP != particles.end(); ++itP) {
-        delete(*itP);
-    }
-    particles.clear();
+    vector<float> *springArrays[] = {&springStiffnesses, &springLengths, &springDampings,
+                                     &springMaxForces, &springLines, &springIntensities};
+    for (unsigned int a = 0; a < sizeof(springArrays) / sizeof(springArrays[0]); ++a)
+        springArrays[a]->clear();
+    springEnds[0].clear();
+    springEnds[1].clear();
+    killSpring.clear();
 
-    std::vector<Spring *>::iterator itS;
-    for (itS = springs.begin(); itS != springs.end(); ++itS) {
-        delete(*itS);
+    topology++;
+}
+
+unsigned int DynamicSystem::addParticle(const Vec &pos, const Vec &vel, double m, double r,
+                                        const Vec &color, bool fixed)
+{
+    unsigned int index = posX.size();
+
+    posX.push_back(pos.x);
+    posY.push_back(pos.y);
+    posZ.push_back(pos.z);
+    velX.push_back(vel.x);
+    velY.push_back(vel.y);
+    velZ.push_back(vel.z);
+    forceX.push_back(0.0f);
+    forceY.push_back(0.0f);
+    forceZ.push_back(0.0f);
+    mass.push_back(m);
+    invMass.push_back(m > 0 ? 1 / m : 0.0);	// the inverse of the mass is also stored
+    radius.push_back(r);
+    colors.push_back(color.x);
+    colors.push_back(color.y);
+    colors.push_back(color.z);
+    killParticle.push_back(0);
+    fixedParticle.push_back(fixed ? 1 : 0);
+
+    if (fixed)
+        fixe.push_back(index);
+
+    topology++;
+    return index;
+}
+
+unsigned int DynamicSystem::addSpring(unsigned int i1, unsigned int i2, double s, double l0, double d)
+{
+    if (i1 >= posX.size() || i2 >= posX.size()) {
+        log_console.errorStream() << "[DynamicSystem] Spring between particles " << i1 << " and " << i2
+            << " but there are only " << posX.size() << " particles !";
+        exit(1);
     }
-    springs.clear();
+
+    unsigned int index = springEnds[0].size();
+
+    springEnds[0].push_back(i1);
+    springEnds[1].push_back(i2);
+    springStiffnesses.push_back(s);
+    springLengths.push_back(l0);
+    springDampings.push_back(d);
+    springMaxForces.push_back(1.0f);	// only scales the intensities, which are not drawn
+    springLines.push_back(posX[i1]);
+    springLines.push_back(posY[i1]);
+    springLines.push_back(posZ[i1]);
+    springLines.push_back(posX[i2]);
+    springLines.push_back(posY[i2]);
+    springLines.push_back(posZ[i2]);
+    springIntensities.push_back(0.0f);
+    springIntensities.push_back(0.0f);
+    killSpring.push_back(0);
+
+    topology++;
+    return index;
+}
+
+struct mappedParticlePointers DynamicSystem::getPointers()
+{
+    struct mappedParticlePointers pt = {
+        posX.data(), posY.data(), posZ.data(), velX.data(), velY.data(), velZ.data(),
+        forceX.data(), forceY.data(), forceZ.data(), mass.data(), invMass.data(), radius.data(),
+        killParticle.data(), fixedParticle.data(),
+        springStiffnesses.data(), springLengths.data(), springDampings.data(),
+        springMaxForces.data(), springLines.data(), springIntensities.data(),
+        springEnds[0].data(), springEnds[1].data(),
+        killSpring.data()
+    };
+    return pt;
 }
 
-const Vec &DynamicSystem::getFixedParticlePosition() const
+Vec DynamicSystem::getFixedParticlePosition() const
 {
-    return fixe[0]->getPosition();	// no check on 0!
+    unsigned int i = fixe[0];	// no check on 0!
+    return Vec(posX[i], posY[i], posZ[i]);
 }
 
 void DynamicSystem::setFixedParticlePosition(const Vec &pos)
 {
-    if (fixe.size() > 0)
-        fixe[0]->setPosition(pos);
+    if (fixe.size() > 0) {
+        posX[fixe[0]] = pos.x;
+        posY[fixe[0]] = pos.y;
+        posZ[fixe[0]] = pos.z;
+    }
+}
+
+unsigned int DynamicSystem::getParticleCount() const
+{
+    return posX.size();
+}
+
+unsigned int DynamicSystem::getSpringCount() const
+{
+    return springEnds[0].size();
 }
 
 void DynamicSystem::setGravity(bool onOff)
@@ -87,6 +196,16 @@ void DynamicSystem::setCollisionsDetection(bool onOff)
     handleCollisions = onOff;
 }
 
+void DynamicSystem::setImplicitIntegration(bool onOff)
+{
+    implicitIntegration = onOff;
+}
+
+void DynamicSystem::setBatchedDrawing(bool onOff)
+{
+    batchedDrawing = onOff;
+}
+
 
 void DynamicSystem::init(Viewer &viewer)
 {
@@ -98,114 +217,211 @@ void DynamicSystem::init(Viewer &viewer)
 }
 
 void DynamicSystem::drawDownwards(const float *currentTransformationMatrix) {
-    // Fixed Particles
-    std::vector<Particle *>::iterator itP;
-    for (itP = fixe.begin(); itP != fixe.end(); ++itP) {
-        glColor3fv((*itP)->getColor());
-        (*itP)->draw();
+    if (batchedDrawing) {
+        // radii, colours and springs ends uploaded once per topology
+        if (rendererTopology != topology) {
+            renderer.setTopology(radius.data(), colors.data(), posX.size(),
+                                 springEnds[0].data(), springEnds[1].data(), springEnds[0].size());
+            rendererTopology = topology;
+        }
+
+        const float springColor[3] = {1.0, 0.28, 0.0};
+        renderer.draw(posX.data(), posY.data(), posZ.data(), currentTransformationMatrix, springColor, 5.0);
+        return;
     }
 
-    // Particles
-    for (itP = particles.begin(); itP != particles.end(); ++itP) {
-        glColor3fv((*itP)->getColor());
-        (*itP)->draw();
+    glPushMatrix();
+    glMultTransposeMatrixf(currentTransformationMatrix);
+
+    // Particles (fixed ones included)
+    for (unsigned int i = 0; i < posX.size(); ++i) {
+        glColor3fv(&colors[3 * i]);
+        glPushMatrix();
+        glTranslatef(posX[i], posY[i], posZ[i]);
+        glutSolidSphere(radius[i], 12, 12);
+        glPopMatrix();
     }
 
     // Springs
     glColor3f(1.0, 0.28, 0.0);
     glLineWidth(5.0);
-    std::vector<Spring *>::iterator itS;
-    for (itS = springs.begin(); itS != springs.end(); ++itS) {
-        (*itS)->draw();
+    glBegin(GL_LINES);
+    for (unsigned int s = 0; s < springEnds[0].size(); ++s) {
+        unsigned int i1 = springEnds[0][s], i2 = springEnds[1][s];
+        glVertex3f(posX[i1], posY[i1], posZ[i1]);
+        glVertex3f(posX[i2], posY[i2], posZ[i2]);
     }
+    glEnd();
+
+    glPopMatrix();
 }
 
 
-void DynamicSystem::animate()
+void DynamicSystem::explicitStep()
 {
+    unsigned int nParticles = posX.size(), nSprings = springEnds[0].size();
+    struct mappedParticlePointers pt = getPointers();
+
+    // springs of each particle, once per topology
+    if (incidenceTopology != topology) {
+        CpuParticleKernels::buildSpringIncidence(springEnds[0].data(), springEnds[1].data(),
+                                                 nParticles, nSprings, &springIncidence);
+        incidenceTopology = topology;
+    }
 
     //======== 1. Compute all forces
-    // map to accumulate the forces to apply on each particle
-    map<const Particle *, Vec> forces;
-
     // weights
-    std::vector<Particle *>::iterator itP;
-    for (itP = particles.begin(); itP != particles.end(); ++itP) {
-        Particle *p = *itP;
-        forces[p] = gravity * p->getMass();
-    }
+    CpuParticleKernels::constantMassForce(&pt, nParticles, gravity.x, gravity.y, gravity.z);
 
     // viscosity
-    for (itP = particles.begin(); itP != particles.end(); ++itP) {
-        Particle *p = *itP;
-        forces[p] += -mediumViscosity * p->getVelocity();
-    }
+    CpuParticleKernels::frottementFluide(&pt, nParticles, mediumViscosity, 0.0);
 
-    // damped springs
-    std::vector<Spring *>::iterator itS;
-    for (itS = springs.begin(); itS != springs.end(); ++itS) {
-        Spring *s = *itS;
-        Vec f12 = s->getCurrentForce();
-        forces[s->getParticle1()] += f12;
-        forces[s->getParticle2()] -= f12; // opposite force
-    }
+    // damped springs (forces per spring, then summed per particle)
+    CpuParticleKernels::springs(&pt, nParticles, nSprings, true, &springIncidence);
 
 
     //======== 2. Integration scheme
-    // update particles velocity (qu. 1)
-    for (itP = particles.begin(); itP != particles.end(); ++itP) {
-        Particle *p = *itP;
-        Vec force = forces[p];
-        // v = v + h * f / m
-        p->incrVelocity(dt * force * p->getInvMass());
-    }
+    // v = v + h * f / m, q = q + h * v, forces reset
+    CpuParticleKernels::dynamicScheme(&pt, nParticles, dt);
+}
 
-    // update particles positions
-    for (itP = particles.begin(); itP != particles.end(); ++itP) {
-        Particle *p = *itP;
-        // q = q + dt * v
-        p->incrPosition(dt * p->getVelocity());
+void DynamicSystem::implicitStep()
+{
+    unsigned int nParticles = posX.size(), nSprings = springEnds[0].size();
+    struct mappedParticlePointers pt = getPointers();
+
+    // matrix pattern, once per topology
+    if (implicitTopology != topology) {
+        implicitSolver.setTopology(springEnds[0].data(), springEnds[1].data(), nParticles, nSprings);
+        implicitTopology = topology;
     }
 
+    // weights as the explicit forces, springs and viscosity in the solver
+    CpuParticleKernels::constantMassForce(&pt, nParticles, gravity.x, gravity.y, gravity.z);
+    implicitSolver.step(&pt, nParticles, nSprings, dt, mediumViscosity);
+}
+
+void DynamicSystem::animate()
+{
+    dt = SimulationClock::global().getDt();
+
+    if (posX.empty())
+        return;
+
+    if (implicitIntegration)
+        implicitStep();
+    else
+        explicitStep();
+
+    // the fixed particles keep their forces in both steps, nothing reads them
+    for (unsigned int f = 0; f < fixe.size(); ++f)
+        forceX[fixe[f]] = forceY[fixe[f]] = forceZ[fixe[f]] = 0.0f;
 
     //======== 3. Collisions
     if (handleCollisions) {
         //TO DO: discuss multi-collisions and order!
-        for (itP = particles.begin(); itP != particles.end(); ++itP) {
-            collisionParticleGround(*itP);
+        collisionParticlesGround();
+
+        // sphere-sphere pairs from the spatial hash instead of all pairs,
+        // visited in the grid order (fixed particles are not collided)
+        unsigned int n = posX.size();
+        float maxRadius = 0.0f;
+        for (unsigned int i = 0; i < n; ++i) {
+            if (!fixedParticle[i])
+                maxRadius = std::max(maxRadius, radius[i]);
         }
-        for(unsigned int i = 1; i < particles.size(); ++i) {
-            Particle *p1 = particles[i - 1];
-            Particle *p2 = particles[i];
-            collisionParticleParticle(p1, p2);
+
+        if (n > fixe.size() + 1 && maxRadius > 0.0f) {
+            collisionGrid.build(posX.data(), posY.data(), posZ.data(), n, 2.0f * maxRadius);
+            const unsigned int *index = collisionGrid.getSortedIndices();
+            const float *sortedX = collisionGrid.getSortedX(), *sortedY = collisionGrid.getSortedY(),
+                  *sortedZ = collisionGrid.getSortedZ();
+
+            for (unsigned int a = 0; a < n; ++a) {
+                unsigned int i = index[a];
+                if (fixedParticle[i])
+                    continue;
+
+                collisionGrid.forEachCandidateRange(sortedX[a], sortedY[a], sortedZ[a],
+                    [&](unsigned int begin, unsigned int end) {
+                        for (unsigned int slot = begin; slot < end; ++slot) {
+                            unsigned int k = index[slot];
+                            if (k > i && !fixedParticle[k])
+                                collisionParticleParticle(i, k);
+                        }
+                    });
+            }
         }
     }
 }
 
-void DynamicSystem::collisionParticleGround(Particle *p)
+void DynamicSystem::collisionParticlesGround()
 {
-    // don't process fixed particles (ground plane is fixed)
-    if (p->getInvMass() == 0)
-        return;
-
-    // particle-plane distance
-    double penetration = (p->getPosition() - groundPosition) * groundNormal;
-    penetration -= p->getRadius();
-    if (penetration >= 0)
-        return;
-
-    // penetration velocity
-    double vPen = p->getVelocity() * groundNormal;
-
-    // updates position and velocity of the particle
-    p->incrPosition(-penetration * groundNormal);
-    p->incrVelocity(-(1 + rebound) * vPen * groundNormal);
+    float *x = posX.data(), *y = posY.data(), *z = posZ.data();
+    float *vx = velX.data(), *vy = velY.data(), *vz = velZ.data();
+    const float *im = invMass.data(), *r = radius.data();
+    const unsigned char *fixed = fixedParticle.data();
+
+    const float gx = groundPosition.x, gy = groundPosition.y, gz = groundPosition.z;
+    const float nx = groundNormal.x, ny = groundNormal.y, nz = groundNormal.z;
+    const float bounce = 1 + rebound;
+
+    ThreadPool::global().parallelFor(0, posX.size(), [=](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; ++i) {
+            // don't process fixed particles (ground plane is fixed)
+            if (fixed[i] || im[i] == 0)
+                continue;
+
+            // particle-plane distance
+            float penetration = (x[i] - gx) * nx + (y[i] - gy) * ny + (z[i] - gz) * nz;
+            penetration -= r[i];
+            if (penetration >= 0)
+                continue;
+
+            // penetration velocity
+            float vPen = vx[i] * nx + vy[i] * ny + vz[i] * nz;
+
+            // updates position and velocity of the particle
+            x[i] -= penetration * nx;
+            y[i] -= penetration * ny;
+            z[i] -= penetration * nz;
+            vx[i] -= bounce * vPen * nx;
+            vy[i] -= bounce * vPen * ny;
+            vz[i] -= bounce * vPen * nz;
+        }
+    }, grain);
 }
 
 
-void DynamicSystem::collisionParticleParticle(Particle *p1, Particle *p2)
+void DynamicSystem::collisionParticleParticle(unsigned int i1, unsigned int i2)
 {
-    // TODO!
+    float invMass12 = invMass[i1] + invMass[i2];
+    if (invMass12 == 0)
+        return;
+
+    // sphere-sphere distance
+    Vec n = Vec(posX[i2] - posX[i1], posY[i2] - posY[i1], posZ[i2] - posZ[i1]);
+    double d = n.norm();
+    double penetration = radius[i1] + radius[i2] - d;
+    if (penetration <= 0 || d == 0)
+        return;
+    n = n / d;
+
+    // push the particles apart, each one in proportion of its inverse mass
+    double w1 = invMass[i1] / invMass12;
+    double w2 = invMass[i2] / invMass12;
+    Vec dx1 = -w1 * penetration * n, dx2 = w2 * penetration * n;
+    posX[i1] += dx1.x; posY[i1] += dx1.y; posZ[i1] += dx1.z;
+    posX[i2] += dx2.x; posY[i2] += dx2.y; posZ[i2] += dx2.z;
+
+    // relative velocity along the normal, only approaching spheres bounce
+    double vPen = (Vec(velX[i2], velY[i2], velZ[i2]) - Vec(velX[i1], velY[i1], velZ[i1])) * n;
+    if (vPen >= 0)
+        return;
+
+    Vec dv1 = (1 + rebound) * vPen * w1 * n, dv2 = -(1 + rebound) * vPen * w2 * n;
+    velX[i1] += dv1.x; velY[i1] += dv1.y; velZ[i1] += dv1.z;
+    velX[i2] += dv2.x; velY[i2] += dv2.y; velZ[i2] += dv2.z;
 }
 
 void DynamicSystem::keyPressEvent(QKeyEvent* e, Viewer& viewer)
@@ -232,6 +448,16 @@ void DynamicSystem::keyPressEvent(QKeyEvent* e, Viewer& viewer)
         viewer.displayMessage("Detects collisions "
                               + (toggleCollisions ? QString("true") : QString("false")));
 
+    } else if ((e->key()==Qt::Key_I) && (modifiers==Qt::NoButton)) {
+        implicitIntegration = !implicitIntegration;
+        viewer.displayMessage("Implicit integration "
+                              + (implicitIntegration ? QString("true") : QString("false")));
+
+    } else if ((e->key()==Qt::Key_B) && (modifiers==Qt::NoButton)) {
+        batchedDrawing = !batchedDrawing;
+        viewer.displayMessage("Batched drawing "
+                              + (batchedDrawing ? QString("true") : QString("false")));
+
     } else if ((e->key()==Qt::Key_Home) && (modifiers==Qt::NoButton)) {
         // stop the animation, and reinit the scene
         viewer.stopAnimation();
@@ -248,3 +474,199 @@ void DynamicSystem::mouseMoveEvent(QMouseEvent*, Viewer& v)
     /* setFixedParticlePosition(v.manipulatedFrame()->position()); */
 }
 
+
+namespace {
+    // benchmark scene : strands of 10 particles hanging from a fixed one
+    class Strands : public DynamicSystem {
+        public:
+            unsigned int nStrands;
+
+            Strands(unsigned int nStrands) : nStrands(nStrands) {
+                handleCollisions = false;
+            }
+
+            // strands on a square grid of this side
+            float getExtent() const {
+                return 0.2f * ceil(sqrt((double) nStrands));
+            }
+
+            void createSystemScene() {
+                clear();
+                unsigned int side = (unsigned int) ceil(sqrt((double) nStrands));
+                for (unsigned int s = 0; s < nStrands; ++s) {
+                    for (unsigned int j = 0; j < 10; ++j) {
+                        Vec pos(0.2 * (s % side), 0.2 * (s / side), -springInitLength * j);
+                        Vec vel = (j == 0 ? Vec() : Vec(0.5 * sin(3.0 * (10 * s + j)), 0.5 * cos(5.0 * (10 * s + j)), 0.0));
+                        unsigned int p = addParticle(pos, vel, particleMass, particleRadius, Vec(1.0, 0.0, 0.0), j == 0);
+                        if (j > 0)
+                            addSpring(p - 1, p, springStiffness, springInitLength, springDamping);
+                    }
+                }
+            }
+
+            Vec getPosition(unsigned int i) const {
+                return Vec(posX[i], posY[i], posZ[i]);
+            }
+    };
+}
+
+void DynamicSystem::benchmark(unsigned int nRuns)
+{
+    // former explicit step : forces accumulated in a std::map, heap allocated Particle and Spring
+    struct Former {
+        vector<Particle *> particles;
+        vector<Spring *> springs;
+        vector<Particle *> fixe;
+
+        ~Former() {
+            for (unsigned int i = 0; i < particles.size(); ++i) delete particles[i];
+            for (unsigned int i = 0; i < springs.size(); ++i) delete springs[i];
+            for (unsigned int i = 0; i < fixe.size(); ++i) delete fixe[i];
+        }
+
+        void step(const Vec &gravity, double mediumViscosity, double dt) {
+            map<const Particle *, Vec> forces;
+
+            std::vector<Particle *>::iterator itP;
+            for (itP = particles.begin(); itP != particles.end(); ++itP)
+                forces[*itP] = gravity * (*itP)->getMass();
+            for (itP = particles.begin(); itP != particles.end(); ++itP)
+                forces[*itP] += -mediumViscosity * (*itP)->getVelocity();
+
+            std::vector<Spring *>::iterator itS;
+            for (itS = springs.begin(); itS != springs.end(); ++itS) {
+                Vec f12 = (*itS)->getCurrentForce();
+                forces[(*itS)->getParticle1()] += f12;
+                forces[(*itS)->getParticle2()] -= f12;
+            }
+
+            for (itP = particles.begin(); itP != particles.end(); ++itP)
+                (*itP)->incrVelocity(dt * forces[*itP] * (*itP)->getInvMass());
+            for (itP = particles.begin(); itP != particles.end(); ++itP)
+                (*itP)->incrPosition(dt * (*itP)->getVelocity());
+        }
+    };
+
+    log_console.infoStream() << "[DynamicSystem Benchmark] Explicit step without collisions, strands of 10 particles, "
+        << ThreadPool::global().getThreadCount() << " threads.";
+
+    const unsigned int sizes[4] = {1000, 10000, 100000, 1000000};
+    for (unsigned int size = 0; size < 4; ++size) {
+        unsigned int nParticles = sizes[size];
+        unsigned int nSteps = std::max(2u, 1000000u / nParticles);
+
+        Strands system(nParticles / 10);
+        system.createSystemScene();
+
+        // same scene, in the former layout (the fixed particles apart)
+        Former former;
+        vector<Particle *> all(nParticles);
+        for (unsigned int i = 0; i < nParticles; ++i) {
+            all[i] = new Particle(system.getPosition(i), Vec(system.velX[i], system.velY[i], system.velZ[i]),
+                                  system.mass[i], system.radius[i]);
+            (system.fixedParticle[i] ? former.fixe : former.particles).push_back(all[i]);
+        }
+        for (unsigned int s = 0; s < system.getSpringCount(); ++s) {
+            former.springs.push_back(new Spring(all[system.springEnds[0][s]], all[system.springEnds[1][s]],
+                                                system.springStiffness, system.springInitLength, system.springDamping));
+        }
+
+        double formerTime = 1.0e30, flatTime = 1.0e30;
+        for (unsigned int run = 0; run < nRuns; ++run) {
+            // the former step only runs once, it stays the reference of the gap
+            if (run == 0) {
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                for (unsigned int step = 0; step < nSteps; ++step)
+                    former.step(system.gravity, system.mediumViscosity, SimulationClock::global().getDt());
+                formerTime = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            }
+
+            system.createSystemScene();
+            std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            for (unsigned int step = 0; step < nSteps; ++step)
+                system.animate();
+            flatTime = std::min(flatTime, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+
+        double gap = 0.0;
+        for (unsigned int i = 0; i < nParticles; ++i)
+            gap = std::max(gap, (all[i]->getPosition() - system.getPosition(i)).norm());
+
+        double formerNs = 1.0e9 * formerTime / nSteps / nParticles, flatNs = 1.0e9 * flatTime / nSteps / nParticles;
+        log_console.infoStream() << "[DynamicSystem Benchmark] " << nParticles << " particles, " << nSteps << " steps : std::map "
+            << formerNs << " ns/particle/step, flat arrays " << flatNs << " ns/particle/step (x" << formerNs / flatNs
+            << "), max position gap " << gap;
+    }
+}
+
+void DynamicSystem::drawBenchmark(unsigned int nFrames)
+{
+    static const char *names[2] = {"immediate mode", "batched VBOs"};
+
+    unsigned int timeQuery;
+    glGenQueries(1, &timeQuery);
+
+    // top view of the whole scene, no camera involved
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    const unsigned int sizes[2] = {10000, 100000};
+    for (unsigned int size = 0; size < 2; ++size) {
+        Strands system(sizes[size] / 10);
+        system.createSystemScene();
+
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(-0.5, system.getExtent() + 0.5, -0.5, system.getExtent() + 0.5, -10.0, 10.0);
+        glMatrixMode(GL_MODELVIEW);
+
+        double frameTimes[2];
+        for (unsigned int mode = 0; mode < 2; ++mode) {
+            system.setBatchedDrawing(mode == 1);
+
+            // the first frame uploads the topology and compiles the programs
+            double cpuTime = 0.0, frameTime = 0.0;
+            GLuint64 gpuTime = 0;
+            for (unsigned int frame = 0; frame <= nFrames; ++frame) {
+                system.animate();
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glFinish();
+
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                glBeginQuery(GL_TIME_ELAPSED, timeQuery);
+                system.drawDownwards(consts::identity4);
+                glEndQuery(GL_TIME_ELAPSED);
+                std::chrono::high_resolution_clock::time_point submitted = std::chrono::high_resolution_clock::now();
+                glFinish();
+                std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(timeQuery, GL_QUERY_RESULT, &elapsed);
+
+                if (frame > 0) {
+                    cpuTime += std::chrono::duration<double>(submitted - start).count();
+                    frameTime += std::chrono::duration<double>(end - start).count();
+                    gpuTime += elapsed;
+                }
+            }
+
+            frameTimes[mode] = 1.0e3 * frameTime / nFrames;
+            log_console.infoStream() << "[DynamicSystem Draw Benchmark] " << sizes[size] << " particles, " << names[mode] << " : "
+                << frameTimes[mode] << " ms/frame (CPU submission " << 1.0e3 * cpuTime / nFrames << " ms, GPU "
+                << 1.0e-6 * gpuTime / nFrames << " ms)";
+        }
+
+        log_console.infoStream() << "[DynamicSystem Draw Benchmark] " << sizes[size] << " particles : batched x"
+            << frameTimes[0] / frameTimes[1] << " faster";
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+
+    glDeleteQueries(1, &timeQuery);
+}
@@ -12,6 +12,10 @@ using namespace std;
 
 #include "spring.h"
 #include "particle.h"
+#include "uniformGrid.h"
+#include "implicitSpringSolver.h"
+#include "cpuParticleKernels.h"
+#include "particleSpringRenderer.h"
 
 /*
  * This class represents a dynamic system made of particles
@@ -20,13 +24,29 @@ using namespace std;
  * Particles a represented by small spheres, with a radius and a mass.
  * The initial scene is composed of a fixed plane, a static particle
  * that can be controlled by the mouse, and a dynamic particle.
+ * The system is stored as flat arrays (structure of arrays, in the
+ * mappedParticlePointers layout) with springs as particle index pairs,
+ * so that the CPU particle kernels step it in parallel.
  */
 class DynamicSystem : public RenderTree {
     protected:
-        // system
-        vector<Particle *> particles;
-        vector<Spring *> springs;
-        vector<Particle *> fixe;
+        // system : particles (fixed ones do not move, the first one follows the mouse)
+        vector<float> posX, posY, posZ, velX, velY, velZ, forceX, forceY, forceZ;
+        vector<float> mass, invMass, radius;
+        vector<float> colors; // rgb per particle
+        vector<unsigned char> killParticle, fixedParticle;
+        vector<unsigned int> fixe; // indices of the fixed particles
+
+        // system : springs between particle indices
+        vector<unsigned int> springEnds[2];
+        vector<float> springStiffnesses, springLengths, springDampings;
+        vector<float> springMaxForces, springLines, springIntensities; // springs kernel outputs
+        vector<unsigned char> killSpring;
+
+        // the particles or springs changed (incidence lists and implicit pattern rebuilt)
+        unsigned int topology;
+        unsigned int incidenceTopology;
+        CpuSpringIncidence springIncidence;
 
         // System parameters (common)
         int numberParticles;
@@ -34,7 +54,7 @@ class DynamicSystem : public RenderTree {
         Vec gravity; // gravity used in simulation
         double defaultMediumViscosity;
         double mediumViscosity; // viscosity used in simulation
-        double dt; // time step
+        double dt; // time step (simulation clock substep)
         bool handleCollisions;
 
         // Collisions parameters
@@ -57,21 +77,42 @@ class DynamicSystem : public RenderTree {
         bool toggleViscosity;
         bool toggleCollisions;
 
+        // broadphase of the particle-particle collisions (cells of two max radius)
+        UniformGrid collisionGrid;
+
+        // implicit integration (backward Euler, springs and viscosity) on the same arrays
+        bool implicitIntegration;
+        ImplicitSpringSolver implicitSolver;
+        unsigned int implicitTopology;
+
+        // batched drawing (streamed positions, instanced impostors, one GL_LINES call)
+        // instead of one GLUT sphere and one line per object
+        bool batchedDrawing;
+        ParticleSpringRenderer renderer;
+        unsigned int rendererTopology;
+
 
     public:
         DynamicSystem();
         virtual ~DynamicSystem();
 
         // Position of the firt particle ca be set through mouse movements
-        const Vec &getFixedParticlePosition() const;
+        Vec getFixedParticlePosition() const;
         void setFixedParticlePosition(const Vec &pos);
 
+        unsigned int getParticleCount() const;
+        unsigned int getSpringCount() const;
+
         // Activate/desactivate gravity during the simulation
         void setGravity(bool onOff);
         // Activate/desactivate viscosity during the simulation
         void setViscosity(bool onOff);
         // Activate/desactivate contacts during the simulation
         void setCollisionsDetection(bool onOff);
+        // Backward Euler (larger stable steps on stiff springs) instead of symplectic Euler
+        void setImplicitIntegration(bool onOff);
+        // Batched VBO drawing instead of immediate mode
+        void setBatchedDrawing(bool onOff);
 
         // event response
         void keyPressEvent(QKeyEvent*, Viewer&);
@@ -81,10 +122,25 @@ class DynamicSystem : public RenderTree {
         // Reset the scene (remove all particles and springs)
         void clear();
 
-        // Compute collision between a sphere and the fixed) ground
-        void collisionParticleGround(Particle *p);
+        // Add a particle, returns its index
+        unsigned int addParticle(const Vec &pos, const Vec &vel, double m, double r,
+                                 const Vec &color = Vec(1.0, 0.0, 0.0), bool fixed = false);
+        // Add a damped spring between the particles of indices i1 and i2, returns its index
+        unsigned int addSpring(unsigned int i1, unsigned int i2, double s, double l0, double d);
+
+        // Pointers on the system arrays, for the particle kernels
+        struct mappedParticlePointers getPointers();
 
-        void collisionParticleParticle(Particle *p1, Particle *p2);
+        // Symplectic Euler (weights, viscosity and springs kernels, then dynamic scheme)
+        void explicitStep();
+        // Springs and viscosity integrated with the ImplicitSpringSolver
+        void implicitStep();
+
+        // Compute collision between the spheres and the fixed ground
+        void collisionParticlesGround();
+
+        // Compute collision between two spheres (mass weighted, fixed particles do not move)
+        void collisionParticleParticle(unsigned int i1, unsigned int i2);
 
         // Compute collision between a sphere and a moving plane
         // 	static void collisionParticlePlane(Particle *p,
@@ -109,6 +165,14 @@ class DynamicSystem : public RenderTree {
 
         // Update positions and velocities of dynamic objects
         void animate();
+
+        // ns per particle and step of the explicit step (no collisions) on 1k to 1M
+        // particles, against the former std::map step on Particle and Spring objects
+        static void benchmark(unsigned int nRuns);
+
+        // frame time of the immediate and batched drawings at 10k and 100k particles
+        // (needs a current GL context)
+        static void drawBenchmark(unsigned int nFrames);
 };
 
 #endif
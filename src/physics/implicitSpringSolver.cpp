@@ -0,0 +1,314 @@
+
+#include "implicitSpringSolver.h"
+#include "particleGroup.h"
+#include "cpuParticleKernels.h"
+#include "threadPool.h"
+#include "log.h"
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+	const unsigned int grain = 4096;
+}
+
+ImplicitSpringSolver::ImplicitSpringSolver(float tolerance, unsigned int maxIterations) :
+	tolerance(tolerance), maxIterations(maxIterations),
+	_nParticles(0), _nSprings(0),
+	_iterations(0), _residual(0.0f)
+{
+}
+
+void ImplicitSpringSolver::setTopology(const unsigned int *id1, const unsigned int *id2, unsigned int nParticles, unsigned int nSprings) {
+	_nParticles = nParticles;
+	_nSprings = nSprings;
+
+	_matrix.setPattern(nParticles, id1, id2, nSprings);
+
+	_springForces.resize(3*(nSprings + 1));
+	_springStiffness.resize(9*(nSprings + 1));
+	_springBlocks.resize(9*(nSprings + 1));
+	_b.resize(3*(nParticles + 1));
+	_dv.assign(3*(nParticles + 1), 0.0f);
+}
+
+void ImplicitSpringSolver::step(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+		float dt, float viscosity, bool handleDumping) {
+
+	if(nParticles != _nParticles || nSprings != _nSprings) {
+		log_console.errorStream() << "[Implicit Springs] Step on " << nParticles << " particles and " << nSprings 
+			<< " springs but the topology was set for " << _nParticles << " and " << _nSprings << " !";
+		exit(1);
+	}
+
+	const float h = dt;
+	float *x = pt->x, *y = pt->y, *z = pt->z, *vx = pt->vx, *vy = pt->vy, *vz = pt->vz;
+	float *fx = pt->fx, *fy = pt->fy, *fz = pt->fz;
+	const float *m = pt->m;
+	const unsigned char *fixed = pt->fixed;
+	const unsigned int *id1 = pt->id1, *id2 = pt->id2;
+
+	float *springForces = &_springForces[0], *springStiffness = &_springStiffness[0], *springBlocks = &_springBlocks[0];
+
+	//======== 1. Per spring force, stiffness and matrix block (lines and intensity as in the springs kernel)
+	const float *k = pt->k, *Lo = pt->Lo, *d = pt->d, *Fmax = pt->Fmax;
+	const unsigned char *killSpring = pt->killSpring;
+	float *lines = pt->lines, *intensity = pt->intensity;
+
+	ThreadPool::global().parallelFor(0, nSprings, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int s = begin; s < end; s++) {
+			float *F = springForces + 3*s, *K = springStiffness + 9*s, *B = springBlocks + 9*s;
+			std::fill(F, F + 3, 0.0f);
+			std::fill(K, K + 9, 0.0f);
+			std::fill(B, B + 9, 0.0f);
+
+			if(killSpring[s])
+				continue;
+
+			unsigned int _id1 = id1[s], _id2 = id2[s];
+			float dx[3] = {x[_id2] - x[_id1], y[_id2] - y[_id1], z[_id2] - z[_id1]};
+			float N = sqrtf(dx[0]*dx[0] + dx[1]*dx[1] + dx[2]*dx[2]);
+			if(N < 1.0e-6f)
+				continue;
+
+			float n[3] = {dx[0]/N, dx[1]/N, dx[2]/N};
+			float damping = (handleDumping ? d[s] : 0.0f);
+			float vn = n[0]*(vx[_id2] - vx[_id1]) + n[1]*(vy[_id2] - vy[_id1]) + n[2]*(vz[_id2] - vz[_id1]);
+
+			//force on the first end, pulled towards the second one when stretched
+			float dF = k[s]*(N - Lo[s]) + damping*vn;
+			for (unsigned int a = 0; a < 3; a++)
+				F[a] = dF*n[a];
+
+			//K = k (nn' + max(0, 1 - Lo/N) (I - nn')), the compressed springs keep their axial term only
+			float transverse = std::max(0.0f, 1.0f - Lo[s]/N);
+			for (unsigned int a = 0; a < 3; a++) {
+				for (unsigned int b = 0; b < 3; b++) {
+					float nn = n[a]*n[b];
+					K[3*a + b] = k[s]*(nn + transverse*((a == b ? 1.0f : 0.0f) - nn));
+					B[3*a + b] = h*damping*nn + h*h*K[3*a + b];
+				}
+			}
+
+			if(lines) {
+				lines[6*s + 0] = x[_id1];
+				lines[6*s + 1] = y[_id1];
+				lines[6*s + 2] = z[_id1];
+				lines[6*s + 3] = x[_id2];
+				lines[6*s + 4] = y[_id2];
+				lines[6*s + 5] = z[_id2];
+
+				float ratio = std::min(std::max(-dF/N/Fmax[s], -1.0f), 1.0f);
+				intensity[2*s + 0] = ratio;
+				intensity[2*s + 1] = ratio;
+			}
+		}
+	}, grain);
+
+	//======== 2. Block rows : (M + h mu) I + sum of the spring blocks, -B off the diagonal,
+	//rhs h (f - mu v + springs forces) + h^2 K (v_j - v_i). Fixed rows are the identity
+	//and their columns are zero, so that their dv stays 0 and the matrix symmetric
+	const unsigned int *offsets = _matrix.getRowOffsets(), *columns = _matrix.getColumns(), *slotPairs = _matrix.getSlotPairs();
+	float *blocks = _matrix.getBlocks(), *b = &_b[0];
+
+	ThreadPool::global().parallelFor(0, nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			float *diagonal = blocks + 9*offsets[i], *bi = b + 3*i;
+			std::fill(diagonal, diagonal + 9, 0.0f);
+
+			if(fixed[i] || m[i] <= 0.0f) {
+				diagonal[0] = diagonal[4] = diagonal[8] = 1.0f;
+				std::fill(bi, bi + 3, 0.0f);
+				std::fill(blocks + 9*(offsets[i] + 1), blocks + 9*offsets[i + 1], 0.0f);
+				continue;
+			}
+
+			float mi = m[i] + h*viscosity;
+			diagonal[0] = diagonal[4] = diagonal[8] = mi;
+
+			float vi[3] = {vx[i], vy[i], vz[i]};
+			bi[0] = h*(fx[i] - viscosity*vi[0]);
+			bi[1] = h*(fy[i] - viscosity*vi[1]);
+			bi[2] = h*(fz[i] - viscosity*vi[2]);
+
+			for (unsigned int slot = offsets[i] + 1; slot < offsets[i + 1]; slot++) {
+				unsigned int s = slotPairs[slot], j = columns[slot];
+				const float *F = springForces + 3*s, *K = springStiffness + 9*s, *B = springBlocks + 9*s;
+				float *block = blocks + 9*slot;
+				float sign = (id1[s] == i ? 1.0f : -1.0f);
+				bool fixedColumn = fixed[j] || m[j] <= 0.0f;
+
+				for (unsigned int c = 0; c < 9; c++) {
+					diagonal[c] += B[c];
+					block[c] = (fixedColumn ? 0.0f : -B[c]);
+				}
+
+				float dv[3] = {vx[j] - vi[0], vy[j] - vi[1], vz[j] - vi[2]};
+				for (unsigned int a = 0; a < 3; a++)
+					bi[a] += h*sign*F[a] + h*h*(K[3*a + 0]*dv[0] + K[3*a + 1]*dv[1] + K[3*a + 2]*dv[2]);
+			}
+		}
+	}, grain);
+
+	//======== 3. Solve (from the dv of the previous step) and integrate
+	float *dv = &_dv[0];
+	_iterations = _matrix.solve(b, dv, tolerance, maxIterations, &_residual);
+
+	ThreadPool::global().parallelFor(0, nParticles, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			if(fixed[i] || m[i] <= 0.0f)
+				continue;
+
+			vx[i] += dv[3*i + 0];
+			vy[i] += dv[3*i + 1];
+			vz[i] += dv[3*i + 2];
+			x[i] += h*vx[i];
+			y[i] += h*vy[i];
+			z[i] += h*vz[i];
+			fx[i] = fy[i] = fz[i] = 0.0f;
+		}
+	}, grain);
+}
+
+unsigned int ImplicitSpringSolver::getIterations() const {
+	return _iterations;
+}
+
+float ImplicitSpringSolver::getResidual() const {
+	return _residual;
+}
+
+void ImplicitSpringSolver::benchmark(unsigned int nRuns) {
+	const unsigned int nStrands = 2000, strandLength = 16;
+	const unsigned int nParticles = nStrands*strandLength, nSprings = nStrands*(strandLength - 1);
+	const float simulatedTime = 2.0f, stiffness = 250.0f, buoyancy = 0.03f*9.81f;
+
+	//seaweed strands with 100x stiffer springs : explicitly stable up to 2/sqrt(4k/m) = 4.5 ms
+	std::vector<float> x0(nParticles), y0(nParticles), z0(nParticles), vx0(nParticles), vz0(nParticles);
+	std::vector<float> x, y, z, vx, vy, vz, fx, fy, fz,
+		m(nParticles, 0.005f), im(nParticles, 200.0f), r(nParticles, 0.001f);
+	std::vector<unsigned char> kill(nParticles, 0), fixed(nParticles, 0), killSpring(nSprings, 0);
+	std::vector<float> k(nSprings, stiffness), Lo(nSprings, 0.1f), d(nSprings, 0.03f), Fmax(nSprings, 10.0f),
+		lines(6*nSprings), intensity(2*nSprings);
+	std::vector<unsigned int> id1(nSprings), id2(nSprings);
+
+	for (unsigned int s = 0; s < nStrands; s++) {
+		for (unsigned int j = 0; j < strandLength; j++) {
+			unsigned int p = s*strandLength + j;
+			x0[p] = 0.5f*(s % 50);
+			y0[p] = 0.15f*j;
+			z0[p] = 0.5f*(s / 50);
+			vx0[p] = (j == 0 ? 0.0f : 0.5f*sinf(3.0f*p));
+			vz0[p] = (j == 0 ? 0.0f : 0.5f*cosf(5.0f*p));
+			fixed[p] = (j == 0);
+
+			if(j >= 1) {
+				unsigned int spring = s*(strandLength - 1) + j - 1;
+				id1[spring] = p - 1;
+				id2[spring] = p;
+			}
+		}
+	}
+
+	CpuSpringIncidence incidence;
+	CpuParticleKernels::buildSpringIncidence(&id1[0], &id2[0], nParticles, nSprings, &incidence);
+	ImplicitSpringSolver solver;
+	solver.setTopology(&id1[0], &id2[0], nParticles, nSprings);
+
+	struct Run {
+		const char *name;
+		bool implicit;
+		float dt;
+	};
+	const float explicitDt = 1.0f/480.0f;
+	const Run runs[4] = {
+		{"explicit springs + DynamicScheme", false, explicitDt}, {"explicit springs + DynamicScheme", false, 10.0f*explicitDt},
+		{"implicit Euler + CG", true, explicitDt}, {"implicit Euler + CG", true, 10.0f*explicitDt}
+	};
+
+	log_console.infoStream() << "[Implicit Benchmark] " << nStrands << " strands of " << strandLength << " particles, k = " << stiffness
+		<< ", " << simulatedTime << " s simulated, CG tolerance 1e-4, " << ThreadPool::global().getThreadCount() << " threads.";
+
+	std::vector<float> referenceTips;
+	for (unsigned int run = 0; run < 4; run++) {
+		const float dt = runs[run].dt;
+		unsigned int nSteps = (unsigned int) (simulatedTime/dt + 0.5f);
+
+		double bestTime = 1.0e30;
+		unsigned long totalIterations = 0;
+		unsigned int worstIterations = 0;
+		float worstResidual = 0.0f;
+		bool diverged = false;
+
+		for (unsigned int repeat = 0; repeat < nRuns; repeat++) {
+			x = x0; y = y0; z = z0;
+			vx = vx0; vy.assign(nParticles, 0.0f); vz = vz0;
+			fx.assign(nParticles, 0.0f); fy.assign(nParticles, 0.0f); fz.assign(nParticles, 0.0f);
+
+			struct mappedParticlePointers pt = {
+				&x[0], &y[0], &z[0], &vx[0], &vy[0], &vz[0], &fx[0], &fy[0], &fz[0], &m[0], &im[0], &r[0],
+				&kill[0], &fixed[0],
+				&k[0], &Lo[0], &d[0], &Fmax[0], &lines[0], &intensity[0],
+				&id1[0], &id2[0],
+				&killSpring[0]
+			};
+
+			totalIterations = 0;
+			worstIterations = 0;
+			worstResidual = 0.0f;
+
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (unsigned int step = 0; step < nSteps; step++) {
+				CpuParticleKernels::constantForce(&pt, nParticles, 0.0f, buoyancy, 0.0f);
+				if(runs[run].implicit) {
+					solver.step(&pt, nParticles, nSprings, dt);
+					totalIterations += solver.getIterations();
+					worstIterations = std::max(worstIterations, solver.getIterations());
+					worstResidual = std::max(worstResidual, solver.getResidual());
+				}
+				else {
+					CpuParticleKernels::springs(&pt, nParticles, nSprings, true, &incidence);
+					CpuParticleKernels::dynamicScheme(&pt, nParticles, dt);
+				}
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			bestTime = std::min(bestTime, elapsed.count());
+
+			diverged = false;
+			for (unsigned int p = 0; p < nParticles && !diverged; p++)
+				diverged = !std::isfinite(x[p] + y[p] + z[p]) || std::abs(y[p]) > 1.0e3f;
+		}
+
+		//strand tips against the first (explicit, smallest dt) run
+		std::vector<float> tips(3*nStrands);
+		for (unsigned int s = 0; s < nStrands; s++) {
+			unsigned int tip = (s + 1)*strandLength - 1;
+			tips[3*s + 0] = x[tip];
+			tips[3*s + 1] = y[tip];
+			tips[3*s + 2] = z[tip];
+		}
+		if(run == 0)
+			referenceTips = tips;
+
+		double gap = 0.0;
+		for (unsigned int s = 0; s < nStrands; s++) {
+			float dx = tips[3*s + 0] - referenceTips[3*s + 0], dy = tips[3*s + 1] - referenceTips[3*s + 1], dz = tips[3*s + 2] - referenceTips[3*s + 2];
+			gap += sqrt(dx*dx + dy*dy + dz*dz)/nStrands;
+		}
+
+		log_console.infoStream() << "[Implicit Benchmark] " << runs[run].name << ", dt = " << 1000.0f*dt << " ms : "
+			<< bestTime/nSteps << " ms/step, " << 1000.0*nSteps/bestTime << " steps/s, " 
+			<< simulatedTime/(bestTime*1.0e-3) << " simulated s per s, "
+			<< (diverged ? "diverged" : "stable");
+
+		if(!diverged) {
+			log_console.infoStream() << "[Implicit Benchmark]     mean tip gap to the first run " << gap;
+			if(runs[run].implicit) {
+				log_console.infoStream() << "[Implicit Benchmark]     CG iterations " << (double) totalIterations/nSteps 
+					<< " on average, " << worstIterations << " at most, worst relative residual " << worstResidual;
+			}
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef IMPLICITSPRINGSOLVER_H
+#define IMPLICITSPRINGSOLVER_H
+
+#include "blockSparseMatrix.h"
+
+#include <vector>
+
+struct mappedParticlePointers;
+
+// Backward Euler step of a mass-spring system (Baraff & Witkin 98) :
+//   (M - h df/dv - h^2 df/dx) dv = h (f + h df/dx v),  v += dv,  x += h v
+// The springs and the linear viscosity are implicit, the forces accumulated by the other
+// kernels explicit. The spring Jacobian is assembled in a BlockSparseMatrix (its compressive
+// part dropped, so that the system stays positive definite) and solved with the block Jacobi
+// preconditioned conjugate gradient, warm started with the previous dv. Fixed particles keep their position, velocity and forces.
+class ImplicitSpringSolver {
+
+	public:
+		ImplicitSpringSolver(float tolerance = 1.0e-4f, unsigned int maxIterations = 200);
+
+		//the springs changed (same ends arrays as the step)
+		void setTopology(const unsigned int *id1, const unsigned int *id2, unsigned int nParticles, unsigned int nSprings);
+
+		//one step of dt on the particles and springs of pt (m, fixed, k, Lo, d, killSpring read,
+		//lines and intensity written when not null), forces of the moving particles reset
+		void step(const struct mappedParticlePointers *pt, unsigned int nParticles, unsigned int nSprings,
+				float dt, float viscosity = 0.0f, bool handleDumping = true);
+
+		//conjugate gradient of the last step
+		unsigned int getIterations() const;
+		float getResidual() const;
+
+		//stiff strands : explicit steps at the largest stable dt against implicit steps 10x larger,
+		//steps/s and iterations to convergence
+		static void benchmark(unsigned int nRuns);
+
+	private:
+		float tolerance;
+		unsigned int maxIterations;
+
+		BlockSparseMatrix _matrix;
+		unsigned int _nParticles, _nSprings;
+
+		//per spring : force on the first end, stiffness -df1/dx2 and the matrix block h c nn' + h^2 K
+		std::vector<float> _springForces, _springStiffness, _springBlocks;
+		std::vector<float> _b, _dv;
+
+		unsigned int _iterations;
+		float _residual;
+};
+
+#endif /* end of include guard: IMPLICITSPRINGSOLVER_H */
@@ -0,0 +1,223 @@
+
+#include "headers.h"
+#include "particleSpringRenderer.h"
+#include "log.h"
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+Program *ParticleSpringRenderer::_particlesProgram = 0;
+Program *ParticleSpringRenderer::_springsProgram = 0;
+std::map<std::string, int> ParticleSpringRenderer::_particlesUniformLocs;
+std::map<std::string, int> ParticleSpringRenderer::_springsUniformLocs;
+
+ParticleSpringRenderer::ParticleSpringRenderer() :
+	_nParticles(0), _nSprings(0), _capacity(0),
+	positions_b(0), attributes_b(0), springs_b(0),
+	_mappedPositions(0), _region(0)
+{
+	for (unsigned int i = 0; i < N_POSITION_REGIONS; i++)
+		_fences[i] = 0;
+}
+
+ParticleSpringRenderer::~ParticleSpringRenderer() {
+	releasePositions();
+	glDeleteBuffers(1, &attributes_b);
+	glDeleteBuffers(1, &springs_b);
+}
+
+void ParticleSpringRenderer::setTopology(const float *r, const float *colors, unsigned int nParticles,
+		const unsigned int *id1, const unsigned int *id2, unsigned int nSprings) {
+
+	if(nParticles > _capacity)
+		allocatePositions(std::max(nParticles, 2*_capacity));
+
+	_nParticles = nParticles;
+	_nSprings = nSprings;
+
+	if(attributes_b == 0) {
+		glGenBuffers(1, &attributes_b);
+		glGenBuffers(1, &springs_b);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, attributes_b);
+	glBufferData(GL_ARRAY_BUFFER, 4*nParticles*sizeof(float), 0, GL_STATIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, nParticles*sizeof(float), r);
+	glBufferSubData(GL_ARRAY_BUFFER, nParticles*sizeof(float), 3*nParticles*sizeof(float), colors);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	std::vector<unsigned int> ends(2*nSprings);
+	for (unsigned int s = 0; s < nSprings; s++) {
+		ends[2*s + 0] = id1[s];
+		ends[2*s + 1] = id2[s];
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, springs_b);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, ends.size()*sizeof(unsigned int), ends.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void ParticleSpringRenderer::allocatePositions(unsigned int capacity) {
+	releasePositions();
+	_capacity = capacity;
+
+	GLsizeiptr size = N_POSITION_REGIONS*3*capacity*sizeof(float);
+
+	glGenBuffers(1, &positions_b);
+	glBindBuffer(GL_ARRAY_BUFFER, positions_b);
+	if(GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, 0, flags);
+		_mappedPositions = (float *) glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+
+		if(_mappedPositions == 0) {
+			log_console.errorStream() << "[Particle Spring Renderer] Failed to map " << size << " bytes persistently !";
+			exit(1);
+		}
+	}
+	else {
+		glBufferData(GL_ARRAY_BUFFER, size, 0, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ParticleSpringRenderer::releasePositions() {
+	for (unsigned int i = 0; i < N_POSITION_REGIONS; i++) {
+		if(_fences[i]) {
+			glDeleteSync(_fences[i]);
+			_fences[i] = 0;
+		}
+	}
+
+	if(_mappedPositions) {
+		glBindBuffer(GL_ARRAY_BUFFER, positions_b);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		_mappedPositions = 0;
+	}
+
+	glDeleteBuffers(1, &positions_b);
+	positions_b = 0;
+	_capacity = 0;
+}
+
+size_t ParticleSpringRenderer::streamPositions(const float *x, const float *y, const float *z) {
+	const size_t blockSize = _nParticles*sizeof(float);
+
+	if(_mappedPositions) {
+		//next region, once the frame that read it is done (already the case unless the GPU is 2 frames late)
+		_region = (_region + 1) % N_POSITION_REGIONS;
+		if(_fences[_region]) {
+			glClientWaitSync(_fences[_region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+			glDeleteSync(_fences[_region]);
+			_fences[_region] = 0;
+		}
+
+		float *region = _mappedPositions + 3*_capacity*_region;
+		memcpy(region, x, blockSize);
+		memcpy(region + _capacity, y, blockSize);
+		memcpy(region + 2*_capacity, z, blockSize);
+
+		return 3*_capacity*_region*sizeof(float);
+	}
+
+	//orphaned, the driver hands a new storage if the previous one is still read
+	glBindBuffer(GL_ARRAY_BUFFER, positions_b);
+	glBufferData(GL_ARRAY_BUFFER, N_POSITION_REGIONS*3*_capacity*sizeof(float), 0, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, blockSize, x);
+	glBufferSubData(GL_ARRAY_BUFFER, _capacity*sizeof(float), blockSize, y);
+	glBufferSubData(GL_ARRAY_BUFFER, 2*_capacity*sizeof(float), blockSize, z);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return 0;
+}
+
+void ParticleSpringRenderer::draw(const float *x, const float *y, const float *z,
+		const float *modelMatrix, const float *springColor, float lineWidth) {
+
+	if(_nParticles == 0)
+		return;
+
+	if(_particlesProgram == 0)
+		makePrograms();
+
+	float proj[16], view[16];
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	glGetFloatv(GL_PROJECTION_MATRIX, proj);
+
+	size_t offset = streamPositions(x, y, z);
+
+	//particles : one impostor quad per instance
+	_particlesProgram->use();
+	glUniformMatrix4fv(_particlesUniformLocs["projectionMatrix"], 1, GL_FALSE, proj);
+	glUniformMatrix4fv(_particlesUniformLocs["viewMatrix"], 1, GL_FALSE, view);
+	glUniformMatrix4fv(_particlesUniformLocs["modelMatrix"], 1, GL_TRUE, modelMatrix);
+
+	glBindBuffer(GL_ARRAY_BUFFER, positions_b);
+	for (unsigned int c = 0; c < 3; c++) {
+		glVertexAttribPointer(c, 1, GL_FLOAT, GL_FALSE, 0, (const void *) (offset + c*_capacity*sizeof(float)));
+		glVertexAttribDivisor(c, 1);
+		glEnableVertexAttribArray(c);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, attributes_b);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, 0, 0);
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 0, (const void *) (_nParticles*sizeof(float)));
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(4);
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, _nParticles);
+
+	for (unsigned int a = 0; a < 5; a++)
+		glVertexAttribDivisor(a, 0);
+	glDisableVertexAttribArray(3);
+	glDisableVertexAttribArray(4);
+
+	//springs : indexed lines on the same positions (attributes 0 to 2)
+	if(_nSprings > 0) {
+		_springsProgram->use();
+		glUniformMatrix4fv(_springsUniformLocs["projectionMatrix"], 1, GL_FALSE, proj);
+		glUniformMatrix4fv(_springsUniformLocs["viewMatrix"], 1, GL_FALSE, view);
+		glUniformMatrix4fv(_springsUniformLocs["modelMatrix"], 1, GL_TRUE, modelMatrix);
+		glUniform3fv(_springsUniformLocs["colour"], 1, springColor);
+
+		glLineWidth(lineWidth);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, springs_b);
+		glDrawElements(GL_LINES, 2*_nSprings, GL_UNSIGNED_INT, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	for (unsigned int c = 0; c < 3; c++)
+		glDisableVertexAttribArray(c);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+
+	if(_mappedPositions)
+		_fences[_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ParticleSpringRenderer::makePrograms() {
+
+	_particlesProgram = new Program("Dynamic System Particles");
+	_particlesProgram->bindAttribLocations("0 1 2 3 4", "x y z r colour");
+	_particlesProgram->bindFragDataLocation(0, "out_colour");
+
+	_particlesProgram->attachShader(Shader("shaders/dynamicSystem/particle_vs.glsl", GL_VERTEX_SHADER));
+	_particlesProgram->attachShader(Shader("shaders/dynamicSystem/particle_fs.glsl", GL_FRAGMENT_SHADER));
+
+	_particlesProgram->link();
+	_particlesUniformLocs = _particlesProgram->getUniformLocationsMap("modelMatrix projectionMatrix viewMatrix", true);
+
+	_springsProgram = new Program("Dynamic System Springs");
+	_springsProgram->bindAttribLocations("0 1 2", "x y z");
+	_springsProgram->bindFragDataLocation(0, "out_colour");
+
+	_springsProgram->attachShader(Shader("shaders/dynamicSystem/spring_vs.glsl", GL_VERTEX_SHADER));
+	_springsProgram->attachShader(Shader("shaders/dynamicSystem/spring_fs.glsl", GL_FRAGMENT_SHADER));
+
+	_springsProgram->link();
+	_springsUniformLocs = _springsProgram->getUniformLocationsMap("modelMatrix projectionMatrix viewMatrix colour", true);
+}
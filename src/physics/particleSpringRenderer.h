@@ -0,0 +1,52 @@
+#ifndef PARTICLESPRINGRENDERER_H
+#define PARTICLESPRINGRENDERER_H
+
+#include "headers.h"
+#include "program.h"
+
+#include <map>
+#include <string>
+
+#define N_POSITION_REGIONS 3
+
+// Batched drawing of particles and springs stored as arrays (DynamicSystem) :
+// all the particles in one instanced draw of sphere impostors, all the springs
+// in one indexed GL_LINES draw on the same positions. The positions are streamed
+// every frame into a persistently mapped VBO split in N_POSITION_REGIONS regions,
+// each one reused once the GPU signaled the fence of the frame that read it
+// (orphaned VBO and glBufferSubData without GL_ARB_buffer_storage).
+// Radii, colours and spring ends only change with the topology.
+class ParticleSpringRenderer {
+
+	public:
+		ParticleSpringRenderer();
+		~ParticleSpringRenderer();
+
+		//the particles or springs changed (colors : rgb per particle)
+		void setTopology(const float *r, const float *colors, unsigned int nParticles,
+				const unsigned int *id1, const unsigned int *id2, unsigned int nSprings);
+
+		//streams the positions and draws, needs the topology of these arrays
+		void draw(const float *x, const float *y, const float *z,
+				const float *modelMatrix, const float *springColor, float lineWidth);
+
+	private:
+		unsigned int _nParticles, _nSprings, _capacity;
+
+		unsigned int positions_b, attributes_b, springs_b; //X Y Z BLOCKS PER REGION, R THEN RGB, LINES INDICES
+		float *_mappedPositions;
+		unsigned int _region;
+		GLsync _fences[N_POSITION_REGIONS];
+
+		void allocatePositions(unsigned int capacity);
+		void releasePositions();
+
+		//byte offset of the x block written this frame
+		size_t streamPositions(const float *x, const float *y, const float *z);
+
+		static Program *_particlesProgram, *_springsProgram;
+		static std::map<std::string, int> _particlesUniformLocs, _springsUniformLocs;
+		static void makePrograms();
+};
+
+#endif /* end of include guard: PARTICLESPRINGRENDERER_H */
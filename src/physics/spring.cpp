@@ -44,6 +44,21 @@ const Particle *Spring::getParticle2() const
     return p2;
 }
 
+double Spring::getStiffness() const
+{
+    return stiffness;
+}
+
+double Spring::getEquilibriumLength() const
+{
+    return equilibriumLength;
+}
+
+double Spring::getDamping() const
+{
+    return damping;
+}
+
 
 void Spring::draw() const
 {
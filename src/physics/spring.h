@@ -39,6 +39,10 @@ class Spring {
         const Particle *getParticle1() const;
         const Particle *getParticle2() const;
 
+        double getStiffness() const;
+        double getEquilibriumLength() const;
+        double getDamping() const;
+
         void draw() const;
 };
 
@@ -7,14 +7,15 @@
 #include "seaFlow.h"
 #include "particule.h"
 #include "rand.h"
+#include "simulationClock.h"
 #include <sstream>
 
 BubblesGenerator::BubblesGenerator(
 		unsigned int nBubbles, unsigned int nGroups, 
-		unsigned int generationFrequency, unsigned int memoryFactor) :
+		float generationPeriod, unsigned int memoryFactor) :
 		_nBubbles(nBubbles), _nGroups(nGroups), 
-		_generationFrequency(generationFrequency),
-		_memoryFactor(memoryFactor) 
+		_memoryFactor(memoryFactor),
+		_generationPeriod(generationPeriod), _timeSinceGeneration(generationPeriod) 
 	{
 		_groups = new ParticleGroup*[_nGroups];
         
@@ -22,7 +23,7 @@ BubblesGenerator::BubblesGenerator(
 		ParticleGroupKernel *archimede = new ConstantForce(g);
         ParticleGroupKernel *dynamicScheme = new DynamicScheme();
         ParticleGroupKernel *killBubbles = new KillParticles(qglviewer::Vec(0,1,0), 10);
-		ParticleGroupKernel *seaflow = new SeaFlow(qglviewer::Vec(1,0,0), 0.002, 0.001);
+		ParticleGroupKernel *seaflow = new SeaFlow(qglviewer::Vec(1,0,0), 0.002, 0.025);
 
 		std::stringstream name;
         for (unsigned int i = 0; i < _nGroups; i++) {
@@ -46,16 +47,22 @@ BubblesGenerator::~BubblesGenerator() {
 	delete [] _groups;
 }
 
+void BubblesGenerator::addKernel(ParticleGroupKernel *kernel) {
+	for (unsigned int i = 0; i < _nGroups; i++) {
+		_groups[i]->addKernel(kernel);
+	}
+}
+
 void BubblesGenerator::drawDownwards(const float *currentTransformationMatrix) {
 }
 
 void BubblesGenerator::animateDownwards() {
-	static unsigned int frameCount = 0;
-
-	if(frameCount % _generationFrequency == 0)
+	if(_timeSinceGeneration >= _generationPeriod) {
 		generateBubbles();
+		_timeSinceGeneration = 0.0f;
+	}
 
-	frameCount++;
+	_timeSinceGeneration += SimulationClock::global().getDt();
 }
 
 void BubblesGenerator::generateBubbles() {
@@ -5,14 +5,19 @@
 class BubblesGenerator : public RenderTree {
 	
 	public:
-		BubblesGenerator(unsigned int nBubbles, unsigned int nGroups, unsigned int generationFrequency, unsigned int memoryFactor);
+		//a wave of bubbles every generationPeriod simulated seconds
+		BubblesGenerator(unsigned int nBubbles, unsigned int nGroups, float generationPeriod, unsigned int memoryFactor);
 		~BubblesGenerator();
 
 		void drawDownwards(const float *currentTransformationMatrix = consts::identity4);
 		void animateDownwards();
 
+		//appends the kernel to every bubbles group (after the default ones)
+		void addKernel(ParticleGroupKernel *kernel);
+
 	private:
-		unsigned int _nBubbles, _nGroups, _generationFrequency, _memoryFactor;
+		unsigned int _nBubbles, _nGroups, _memoryFactor;
+		float _generationPeriod, _timeSinceGeneration;
         ParticleGroup **_groups;
 
 		void generateBubbles();
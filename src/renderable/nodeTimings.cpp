@@ -0,0 +1,378 @@
+
+#include "nodeTimings.h"
+
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+	//frames in flight of the query ring
+	const unsigned int ringSize = 4;
+
+	const char *traceCategories[] = {"draw", "draw", "animate"};
+
+	std::string jsonEscape(const std::string &str) {
+		std::string escaped;
+		for (unsigned int i = 0; i < str.size(); i++) {
+			if(str[i] == '"' || str[i] == '\\')
+				escaped += '\\';
+			escaped += str[i];
+		}
+		return escaped;
+	}
+}
+
+NodeTimings::NodeTimings(ReadBack readBack, unsigned int histogramWindow) :
+	_readBack(readBack),
+	_slots(readBack == QUERY_RING ? ringSize : 1),
+	_currentSlot(0), _oldestSlot(0),
+	_frameOpen(false),
+	_nextFrame(0), _lastFrame(-1),
+	_droppedFrames(0),
+	_frameCpu(0.0), _frameGpu(0.0),
+	_histogramWindow(histogramWindow),
+	_recordTrace(false), _maxTraceEvents(0),
+	_gpuOrigin(0)
+{
+	for (unsigned int m = 0; m < N_MEASURES; m++)
+		_frameHistograms[m] = RollingHistogram(histogramWindow);
+
+	for (unsigned int i = 0; i < _slots.size(); i++) {
+		_slots[i].usedQueries = 0;
+		_slots[i].frameBeginQuery = 0;
+		_slots[i].frameEndQuery = 0;
+		_slots[i].frameCpu = 0.0;
+		_slots[i].frame = -1;
+		_slots[i].pending = false;
+	}
+
+	//common origin of the CPU and GPU tracks of the trace
+	_cpuOrigin = std::chrono::steady_clock::now();
+	glGetInteger64v(GL_TIMESTAMP, &_gpuOrigin);
+}
+
+NodeTimings::~NodeTimings() {
+	for (unsigned int i = 0; i < _slots.size(); i++) {
+		if(!_slots[i].queries.empty())
+			glDeleteQueries(_slots[i].queries.size(), _slots[i].queries.data());
+	}
+}
+
+void NodeTimings::beginFrame() {
+	if(_frameOpen)
+		return;
+	_frameOpen = true;
+
+	FrameSlot &slot = _slots[_currentSlot];
+	assert(!slot.pending);
+
+	slot.usedQueries = 0;
+	slot.draws.clear();
+	slot.drawCpu.assign(_nodes.size(), 0.0);
+	slot.animateCpu.assign(_nodes.size(), 0.0);
+	slot.frame = _nextFrame++;
+
+	_nodeStack.assign(1, nodeId("root"));
+	_sections.clear();
+
+	_frameBegin = std::chrono::steady_clock::now();
+	slot.frameBeginQuery = timestamp();
+}
+
+void NodeTimings::endFrame() {
+	if(!_frameOpen)
+		return;
+	_frameOpen = false;
+
+	assert(_nodeStack.size() == 1 && _sections.empty());
+
+	FrameSlot &slot = _slots[_currentSlot];
+	slot.frameEndQuery = timestamp();
+	slot.frameCpu = elapsedMs(_frameBegin);
+	slot.pending = true;
+	recordTrace(-1, DRAW_CPU, cpuTraceTime(_frameBegin), slot.frameCpu*1.0e3);
+
+	if(_readBack == BLOCKING_READBACK) {
+		readBack(slot);
+		return;
+	}
+
+	_currentSlot = (_currentSlot + 1) % _slots.size();
+
+	//frames are read back in order, as long as their queries are available
+	while(_slots[_oldestSlot].pending && isAvailable(_slots[_oldestSlot])) {
+		readBack(_slots[_oldestSlot]);
+		_oldestSlot = (_oldestSlot + 1) % _slots.size();
+	}
+
+	//ring full : the oldest frame is dropped rather than waited for
+	if(_slots[_currentSlot].pending) {
+		assert(_oldestSlot == _currentSlot);
+		_slots[_currentSlot].pending = false;
+		_oldestSlot = (_oldestSlot + 1) % _slots.size();
+		_droppedFrames++;
+	}
+}
+
+void NodeTimings::enterNode(const std::string &key) {
+	_nodeStack.push_back(nodeId(_nodes[_nodeStack.back()].path + "/" + key));
+}
+
+void NodeTimings::leaveNode() {
+	assert(_nodeStack.size() > 1);
+	_nodeStack.pop_back();
+}
+
+void NodeTimings::beginDraw() {
+	OpenSection section;
+	section.node = _nodeStack.back();
+	section.beginQuery = timestamp();
+	section.cpuBegin = std::chrono::steady_clock::now();
+	_sections.push_back(section);
+}
+
+void NodeTimings::endDraw() {
+	assert(!_sections.empty());
+	const OpenSection &section = _sections.back();
+	FrameSlot &slot = _slots[_currentSlot];
+
+	double cpu = elapsedMs(section.cpuBegin);
+	slot.drawCpu[section.node] += cpu;
+	recordTrace(section.node, DRAW_CPU, cpuTraceTime(section.cpuBegin), cpu*1.0e3);
+
+	PendingDraw draw;
+	draw.node = section.node;
+	draw.beginQuery = section.beginQuery;
+	draw.endQuery = timestamp();
+	slot.draws.push_back(draw);
+
+	_sections.pop_back();
+}
+
+void NodeTimings::beginAnimate() {
+	OpenSection section;
+	section.node = _nodeStack.back();
+	section.beginQuery = 0;
+	section.cpuBegin = std::chrono::steady_clock::now();
+	_sections.push_back(section);
+}
+
+void NodeTimings::endAnimate() {
+	assert(!_sections.empty());
+	const OpenSection &section = _sections.back();
+
+	double cpu = elapsedMs(section.cpuBegin);
+	_slots[_currentSlot].animateCpu[section.node] += cpu;
+	recordTrace(section.node, ANIMATE_CPU, cpuTraceTime(section.cpuBegin), cpu*1.0e3);
+
+	_sections.pop_back();
+}
+
+const std::vector<NodeTimings::NodeTime> &NodeTimings::getNodes() const {
+	return _nodes;
+}
+
+long NodeTimings::getLastFrame() const {
+	return _lastFrame;
+}
+
+double NodeTimings::getFrameCpuTime() const {
+	return _frameCpu;
+}
+
+double NodeTimings::getFrameGpuTime() const {
+	return _frameGpu;
+}
+
+unsigned int NodeTimings::getDroppedFrames() const {
+	return _droppedFrames;
+}
+
+const RollingHistogram &NodeTimings::getHistogram(unsigned int node, Measure measure) const {
+	return _histograms[measure][node];
+}
+
+const RollingHistogram &NodeTimings::getFrameHistogram(Measure measure) const {
+	return _frameHistograms[measure];
+}
+
+std::vector<std::string> NodeTimings::getOverlayLines() const {
+	std::vector<std::string> lines;
+	char line[256];
+
+	snprintf(line, sizeof(line), "%-24s %7s %7s %7s %7s %7s  %-16s %-16s",
+			"node (ms)", "CPU", "p95", "GPU", "p95", "anim", "CPU histogram", "GPU histogram");
+	lines.push_back(line);
+
+	for (unsigned int i = 0; i <= _nodes.size(); i++) {
+		bool frame = (i == _nodes.size());
+		const RollingHistogram &cpu = (frame ? _frameHistograms[DRAW_CPU] : _histograms[DRAW_CPU][i]);
+		const RollingHistogram &gpu = (frame ? _frameHistograms[DRAW_GPU] : _histograms[DRAW_GPU][i]);
+		const RollingHistogram &animate = (frame ? _frameHistograms[ANIMATE_CPU] : _histograms[ANIMATE_CPU][i]);
+
+		snprintf(line, sizeof(line), "%-24.24s %7.3f %7.3f %7.3f %7.3f %7.3f |%s|%s|",
+				(frame ? "frame" : _nodes[i].path.c_str()),
+				cpu.getMean(), cpu.getPercentile(0.95),
+				gpu.getMean(), gpu.getPercentile(0.95),
+				animate.getMean(),
+				cpu.toString().c_str(), gpu.toString().c_str());
+		lines.push_back(line);
+	}
+
+	if(_droppedFrames > 0) {
+		snprintf(line, sizeof(line), "%u frames dropped (GPU results not available in time)", _droppedFrames);
+		lines.push_back(line);
+	}
+
+	return lines;
+}
+
+void NodeTimings::setTraceRecording(bool record, unsigned int maxEvents) {
+	_recordTrace = record;
+	_maxTraceEvents = maxEvents;
+}
+
+bool NodeTimings::writeChromeTrace(const std::string &fileName) const {
+	std::ofstream out(fileName.c_str());
+	if(!out.good())
+		return false;
+
+	out.setf(std::ios::fixed);
+	out.precision(3);
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+
+	for (unsigned int i = 0; i < _traceEvents.size(); i++) {
+		const TraceEvent &event = _traceEvents[i];
+		out << ",\n{\"name\":\"" << (event.node < 0 ? std::string("frame") : jsonEscape(_nodes[event.node].path))
+			<< "\",\"cat\":\"" << (event.node < 0 ? "frame" : traceCategories[event.measure])
+			<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.measure == DRAW_GPU ? 2 : 1)
+			<< ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << "}";
+	}
+
+	out << "\n]}\n";
+	return out.good();
+}
+
+void NodeTimings::writeCsvHeader(std::ostream &out) {
+	out << "frame,node,cpu_ms,gpu_ms,animate_ms\n";
+}
+
+void NodeTimings::writeCsv(std::ostream &out) const {
+	double animateCpu = 0.0;
+	for (unsigned int i = 0; i < _nodes.size(); i++) {
+		const NodeTime &node = _nodes[i];
+		out << _lastFrame << "," << node.path << "," << node.drawCpu << "," << node.drawGpu << "," << node.animateCpu << "\n";
+		animateCpu += node.animateCpu;
+	}
+	out << _lastFrame << ",frame," << _frameCpu << "," << _frameGpu << "," << animateCpu << "\n";
+}
+
+unsigned int NodeTimings::nodeId(const std::string &path) {
+	std::map<std::string, unsigned int>::const_iterator it = _nodeIds.find(path);
+	if(it != _nodeIds.end())
+		return it->second;
+
+	NodeTime node;
+	node.path = path;
+	node.drawCpu = 0.0;
+	node.drawGpu = 0.0;
+	node.animateCpu = 0.0;
+
+	_nodes.push_back(node);
+	_nodeIds[path] = _nodes.size() - 1;
+
+	for (unsigned int m = 0; m < N_MEASURES; m++)
+		_histograms[m].push_back(RollingHistogram(_histogramWindow));
+
+	//the slots of the previous frames are shorter, their missing nodes read back as zeros
+	_slots[_currentSlot].drawCpu.resize(_nodes.size(), 0.0);
+	_slots[_currentSlot].animateCpu.resize(_nodes.size(), 0.0);
+
+	return _nodes.size() - 1;
+}
+
+//the query objects of a slot are reused from frame to frame, the pool only grows with the tree
+unsigned int NodeTimings::timestamp() {
+	FrameSlot &slot = _slots[_currentSlot];
+
+	if(slot.usedQueries == slot.queries.size()) {
+		unsigned int n = (slot.queries.empty() ? 64 : slot.queries.size());
+		slot.queries.resize(slot.queries.size() + n);
+		glGenQueries(n, slot.queries.data() + slot.queries.size() - n);
+	}
+
+	glQueryCounter(slot.queries[slot.usedQueries], GL_TIMESTAMP);
+	return slot.usedQueries++;
+}
+
+void NodeTimings::readBack(FrameSlot &slot) {
+	double animateCpu = 0.0;
+	for (unsigned int i = 0; i < _nodes.size(); i++) {
+		_nodes[i].drawCpu = (i < slot.drawCpu.size() ? slot.drawCpu[i] : 0.0);
+		_nodes[i].animateCpu = (i < slot.animateCpu.size() ? slot.animateCpu[i] : 0.0);
+		_nodes[i].drawGpu = 0.0;
+		animateCpu += _nodes[i].animateCpu;
+	}
+
+	for (unsigned int i = 0; i < slot.draws.size(); i++) {
+		const PendingDraw &draw = slot.draws[i];
+		GLuint64 begin = queryResult(slot, draw.beginQuery);
+		GLuint64 end = queryResult(slot, draw.endQuery);
+		_nodes[draw.node].drawGpu += (end - begin)*1.0e-6;
+		recordTrace(draw.node, DRAW_GPU, (GLint64(begin) - _gpuOrigin)*1.0e-3, (end - begin)*1.0e-3);
+	}
+
+	GLuint64 frameBegin = queryResult(slot, slot.frameBeginQuery);
+	GLuint64 frameEnd = queryResult(slot, slot.frameEndQuery);
+	_frameCpu = slot.frameCpu;
+	_frameGpu = (frameEnd - frameBegin)*1.0e-6;
+	recordTrace(-1, DRAW_GPU, (GLint64(frameBegin) - _gpuOrigin)*1.0e-3, (frameEnd - frameBegin)*1.0e-3);
+
+	for (unsigned int i = 0; i < _nodes.size(); i++) {
+		_histograms[DRAW_CPU][i].add(_nodes[i].drawCpu);
+		_histograms[DRAW_GPU][i].add(_nodes[i].drawGpu);
+		_histograms[ANIMATE_CPU][i].add(_nodes[i].animateCpu);
+	}
+	_frameHistograms[DRAW_CPU].add(_frameCpu);
+	_frameHistograms[DRAW_GPU].add(_frameGpu);
+	_frameHistograms[ANIMATE_CPU].add(animateCpu);
+
+	_lastFrame = slot.frame;
+	slot.pending = false;
+}
+
+//queries complete in order : the last one of the frame tells for all of them
+bool NodeTimings::isAvailable(const FrameSlot &slot) const {
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(slot.queries[slot.frameEndQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+	return available == GL_TRUE;
+}
+
+void NodeTimings::recordTrace(int node, Measure measure, double begin, double duration) {
+	if(!_recordTrace || _traceEvents.size() >= _maxTraceEvents)
+		return;
+
+	TraceEvent event;
+	event.node = node;
+	event.measure = measure;
+	event.begin = begin;
+	event.duration = duration;
+	_traceEvents.push_back(event);
+}
+
+double NodeTimings::elapsedMs(std::chrono::steady_clock::time_point begin) const {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+double NodeTimings::cpuTraceTime(std::chrono::steady_clock::time_point time) const {
+	return std::chrono::duration<double, std::micro>(time - _cpuOrigin).count();
+}
+
+GLuint64 NodeTimings::queryResult(const FrameSlot &slot, unsigned int query) const {
+	GLuint64 result;
+	glGetQueryObjectui64v(slot.queries[query], GL_QUERY_RESULT, &result);
+	return result;
+}
@@ -0,0 +1,147 @@
+#ifndef NODETIMINGS_H
+#define NODETIMINGS_H
+
+#include "headers.h"
+#include "rollingHistogram.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ostream>
+#include <chrono>
+
+// Per node CPU and GPU times of the RenderTree frames (opt-in, see RenderTree::setNodeTimings)
+// A node is named by the path of its children keys from the drawn tree ("root/terrain").
+// Only the own drawDownwards/drawUpwards and animateDownwards/animateUpwards of a node are
+// accounted to it, its children have their own entries.
+// GPU times come from GL_TIMESTAMP query pairs : unlike GL_TIME_ELAPSED queries they nest,
+// and they place the GPU sections on the trace timeline.
+// With BLOCKING_READBACK, endFrame() waits for the queries of the frame (benchmarks).
+// With QUERY_RING, the queries of a frame are read back frames later, once available, so
+// that the GPU never stalls the viewer : the results lag behind, and the frames still not
+// available when their ring slot comes back are dropped.
+class NodeTimings {
+
+	public:
+		enum ReadBack {
+			BLOCKING_READBACK,
+			QUERY_RING
+		};
+
+		enum Measure {
+			DRAW_CPU,
+			DRAW_GPU,
+			ANIMATE_CPU,
+			N_MEASURES
+		};
+
+		struct NodeTime {
+			std::string path;
+			double drawCpu, drawGpu, animateCpu; //ms
+		};
+
+		NodeTimings(ReadBack readBack = BLOCKING_READBACK, unsigned int histogramWindow = 120);
+		~NodeTimings();
+
+		//opens the frame if not already opened (animate and draw may both open it)
+		void beginFrame();
+		void endFrame();
+
+		//RenderTree hooks, between beginFrame and endFrame
+		void enterNode(const std::string &key);
+		void leaveNode();
+		void beginDraw();
+		void endDraw();
+		void beginAnimate();
+		void endAnimate();
+
+		//nodes of the last read back frame, in order of first visit
+		const std::vector<NodeTime> &getNodes() const;
+		//index (from 0) of the last read back frame, -1 before the first one
+		long getLastFrame() const;
+		//whole last read back frame (animations and drawing), ms
+		double getFrameCpuTime() const;
+		double getFrameGpuTime() const;
+		//frames whose GPU results were not available in time (QUERY_RING)
+		unsigned int getDroppedFrames() const;
+
+		//rolling distributions over the last read back frames
+		const RollingHistogram &getHistogram(unsigned int node, Measure measure) const;
+		const RollingHistogram &getFrameHistogram(Measure measure) const;
+		//one line per node : mean, p95 and histogram of the draw CPU, draw GPU and animate times
+		std::vector<std::string> getOverlayLines() const;
+
+		//Chrome trace events (chrome://tracing, Perfetto), CPU and GPU tracks, at most maxEvents
+		void setTraceRecording(bool record, unsigned int maxEvents = 1000000);
+		bool writeChromeTrace(const std::string &fileName) const;
+
+		//one row per node and per frame, plus a "frame" row with the whole frame times
+		static void writeCsvHeader(std::ostream &out);
+		void writeCsv(std::ostream &out) const;
+
+	private:
+		struct OpenSection {
+			unsigned int node;
+			unsigned int beginQuery;
+			std::chrono::steady_clock::time_point cpuBegin;
+		};
+
+		struct PendingDraw {
+			unsigned int node;
+			unsigned int beginQuery, endQuery;
+		};
+
+		//queries and CPU times of a frame, until its read back
+		struct FrameSlot {
+			std::vector<GLuint> queries;
+			unsigned int usedQueries;
+			unsigned int frameBeginQuery, frameEndQuery;
+			std::vector<PendingDraw> draws;
+			std::vector<double> drawCpu, animateCpu;
+			double frameCpu;
+			long frame;
+			bool pending;
+		};
+
+		struct TraceEvent {
+			int node; //-1 : whole frame
+			unsigned char measure;
+			double begin, duration; //us
+		};
+
+		ReadBack _readBack;
+		std::vector<FrameSlot> _slots;
+		unsigned int _currentSlot, _oldestSlot;
+		bool _frameOpen;
+		long _nextFrame, _lastFrame;
+		unsigned int _droppedFrames;
+
+		std::vector<NodeTime> _nodes;
+		std::map<std::string, unsigned int> _nodeIds;
+		std::vector<unsigned int> _nodeStack;
+		std::vector<OpenSection> _sections;
+
+		double _frameCpu, _frameGpu;
+		std::chrono::steady_clock::time_point _frameBegin;
+
+		unsigned int _histogramWindow;
+		std::vector<RollingHistogram> _histograms[N_MEASURES];
+		RollingHistogram _frameHistograms[N_MEASURES];
+
+		bool _recordTrace;
+		unsigned int _maxTraceEvents;
+		std::vector<TraceEvent> _traceEvents;
+		std::chrono::steady_clock::time_point _cpuOrigin;
+		GLint64 _gpuOrigin;
+
+		unsigned int nodeId(const std::string &path);
+		unsigned int timestamp();
+		void readBack(FrameSlot &slot);
+		bool isAvailable(const FrameSlot &slot) const;
+		void recordTrace(int node, Measure measure, double begin, double duration);
+		double elapsedMs(std::chrono::steady_clock::time_point begin) const;
+		double cpuTraceTime(std::chrono::steady_clock::time_point time) const;
+		GLuint64 queryResult(const FrameSlot &slot, unsigned int query) const;
+};
+
+#endif /* end of include guard: NODETIMINGS_H */
@@ -5,7 +5,7 @@
 
 void RenderRoot::drawDownwards(const float *currentTransformationMatrix) {
 	
-		qglviewer::Camera *camera = Globals::viewer->camera();	
+		qglviewer::Camera *camera = Globals::camera;	
 		qglviewer::Vec cameraPos = camera->position();
 		qglviewer::Vec cameraDir = camera->viewDirection();
 		qglviewer::Vec cameraUp = camera->upVector();
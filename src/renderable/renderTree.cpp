@@ -2,36 +2,74 @@
 #include "renderTree.h"
 #include "log.h"
 #include "matrix.h"
+#ifdef CHECK_ALLOCATIONS
+#include "allocationCounter.h"
+#endif
 
 #include <cassert>
 #include <string>
+#include <vector>
+#include <sstream>
+#include <chrono>
+#include <cmath>
+
+NodeTimings *RenderTree::nodeTimings = 0;
+unsigned long RenderTree::structureVersion = 1;
+
+#ifdef CHECK_ALLOCATIONS
+namespace {
+	//keeps the transform it is drawn with and when it is drawn
+	class CheckNode : public RenderTree {
+		public:
+			Mat4 lastTransform;
+			unsigned int downOrder, upOrder;
+			static unsigned int drawCount;
+
+		protected:
+			void drawDownwards(const float *currentTransformationMatrix) {
+				memcpy(lastTransform.data(), currentTransformationMatrix, 16*sizeof(float));
+				downOrder = drawCount++;
+			}
+			void drawUpwards(const float *currentTransformationMatrix) {
+				upOrder = drawCount++;
+			}
+	};
+
+	unsigned int CheckNode::drawCount = 0;
+}
+#endif
 
 RenderTree::RenderTree(bool active) 
-: active(active)
+: relativeModelMatrix(Mat4::identity()), relativeMatrixVersion(1), active(active),
+  fatherMatrix(Mat4::identity()), flatStructureVersion(0)
 {
-	relativeModelMatrix = new float[16];
-	setRelativeModelMatrix(consts::identity4);
 }
 
 RenderTree::~RenderTree() {
-	delete [] relativeModelMatrix;
 }
 		
 const float *RenderTree::getRelativeModelMatrix() const {
-	return relativeModelMatrix;
+	return relativeModelMatrix.data();
 }
 
 void RenderTree::setRelativeModelMatrix(const float *matrix) {
-	memcpy(relativeModelMatrix, matrix, 16*sizeof(float));
+	relativeModelMatrix = Mat4(matrix);
+	relativeModelMatrixChanged();
+}
+
+void RenderTree::relativeModelMatrixChanged() {
+	relativeMatrixVersion++;
 }
 
 
 void RenderTree::addChild(std::string key, RenderTree *child) {
 	assert(children.insert(std::pair<std::string,RenderTree*>(key, child)).second == true);	
+	structureVersion++;
 }
 
 void RenderTree::removeChild(std::string key) {
 	assert(children.erase(key) == 1);
+	structureVersion++;
 }
 
 
@@ -50,7 +88,7 @@ void RenderTree::activateChild(std::string childName) {
 	it = children.find(childName);
 	assert(it != children.end());
 
-	it->second->active = false;
+	it->second->active = true;
 }
 
 // RENDERABLE WRAPPER //
@@ -58,42 +96,201 @@ void RenderTree::draw() {
 	draw(consts::identity4);
 }
 
+void RenderTree::flatten(RenderTree *node, int father, const std::string *key, unsigned int depth) {
+	int entry = flatNodes.size();
+	FlatNode flatNode = {node, father, 0, key, 0, false};
+	flatNodes.push_back(flatNode);
+	openNodes.resize(std::max<size_t>(openNodes.size(), depth + 1));
+
+	std::map<std::string, RenderTree*>::const_iterator it;
+	for (it = node->children.cbegin(); it != node->children.cend(); it++) {
+		flatten(it->second, entry, &it->first, depth + 1);
+	}
+
+	flatNodes[entry].end = flatNodes.size();
+}
+
 void RenderTree::draw(const float *currentTransformationMatrix) {
 	
 	//if not active draw nothing
 	if(!this->active)
 		return;
-	
-	//draw current object
-	const float *newTransformationMatrix = Matrix::multMat4f(currentTransformationMatrix, this->getRelativeModelMatrix());
 
-	this->drawDownwards(newTransformationMatrix);
+	//children added or removed since the last draw : every world matrix is recomputed
+	if(flatStructureVersion != structureVersion) {
+		flatNodes.clear();
+		openNodes.clear();
+		flatten(this, -1, 0, 0);
+		worldMatrices.resize(flatNodes.size());
+		flatStructureVersion = structureVersion;
+	}
 
-	//draw subtrees
-	std::map<std::string, RenderTree*>::const_iterator it;
-	for (it = children.cbegin(); it != children.cend(); it++) {
-		it->second->draw(newTransformationMatrix);
+	bool fatherChanged = (memcmp(fatherMatrix.data(), currentTransformationMatrix, 16*sizeof(float)) != 0);
+	if(fatherChanged)
+		fatherMatrix = Mat4(currentTransformationMatrix);
+
+	//depth first order : the fathers come before their children, the subtrees whose
+	//end is reached are drawn upwards (in reverse order) before the next node
+	unsigned int nOpen = 0, nNodes = flatNodes.size();
+	for (unsigned int i = 0; i < nNodes; ) {
+		while (nOpen > 0 && flatNodes[openNodes[nOpen - 1]].end <= i)
+			closeNode(openNodes[--nOpen]);
+
+		FlatNode &flatNode = flatNodes[i];
+		RenderTree *node = flatNode.node;
+
+		if(nodeTimings && flatNode.key) nodeTimings->enterNode(*flatNode.key);
+
+		//desactivated subtree skipped, its matrices will be recomputed once activated
+		if(!node->active) {
+			flatNode.matrixVersion = 0;
+			if(nodeTimings && flatNode.key) nodeTimings->leaveNode();
+			i = flatNode.end;
+			continue;
+		}
+
+		flatNode.updated = (flatNode.father < 0 ? fatherChanged : flatNodes[flatNode.father].updated)
+			|| flatNode.matrixVersion != node->relativeMatrixVersion;
+		if(flatNode.updated) {
+			const float *father = (flatNode.father < 0 ? fatherMatrix.data() : worldMatrices[flatNode.father].data());
+			Matrix::multMat4f(father, node->relativeModelMatrix.data(), worldMatrices[i].data());
+			flatNode.matrixVersion = node->relativeMatrixVersion;
+		}
+
+		if(nodeTimings) nodeTimings->beginDraw();
+		node->drawDownwards(worldMatrices[i].data());
+		if(nodeTimings) nodeTimings->endDraw();
+
+		openNodes[nOpen++] = i;
+		i++;
 	}
 
-	this->drawUpwards(newTransformationMatrix);
+	while (nOpen > 0)
+		closeNode(openNodes[--nOpen]);
+}
+
+void RenderTree::closeNode(unsigned int entry) {
+	if(nodeTimings) nodeTimings->beginDraw();
+	flatNodes[entry].node->drawUpwards(worldMatrices[entry].data());
+	if(nodeTimings) nodeTimings->endDraw();
 
-	delete [] newTransformationMatrix;
+	if(nodeTimings && flatNodes[entry].key) nodeTimings->leaveNode();
 }
 
 void RenderTree::animate() {
 	if(!this->active)
 		return;
 	
+	if(nodeTimings) nodeTimings->beginAnimate();
 	this->animateDownwards();
+	if(nodeTimings) nodeTimings->endAnimate();
 
 	//animate subtrees
 	std::map<std::string, RenderTree*>::const_iterator it;
 	for (it = children.cbegin(); it != children.cend(); it++) {
+		if(nodeTimings) nodeTimings->enterNode(it->first);
 		it->second->animate();
+		if(nodeTimings) nodeTimings->leaveNode();
 	}
 
+	if(nodeTimings) nodeTimings->beginAnimate();
 	this->animateUpwards();
+	if(nodeTimings) nodeTimings->endAnimate();
+}
+
+void RenderTree::setNodeTimings(NodeTimings *timings) {
+	nodeTimings = timings;
+}
+
+#ifdef CHECK_ALLOCATIONS
+bool RenderTree::checkAllocations() {
+	const unsigned int fanOut = 8, nDraws = 1000;
+	bool ok = true;
+
+	//3 levels of 8 children, each node moved, rotated and scaled
+	std::vector<CheckNode*> nodes;
+	std::vector<int> fathers;
+	CheckNode *root = new CheckNode();
+	root->translate(1.0f, 2.0f, 3.0f);
+	nodes.push_back(root);
+	fathers.push_back(-1);
+
+	for (unsigned int level = 0, first = 0; level < 3; level++) {
+		unsigned int last = nodes.size();
+		for (unsigned int p = first; p < last; p++) {
+			for (unsigned int c = 0; c < fanOut; c++) {
+				CheckNode *child = new CheckNode();
+				child->rotate(qglviewer::Quaternion(qglviewer::Vec(0.0, 1.0, 0.0), 0.1*(c + 1)));
+				child->translate(c, 0.5f*level, -1.0f);
+				child->scale(1.0f + 0.01f*c);
+
+				std::stringstream key;
+				key << c;
+				nodes[p]->addChild(key.str(), child);
+				nodes.push_back(child);
+				fathers.push_back(p);
+			}
+		}
+		first = last;
+	}
+
+	//world matrices of the drawn nodes (same products) and draw order
+	auto checkTransforms = [&]() -> bool {
+		std::vector<Mat4> expected(nodes.size());
+		bool same = true;
+		for (unsigned int i = 0; i < nodes.size(); i++) {
+			const float *father = (fathers[i] < 0 ? consts::identity4 : expected[fathers[i]].data());
+			Matrix::multMat4f(father, nodes[i]->relativeModelMatrix.data(), expected[i].data());
+			same &= (memcmp(nodes[i]->lastTransform.data(), expected[i].data(), 16*sizeof(float)) == 0);
+			if(fathers[i] >= 0) {
+				CheckNode *father = nodes[fathers[i]];
+				same &= (father->downOrder < nodes[i]->downOrder && nodes[i]->upOrder < father->upOrder);
+			}
+		}
+		return same;
+	};
+
+	//warm up, then the counted draws : still tree, then the first child turning each frame (Terrain)
+	root->draw(consts::identity4);
+	ok &= checkTransforms();
+
+	double elapsed[2];
+	unsigned long allocations = 0;
+	for (unsigned int moving = 0; moving < 2; moving++) {
+		unsigned long count = AllocationCounter::getCount();
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < nDraws; i++) {
+			if(moving)
+				root->rotateChild("0", qglviewer::Quaternion(qglviewer::Vec(0.0, 1.0, 0.0), 0.001));
+			root->draw(consts::identity4);
+		}
+		elapsed[moving] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+		allocations += AllocationCounter::getCount() - count;
+		ok &= checkTransforms();
+	}
+	ok &= (allocations == 0);
+
+	//the root moves while a subtree is desactivated : recomputed once activated again
+	root->desactivateChild("7");
+	root->translate(0.0f, 1.0f, 0.0f);
+	root->draw(consts::identity4);
+	root->activateChild("7");
+	root->draw(consts::identity4);
+	bool activation = checkTransforms();
+	ok &= activation;
+
+	unsigned int nNodes = nodes.size();
+	log_console.infoStream() << "[RenderTree Check] " << nDraws << " draws of " << nNodes << " nodes : "
+		<< allocations << " allocations, still tree " << elapsed[0]/(nDraws*nNodes) << " ns/node, one moving subtree of "
+		<< 1 + fanOut + fanOut*fanOut << " nodes " << elapsed[1]/(nDraws*nNodes) << " ns/node, transforms and draw order "
+		<< (ok ? "exact." : "WRONG !") << (activation ? "" : " (desactivated subtree)");
+
+	for (unsigned int i = 0; i < nodes.size(); i++)
+		delete nodes[i];
+
+	return ok;
 }
+#endif
 		
 void RenderTree::keyPressEvent(QKeyEvent* event, Viewer& v) {
 	if(!this->active)
@@ -123,70 +320,74 @@ void RenderTree::mouseMoveEvent(QMouseEvent* event, Viewer& v) {
 ///////////////////////////
 		
 void RenderTree::move(float x, float y, float z) {
-	Matrix::setOffsetMat4f(relativeModelMatrix,x,y,z);
+	Matrix::setOffsetMat4f(relativeModelMatrix.data(),x,y,z);
+	relativeModelMatrixChanged();
 }
 void RenderTree::move(qglviewer::Vec v) {
-	Matrix::setOffsetMat4f(relativeModelMatrix,v);
+	Matrix::setOffsetMat4f(relativeModelMatrix.data(),v);
+	relativeModelMatrixChanged();
 }
 void RenderTree::orientate(qglviewer::Quaternion rot, float scale) {
-	Matrix::setRotationMat4f(relativeModelMatrix, rot, scale);
+	Matrix::setRotationMat4f(relativeModelMatrix.data(), rot, scale);
+	relativeModelMatrixChanged();
 }
 void RenderTree::translate(float x, float y, float z) {
-	Matrix::translateMat4f(relativeModelMatrix,x,y,z);
+	Matrix::translateMat4f(relativeModelMatrix.data(),x,y,z);
+	relativeModelMatrixChanged();
 }
 void RenderTree::translate(qglviewer::Vec v) {
-	Matrix::translateMat4f(relativeModelMatrix,v);
+	Matrix::translateMat4f(relativeModelMatrix.data(),v);
+	relativeModelMatrixChanged();
 }
 void RenderTree::scale(float alpha) {
-	Matrix::scaleMat4f(relativeModelMatrix,alpha);
+	Matrix::scaleMat4f(relativeModelMatrix.data(),alpha);
+	relativeModelMatrixChanged();
 }
 void RenderTree::scale(float alpha, float beta, float gamma) {
-	Matrix::scaleMat4f(relativeModelMatrix,alpha,beta,gamma);
+	Matrix::scaleMat4f(relativeModelMatrix.data(),alpha,beta,gamma);
+	relativeModelMatrixChanged();
 }
 void RenderTree::scale(qglviewer::Vec v) {
-	Matrix::scaleMat4f(relativeModelMatrix,v);
+	Matrix::scaleMat4f(relativeModelMatrix.data(),v);
+	relativeModelMatrixChanged();
 }
 void RenderTree::rotate(qglviewer::Quaternion rot) {
-	Matrix::rotateMat4f(relativeModelMatrix,rot);
+	Matrix::rotateMat4f(relativeModelMatrix.data(),rot);
+	relativeModelMatrixChanged();
 }
 void RenderTree::pushMatrix(const float *matrix) {
-	float *tmp = Matrix::multMat4f(matrix, relativeModelMatrix);	
-	delete [] relativeModelMatrix;
-	relativeModelMatrix = tmp;
+	Matrix::multMat4f(matrix, relativeModelMatrix.data(), relativeModelMatrix.data());
+	relativeModelMatrixChanged();
 }
 
 		
 void RenderTree::moveChild(std::string childName, float x, float y, float z) {
-	Matrix::setOffsetMat4f(children[childName]->relativeModelMatrix,x,y,z);
+	children[childName]->move(x,y,z);
 }
 void RenderTree::moveChild(std::string childName, qglviewer::Vec v) {
-	Matrix::setOffsetMat4f(children[childName]->relativeModelMatrix,v);
+	children[childName]->move(v);
 }
 void RenderTree::orientateChild(std::string childName, qglviewer::Quaternion rot, float scale) {
-	Matrix::setRotationMat4f(children[childName]->relativeModelMatrix, rot, scale);
+	children[childName]->orientate(rot, scale);
 }
 void RenderTree::translateChild(std::string childName, float x, float y, float z) {
-	Matrix::translateMat4f(children[childName]->relativeModelMatrix,x,y,z);
+	children[childName]->translate(x,y,z);
 }
 void RenderTree::translateChild(std::string childName, qglviewer::Vec v) {
-	Matrix::translateMat4f(children[childName]->relativeModelMatrix,v);
+	children[childName]->translate(v);
 }
 void RenderTree::scaleChild(std::string childName, float alpha) {
-	Matrix::scaleMat4f(children[childName]->relativeModelMatrix,alpha);
+	children[childName]->scale(alpha);
 }
 void RenderTree::scaleChild(std::string childName, float alpha, float beta, float gamma) {
-	Matrix::scaleMat4f(children[childName]->relativeModelMatrix,alpha,beta,gamma);
+	children[childName]->scale(alpha,beta,gamma);
 }
 void RenderTree::scaleChild(std::string childName, qglviewer::Vec v) {
-	Matrix::scaleMat4f(children[childName]->relativeModelMatrix,v);
+	children[childName]->scale(v);
 }
 void RenderTree::rotateChild(std::string childName, qglviewer::Quaternion rot) {
-	Matrix::rotateMat4f(children[childName]->relativeModelMatrix,rot);
+	children[childName]->rotate(rot);
 }
 void RenderTree::pushMatrixToChild(std::string childName, const float *matrix) {
-	float *src = children[childName]->relativeModelMatrix;
-	float *tmp = Matrix::multMat4f(matrix, src);	
-	delete [] src;
-
-	children[childName]->relativeModelMatrix = tmp;
+	children[childName]->pushMatrix(matrix);
 }
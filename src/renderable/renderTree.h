@@ -5,9 +5,12 @@
 #include "headers.h"
 #include "renderable.h"
 #include "consts.h"
+#include "nodeTimings.h"
+#include "mat4.h"
 
 #include <string>
 #include <map>
+#include <vector>
 
 #include <iostream>
 
@@ -17,6 +20,12 @@
 // The same possibilities are available for animate()
 // Note : Your class should inherit RenderTree instead of Renderable
 // Warning : Renderable init func is deprecated
+//
+// The node draw() is called on flattens its subtree in draw order (rebuilt when a child is
+// added or removed anywhere) and draws it in one loop. The world matrices are cached there :
+// a node matrix is only recomputed when its relative matrix changed (move, translate, rotate,
+// scale, pushMatrix...) or when the one of its father was, the subtrees that do not move
+// cost no product.
 
 class RenderTree : public Renderable {
 	
@@ -59,6 +68,16 @@ class RenderTree : public Renderable {
 		void rotateChild(std::string childName, qglviewer::Quaternion rot);
 		void pushMatrixToChild(std::string childName, const float *matrix); //matrice 4x4
 
+		//opt-in per node draw and animate times (NULL to disable, the default)
+		static void setNodeTimings(NodeTimings *timings);
+
+#ifdef CHECK_ALLOCATIONS
+		//draws a 585 nodes tree, still and with a moving node, checks the transforms the
+		//nodes get (cached or recomputed, desactivated subtrees included) and that the
+		//traversal does not allocate, logs the time per node
+		static bool checkAllocations();
+#endif
+
 	protected:
 		RenderTree(bool active = true);
 		
@@ -75,8 +94,6 @@ class RenderTree : public Renderable {
 		virtual void keyPressEvent(QKeyEvent*) {};
 		virtual void mouseMoveEvent(QMouseEvent*) {};
 
-		float *relativeModelMatrix;
-
 	private:
 		//QGLViewer overrides (via renderable)
 		void draw();
@@ -84,9 +101,38 @@ class RenderTree : public Renderable {
 		void keyPressEvent(QKeyEvent*, Viewer&);
 		void mouseMoveEvent(QMouseEvent*, Viewer&);
 		///////////////////////////////////////
-		
+
+		//one node of a flattened subtree, in draw order
+		struct FlatNode {
+			RenderTree *node;
+			int father;                 //index of the father entry, -1 for the subtree root
+			unsigned int end;           //one past the last entry of the subtree
+			const std::string *key;     //child key (node timings), NULL for the subtree root
+			unsigned long matrixVersion; //relativeMatrixVersion of the cached world matrix, 0 to recompute
+			bool updated;               //world matrix recomputed during the current draw
+		};
+
+		void flatten(RenderTree *node, int father, const std::string *key, unsigned int depth);
+		void closeNode(unsigned int entry);
+		void relativeModelMatrixChanged();
+
+		//changes go through the setters : they mark the matrix dirty
+		Mat4 relativeModelMatrix;
+		unsigned long relativeMatrixVersion;
+
 		bool active;
 		std::map<std::string, RenderTree*> children;
+
+		//flattened subtree of the last draw() called on this node, cached world matrices
+		std::vector<FlatNode> flatNodes;
+		std::vector<Mat4> worldMatrices;
+		std::vector<unsigned int> openNodes;
+		Mat4 fatherMatrix;
+		unsigned long flatStructureVersion;
+
+		//bumped by addChild and removeChild in any tree
+		static unsigned long structureVersion;
+		static NodeTimings *nodeTimings;
 };
 
 #endif /* end of include guard: RENDERTREE_H */
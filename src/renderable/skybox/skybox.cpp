@@ -108,7 +108,7 @@ void Skybox::drawDownwards(const float *currentTransformationMatrix) {
 
     // Couleur sous l'eau
     float scale = 50.0-0.01; // cf main + offset pour z-fighting
-    float offsetH = 1.0 * (Globals::viewer->camera()->position()[1] > 10.0 ? -1.0 : 1.0); // pour cacher les décalages avec les vagues
+    float offsetH = 1.0 * (Globals::camera->position()[1] > 10.0 ? -1.0 : 1.0); // pour cacher les décalages avec les vagues
     float waterHeight = 10.0 + offsetH;
     glColor3ub(57, 88, 121);
     glDisable(GL_LIGHTING);
@@ -6,6 +6,7 @@
 #include "log.h"
 #include "terrain.h"
 #include "matrix.h"
+#include "simulationClock.h"
 #include <GL/glew.h>
 
 Terrain::Terrain(unsigned char *heightmap, unsigned int width, unsigned int height, bool centered) :
@@ -111,7 +112,9 @@ void Terrain::drawDownwards(const float *currentTransformationMatrix) {
 }
 
 void Terrain::animateDownwards() {
-	this->rotate(qglviewer::Quaternion(qglviewer::Vec(0.0f,1.0f,0.0f), 3.14/1024));
+	//pi/1024 per frame at 25 Hz
+	float angularSpeed = 3.14f*25.0f/1024.0f;
+	this->rotate(qglviewer::Quaternion(qglviewer::Vec(0.0f,1.0f,0.0f), angularSpeed*SimulationClock::global().getDt()));
 }
 
 void Terrain::writeColor(int height, unsigned int &idx, float *color) {
@@ -9,6 +9,7 @@
 #include "globals.h"
 #include "shader.h"
 #include "viewer.h"
+#include "simulationClock.h"
 #include "audible.h"
 #include "waves.h"
 #include "consts.h"
@@ -19,6 +20,9 @@ using namespace Matrix;
 #define N_MOBILES_X 256
 #define N_MOBILES_Z 256
 
+// waves time units per simulated second (tuned at 1/50 per frame on the 25 Hz QGLViewer animation)
+#define WAVES_SPEED 0.5f
+
 Waves::~Waves() {
     delete[] mobiles;
     delete[] indices;
@@ -126,20 +130,24 @@ program("Waves") {
 
 void Waves::drawDownwards(const float *currentTransformationMatrix) {
         
-    float *proj = new float[16], *view = new float[16];
+    float proj[16], view[16], viewInv[16];
 
 	program.use();
 
 	glGetFloatv(GL_MODELVIEW_MATRIX, view);
 	glGetFloatv(GL_PROJECTION_MATRIX, proj);
-    float *viewInv = inverseMat4f(view);
+    inverseMat4f(view, viewInv);
     //std::cout << viewInv[0] << "/" << viewInv[1] << "/" << viewInv[2] << "/" << viewInv[3] << "\n" << viewInv[4] << "/" << viewInv[5] << "/" << viewInv[6] << "/" << viewInv[7] << "\n" << viewInv[8] << "/" << viewInv[9] << "/" << viewInv[10] << "/" << viewInv[11] << "\n" << viewInv[12] << "/" << viewInv[13] << "/" << viewInv[14] << "/" << viewInv[15] << "\n\n"; 
 
 	glUniformMatrix4fv(uniformLocs["modelMatrix"], 1, GL_TRUE, currentTransformationMatrix);
 	glUniformMatrix4fv(uniformLocs["viewMatrix"], 1, GL_FALSE, view);
 	glUniformMatrix4fv(uniformLocs["projectionMatrix"], 1, GL_FALSE, proj);
     glUniformMatrix4fv(uniformLocs["invView"], 1, GL_FALSE, viewInv);
-    glUniform1f(uniformLocs["time"], time);
+    // between the last two substeps
+    float renderTime = time;
+    if (!stopAnimating)
+        renderTime -= (1.0f - SimulationClock::global().getAlpha()) * WAVES_SPEED * SimulationClock::global().getDt();
+    glUniform1f(uniformLocs["time"], renderTime);
     glUniform1f(uniformLocs["deltaX"], deltaX);
     glUniform1f(uniformLocs["deltaZ"], deltaZ);
 
@@ -162,8 +170,7 @@ void Waves::animateDownwards() {
     // Check if we were told to stop animating
     if (stopAnimating) return;
 
-    float deltaT = 1.0 / 50;
-    time += deltaT;
+    time += WAVES_SPEED * SimulationClock::global().getDt();
 
     //std::cout << "time=" << time << std::endl;
     
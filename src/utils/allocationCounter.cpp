@@ -0,0 +1,43 @@
+#include "allocationCounter.h"
+
+#ifdef CHECK_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+	std::atomic<unsigned long> allocations(0);
+}
+
+//new[] and the nothrow versions go through this one
+//like the default one, calls the new handler until malloc succeeds or there is no handler
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if(size == 0)
+		size = 1;
+
+	void *ptr;
+	while((ptr = malloc(size)) == 0) {
+		std::new_handler handler = std::get_new_handler();
+		if(!handler)
+			throw std::bad_alloc();
+
+		handler();
+	}
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+	free(ptr);
+}
+
+namespace AllocationCounter {
+	unsigned long getCount() {
+		return allocations.load(std::memory_order_relaxed);
+	}
+}
+
+#endif
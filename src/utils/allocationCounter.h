@@ -0,0 +1,14 @@
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+// Number of operator new calls since the start of the process, for the checks that a code
+// path does not allocate (see RenderTree::checkAllocations).
+// The global operator new is replaced by malloc plus a relaxed atomic increment, so it is only
+// built with CHECK_ALLOCATIONS (off by default).
+#ifdef CHECK_ALLOCATIONS
+namespace AllocationCounter {
+	unsigned long getCount();
+}
+#endif
+
+#endif /* end of include guard: ALLOCATIONCOUNTER_H */
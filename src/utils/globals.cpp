@@ -25,9 +25,9 @@ const unsigned char *Globals::glVersion = 0;
 const unsigned char *Globals::glShadingLanguageVersion = 0;
 
 Viewer *Globals::viewer = 0;
+qglviewer::Camera *Globals::camera = 0;
 unsigned int Globals::projectionViewUniformBlock = 0;
 
-float Globals::dt = 0.1;
 Vec Globals::pos = Vec(0, 0, 0);
 Vec Globals::offset = Vec(0, 0, 0);
 
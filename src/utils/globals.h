@@ -45,10 +45,11 @@ class Globals {
 		static float glPointSize;
 		
 		static Viewer *viewer;
+		//camera of the viewer, or of the headless renderer (no viewer then)
+		static qglviewer::Camera *camera;
 		static unsigned int projectionViewUniformBlock;
 
         // Diver
-        static float dt;
         static Vec pos;
         static Vec offset;
 };
@@ -0,0 +1,43 @@
+#ifndef MAT4_H
+#define MAT4_H
+
+#include <cstring>
+
+// 4x4 float matrix held by value, row major like the Matrix functions (translation in 3, 7
+// and 11, uploaded with transpose = GL_TRUE). Aligned on 16 bytes so that each row loads
+// in one SSE register. No constructor initializes it but the explicit ones, so that
+// stack matrices cost nothing before being written.
+struct alignas(16) Mat4 {
+	float m[16];
+
+	Mat4() {}
+
+	explicit Mat4(const float *values) {
+		memcpy(m, values, 16*sizeof(float));
+	}
+
+	static Mat4 identity() {
+		Mat4 I;
+		memset(I.m, 0, 16*sizeof(float));
+		I.m[0] = I.m[5] = I.m[10] = I.m[15] = 1.0f;
+		return I;
+	}
+
+	float *data() {
+		return m;
+	}
+
+	const float *data() const {
+		return m;
+	}
+
+	float &operator[](unsigned int i) {
+		return m[i];
+	}
+
+	float operator[](unsigned int i) const {
+		return m[i];
+	}
+};
+
+#endif /* end of include guard: MAT4_H */
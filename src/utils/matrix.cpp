@@ -1,25 +1,358 @@
 
 #include "matrix.h"
+#include "log.h"
 
-namespace Matrix {
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	// Scalar kernels : fallback without SSE2 and reference of Matrix::check and Matrix::benchmark.
+	// The SIMD kernels do the same operations in the same order (no FMA), lane by lane.
 
-	
-	float* multMat4f(const float *m1, const float* m2) {
-		float *m = new float[16]();
+	void scalarMultMat4f(const float *m1, const float *m2, float *m) {
+		float res[16] = {0};
 
 		for (int i = 0; i < 4; i++) {
 			for (int j = 0; j < 4; j++) {
 				for (int k = 0; k < 4; k++) {
-					m[4*i+j] += m1[4*i+k] * m2[4*k+j];
+					res[4*i+j] += m1[4*i+k] * m2[4*k+j];
 				}
 			}
 		}
 
+		memcpy(m, res, 16*sizeof(float));
+	}
+
+	void scalarTranspose(const float *M, float *tr, const unsigned int dim) {
+		if (M == tr) {
+			for (unsigned int i = 0; i < dim; i++) {
+				for (unsigned int j = i + 1; j < dim; j++) {
+					std::swap(tr[i*dim+j], tr[j*dim+i]);
+				}
+			}
+			return;
+		}
+
+		for (unsigned int i = 0; i < dim; i++) {
+			for (unsigned int j = 0; j < dim; j++) {
+				tr[i*dim+j] = M[j*dim+i];
+			}
+		}
+	}
+
+	void singularMat4f() {
+		std::cout << "[Matrix] inverseMat4f: det = 0 !" << std::endl;
+		exit(1);
+	}
+
+	void scalarInverseMat4f(const float *M, float *res) {
+		float inv[16];
+
+		float s0 = M[0] * M[5] - M[4] * M[1];
+		float s1 = M[0] * M[6] - M[4] * M[2];
+		float s2 = M[0] * M[7] - M[4] * M[3];
+		float s3 = M[1] * M[6] - M[5] * M[2];
+		float s4 = M[1] * M[7] - M[5] * M[3];
+		float s5 = M[2] * M[7] - M[6] * M[3];
+		float c5 = M[10] * M[15] - M[14] * M[11];
+		float c4 = M[9] * M[15] - M[13] * M[11];
+		float c3 = M[9] * M[14] - M[13] * M[10];
+		float c2 = M[8] * M[15] - M[12] * M[11];
+		float c1 = M[8] * M[14] - M[12] * M[10];
+		float c0 = M[8] * M[13] - M[12] * M[9];
+
+		float det = (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+		if (fabs(det) < 0.000000000001)
+			singularMat4f();
+		float invdet = 1.0 / det;
+
+		inv[0] = ( M[5] * c5 - M[6] * c4 + M[7] * c3) * invdet;
+		inv[1] = (-M[1] * c5 + M[2] * c4 - M[3] * c3) * invdet;
+		inv[2] = ( M[13] * s5 - M[14] * s4 + M[15] * s3) * invdet;
+		inv[3] = (-M[9] * s5 + M[10] * s4 - M[11] * s3) * invdet;
+
+		inv[4] = (-M[4] * c5 + M[6] * c2 - M[7] * c1) * invdet;
+		inv[5] = ( M[0] * c5 - M[2] * c2 + M[3] * c1) * invdet;
+		inv[6] = (-M[12] * s5 + M[14] * s2 - M[15] * s1) * invdet;
+		inv[7] = ( M[8] * s5 - M[10] * s2 + M[11] * s1) * invdet;
+
+		inv[8] = ( M[4] * c4 - M[5] * c2 + M[7] * c0) * invdet;
+		inv[9] = (-M[0] * c4 + M[1] * c2 - M[3] * c0) * invdet;
+		inv[10] = ( M[12] * s4 - M[13] * s2 + M[15] * s0) * invdet;
+		inv[11] = (-M[8] * s4 + M[9] * s2 - M[11] * s0) * invdet;
+
+		inv[12] = (-M[4] * c3 + M[5] * c1 - M[6] * c0) * invdet;
+		inv[13] = ( M[0] * c3 - M[1] * c1 + M[2] * c0) * invdet;
+		inv[14] = (-M[12] * s3 + M[13] * s1 - M[14] * s0) * invdet;
+		inv[15] = ( M[8] * s3 - M[9] * s1 + M[10] * s0) * invdet;
+
+		memcpy(res, inv, 16*sizeof(float));
+	}
+
+	void scalarMat3f(const float *M, float *res) {
+		res[0] = M[0];
+		res[1] = M[1];
+		res[2] = M[2];
+		res[3] = M[4];
+		res[4] = M[5];
+		res[5] = M[6];
+		res[6] = M[8];
+		res[7] = M[9];
+		res[8] = M[10];
+	}
+
+	void scalarMultMat4f(const Mat4 &A, const Mat4 *M, Mat4 *res, unsigned int count) {
+		for (unsigned int i = 0; i < count; i++) {
+			scalarMultMat4f(A.data(), M[i].data(), res[i].data());
+		}
+	}
+
+	void scalarTransformPoints(const float *M, const float *x, const float *y, const float *z,
+			float *rx, float *ry, float *rz, float *rw, unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			float X = x[i], Y = y[i], Z = z[i];
+			rx[i] = M[0]*X + M[1]*Y + M[2]*Z + M[3];
+			ry[i] = M[4]*X + M[5]*Y + M[6]*Z + M[7];
+			rz[i] = M[8]*X + M[9]*Y + M[10]*Z + M[11];
+			if(rw)
+				rw[i] = M[12]*X + M[13]*Y + M[14]*Z + M[15];
+		}
+	}
+
+#ifdef __SSE2__
+	inline __m128 madd(__m128 acc, __m128 a, __m128 b) {
+		return _mm_add_ps(acc, _mm_mul_ps(a, b));
+	}
+
+	//every row is loaded before the first store : m may be m1 or m2
+	void simdMultMat4f(const float *m1, const float *m2, float *m) {
+#ifdef __AVX2__
+		//two rows of m per register, the rows of m2 in both halves
+		__m256 a01 = _mm256_loadu_ps(m1), a23 = _mm256_loadu_ps(m1 + 8);
+		__m256 b0 = _mm256_broadcast_ps((const __m128 *) m2), b1 = _mm256_broadcast_ps((const __m128 *) (m2 + 4)),
+		       b2 = _mm256_broadcast_ps((const __m128 *) (m2 + 8)), b3 = _mm256_broadcast_ps((const __m128 *) (m2 + 12));
+
+		__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xAA), b2));
+		r01 = _mm256_add_ps(r01, _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xFF), b3));
+
+		__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xAA), b2));
+		r23 = _mm256_add_ps(r23, _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xFF), b3));
+
+		_mm256_storeu_ps(m, r01);
+		_mm256_storeu_ps(m + 8, r23);
+#else
+		__m128 b0 = _mm_loadu_ps(m2), b1 = _mm_loadu_ps(m2 + 4), b2 = _mm_loadu_ps(m2 + 8), b3 = _mm_loadu_ps(m2 + 12);
+		__m128 r[4];
+
+		for (int i = 0; i < 4; i++) {
+			__m128 a = _mm_loadu_ps(m1 + 4*i);
+			r[i] = _mm_mul_ps(_mm_shuffle_ps(a, a, 0x00), b0);
+			r[i] = madd(r[i], _mm_shuffle_ps(a, a, 0x55), b1);
+			r[i] = madd(r[i], _mm_shuffle_ps(a, a, 0xAA), b2);
+			r[i] = madd(r[i], _mm_shuffle_ps(a, a, 0xFF), b3);
+		}
+
+		for (int i = 0; i < 4; i++) {
+			_mm_storeu_ps(m + 4*i, r[i]);
+		}
+#endif
+	}
+
+	void simdTranspose4f(const float *M, float *tr) {
+		__m128 r0 = _mm_loadu_ps(M), r1 = _mm_loadu_ps(M + 4), r2 = _mm_loadu_ps(M + 8), r3 = _mm_loadu_ps(M + 12);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(tr, r0);
+		_mm_storeu_ps(tr + 4, r1);
+		_mm_storeu_ps(tr + 8, r2);
+		_mm_storeu_ps(tr + 12, r3);
+	}
+
+	// Same cofactors as scalarInverseMat4f, four at a time :
+	//   S = (s0, s1, s2, s3), C = (c0, c1, c2, c3) and SC45 = (s4, s5, c4, c5) are the 2x2 minors
+	//   of the rows 0-1 and 2-3 on the column pairs (0,1) (0,2) (0,3) (1,2) (1,3) (2,3),
+	//   K[i] = (ci, ci, si, si) and col[k] = (M[4+k], M[k], M[12+k], M[8+k]), so that
+	//   row 0 of the inverse is (col1*K5 - col2*K4 + col3*K3)*invdet, and so on.
+	// The negative terms of the scalar version are negated factors here (-a*b + c*d = (-a)*b - (-c)*d),
+	// which keeps the roundings and the signed zeros of each lane.
+	void simdInverseMat4f(const float *M, float *res) {
+		__m128 r0 = _mm_loadu_ps(M), r1 = _mm_loadu_ps(M + 4), r2 = _mm_loadu_ps(M + 8), r3 = _mm_loadu_ps(M + 12);
+
+		const int a = _MM_SHUFFLE(1, 0, 0, 0), b = _MM_SHUFFLE(2, 3, 2, 1);
+		__m128 S = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(r0, r0, a), _mm_shuffle_ps(r1, r1, b)),
+				_mm_mul_ps(_mm_shuffle_ps(r1, r1, a), _mm_shuffle_ps(r0, r0, b)));
+		__m128 C = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(r2, r2, a), _mm_shuffle_ps(r3, r3, b)),
+				_mm_mul_ps(_mm_shuffle_ps(r3, r3, a), _mm_shuffle_ps(r2, r2, b)));
+		__m128 SC45 = _mm_sub_ps(
+				_mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 1, 2, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 3, 3, 3))),
+				_mm_mul_ps(_mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 1, 2, 1)), _mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 3, 3, 3))));
+
+		//the determinant stays scalar to keep the order of the sums
+		alignas(16) float s[4], c[4], sc45[4];
+		_mm_store_ps(s, S);
+		_mm_store_ps(c, C);
+		_mm_store_ps(sc45, SC45);
+
+		float det = (s[0] * sc45[3] - s[1] * sc45[2] + s[2] * c[3] + s[3] * c[2] - sc45[0] * c[1] + sc45[1] * c[0]);
+		if (fabs(det) < 0.000000000001)
+			singularMat4f();
+		float invdet = 1.0 / det;
+
+		__m128 lo = _mm_unpacklo_ps(C, S), hi = _mm_unpackhi_ps(C, S);
+		__m128 K0 = _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 1, 0, 0));
+		__m128 K1 = _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(3, 3, 2, 2));
+		__m128 K2 = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 1, 0, 0));
+		__m128 K3 = _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(3, 3, 2, 2));
+		__m128 K4 = _mm_shuffle_ps(SC45, SC45, _MM_SHUFFLE(0, 0, 2, 2));
+		__m128 K5 = _mm_shuffle_ps(SC45, SC45, _MM_SHUFFLE(1, 1, 3, 3));
+
+		__m128 col0 = r1, col1 = r0, col2 = r3, col3 = r2;
+		_MM_TRANSPOSE4_PS(col0, col1, col2, col3);
+
+		//rows 0 and 2 negate the lanes 1 and 3, rows 1 and 3 the lanes 0 and 2
+		const __m128 oddLanes = _mm_setr_ps(0.0f, -0.0f, 0.0f, -0.0f), evenLanes = _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f);
+		__m128 colA0 = _mm_xor_ps(col0, oddLanes), colA1 = _mm_xor_ps(col1, oddLanes),
+		       colA2 = _mm_xor_ps(col2, oddLanes), colA3 = _mm_xor_ps(col3, oddLanes);
+		__m128 colB0 = _mm_xor_ps(col0, evenLanes), colB1 = _mm_xor_ps(col1, evenLanes),
+		       colB2 = _mm_xor_ps(col2, evenLanes), colB3 = _mm_xor_ps(col3, evenLanes);
+		const __m128 invdet4 = _mm_set1_ps(invdet);
+
+		__m128 row0 = madd(_mm_sub_ps(_mm_mul_ps(colA1, K5), _mm_mul_ps(colA2, K4)), colA3, K3);
+		__m128 row1 = madd(_mm_sub_ps(_mm_mul_ps(colB0, K5), _mm_mul_ps(colB2, K2)), colB3, K1);
+		__m128 row2 = madd(_mm_sub_ps(_mm_mul_ps(colA0, K4), _mm_mul_ps(colA1, K2)), colA3, K0);
+		__m128 row3 = madd(_mm_sub_ps(_mm_mul_ps(colB0, K3), _mm_mul_ps(colB1, K1)), colB2, K0);
+
+		_mm_storeu_ps(res, _mm_mul_ps(row0, invdet4));
+		_mm_storeu_ps(res + 4, _mm_mul_ps(row1, invdet4));
+		_mm_storeu_ps(res + 8, _mm_mul_ps(row2, invdet4));
+		_mm_storeu_ps(res + 12, _mm_mul_ps(row3, invdet4));
+	}
+
+	void simdMat3f(const float *M, float *res) {
+		__m128 r0 = _mm_loadu_ps(M), r1 = _mm_loadu_ps(M + 4), r2 = _mm_loadu_ps(M + 8);
+		//overlapping stores, the 4th float of each row is overwritten by the next one
+		_mm_storeu_ps(res, r0);
+		_mm_storeu_ps(res + 3, r1);
+		_mm_storel_pi((__m64 *) (res + 6), r2);
+		_mm_store_ss(res + 8, _mm_movehl_ps(r2, r2));
+	}
+
+	void simdMultMat4f(const Mat4 &A, const Mat4 *M, Mat4 *res, unsigned int count) {
+#ifdef __AVX2__
+		//the broadcasts of A are kept in registers for the whole batch
+		const float *m1 = A.data();
+		__m256 a01 = _mm256_loadu_ps(m1), a23 = _mm256_loadu_ps(m1 + 8);
+		const __m256 a01x = _mm256_shuffle_ps(a01, a01, 0x00), a01y = _mm256_shuffle_ps(a01, a01, 0x55),
+		             a01z = _mm256_shuffle_ps(a01, a01, 0xAA), a01w = _mm256_shuffle_ps(a01, a01, 0xFF);
+		const __m256 a23x = _mm256_shuffle_ps(a23, a23, 0x00), a23y = _mm256_shuffle_ps(a23, a23, 0x55),
+		             a23z = _mm256_shuffle_ps(a23, a23, 0xAA), a23w = _mm256_shuffle_ps(a23, a23, 0xFF);
+
+		for (unsigned int i = 0; i < count; i++) {
+			const float *m2 = M[i].data();
+			__m256 b0 = _mm256_broadcast_ps((const __m128 *) m2), b1 = _mm256_broadcast_ps((const __m128 *) (m2 + 4)),
+			       b2 = _mm256_broadcast_ps((const __m128 *) (m2 + 8)), b3 = _mm256_broadcast_ps((const __m128 *) (m2 + 12));
+
+			__m256 r01 = _mm256_mul_ps(a01x, b0);
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(a01y, b1));
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(a01z, b2));
+			r01 = _mm256_add_ps(r01, _mm256_mul_ps(a01w, b3));
+
+			__m256 r23 = _mm256_mul_ps(a23x, b0);
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(a23y, b1));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(a23z, b2));
+			r23 = _mm256_add_ps(r23, _mm256_mul_ps(a23w, b3));
+
+			_mm256_storeu_ps(res[i].data(), r01);
+			_mm256_storeu_ps(res[i].data() + 8, r23);
+		}
+#else
+		for (unsigned int i = 0; i < count; i++) {
+			simdMultMat4f(A.data(), M[i].data(), res[i].data());
+		}
+#endif
+	}
+
+	//SoA : one point per lane, the matrix broadcasted
+	void simdTransformPoints(const float *M, const float *x, const float *y, const float *z,
+			float *rx, float *ry, float *rz, float *rw, unsigned int count) {
+		unsigned int i = 0;
+#ifdef __AVX2__
+		__m256 m[16];
+		for (int k = 0; k < 16; k++) {
+			m[k] = _mm256_set1_ps(M[k]);
+		}
+
+		for (; i + 8 <= count; i += 8) {
+			__m256 X = _mm256_loadu_ps(x + i), Y = _mm256_loadu_ps(y + i), Z = _mm256_loadu_ps(z + i);
+			__m256 res[4];
+			for (int row = 0; row < (rw ? 4 : 3); row++) {
+				__m256 r = _mm256_mul_ps(m[4*row], X);
+				r = _mm256_add_ps(r, _mm256_mul_ps(m[4*row+1], Y));
+				r = _mm256_add_ps(r, _mm256_mul_ps(m[4*row+2], Z));
+				res[row] = _mm256_add_ps(r, m[4*row+3]);
+			}
+			_mm256_storeu_ps(rx + i, res[0]);
+			_mm256_storeu_ps(ry + i, res[1]);
+			_mm256_storeu_ps(rz + i, res[2]);
+			if(rw)
+				_mm256_storeu_ps(rw + i, res[3]);
+		}
+#else
+		__m128 m[16];
+		for (int k = 0; k < 16; k++) {
+			m[k] = _mm_set1_ps(M[k]);
+		}
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 X = _mm_loadu_ps(x + i), Y = _mm_loadu_ps(y + i), Z = _mm_loadu_ps(z + i);
+			__m128 res[4];
+			for (int row = 0; row < (rw ? 4 : 3); row++) {
+				__m128 r = _mm_mul_ps(m[4*row], X);
+				r = madd(r, m[4*row+1], Y);
+				r = madd(r, m[4*row+2], Z);
+				res[row] = _mm_add_ps(r, m[4*row+3]);
+			}
+			_mm_storeu_ps(rx + i, res[0]);
+			_mm_storeu_ps(ry + i, res[1]);
+			_mm_storeu_ps(rz + i, res[2]);
+			if(rw)
+				_mm_storeu_ps(rw + i, res[3]);
+		}
+#endif
+		scalarTransformPoints(M, x, y, z, rx, ry, rz, rw, i, count);
+	}
+#endif
+}
+
+namespace Matrix {
+
+	void multMat4f(const float *m1, const float *m2, float *m) {
+#ifdef __SSE2__
+		simdMultMat4f(m1, m2, m);
+#else
+		scalarMultMat4f(m1, m2, m);
+#endif
+	}
+
+	Mat4 multMat4f(const Mat4 &m1, const Mat4 &m2) {
+		Mat4 m;
+		multMat4f(m1.data(), m2.data(), m.data());
 		return m;
 	}
 
-	
-	
 	void scaleMat4f(float* M, float alpha) {
 		M[0]*=alpha;
 		M[5]*=alpha;
@@ -77,8 +410,8 @@ namespace Matrix {
 
 	void rotateMat4f(float* M, qglviewer::Quaternion const &quat) {
 
-		double *rot = new double[16];
-		float *rotf = new float[16];
+		double rot[16];
+		float rotf[16];
 
 		quat.getMatrix(rot);
 
@@ -86,31 +419,27 @@ namespace Matrix {
 			rotf[i] = rot[i];
 		}
 
-		const float *res = multMat4f(rotf, M);
-
-		for (int i = 0; i < 16; i++) {
-			M[i] = res[i];
-		}
-
-		delete [] res;
-		delete [] rot;
-		delete [] rotf;
+		multMat4f(rotf, M, M);
 	}
 
-    float *transpose(const float *M, const unsigned int dim) {
-        float *tr = new float[dim*dim];
-
-        for (unsigned int i = 0; i < dim; i++) {
-            for (unsigned int j = 0; j < dim; j++) {
-                tr[i*dim+j] = M[j*dim+i];
-            }
+    void transpose(const float *M, float *tr, const unsigned int dim) {
+#ifdef __SSE2__
+        if (dim == 4) {
+            simdTranspose4f(M, tr);
+            return;
         }
+#endif
+        scalarTranspose(M, tr, dim);
+    }
 
+    Mat4 transpose(const Mat4 &M) {
+        Mat4 tr;
+        transpose(M.data(), tr.data());
         return tr;
     }
     
-    float *inverseMat3f(const float *M) {
-        float *inv = new float[9];
+    void inverseMat3f(const float *M, float *res) {
+        float inv[9];
         float det = M[0] * (M[4] * M[8] - M[7] * M[5]) -
                     M[1] * (M[3] * M[8] - M[5] * M[6]) +
                     M[2] * (M[3] * M[7] - M[4] * M[6]);
@@ -132,75 +461,253 @@ namespace Matrix {
         inv[7] = (M[6] * M[1] - M[0] * M[7]) * invdet;
         inv[8] = (M[0] * M[4] - M[3] * M[1]) * invdet;
 
+        memcpy(res, inv, 9*sizeof(float));
+    }
+
+    void inverseMat4f(const float *M, float *res) {
+#ifdef __SSE2__
+        simdInverseMat4f(M, res);
+#else
+        scalarInverseMat4f(M, res);
+#endif
+    }
+
+    Mat4 inverseMat4f(const Mat4 &M) {
+        Mat4 inv;
+        inverseMat4f(M.data(), inv.data());
         return inv;
     }
 
-    float *inverseMat4f(const float *M) {
-        float *inv = new float[16];
-
-        float s0 = M[0] * M[5] - M[4] * M[1];
-        float s1 = M[0] * M[6] - M[4] * M[2];
-        float s2 = M[0] * M[7] - M[4] * M[3];
-        float s3 = M[1] * M[6] - M[5] * M[2];
-        float s4 = M[1] * M[7] - M[5] * M[3];
-        float s5 = M[2] * M[7] - M[6] * M[3];
-        float c5 = M[10] * M[15] - M[14] * M[11];
-        float c4 = M[9] * M[15] - M[13] * M[11];
-        float c3 = M[9] * M[14] - M[13] * M[10];
-        float c2 = M[8] * M[15] - M[12] * M[11];
-        float c1 = M[8] * M[13] - M[12] * M[10];
-        float c0 = M[8] * M[12] - M[12] * M[9];
-
-        float det = (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
-        if (fabs(det) < 0.000000000001) {
-            std::cout << "[Matrix] inverseMat4f: det = 0 !" << std::endl;
-            exit(1);
+    void mat3f(const float *M, float *res) {
+#ifdef __SSE2__
+        simdMat3f(M, res);
+#else
+        scalarMat3f(M, res);
+#endif
+    }
+
+    void getColumn(const float *M, const unsigned int dim, const unsigned int col, float *res) {
+        for (unsigned int i = 0; i < dim; i++) {
+            res[i] = M[i*dim + col];
         }
-        float invdet = 1.0 / det;
+    }
 
-        inv[0] = ( M[5] * c5 - M[6] * c4 + M[7] * c3) * invdet;
-        inv[1] = (-M[1] * c5 + M[2] * c4 - M[3] * c3) * invdet;
-        inv[2] = ( M[13] * s5 - M[14] * s4 + M[15] * s3) * invdet;
-        inv[3] = (-M[9] * s5 + M[10] * s4 - M[11] * s3) * invdet;
+    void multMat4f(const Mat4 &A, const Mat4 *M, Mat4 *res, unsigned int count) {
+#ifdef __SSE2__
+        simdMultMat4f(A, M, res, count);
+#else
+        scalarMultMat4f(A, M, res, count);
+#endif
+    }
 
-        inv[4] = (-M[4] * c5 + M[6] * c2 - M[7] * c1) * invdet;
-        inv[5] = ( M[0] * c5 - M[2] * c2 + M[3] * c1) * invdet;
-        inv[6] = (-M[12] * s5 + M[14] * s2 - M[15] * s1) * invdet;
-        inv[7] = ( M[8] * s5 - M[10] * s2 + M[11] * s1) * invdet;
+    void transformPoints(const float *M, const float *x, const float *y, const float *z,
+            float *rx, float *ry, float *rz, float *rw, unsigned int count) {
+#ifdef __SSE2__
+        simdTransformPoints(M, x, y, z, rx, ry, rz, rw, count);
+#else
+        scalarTransformPoints(M, x, y, z, rx, ry, rz, rw, 0, count);
+#endif
+    }
 
-        inv[8] = ( M[4] * c4 - M[5] * c2 + M[7] * c0) * invdet;
-        inv[9] = (-M[0] * c4 + M[1] * c2 - M[3] * c0) * invdet;
-        inv[10] = ( M[12] * s4 - M[13] * s2 + M[15] * s0) * invdet;
-        inv[11] = (-M[8] * s4 + M[9] * s2 - M[11] * s0) * invdet;
+    namespace {
+        float randomFloat(float min, float max) {
+            return min + (max - min)*(rand() / (float) RAND_MAX);
+        }
 
-        inv[12] = (-M[4] * c3 + M[5] * c1 - M[6] * c0) * invdet;
-        inv[13] = ( M[0] * c3 - M[1] * c1 + M[2] * c0) * invdet;
-        inv[14] = (-M[12] * s3 + M[13] * s1 - M[14] * s0) * invdet;
-        inv[15] = ( M[8] * s3 - M[9] * s1 + M[10] * s0) * invdet;
+        //invertible : random entries around a dominant diagonal, or rotation + scale + offset
+        void randomMat4f(float *M, bool affine) {
+            if (affine) {
+                qglviewer::Quaternion q(qglviewer::Vec(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(0.1f, 1.0f)),
+                        randomFloat(-M_PI, M_PI));
+                memcpy(M, Mat4::identity().data(), 16*sizeof(float));
+                setRotationMat4f(M, q, randomFloat(0.5f, 2.0f));
+                setOffsetMat4f(M, randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f));
+                return;
+            }
 
-        return inv;
+            for (unsigned int i = 0; i < 16; i++) {
+                M[i] = randomFloat(-1.0f, 1.0f) + (i % 5 == 0 ? 4.0f : 0.0f);
+            }
+        }
+
+        //floats that differ (== : -0 matches +0, the scalar product sums from +0)
+        unsigned int countDifferences(const float *a, const float *b, unsigned int n) {
+            unsigned int count = 0;
+            for (unsigned int i = 0; i < n; i++) {
+                count += (a[i] != b[i]);
+            }
+            return count;
+        }
     }
 
-    float *mat3f(const float *M) {
-        float *res = new float[9];
-        res[0] = M[0];
-        res[1] = M[1];
-        res[2] = M[2];
-        res[3] = M[4];
-        res[4] = M[5];
-        res[5] = M[6];
-        res[6] = M[8];
-        res[7] = M[9];
-        res[8] = M[10];
-        return res;
+    bool check() {
+        const unsigned int nMatrices = 10000, nPoints = 10003;
+
+        std::vector<Mat4> A(nMatrices), B(nMatrices), res(nMatrices), ref(nMatrices);
+        for (unsigned int i = 0; i < nMatrices; i++) {
+            randomMat4f(A[i].data(), i % 2 == 0);
+            randomMat4f(B[i].data(), i % 3 == 0);
+        }
+
+        unsigned int mult = 0, multAliased = 0, transposed = 0, inverse = 0, inverseAliased = 0, mat3 = 0;
+        for (unsigned int i = 0; i < nMatrices; i++) {
+            Mat4 a = A[i], b = B[i], r;
+            float r3[9], ref3[9];
+
+            scalarMultMat4f(a.data(), b.data(), ref[i].data());
+            mult += countDifferences(multMat4f(a, b).data(), ref[i].data(), 16);
+            multMat4f(a.data(), b.data(), a.data());
+            multAliased += countDifferences(a.data(), ref[i].data(), 16);
+            a = A[i];
+            multMat4f(a.data(), b.data(), b.data());
+            multAliased += countDifferences(b.data(), ref[i].data(), 16);
+            b = B[i];
+
+            scalarTranspose(a.data(), r.data(), 4);
+            transposed += countDifferences(transpose(a).data(), r.data(), 16);
+            transpose(a.data(), a.data());
+            transposed += countDifferences(a.data(), r.data(), 16);
+            a = A[i];
+
+            scalarInverseMat4f(a.data(), r.data());
+            inverse += countDifferences(inverseMat4f(a).data(), r.data(), 16);
+            inverseMat4f(a.data(), a.data());
+            inverseAliased += countDifferences(a.data(), r.data(), 16);
+            a = A[i];
+
+            scalarMat3f(a.data(), ref3);
+            mat3f(a.data(), r3);
+            mat3 += countDifferences(r3, ref3, 9);
+        }
+
+        //batch : A[0]*B[i], then in place
+        scalarMultMat4f(A[0], &B[0], &ref[0], nMatrices);
+        multMat4f(A[0], &B[0], &res[0], nMatrices);
+        unsigned int batch = countDifferences(res[0].data(), ref[0].data(), 16*nMatrices);
+        res = B;
+        multMat4f(A[0], &res[0], &res[0], nMatrices);
+        batch += countDifferences(res[0].data(), ref[0].data(), 16*nMatrices);
+
+        //points (count not a multiple of the SIMD width), with and without w, then in place
+        std::vector<float> p(3*nPoints), r(4*nPoints), rRef(4*nPoints);
+        for (unsigned int i = 0; i < 3*nPoints; i++) {
+            p[i] = randomFloat(-100.0f, 100.0f);
+        }
+        float *x = &p[0], *y = x + nPoints, *z = y + nPoints;
+
+        unsigned int points = 0;
+        for (unsigned int pass = 0; pass < 2; pass++) {
+            const float *M = A[pass].data();
+            float *rw = (pass == 0 ? &r[3*nPoints] : 0), *rwRef = (pass == 0 ? &rRef[3*nPoints] : 0);
+            scalarTransformPoints(M, x, y, z, &rRef[0], &rRef[nPoints], &rRef[2*nPoints], rwRef, 0, nPoints);
+            transformPoints(M, x, y, z, &r[0], &r[nPoints], &r[2*nPoints], rw, nPoints);
+            points += countDifferences(&r[0], &rRef[0], (pass == 0 ? 4 : 3)*nPoints);
+        }
+        transformPoints(A[1].data(), x, y, z, x, y, z, 0, nPoints);
+        points += countDifferences(&p[0], &rRef[0], 3*nPoints);
+
+        unsigned int differences = mult + multAliased + transposed + inverse + inverseAliased + mat3 + batch + points;
+
+#if defined(__AVX2__)
+        const char *simd = "AVX2";
+#elif defined(__SSE2__)
+        const char *simd = "SSE2";
+#else
+        const char *simd = "none (scalar build)";
+#endif
+        log_console.infoStream() << "[Matrix Check] SIMD " << simd << ", " << nMatrices << " random matrices (half affine), "
+            << nPoints << " points, floats differing from the scalar kernels : multiply " << mult << " (aliased " << multAliased
+            << "), transpose " << transposed << ", inverse " << inverse << " (aliased " << inverseAliased << "), mat3 " << mat3
+            << ", batch multiply " << batch << ", points " << points << ".";
+
+        if (differences != 0)
+            log_console.errorStream() << "[Matrix Check] The SIMD kernels differ from the scalar ones !";
+        return differences == 0;
     }
 
-    float *getColumn(const float *M, const unsigned int dim, const unsigned int col) {
-        float *res = new float[dim];
-        for (unsigned int i = 0; i < dim; i++) {
-            res[i] = M[i*dim + col];
+    void benchmark(unsigned int nRuns) {
+        //64 kB of matrices per array : L2 resident
+        const unsigned int nMatrices = 1024, nRepeats = 200, nPoints = 1 << 16, nPointRepeats = 20;
+
+        std::vector<Mat4> A(nMatrices), B(nMatrices), res(nMatrices);
+        std::vector<float> res3(9*nMatrices);
+        for (unsigned int i = 0; i < nMatrices; i++) {
+            randomMat4f(A[i].data(), i % 2 == 0);
+            randomMat4f(B[i].data(), true);
         }
 
-        return res;
+        std::vector<float> p(3*nPoints), r(4*nPoints);
+        for (unsigned int i = 0; i < 3*nPoints; i++) {
+            p[i] = randomFloat(-100.0f, 100.0f);
+        }
+        const float *x = &p[0], *y = x + nPoints, *z = y + nPoints;
+
+        //best of nRuns, in ns per operation
+        auto time = [nRuns](const std::function<void()> &kernel, double nOps) -> double {
+            double bestTime = 1.0e30;
+            for (unsigned int run = 0; run < nRuns; run++) {
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                kernel();
+                std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+                bestTime = std::min(bestTime, elapsed.count());
+            }
+            return bestTime / nOps;
+        };
+
+        struct Timing {
+            const char *name;
+            double scalarNs, simdNs;
+        };
+        const double nOps = double(nMatrices) * nRepeats, nPointOps = double(nPoints) * nPointRepeats;
+
+        Timing timings[] = {
+            {"multMat4f",
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    scalarMultMat4f(A[i].data(), B[i].data(), res[i].data()); }, nOps),
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    multMat4f(A[i].data(), B[i].data(), res[i].data()); }, nOps)},
+            {"inverseMat4f",
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    scalarInverseMat4f(A[i].data(), res[i].data()); }, nOps),
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    inverseMat4f(A[i].data(), res[i].data()); }, nOps)},
+            {"transpose",
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    scalarTranspose(A[i].data(), res[i].data(), 4); }, nOps),
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    transpose(A[i].data(), res[i].data()); }, nOps)},
+            {"mat3f",
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    scalarMat3f(A[i].data(), &res3[9*i]); }, nOps),
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) for (unsigned int i = 0; i < nMatrices; i++)
+                    mat3f(A[i].data(), &res3[9*i]); }, nOps)},
+            {"batch multMat4f (per matrix)",
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) scalarMultMat4f(A[k % nMatrices], &B[0], &res[0], nMatrices); }, nOps),
+                time([&]() { for (unsigned int k = 0; k < nRepeats; k++) multMat4f(A[k % nMatrices], &B[0], &res[0], nMatrices); }, nOps)},
+            {"transformPoints xyz (per point)",
+                time([&]() { for (unsigned int k = 0; k < nPointRepeats; k++)
+                    scalarTransformPoints(A[k].data(), x, y, z, &r[0], &r[nPoints], &r[2*nPoints], 0, 0, nPoints); }, nPointOps),
+                time([&]() { for (unsigned int k = 0; k < nPointRepeats; k++)
+                    transformPoints(A[k].data(), x, y, z, &r[0], &r[nPoints], &r[2*nPoints], 0, nPoints); }, nPointOps)},
+            {"transformPoints xyzw (per point)",
+                time([&]() { for (unsigned int k = 0; k < nPointRepeats; k++)
+                    scalarTransformPoints(A[k].data(), x, y, z, &r[0], &r[nPoints], &r[2*nPoints], &r[3*nPoints], 0, nPoints); }, nPointOps),
+                time([&]() { for (unsigned int k = 0; k < nPointRepeats; k++)
+                    transformPoints(A[k].data(), x, y, z, &r[0], &r[nPoints], &r[2*nPoints], &r[3*nPoints], nPoints); }, nPointOps)}
+        };
+
+#if defined(__AVX2__)
+        const char *simd = "AVX2";
+#elif defined(__SSE2__)
+        const char *simd = "SSE2";
+#else
+        const char *simd = "none (scalar build)";
+#endif
+        log_console.infoStream() << "[Matrix Benchmark] " << nMatrices << " matrices x " << nRepeats << ", " << nPoints
+            << " points x " << nPointRepeats << ", best of " << nRuns << " runs, SIMD " << simd << " :";
+        for (unsigned int i = 0; i < sizeof(timings)/sizeof(Timing); i++) {
+            log_console.infoStream() << "[Matrix Benchmark]\t" << timings[i].name << " : scalar " << timings[i].scalarNs
+                << " ns/op, SIMD " << timings[i].simdNs << " ns/op (x" << timings[i].scalarNs / timings[i].simdNs << ")";
+        }
     }
-} 
+}
@@ -1,18 +1,25 @@
-
 #ifndef __MATRIX_H__
 #define __MATRIX_H__
 
+#include "mat4.h"
+
 #include <QGLViewer/vec.h>
 #include <QGLViewer/quaternion.h>
 
+// Row major matrices, nothing is allocated : results are returned by value (Mat4)
+// or written into the caller storage, which may alias the operands.
+// multMat4f, transpose, inverseMat4f, mat3f and the batches run on SSE2 (AVX2 for the
+// products when built with it) and give the same floats as the scalar versions they
+// replaced, which stay the fallback and the reference of check().
 namespace Matrix {
-		
-		float *multMat4f(const float *m1, const float* m2);
-	
+
+		void multMat4f(const float *m1, const float *m2, float *m);
+		Mat4 multMat4f(const Mat4 &m1, const Mat4 &m2);
+
 		void scaleMat4f(float *M, float alpha);
 		void scaleMat4f(float *M, float alpha, float beta, float gamma);
 		void scaleMat4f(float *M, qglviewer::Vec &v);
-		
+
 		void translateMat4f(float *M, float x, float y, float z);
 		void translateMat4f(float *M, qglviewer::Vec &v);
 
@@ -23,18 +30,35 @@ namespace Matrix {
 
 		void rotateMat4f(float *M, qglviewer::Quaternion const &quat);
 
-        float *transpose(const float *M, const unsigned int dim = 4);
+        void transpose(const float *M, float *tr, const unsigned int dim = 4);
+        Mat4 transpose(const Mat4 &M);
 
-        float *inverseMat3f(const float *M);
+        void inverseMat3f(const float *M, float *inv);
 
-        float *inverseMat4f(const float *M);
+        void inverseMat4f(const float *M, float *inv);
+        Mat4 inverseMat4f(const Mat4 &M);
 
         // Equivalent to mat3(mat4) in glsl
-        float *mat3f(const float *M);
+        void mat3f(const float *M, float *res);
 
         // Row major matrix
-        float *getColumn(const float *M, const unsigned int dim, const unsigned int col);
+        void getColumn(const float *M, const unsigned int dim, const unsigned int col, float *res);
+
+        // Batches (instances, culling), single threaded : split the ranges over the ThreadPool
+        // res[i] = A*M[i], res may be M
+        void multMat4f(const Mat4 &A, const Mat4 *M, Mat4 *res, unsigned int count);
+
+        // (rx, ry, rz, rw) = M*(x, y, z, 1) on SoA points (particle layout), in place allowed.
+        // rw is optional : clip space w of the points for a projection matrix.
+        void transformPoints(const float *M, const float *x, const float *y, const float *z,
+                        float *rx, float *ry, float *rz, float *rw, unsigned int count);
+
+        // every SIMD kernel against its scalar version on random matrices and points, aliased
+        // operands included, the results must be equal
+        bool check();
+
+        // ns/op of the scalar and SIMD kernels
+        void benchmark(unsigned int nRuns);
 }
 
 #endif /* end of include guard: __MATRIX_H__ */
-
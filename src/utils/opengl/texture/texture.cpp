@@ -32,6 +32,10 @@ Texture::Texture(GLenum textureType) :
 } 
 
 Texture::~Texture() {
+	//free the texture unit for the manager
+	if(isBinded())
+		textureLocations[lastKnownLocation] = -1;
+
 	glDeleteTextures(1, &textureId);
 }
 
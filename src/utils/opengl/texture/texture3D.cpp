@@ -14,7 +14,8 @@ Texture3D::Texture3D(unsigned int width, unsigned int height, unsigned int lengt
 	Texture(GL_TEXTURE_3D), 
 	_width(width), _height(height), _length(length),
 	_texels(sourceData), _internalFormat(internalFormat),
-	_sourceFormat(sourceFormat), _sourceType(sourceType)
+	_sourceFormat(sourceFormat), _sourceType(sourceType),
+	_dataChanged(true)
 {
 	log_console.infoStream() << logTextureHead << "Created 3D TEXTURE with size " 
 		<< _width << "x" << _height << "x" << _length << " !";
@@ -34,15 +35,18 @@ void Texture3D::bindAndApplyParameters(unsigned int location) {
 	glActiveTexture(GL_TEXTURE0 + location);
 	glBindTexture(textureType, textureId);
 
-	log_console.infoStream() << logTextureHead << "Bind 3D TEXTURE [id=" 
+	log_console.debugStream() << logTextureHead << "Bind 3D TEXTURE [id=" 
 		<< textureId << "] to texture location " << location << ".";
 
-	glTexImage3D(GL_TEXTURE_3D, 0, _internalFormat, _width, _height, _length, 0,
-			_sourceFormat, _sourceType, _texels);
+	if(_dataChanged) {
+		glTexImage3D(GL_TEXTURE_3D, 0, _internalFormat, _width, _height, _length, 0,
+				_sourceFormat, _sourceType, _texels);
+		_dataChanged = false;
 
-	log_console.infoStream() << logTextureHead << "Updated texture data !"; 
+		log_console.infoStream() << logTextureHead << "Updated texture data !"; 
+	}
 
-	log_console.infoStream() << logTextureHead << "Applying " << params.size() << " parameters !";
+	log_console.debugStream() << logTextureHead << "Applying " << params.size() << " parameters !";
 
 	applyParameters();
 
@@ -60,4 +64,17 @@ void Texture3D::setData(void *data, GLenum sourceFormat, GLenum sourceType) {
 	_texels = data;
 	_sourceFormat = sourceFormat;
 	_sourceType = sourceType;
+	_dataChanged = true;
+}
+
+unsigned int Texture3D::getWidth() const {
+	return _width;
+}
+
+unsigned int Texture3D::getHeight() const {
+	return _height;
+}
+
+unsigned int Texture3D::getLength() const {
+	return _length;
 }
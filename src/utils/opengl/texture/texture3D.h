@@ -18,12 +18,16 @@ class Texture3D : public Texture {
 
 		virtual ~Texture3D();
 
-		//allocate data, transfers data if not NULL and bind to texture unit location 
+		//allocate data (first bind or after setData), transfers data if not NULL and bind to texture unit location 
 		void bindAndApplyParameters(unsigned int location);
 	
 		//data only updated when bind is called !!
 		void setData(void *data, GLenum sourceFormat = 0, GLenum sourceType = 0);
 
+		unsigned int getWidth() const;
+		unsigned int getHeight() const;
+		unsigned int getLength() const;
+
 	protected:
 		unsigned int _width, _height, _length;
 
@@ -31,6 +35,9 @@ class Texture3D : public Texture {
 		GLint _internalFormat;
 		
 		GLenum _sourceFormat, _sourceType;
+
+		//rebinding a texture rendered into must not reallocate it
+		bool _dataChanged;
 };
 
 #endif /* end of include guard: TEXTURE2D_H */
@@ -0,0 +1,260 @@
+
+#include "blockSparseMatrix.h"
+#include "threadPool.h"
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace {
+	//block rows per chunk of the product
+	const unsigned int rowGrain = 1024;
+
+	//chunks of the reductions, per thread (fixed for a given pool, so are the sums)
+	const unsigned int chunksPerThread = 4;
+
+	//3x3 inverse, identity when singular
+	void invert3x3(const float *a, float *inv) {
+		float c00 = a[4]*a[8] - a[5]*a[7], c01 = a[5]*a[6] - a[3]*a[8], c02 = a[3]*a[7] - a[4]*a[6];
+		float det = a[0]*c00 + a[1]*c01 + a[2]*c02;
+
+		if(std::abs(det) < 1.0e-30f) {
+			std::fill(inv, inv + 9, 0.0f);
+			inv[0] = inv[4] = inv[8] = 1.0f;
+			return;
+		}
+
+		float id = 1.0f/det;
+		inv[0] = c00*id;
+		inv[1] = (a[2]*a[7] - a[1]*a[8])*id;
+		inv[2] = (a[1]*a[5] - a[2]*a[4])*id;
+		inv[3] = c01*id;
+		inv[4] = (a[0]*a[8] - a[2]*a[6])*id;
+		inv[5] = (a[2]*a[3] - a[0]*a[5])*id;
+		inv[6] = c02*id;
+		inv[7] = (a[1]*a[6] - a[0]*a[7])*id;
+		inv[8] = (a[0]*a[4] - a[1]*a[3])*id;
+	}
+
+	//sum of a[j]*b[j] in double, 8 products at a time on two accumulators with AVX2
+	inline double dot(const float *a, const float *b, unsigned int begin, unsigned int end) {
+		double sum = 0.0;
+		unsigned int j = begin;
+#ifdef __AVX2__
+		__m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+		for (; j + 8 <= end; j += 8) {
+			__m256 product = _mm256_mul_ps(_mm256_loadu_ps(a + j), _mm256_loadu_ps(b + j));
+			s0 = _mm256_add_pd(s0, _mm256_cvtps_pd(_mm256_castps256_ps128(product)));
+			s1 = _mm256_add_pd(s1, _mm256_cvtps_pd(_mm256_extractf128_ps(product, 1)));
+		}
+		double lanes[4];
+		_mm256_storeu_pd(lanes, _mm256_add_pd(s0, s1));
+		sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+		for (; j < end; j++)
+			sum += (double) a[j]*b[j];
+		return sum;
+	}
+
+	inline void multiplyBlock(const float *block, const float *x, float *y) {
+		y[0] = block[0]*x[0] + block[1]*x[1] + block[2]*x[2];
+		y[1] = block[3]*x[0] + block[4]*x[1] + block[5]*x[2];
+		y[2] = block[6]*x[0] + block[7]*x[1] + block[8]*x[2];
+	}
+}
+
+BlockSparseMatrix::BlockSparseMatrix() :
+	_nRows(0)
+{
+	_rowOffsets.assign(1, 0);
+}
+
+void BlockSparseMatrix::setPattern(unsigned int nRows, const unsigned int *id1, const unsigned int *id2, unsigned int nPairs) {
+	_nRows = nRows;
+
+	_rowOffsets.assign(nRows + 1, 0);
+	for (unsigned int i = 0; i < nRows; i++) {
+		_rowOffsets[i + 1] = 1;
+	}
+	for (unsigned int p = 0; p < nPairs; p++) {
+		_rowOffsets[id1[p] + 1]++;
+		_rowOffsets[id2[p] + 1]++;
+	}
+	for (unsigned int i = 0; i < nRows; i++) {
+		_rowOffsets[i + 1] += _rowOffsets[i];
+	}
+
+	unsigned int nBlocks = _rowOffsets[nRows];
+	_columns.resize(nBlocks + 1); //never empty
+	_slotPairs.resize(nBlocks + 1);
+	_pairSlots.resize(2*nPairs + 1);
+	_blocks.assign(9*(nBlocks + 1), 0.0f);
+
+	std::vector<unsigned int> cursor(_rowOffsets.begin(), _rowOffsets.end() - 1);
+	for (unsigned int i = 0; i < nRows; i++) {
+		_columns[cursor[i]] = i;
+		_slotPairs[cursor[i]] = NO_PAIR;
+		cursor[i]++;
+	}
+	for (unsigned int p = 0; p < nPairs; p++) {
+		unsigned int a = cursor[id1[p]]++, b = cursor[id2[p]]++;
+		_columns[a] = id2[p];
+		_columns[b] = id1[p];
+		_slotPairs[a] = _slotPairs[b] = p;
+		_pairSlots[2*p + 0] = a;
+		_pairSlots[2*p + 1] = b;
+	}
+
+	unsigned int n = 3*nRows + 1;
+	_r.resize(n);
+	_z.resize(n);
+	_p.resize(n);
+	_Ap.resize(n);
+	_invDiagonal.resize(9*(nRows + 1));
+}
+
+unsigned int BlockSparseMatrix::getRowCount() const {
+	return _nRows;
+}
+
+unsigned int BlockSparseMatrix::getBlockCount() const {
+	return _rowOffsets[_nRows];
+}
+
+const unsigned int *BlockSparseMatrix::getRowOffsets() const {
+	return &_rowOffsets[0];
+}
+
+const unsigned int *BlockSparseMatrix::getColumns() const {
+	return &_columns[0];
+}
+
+const unsigned int *BlockSparseMatrix::getPairSlots() const {
+	return &_pairSlots[0];
+}
+
+const unsigned int *BlockSparseMatrix::getSlotPairs() const {
+	return &_slotPairs[0];
+}
+
+float *BlockSparseMatrix::getBlocks() {
+	return &_blocks[0];
+}
+
+void BlockSparseMatrix::multiply(const float *x, float *y) const {
+	const unsigned int *offsets = &_rowOffsets[0], *columns = &_columns[0];
+	const float *blocks = &_blocks[0];
+
+	ThreadPool::global().parallelFor(0, _nRows, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			float sum[3] = {0.0f, 0.0f, 0.0f}, product[3];
+			for (unsigned int slot = offsets[i]; slot < offsets[i + 1]; slot++) {
+				multiplyBlock(blocks + 9*slot, x + 3*columns[slot], product);
+				sum[0] += product[0];
+				sum[1] += product[1];
+				sum[2] += product[2];
+			}
+			y[3*i + 0] = sum[0];
+			y[3*i + 1] = sum[1];
+			y[3*i + 2] = sum[2];
+		}
+	}, rowGrain);
+}
+
+double BlockSparseMatrix::reduce(const std::function<double(unsigned int, unsigned int)> &func) {
+	unsigned int n = _nRows;
+	unsigned int nChunks = chunksPerThread*ThreadPool::global().getThreadCount();
+	_partialSums.assign(nChunks, 0.0);
+	double *partialSums = &_partialSums[0];
+
+	ThreadPool::global().parallelFor(0, nChunks, [=, &func](unsigned int begin, unsigned int end) {
+		for (unsigned int c = begin; c < end; c++)
+			partialSums[c] = func((unsigned long) n*c/nChunks, (unsigned long) n*(c + 1)/nChunks);
+	});
+
+	double sum = 0.0;
+	for (unsigned int c = 0; c < nChunks; c++)
+		sum += partialSums[c];
+	return sum;
+}
+
+unsigned int BlockSparseMatrix::solve(const float *b, float *x, float tolerance, unsigned int maxIterations, float *residual) {
+	float *r = &_r[0], *z = &_z[0], *p = &_p[0], *Ap = &_Ap[0], *invDiagonal = &_invDiagonal[0];
+	const unsigned int *offsets = &_rowOffsets[0];
+	const float *blocks = &_blocks[0];
+
+	double bNorm = std::sqrt(reduce([=](unsigned int begin, unsigned int end) {
+		return dot(b, b, 3*begin, 3*end);
+	}));
+
+	if(bNorm == 0.0) {
+		std::fill(x, x + 3*_nRows, 0.0f);
+		*residual = 0.0f;
+		return 0;
+	}
+
+	//block Jacobi preconditioner, then r = b - A x, z = P r, p = z
+	multiply(x, Ap);
+	double rz = reduce([=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++) {
+			invert3x3(blocks + 9*offsets[i], invDiagonal + 9*i);
+			for (unsigned int c = 0; c < 3; c++)
+				r[3*i + c] = b[3*i + c] - Ap[3*i + c];
+			multiplyBlock(invDiagonal + 9*i, r + 3*i, z + 3*i);
+			for (unsigned int c = 0; c < 3; c++)
+				p[3*i + c] = z[3*i + c];
+		}
+		return dot(r, z, 3*begin, 3*end);
+	});
+
+	double rNorm = std::sqrt(reduce([=](unsigned int begin, unsigned int end) {
+		return dot(r, r, 3*begin, 3*end);
+	}));
+
+	unsigned int iteration = 0;
+	while(iteration < maxIterations && rNorm > tolerance*bNorm) {
+		multiply(p, Ap);
+		double pAp = reduce([=](unsigned int begin, unsigned int end) {
+			return dot(p, Ap, 3*begin, 3*end);
+		});
+
+		//not positive definite along p (should not happen), keep the current x
+		if(pAp <= 0.0)
+			break;
+
+		iteration++;
+
+		//x += alpha p, r -= alpha Ap and |r|^2 in one pass
+		float alpha = (float) (rz/pAp);
+		rNorm = std::sqrt(reduce([=](unsigned int begin, unsigned int end) {
+			for (unsigned int j = 3*begin; j < 3*end; j++) {
+				x[j] += alpha*p[j];
+				r[j] -= alpha*Ap[j];
+			}
+			return dot(r, r, 3*begin, 3*end);
+		}));
+
+		if(rNorm <= tolerance*bNorm)
+			break;
+
+		//z = P r and r.z in one pass
+		double rzNew = reduce([=](unsigned int begin, unsigned int end) {
+			for (unsigned int i = begin; i < end; i++)
+				multiplyBlock(invDiagonal + 9*i, r + 3*i, z + 3*i);
+			return dot(r, z, 3*begin, 3*end);
+		});
+
+		float beta = (float) (rzNew/rz);
+		rz = rzNew;
+		ThreadPool::global().parallelFor(0, 3*_nRows, [=](unsigned int begin, unsigned int end) {
+			for (unsigned int j = begin; j < end; j++)
+				p[j] = z[j] + beta*p[j];
+		}, 3*rowGrain);
+	}
+
+	*residual = (float) (rNorm/bNorm);
+	return iteration;
+}
@@ -0,0 +1,50 @@
+#ifndef BLOCKSPARSEMATRIX_H
+#define BLOCKSPARSEMATRIX_H
+
+#include <vector>
+#include <functional>
+
+// Symmetric matrix of 3x3 blocks in BSR form (CSR of row major blocks), one block row per
+// particle : the diagonal block first, then one block per pair end. The product and the
+// block Jacobi preconditioned conjugate gradient are split over the global ThreadPool by
+// block rows, the dot products are summed per chunk in double, in a fixed order.
+class BlockSparseMatrix {
+
+	public:
+		BlockSparseMatrix();
+
+		//pairSlots[2*p] is the block (id1,id2) of pair p, pairSlots[2*p+1] the block (id2,id1)
+		void setPattern(unsigned int nRows, const unsigned int *id1, const unsigned int *id2, unsigned int nPairs);
+
+		unsigned int getRowCount() const;
+		unsigned int getBlockCount() const;
+		const unsigned int *getRowOffsets() const;
+		const unsigned int *getColumns() const;
+		const unsigned int *getPairSlots() const;
+		//pair of each off diagonal block (NO_PAIR on the diagonal)
+		const unsigned int *getSlotPairs() const;
+		float *getBlocks(); //9 floats per block
+
+		//y = A x, vectors of 3*nRows floats
+		void multiply(const float *x, float *y) const;
+
+		//A x = b from the given x (a previous solution, or 0) until |r| <= tolerance*|b|, returns
+		//the iterations (maxIterations if it did not converge) and the relative residual
+		unsigned int solve(const float *b, float *x, float tolerance, unsigned int maxIterations, float *residual);
+
+		static const unsigned int NO_PAIR = 0xffffffff;
+
+	private:
+		unsigned int _nRows;
+		std::vector<unsigned int> _rowOffsets, _columns, _pairSlots, _slotPairs;
+		std::vector<float> _blocks;
+
+		//solver scratch
+		std::vector<float> _r, _z, _p, _Ap, _invDiagonal;
+		std::vector<double> _partialSums;
+
+		//sum over fixed chunks of block rows of func(begin, end)
+		double reduce(const std::function<double(unsigned int, unsigned int)> &func);
+};
+
+#endif /* end of include guard: BLOCKSPARSEMATRIX_H */
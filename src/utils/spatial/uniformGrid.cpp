@@ -0,0 +1,108 @@
+
+#include "uniformGrid.h"
+#include "threadPool.h"
+
+#include <cmath>
+#include <algorithm>
+
+namespace {
+	//10 bits -> every third bit of 30
+	inline unsigned int expandBits(unsigned int v) {
+		v &= 0x3ff;
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+}
+
+UniformGrid::UniformGrid() :
+	_cellSize(1.0f), _invCellSize(1.0f),
+	_nPoints(0), _tableMask(0)
+{
+}
+
+//cell coordinates wrap every 1024 cells, the hash is periodic anyway
+unsigned int UniformGrid::mortonCode(int cx, int cy, int cz) {
+	return (expandBits((unsigned int) cx) << 2) | (expandBits((unsigned int) cy) << 1) | expandBits((unsigned int) cz);
+}
+
+int UniformGrid::cellCoord(float x) const {
+	return (int) floorf(x*_invCellSize);
+}
+
+unsigned int UniformGrid::cellKey(int cx, int cy, int cz) const {
+	return mortonCode(cx, cy, cz) & _tableMask;
+}
+
+void UniformGrid::build(const float *x, const float *y, const float *z, unsigned int nPoints, float cellSize) {
+	_nPoints = nPoints;
+	_cellSize = cellSize;
+	_invCellSize = 1.0f/cellSize;
+
+	unsigned int tableBits = 10;
+	while((1u << tableBits) < nPoints && tableBits < 30)
+		tableBits++;
+	unsigned int tableSize = 1u << tableBits;
+	_tableMask = tableSize - 1;
+
+	_keys.resize(nPoints);
+	_sortedIndices.resize(nPoints);
+	_sortedX.resize(nPoints);
+	_sortedY.resize(nPoints);
+	_sortedZ.resize(nPoints);
+	_cellStart.assign(tableSize + 1, 0);
+	_cursor.resize(tableSize);
+
+	unsigned int *keys = _keys.data();
+	ThreadPool::global().parallelFor(0, nPoints, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i++)
+			keys[i] = cellKey(cellCoord(x[i]), cellCoord(y[i]), cellCoord(z[i]));
+	}, 8192);
+
+	//counting sort : histogram, exclusive scan, stable scatter
+	for (unsigned int i = 0; i < nPoints; i++)
+		_cellStart[keys[i] + 1]++;
+	for (unsigned int k = 0; k < tableSize; k++)
+		_cellStart[k + 1] += _cellStart[k];
+
+	std::copy(_cellStart.begin(), _cellStart.end() - 1, _cursor.begin());
+	for (unsigned int i = 0; i < nPoints; i++)
+		_sortedIndices[_cursor[keys[i]]++] = i;
+
+	gather(x, _sortedX.data());
+	gather(y, _sortedY.data());
+	gather(z, _sortedZ.data());
+}
+
+void UniformGrid::gather(const float *src, float *dst) const {
+	const unsigned int *index = _sortedIndices.data();
+	ThreadPool::global().parallelFor(0, _nPoints, [=](unsigned int begin, unsigned int end) {
+		for (unsigned int slot = begin; slot < end; slot++)
+			dst[slot] = src[index[slot]];
+	}, 8192);
+}
+
+unsigned int UniformGrid::getPointCount() const {
+	return _nPoints;
+}
+unsigned int UniformGrid::getTableSize() const {
+	return _tableMask + 1;
+}
+float UniformGrid::getCellSize() const {
+	return _cellSize;
+}
+
+const unsigned int *UniformGrid::getSortedIndices() const {
+	return _sortedIndices.data();
+}
+const float *UniformGrid::getSortedX() const {
+	return _sortedX.data();
+}
+const float *UniformGrid::getSortedY() const {
+	return _sortedY.data();
+}
+const float *UniformGrid::getSortedZ() const {
+	return _sortedZ.data();
+}
@@ -0,0 +1,76 @@
+
+#ifndef UNIFORMGRID_H
+#define UNIFORMGRID_H
+
+#include <vector>
+
+// Spatial hash of points for fixed radius neighbour queries.
+// Cells have the query radius as size, each cell is hashed to the low bits of its
+// Morton code (table of at least n entries, so memory stays O(n) for unbounded scenes)
+// and the points are counting sorted by cell. A query visits the 27 cells around
+// the point : cells that share a hash only add candidates, the caller checks distances.
+class UniformGrid {
+
+	public:
+		UniformGrid();
+
+		void build(const float *x, const float *y, const float *z, unsigned int nPoints, float cellSize);
+
+		unsigned int getPointCount() const;
+		unsigned int getTableSize() const;
+		float getCellSize() const;
+
+		//point order after the sort (sorted slot -> point id) and sorted positions
+		const unsigned int *getSortedIndices() const;
+		const float *getSortedX() const;
+		const float *getSortedY() const;
+		const float *getSortedZ() const;
+
+		//dst[slot] = src[sortedIndices[slot]]
+		void gather(const float *src, float *dst) const;
+
+		//calls func(beginSlot, endSlot) for each of the 27 cells around (x,y,z), each cell once
+		template <typename F>
+		void forEachCandidateRange(float x, float y, float z, F func) const;
+
+		static unsigned int mortonCode(int cx, int cy, int cz);
+
+	private:
+		float _cellSize, _invCellSize;
+		unsigned int _nPoints, _tableMask;
+
+		std::vector<unsigned int> _keys, _cellStart, _cursor, _sortedIndices;
+		std::vector<float> _sortedX, _sortedY, _sortedZ;
+
+		int cellCoord(float x) const;
+		unsigned int cellKey(int cx, int cy, int cz) const;
+};
+
+template <typename F>
+void UniformGrid::forEachCandidateRange(float x, float y, float z, F func) const {
+	int cx = cellCoord(x), cy = cellCoord(y), cz = cellCoord(z);
+
+	unsigned int keys[27], nKeys = 0;
+	for (int dz = -1; dz <= 1; dz++) {
+		for (int dy = -1; dy <= 1; dy++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				unsigned int key = cellKey(cx + dx, cy + dy, cz + dz);
+
+				bool visited = false;
+				for (unsigned int k = 0; k < nKeys && !visited; k++)
+					visited = (keys[k] == key);
+
+				if(!visited)
+					keys[nKeys++] = key;
+			}
+		}
+	}
+
+	for (unsigned int k = 0; k < nKeys; k++) {
+		unsigned int begin = _cellStart[keys[k]], end = _cellStart[keys[k] + 1];
+		if(begin < end)
+			func(begin, end);
+	}
+}
+
+#endif /* end of include guard: UNIFORMGRID_H */
@@ -0,0 +1,72 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <vector>
+#include <atomic>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread
+// The producer only writes _tail and the consumer only writes _head, each index
+// being published with a release store and read with an acquire load.
+template <typename T>
+class SpscQueue {
+
+	public:
+		explicit SpscQueue(unsigned int capacity) :
+			_buffer(capacity + 1), _head(0), _tail(0)
+		{
+		}
+
+		//producer thread, false when full
+		bool tryPush(const T &value) {
+			unsigned int tail = _tail.load(std::memory_order_relaxed);
+			unsigned int next = increment(tail);
+			if(next == _head.load(std::memory_order_acquire))
+				return false;
+
+			_buffer[tail] = value;
+			_tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		//consumer thread, false when empty
+		bool tryPop(T &value) {
+			unsigned int head = _head.load(std::memory_order_relaxed);
+			if(head == _tail.load(std::memory_order_acquire))
+				return false;
+
+			value = _buffer[head];
+			_head.store(increment(head), std::memory_order_release);
+			return true;
+		}
+
+		//any thread, only a hint while the other side is running
+		unsigned int size() const {
+			unsigned int head = _head.load(std::memory_order_acquire);
+			unsigned int tail = _tail.load(std::memory_order_acquire);
+			return (tail >= head ? tail - head : tail + _buffer.size() - head);
+		}
+
+		unsigned int capacity() const {
+			return _buffer.size() - 1;
+		}
+
+	private:
+		std::vector<T> _buffer;
+
+		//on separate cache lines so that both sides do not invalidate each other
+		//(padding rather than alignas : the queue may be heap allocated)
+		char _padding0[64];
+		std::atomic<unsigned int> _head;
+		char _padding1[64 - sizeof(std::atomic<unsigned int>)];
+		std::atomic<unsigned int> _tail;
+		char _padding2[64 - sizeof(std::atomic<unsigned int>)];
+
+		unsigned int increment(unsigned int index) const {
+			return (index + 1 == _buffer.size() ? 0 : index + 1);
+		}
+
+		SpscQueue(const SpscQueue &);
+		SpscQueue &operator=(const SpscQueue &);
+};
+
+#endif /* end of include guard: SPSCQUEUE_H */
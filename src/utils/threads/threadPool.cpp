@@ -0,0 +1,133 @@
+
+#include "threadPool.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace {
+	//state shared between the caller of parallelFor and the workers helping it
+	struct ParallelForState {
+		std::function<void(unsigned int, unsigned int)> func;
+		unsigned int begin, end, chunkSize, nChunks;
+		std::atomic<unsigned int> nextChunk, doneChunks;
+		std::mutex mutex;
+		std::condition_variable done;
+
+		//returns false when there is no chunk left to process
+		bool runNextChunk() {
+			unsigned int chunk = nextChunk.fetch_add(1);
+			if(chunk >= nChunks)
+				return false;
+
+			unsigned int chunkBegin = begin + chunk*chunkSize;
+			unsigned int chunkEnd = std::min(end, chunkBegin + chunkSize);
+			func(chunkBegin, chunkEnd);
+
+			if(doneChunks.fetch_add(1) + 1 == nChunks) {
+				std::lock_guard<std::mutex> lock(mutex);
+				done.notify_all();
+			}
+
+			return true;
+		}
+	};
+}
+
+ThreadPool::ThreadPool(unsigned int nThreads) :
+	_stop(false)
+{
+	if(nThreads == 0)
+		nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < nThreads; i++) {
+		_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_jobAvailable.notify_all();
+
+	for (unsigned int i = 0; i < _workers.size(); i++) {
+		_workers[i].join();
+	}
+}
+
+unsigned int ThreadPool::getThreadCount() const {
+	return _workers.size();
+}
+
+void ThreadPool::parallelFor(unsigned int begin, unsigned int end,
+		const std::function<void(unsigned int, unsigned int)> &func,
+		unsigned int grain) {
+
+	if(end <= begin)
+		return;
+
+	unsigned int count = end - begin;
+	grain = std::max(1u, grain);
+
+	//a few chunks per thread to balance uneven workloads
+	unsigned int nChunks = std::min((count + grain - 1)/grain, 4*(getThreadCount() + 1));
+	if(nChunks <= 1) {
+		func(begin, end);
+		return;
+	}
+
+	std::shared_ptr<ParallelForState> state(new ParallelForState);
+	state->func = func;
+	state->begin = begin;
+	state->end = end;
+	state->chunkSize = (count + nChunks - 1)/nChunks;
+	state->nChunks = (count + state->chunkSize - 1)/state->chunkSize;
+	state->nextChunk = 0;
+	state->doneChunks = 0;
+
+	unsigned int nHelpers = std::min(getThreadCount(), state->nChunks - 1);
+	for (unsigned int i = 0; i < nHelpers; i++) {
+		enqueue([state]() { while(state->runNextChunk()); });
+	}
+
+	//the caller works too
+	while(state->runNextChunk());
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	while(state->doneChunks.load() < state->nChunks)
+		state->done.wait(lock);
+}
+
+ThreadPool &ThreadPool::global() {
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::enqueue(const std::function<void()> &job) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(job);
+	}
+	_jobAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+	while(true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while(!_stop && _jobs.empty())
+				_jobAvailable.wait(lock);
+
+			if(_stop && _jobs.empty())
+				return;
+
+			job = _jobs.front();
+			_jobs.pop_front();
+		}
+
+		job();
+	}
+}
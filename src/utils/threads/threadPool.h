@@ -0,0 +1,45 @@
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Fixed size pool of worker threads
+// parallelFor splits an index range into contiguous chunks that are
+// consumed by the workers AND by the calling thread, so it can safely
+// be called from inside a job running on the pool.
+class ThreadPool {
+
+	public:
+		explicit ThreadPool(unsigned int nThreads = 0); //0 = hardware concurrency
+		~ThreadPool();
+
+		unsigned int getThreadCount() const;
+
+		//calls func(chunkBegin, chunkEnd) on [begin,end) and blocks until all chunks are done
+		//grain is the minimum chunk size
+		void parallelFor(unsigned int begin, unsigned int end,
+				const std::function<void(unsigned int, unsigned int)> &func,
+				unsigned int grain = 1);
+
+		//shared pool, created on first use
+		static ThreadPool &global();
+
+	private:
+		std::vector<std::thread> _workers;
+		std::deque<std::function<void()> > _jobs;
+
+		std::mutex _mutex;
+		std::condition_variable _jobAvailable;
+		bool _stop;
+
+		void enqueue(const std::function<void()> &job);
+		void workerLoop();
+};
+
+#endif /* end of include guard: THREADPOOL_H */
@@ -0,0 +1,100 @@
+#include "rollingHistogram.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+RollingHistogram::RollingHistogram(unsigned int windowSize) :
+	_samples(std::max(windowSize, 1u), 0.0),
+	_next(0), _count(0),
+	_sum(0.0)
+{
+	memset(_bins, 0, sizeof(_bins));
+}
+
+void RollingHistogram::add(double sample) {
+	if(_count == _samples.size()) {
+		double oldest = _samples[_next];
+		_sum -= oldest;
+		_bins[bin(oldest)]--;
+	}
+	else {
+		_count++;
+	}
+
+	_samples[_next] = sample;
+	_sum += sample;
+	_bins[bin(sample)]++;
+
+	_next = (_next + 1) % _samples.size();
+}
+
+void RollingHistogram::clear() {
+	_next = 0;
+	_count = 0;
+	_sum = 0.0;
+	memset(_bins, 0, sizeof(_bins));
+}
+
+unsigned int RollingHistogram::getSampleCount() const {
+	return _count;
+}
+
+unsigned int RollingHistogram::getWindowSize() const {
+	return _samples.size();
+}
+
+double RollingHistogram::getMean() const {
+	return (_count > 0 ? _sum/_count : 0.0);
+}
+
+double RollingHistogram::getMax() const {
+	double max = 0.0;
+	for (unsigned int i = 0; i < _count; i++)
+		max = std::max(max, _samples[i]);
+	return max;
+}
+
+double RollingHistogram::getPercentile(double p) const {
+	if(_count == 0)
+		return 0.0;
+
+	std::vector<double> sorted(_samples.begin(), _samples.begin() + _count);
+	unsigned int rank = (unsigned int) std::ceil(std::min(std::max(p, 0.0), 1.0)*_count);
+	rank = std::min(std::max(rank, 1u), _count) - 1;
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+const unsigned int *RollingHistogram::getBins() const {
+	return _bins;
+}
+
+//ms
+double RollingHistogram::getBinUpperBound(unsigned int bin) {
+	return (bin + 1 < ROLLING_HISTOGRAM_BINS ? std::ldexp(1.0e-3, bin) : HUGE_VAL);
+}
+
+std::string RollingHistogram::toString() const {
+	static const char levels[] = " .:-=+*#";
+	const unsigned int nLevels = sizeof(levels) - 1;
+
+	unsigned int maxBin = *std::max_element(_bins, _bins + ROLLING_HISTOGRAM_BINS);
+
+	std::string histogram(ROLLING_HISTOGRAM_BINS, ' ');
+	for (unsigned int i = 0; i < ROLLING_HISTOGRAM_BINS; i++) {
+		if(_bins[i] > 0)
+			histogram[i] = levels[(_bins[i]*(nLevels - 1) + maxBin - 1)/maxBin];
+	}
+	return histogram;
+}
+
+unsigned int RollingHistogram::bin(double sample) {
+	double us = sample*1.0e3;
+	if(!(us >= 1.0))
+		return 0;
+
+	int exponent;
+	std::frexp(us, &exponent);
+	return std::min((unsigned int) exponent, ROLLING_HISTOGRAM_BINS - 1u);
+}
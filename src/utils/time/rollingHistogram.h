@@ -0,0 +1,44 @@
+#ifndef ROLLINGHISTOGRAM_H
+#define ROLLINGHISTOGRAM_H
+
+#include <vector>
+#include <string>
+
+#define ROLLING_HISTOGRAM_BINS 16
+
+// Distribution of the last samples of a time (ms), for the profiling overlay
+// The samples are kept in a ring of windowSize values, the oldest one leaves when a new one comes.
+// Bins are powers of two from 1 us : bin 0 counts the samples under 1 us, bin i the samples
+// in [2^(i-1), 2^i) us, the last bin everything above (16 ms and more).
+class RollingHistogram {
+
+	public:
+		RollingHistogram(unsigned int windowSize = 120);
+
+		void add(double sample);
+		void clear();
+
+		unsigned int getSampleCount() const;
+		unsigned int getWindowSize() const;
+
+		double getMean() const;
+		double getMax() const;
+		//p in [0,1], nearest rank over the window
+		double getPercentile(double p) const;
+
+		const unsigned int *getBins() const;
+		static double getBinUpperBound(unsigned int bin);
+
+		//one character per bin, from ' ' (empty) to '#' (most populated bin)
+		std::string toString() const;
+
+	private:
+		std::vector<double> _samples;
+		unsigned int _next, _count;
+		double _sum;
+		unsigned int _bins[ROLLING_HISTOGRAM_BINS];
+
+		static unsigned int bin(double sample);
+};
+
+#endif /* end of include guard: ROLLINGHISTOGRAM_H */
@@ -0,0 +1,143 @@
+
+#include "simulationClock.h"
+#include "log.h"
+
+#include <cmath>
+#include <algorithm>
+
+SimulationClock::SimulationClock(float stepRate, unsigned int maxSubsteps) :
+	_stepRate(stepRate), _dt(1.0f/stepRate),
+	_maxSubsteps(maxSubsteps),
+	_time(0.0), _accumulator(0.0), _droppedTime(0.0),
+	_stepCount(0),
+	_started(false)
+{
+}
+
+unsigned int SimulationClock::beginFrame() {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	//first frame : nothing to catch up
+	if(!_started) {
+		_started = true;
+		_lastFrame = now;
+		return 0;
+	}
+
+	std::chrono::duration<double> elapsed = now - _lastFrame;
+	_lastFrame = now;
+
+	return advance(elapsed.count());
+}
+
+unsigned int SimulationClock::advance(double elapsed) {
+	_accumulator += std::max(elapsed, 0.0);
+
+	unsigned int nSteps = (unsigned int) std::floor(_accumulator/_dt);
+	if(nSteps > _maxSubsteps) {
+		_droppedTime += _accumulator - _maxSubsteps*(double)_dt;
+		_accumulator = _maxSubsteps*(double)_dt;
+		nSteps = _maxSubsteps;
+	}
+
+	_accumulator -= nSteps*(double)_dt;
+	_time += nSteps*(double)_dt;
+	_stepCount += nSteps;
+
+	return nSteps;
+}
+
+void SimulationClock::reset() {
+	_started = false;
+	_accumulator = 0.0;
+}
+
+void SimulationClock::setStepRate(float stepRate) {
+	_stepRate = stepRate;
+	_dt = 1.0f/stepRate;
+	_accumulator = std::min(_accumulator, (double)_dt);
+}
+
+void SimulationClock::setMaxSubsteps(unsigned int maxSubsteps) {
+	_maxSubsteps = maxSubsteps;
+}
+
+float SimulationClock::getStepRate() const {
+	return _stepRate;
+}
+unsigned int SimulationClock::getMaxSubsteps() const {
+	return _maxSubsteps;
+}
+float SimulationClock::getDt() const {
+	return _dt;
+}
+double SimulationClock::getTime() const {
+	return _time;
+}
+double SimulationClock::getDroppedTime() const {
+	return _droppedTime;
+}
+unsigned long SimulationClock::getStepCount() const {
+	return _stepCount;
+}
+
+float SimulationClock::getAlpha() const {
+	return std::min((float)(_accumulator/_dt), 1.0f);
+}
+
+double SimulationClock::getInterpolatedTime() const {
+	return _time - (1.0 - getAlpha())*_dt;
+}
+
+SimulationClock &SimulationClock::global() {
+	static SimulationClock clock;
+	return clock;
+}
+
+bool SimulationClock::check() {
+	SimulationClock clock(120.0f, 8);
+	bool ok = true;
+
+	//30 Hz display with +-20% jitter : 4 substeps per frame on average
+	double wallTime = 0.0;
+	unsigned int minSteps = 1000, maxSteps = 0;
+	for (unsigned int frame = 0; frame < 300; frame++) {
+		double elapsed = (1.0 + 0.2*std::sin(7.0*frame))/30.0;
+		wallTime += elapsed;
+
+		unsigned int nSteps = clock.advance(elapsed);
+		minSteps = std::min(minSteps, nSteps);
+		maxSteps = std::max(maxSteps, nSteps);
+
+		float alpha = clock.getAlpha();
+		ok &= (alpha >= 0.0f && alpha < 1.0f);
+		ok &= (std::abs(clock.getInterpolatedTime() + clock.getDt() - wallTime) < 1.0e-6);
+	}
+	ok &= (std::abs(clock.getTime() - wallTime) < clock.getDt());
+	ok &= (clock.getDroppedTime() == 0.0);
+
+	log_console.infoStream() << "[Clock Check] 300 frames at 30 Hz (+-20%) on a " << clock.getStepRate() << " Hz clock : "
+		<< clock.getStepCount() << " substeps (" << minSteps << " to " << maxSteps << " per frame), simulated "
+		<< clock.getTime() << " s for " << wallTime << " s.";
+
+	//one second stall : clamped to maxSubsteps, the rest is dropped
+	unsigned int nSteps = clock.advance(1.0);
+	wallTime += 1.0;
+	ok &= (nSteps == clock.getMaxSubsteps());
+	ok &= (std::abs(clock.getTime() + clock.getDroppedTime() + clock.getAlpha()*clock.getDt() - wallTime) < 1.0e-6);
+
+	log_console.infoStream() << "[Clock Check] 1 s stall : " << nSteps << " substeps, "
+		<< clock.getDroppedTime() << " s dropped.";
+
+	//240 Hz display : one substep every other frame
+	clock.reset();
+	unsigned int stepsAt240 = 0;
+	for (unsigned int frame = 0; frame < 240; frame++)
+		stepsAt240 += clock.advance(1.0/240.0);
+	ok &= (stepsAt240 >= 119 && stepsAt240 <= 120);
+
+	log_console.infoStream() << "[Clock Check] 1 s at 240 Hz : " << stepsAt240 << " substeps. "
+		<< (ok ? "OK" : "FAILED") << ".";
+
+	return ok;
+}
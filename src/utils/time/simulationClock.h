@@ -0,0 +1,61 @@
+
+#ifndef SIMULATIONCLOCK_H
+#define SIMULATIONCLOCK_H
+
+#include <chrono>
+
+// Fixed timestep clock of the simulation
+// Each frame, the measured elapsed time is accumulated and consumed by fixed substeps
+// of 1/stepRate seconds, so the simulation runs at the same speed whatever the render rate.
+// At most maxSubsteps are run per frame : under load the extra time is dropped (the
+// simulation slows down instead of spiraling). The time left in the accumulator gives
+// the interpolation alpha in [0,1) between the last two simulated states for rendering.
+class SimulationClock {
+
+	public:
+		SimulationClock(float stepRate = 120.0f, unsigned int maxSubsteps = 8);
+
+		//measures the wall time since the last call (or reset) and returns the substeps to run
+		unsigned int beginFrame();
+		//same with an explicit elapsed time, in seconds
+		unsigned int advance(double elapsed);
+		//restarts the wall time measure (animation started or resumed), keeps the simulated time
+		void reset();
+
+		void setStepRate(float stepRate);
+		void setMaxSubsteps(unsigned int maxSubsteps);
+
+		float getStepRate() const;
+		unsigned int getMaxSubsteps() const;
+		//fixed timestep of every substep, in seconds
+		float getDt() const;
+		//simulated time at the last substep, in seconds
+		double getTime() const;
+		//elapsed time that was not simulated because of the catch-up clamp, in seconds
+		double getDroppedTime() const;
+		unsigned long getStepCount() const;
+
+		//position of the rendered frame between the last two substeps
+		float getAlpha() const;
+		//simulated time of the rendered frame : getTime() - (1 - alpha)*dt
+		double getInterpolatedTime() const;
+
+		//shared clock, driven by the viewer
+		static SimulationClock &global();
+
+		//replays a 30 Hz display with jitter and a stall on a 120 Hz clock, logs and checks
+		//the simulated time against the wall time, the substeps and the clamp
+		static bool check();
+
+	private:
+		float _stepRate, _dt;
+		unsigned int _maxSubsteps;
+
+		double _time, _accumulator, _droppedTime;
+		unsigned long _stepCount;
+
+		bool _started;
+		std::chrono::steady_clock::time_point _lastFrame;
+};
+
+#endif /* end of include guard: SIMULATIONCLOCK_H */
@@ -0,0 +1,246 @@
+
+#include "headers.h"
+#include "headlessRenderer.h"
+#include "renderable.h"
+#include "renderTree.h"
+#include "nodeTimings.h"
+#include "simulationClock.h"
+#include "log.h"
+
+#include <QFile>
+#include <QDomDocument>
+
+#include <vector>
+#include <fstream>
+#include <cmath>
+
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace {
+	const double frameDuration = 1.0/60.0;
+
+	void eglFailure(const char *what) {
+		log_console.errorStream() << "[Headless] " << what << " (EGL error 0x" << std::hex << eglGetError() << std::dec << ") !";
+		exit(1);
+	}
+}
+
+HeadlessRenderer::HeadlessRenderer(unsigned int width, unsigned int height) :
+	_width(width), _height(height),
+	_display(0), _surface(0), _context(0),
+	_camera(0), _cameraPath(0)
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	//surfaceless Mesa platform : neither X nor Wayland server needed
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(clientExtensions && getPlatformDisplay && std::string(clientExtensions).find("EGL_MESA_platform_surfaceless") != std::string::npos)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if(display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		eglFailure("Failed to initialize an EGL display");
+
+	if(!eglBindAPI(EGL_OPENGL_API))
+		eglFailure("Desktop OpenGL is not supported by the EGL display");
+
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint nConfigs = 0;
+	if(!eglChooseConfig(display, configAttributes, &config, 1, &nConfigs) || nConfigs == 0)
+		eglFailure("No RGBA8 + depth 24 pbuffer config");
+
+	const EGLint surfaceAttributes[] = {
+		EGL_WIDTH, (EGLint) width,
+		EGL_HEIGHT, (EGLint) height,
+		EGL_NONE
+	};
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	if(surface == EGL_NO_SURFACE)
+		eglFailure("Failed to create the pbuffer");
+
+	//no attributes : compatibility profile, the scene still relies on the fixed pipeline matrices
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if(context == EGL_NO_CONTEXT)
+		eglFailure("Failed to create the OpenGL context");
+
+	if(!eglMakeCurrent(display, surface, surface, context))
+		eglFailure("Failed to make the OpenGL context current");
+
+	_display = display;
+	_surface = surface;
+	_context = context;
+
+	_camera = new qglviewer::Camera();
+
+	log_console.infoStream() << "[Headless] EGL " << major << "." << minor << " (" << eglQueryString(display, EGL_VENDOR) << "), "
+		<< width << "x" << height << " pbuffer";
+}
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+	//renderables release their GL objects, the context must still be current
+	std::list<Renderable *>::iterator it;
+	for (it = _renderables.begin(); it != _renderables.end(); ++it) {
+		delete(*it);
+	}
+	_renderables.clear();
+
+	delete _camera;
+
+	eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(_display, _context);
+	eglDestroySurface(_display, _surface);
+	eglTerminate(_display);
+}
+
+void HeadlessRenderer::addRenderable(Renderable *r)
+{
+	_renderables.push_back(r);
+}
+
+qglviewer::Camera *HeadlessRenderer::camera()
+{
+	return _camera;
+}
+
+bool HeadlessRenderer::loadCameraPath(const std::string &stateFile)
+{
+	QFile file(QString::fromStdString(stateFile));
+	QDomDocument document;
+	if(!file.open(QIODevice::ReadOnly) || !document.setContent(&file)) {
+		log_console.warnStream() << "[Headless] Cannot read the QGLViewer state file " << stateFile << ", the camera orbits around the scene.";
+		return false;
+	}
+	file.close();
+
+	QDomElement cameraElement = document.documentElement().firstChildElement("Camera");
+	if(cameraElement.isNull()) {
+		log_console.warnStream() << "[Headless] No camera in " << stateFile << ", the camera orbits around the scene.";
+		return false;
+	}
+
+	//the camera keeps the ownership of its keyframe interpolators
+	_camera->initFromDOMElement(cameraElement);
+
+	//first path defined in the viewer (Control+F1 to Control+F12)
+	for (unsigned int i = 0; i <= 12; i++) {
+		qglviewer::KeyFrameInterpolator *path = _camera->keyFrameInterpolator(i);
+		if(path && path->numberOfKeyFrames() > 1) {
+			_cameraPath = path;
+			log_console.infoStream() << "[Headless] Camera path F" << i << " of " << stateFile << " : "
+				<< path->numberOfKeyFrames() << " keyframes, " << path->duration() << " s";
+			return true;
+		}
+	}
+
+	log_console.warnStream() << "[Headless] No keyframe path in " << stateFile << ", the camera orbits around the scene.";
+	return false;
+}
+
+void HeadlessRenderer::init()
+{
+	glViewport(0, 0, _width, _height);
+
+	//QGLViewer defaults
+	glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_LIGHT0);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_COLOR_MATERIAL);
+
+	//Viewer::init, Renderable::init(Viewer&) is not called (deprecated for RenderTree nodes)
+	_camera->setScreenWidthAndHeight(_width, _height);
+	_camera->setSceneRadius(100.0f);
+	_camera->setZNearCoefficient(0.00001);
+	_camera->setZClippingCoefficient(1000.0);
+}
+
+void HeadlessRenderer::placeCamera(unsigned int frame, unsigned int nFrames)
+{
+	double t = (nFrames > 1 ? double(frame)/(nFrames - 1) : 0.0);
+
+	if(_cameraPath) {
+		_cameraPath->interpolateAtTime(_cameraPath->firstTime() + t*(_cameraPath->lastTime() - _cameraPath->firstTime()));
+	}
+	else {
+		//one turn under the waves, around the terrain center
+		double angle = 2.0*M_PI*t;
+		_camera->setPosition(qglviewer::Vec(60.0*cos(angle), -10.0, 60.0*sin(angle)));
+		_camera->setUpVector(qglviewer::Vec(0.0, 1.0, 0.0));
+		_camera->lookAt(qglviewer::Vec(0.0, -30.0, 0.0));
+	}
+}
+
+void HeadlessRenderer::benchmark(unsigned int nFrames, const std::string &csvFile)
+{
+	std::ofstream csv(csvFile.c_str());
+	if(!csv.good()) {
+		log_console.errorStream() << "[Headless] Cannot write " << csvFile << " !";
+		exit(1);
+	}
+
+	init();
+
+	NodeTimings timings(NodeTimings::BLOCKING_READBACK, nFrames);
+	timings.setTraceRecording(true);
+	RenderTree::setNodeTimings(&timings);
+	NodeTimings::writeCsvHeader(csv);
+
+	std::list<Renderable *>::iterator it;
+	for (unsigned int frame = 0; frame < nFrames; frame++) {
+		timings.beginFrame();
+
+		//fixed frame duration whatever the time taken to render it, so that the runs simulate the same steps
+		unsigned int nSteps = SimulationClock::global().advance(frameDuration);
+		for (unsigned int step = 0; step < nSteps; step++) {
+			for (it = _renderables.begin(); it != _renderables.end(); ++it) {
+				(*it)->animate();
+			}
+		}
+
+		placeCamera(frame, nFrames);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		_camera->loadProjectionMatrix();
+		_camera->loadModelViewMatrix();
+
+		for (it = _renderables.begin(); it != _renderables.end(); ++it) {
+			(*it)->draw();
+		}
+
+		timings.endFrame();
+		timings.writeCsv(csv);
+	}
+
+	RenderTree::setNodeTimings(0);
+
+	if(nFrames == 0)
+		return;
+
+	std::string traceFile = csvFile.substr(0, csvFile.rfind(".csv")) + ".json";
+	if(!timings.writeChromeTrace(traceFile))
+		log_console.errorStream() << "[Headless] Cannot write the trace " << traceFile << " !";
+
+	//the histograms window covers all the frames
+	log_console.infoStream() << "[Headless] " << nFrames << " frames of " << _width << "x" << _height << " : "
+		<< timings.getFrameHistogram(NodeTimings::DRAW_CPU).getMean() << " ms/frame CPU, "
+		<< timings.getFrameHistogram(NodeTimings::DRAW_GPU).getMean() << " ms/frame GPU, per node times in " << csvFile
+		<< " (Chrome trace in " << traceFile << ")";
+
+	std::vector<std::string> lines = timings.getOverlayLines();
+	for (unsigned int i = 0; i < lines.size(); i++) {
+		log_console.infoStream() << "[Headless]\t" << lines[i];
+	}
+}
@@ -0,0 +1,62 @@
+
+/*
+ * Offscreen counterpart of the Viewer, for benchmarks without window nor display server.
+ *
+ * The OpenGL context comes from EGL : the Mesa surfaceless platform when available
+ * (llvmpipe in a container, or the render node of a GPU), the default display otherwise.
+ * The default framebuffer is a width x height pbuffer, so the scene code that binds
+ * the framebuffer 0 back still renders offscreen.
+ * The camera replays the keyframe path saved by QGLViewer (Control+F1..F12 in the viewer,
+ * written to .qglviewer.xml when it is closed) over a fixed number of frames, and the
+ * simulation advances of a fixed 1/60 s per frame, so that runs can be compared.
+ */
+
+#ifndef _HEADLESS_RENDERER_
+#define _HEADLESS_RENDERER_
+
+#include <QGLViewer/camera.h>
+#include <list>
+#include <string>
+
+class Renderable;
+
+class HeadlessRenderer
+{
+	public :
+
+		/// Creates the EGL context and makes it current (exits on failure),
+		/// glewInit and the Globals are left to the caller as with the Viewer
+		HeadlessRenderer(unsigned int width, unsigned int height);
+		virtual ~HeadlessRenderer();
+
+		void addRenderable(Renderable *r);
+		qglviewer::Camera *camera();
+
+		/// Camera path of the first keyframe interpolator of a QGLViewer state file,
+		/// false (the camera orbits around the scene) if there is none
+		bool loadCameraPath(const std::string &stateFile);
+
+		/// Animates and draws nFrames along the camera path, and writes the per frame
+		/// CPU and GPU times of every RenderTree node to csvFile (see NodeTimings),
+		/// and their Chrome trace next to it (.json instead of .csv)
+		void benchmark(unsigned int nFrames, const std::string &csvFile);
+
+	private :
+		unsigned int _width, _height;
+
+		/// EGLDisplay, EGLSurface and EGLContext (EGL headers kept out of the Qt ones)
+		void *_display, *_surface, *_context;
+
+		qglviewer::Camera *_camera;
+		qglviewer::KeyFrameInterpolator *_cameraPath;
+
+		std::list<Renderable *> _renderables;
+
+		/// Same GL state and camera parameters as QGLViewer and Viewer::init
+		void init();
+
+		/// Camera of the frame along the path, or along the orbit
+		void placeCamera(unsigned int frame, unsigned int nFrames);
+};
+
+#endif
@@ -1,19 +1,25 @@
-#include <QKeyEvent>
+#include "headers.h"
 
-#ifndef __APPLE__
-#include <GL/glut.h>
-#else
-#include <GLUT/glut.h>
-#endif
+#include <QKeyEvent>
 
 #include "viewer.h"
 #include "renderable.h"
+#include "renderTree.h"
+#include "nodeTimings.h"
+#include "simulationClock.h"
+#include "log.h"
 
-Viewer::Viewer() {
+Viewer::Viewer() : nodeTimings(0) {
 }
 
 Viewer::~Viewer()
 {
+    // the timings release their queries
+    if (nodeTimings) {
+        makeCurrent();
+        toggleNodeTimings();
+    }
+
     list<Renderable *>::iterator it;
     for (it = renderableList.begin(); it != renderableList.end(); ++it) {
         delete(*it);
@@ -61,27 +67,46 @@ void Viewer::init()
 
 void Viewer::draw()
 { 
+    // the frame is already opened if animate() ran before
+    if (nodeTimings) nodeTimings->beginFrame();
+
     // draw every objects in renderableList
     list<Renderable *>::iterator it;
     for(it = renderableList.begin(); it != renderableList.end(); ++it) {
         (*it)->draw();
     }
 
+    if (nodeTimings) {
+        nodeTimings->endFrame();
+        drawNodeTimings();
+    }
+
     if (toggleRecord) saveSnapshot();
 }
 
 
 void Viewer::animate()
 {
+    // as many fixed substeps as the wall time since the last frame asks for,
+    // draw() then uses SimulationClock::global().getAlpha() to interpolate
+    unsigned int nSteps = SimulationClock::global().beginFrame();
+
+    if (nodeTimings) nodeTimings->beginFrame();
+
     // animate every objects in renderableList
     list<Renderable *>::iterator it;
-    for(it = renderableList.begin(); it != renderableList.end(); ++it) {
-        (*it)->animate();
+    for (unsigned int step = 0; step < nSteps; step++) {
+        for(it = renderableList.begin(); it != renderableList.end(); ++it) {
+            (*it)->animate();
+        }
     }
+}
 
-    // this code might change if some rendered objets (stored as
-    // attributes) need to be specifically updated with common
-    // attributes, like real CPU time (?)
+void Viewer::startAnimation()
+{
+    // the time spent paused is not simulated
+    SimulationClock::global().reset();
+    QGLViewer::startAnimation();
 }
 
 
@@ -125,6 +150,9 @@ void Viewer::keyPressEvent(QKeyEvent *e)
     } 
     else if (e->key()==Qt::Key_R) {
         toggleRecord = !toggleRecord;
+    } 
+    else if ((e->key()==Qt::Key_T) && (modifiers==Qt::NoButton)) {
+        toggleNodeTimings();
 
     // ... and so on with all events to handle here!
     
@@ -136,6 +164,43 @@ void Viewer::keyPressEvent(QKeyEvent *e)
 }
 
 
+void Viewer::toggleNodeTimings()
+{
+    if (!nodeTimings) {
+        // GPU results read back frames later, the viewer never waits for them
+        nodeTimings = new NodeTimings(NodeTimings::QUERY_RING);
+        nodeTimings->setTraceRecording(true);
+        RenderTree::setNodeTimings(nodeTimings);
+        return;
+    }
+
+    RenderTree::setNodeTimings(0);
+
+    if (nodeTimings->writeChromeTrace("profile.json"))
+        log_console.infoStream() << "[Viewer] Node timings trace written to profile.json (chrome://tracing)";
+    else
+        log_console.errorStream() << "[Viewer] Cannot write the node timings trace profile.json !";
+
+    delete nodeTimings;
+    nodeTimings = 0;
+}
+
+void Viewer::drawNodeTimings()
+{
+    // fixed pipeline text on top of the shaders of the scene
+    glUseProgram(0);
+    qglColor(foregroundColor());
+
+    QFont font("Monospace", 9);
+    font.setStyleHint(QFont::TypeWriter);
+
+    std::vector<std::string> lines = nodeTimings->getOverlayLines();
+    for (unsigned int i = 0; i < lines.size(); i++) {
+        drawText(10, 40 + 14*i, QString::fromStdString(lines[i]), font);
+    }
+}
+
+
 QString Viewer::helpString() const
 {
     // Some usefull hints...
@@ -148,6 +213,7 @@ QString Viewer::helpString() const
     text += "camera path. Paths are saved when you quit the application and restored at next start.<br><br>";
     text += "Press <b>F</b> to display the frame rate, <b>A</b> for the world axis, ";
     text += "<b>Alt+Return</b> for full screen mode and <b>Control+S</b> to save a snapshot. ";
+    text += "Press <b>T</b> to display the CPU and GPU times of the scene nodes, press it again to write them to <i>profile.json</i> (chrome://tracing).<br><br>";
     text += "See the <b>Keyboard</b> tab in this window for a complete shortcut list.<br><br>";
     text += "Double clicks automates single click actions: A left button double click aligns the closer axis with the camera (if close enough). ";
     text += "A middle button double click fits the zoom of the camera and the right button re-centers the scene.<br><br>";
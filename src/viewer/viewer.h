@@ -15,6 +15,7 @@
 using namespace std;
 
 class Renderable;
+class NodeTimings;
 
 
 class Viewer : public QGLViewer
@@ -36,9 +37,13 @@ class Viewer : public QGLViewer
 		/// Draw every objects of the scene
 		virtual void draw();
 		
-		/// Animate every objects of the scene
+		/// Animate every objects of the scene, once per fixed substep of the simulation clock
 		virtual void animate();
 
+	public :
+		/// Restarts the simulation clock wall time measure
+		virtual void startAnimation();
+
 
 /* Viewing parameters */
 	protected :
@@ -46,6 +51,15 @@ class Viewer : public QGLViewer
 		bool toogleLight;
         bool toggleRecord;
 
+		/// Per RenderTree node timings (key T), NULL when off
+		NodeTimings *nodeTimings;
+
+		/// Starts the timings, or stops them and writes their Chrome trace
+		void toggleNodeTimings();
+
+		/// Per node means, p95 and histograms over the last frames
+		void drawNodeTimings();
+
 		/// Handle keyboard events specifically
 		virtual void keyPressEvent(QKeyEvent *e);
 
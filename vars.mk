@@ -1,2 +1,4 @@
 L_QGLVIEWER=-lQGLViewer #-lqglviewer on some systems
 NARCH=11 #11 minimum
+SIMDFLAGS= #-mavx2 -mfma to build CPU kernels with AVX2/FMA (the binary then needs an AVX2 CPU)
+CHECK_ALLOCATIONS= #1 to build --check-allocations (replaces the global operator new by a counting one)